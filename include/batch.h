@@ -0,0 +1,32 @@
+#ifndef LAB1_BATCH_H
+#define LAB1_BATCH_H
+
+#define WORK_POOL_MAX_WORKERS 1024  // the most threads a pool is asked for with -j
+
+// Called by a worker to run one job. worker identifies the calling thread,
+// from 0 to the number of workers - 1, so per-worker state can be kept.
+typedef void (*work_function)(void *context, int job, int worker);
+
+/**
+ * Runs jobs 0 to jobs - 1 on a pool of worker threads, returning once all have finished.
+ * Jobs are dealt out to the workers in contiguous ranges, and workers that run out of
+ * jobs steal from the others.
+ */
+void work_pool_run(int jobs, int workers, work_function run, void *context);
+
+/**
+ * @return the number of processors online, used as the default number of workers
+ */
+int work_pool_default_workers();
+
+/**
+ * Collects the files named by a batch argument: every regular, non-hidden file of a
+ * directory in name order, with numbers in names ordered by value, or else every non-empty
+ * line of a list file.
+ * @param source the directory or list file
+ * @param count output; the number of files found
+ * @return the file paths, or NULL if source cannot be read
+ */
+char **batch_collect_files(const char *source, int *count);
+
+#endif //LAB1_BATCH_H
@@ -0,0 +1,93 @@
+#ifndef LAB1_CACHE_H
+#define LAB1_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// A data cache between the memory stage and data memory. It only models timing: the
+// words themselves always live in data_memory, and the cache tracks which lines it
+// holds. A hit keeps an instruction in the memory stage for hit_latency cycles, and a
+// miss adds miss_latency cycles to fetch the line, plus as many again to write back a
+// dirty line it replaces.
+//
+// A write-back cache allocates a line on every miss, and writes it back when it is
+// replaced. A write-through cache sends every store on to memory through a write buffer,
+// at the cost of a hit, and does not allocate lines for stores.
+typedef enum {
+    CACHE_WRITE_BACK, CACHE_WRITE_THROUGH
+} cache_write_policy;
+
+typedef enum {
+    CACHE_LRU, CACHE_FIFO, CACHE_RANDOM
+} cache_replacement;
+
+#define DEFAULT_CACHE_WORDS 256
+#define DEFAULT_CACHE_WAYS 2
+#define DEFAULT_CACHE_LINE 4
+#define DEFAULT_CACHE_HIT 1
+#define DEFAULT_CACHE_MISS 10
+#define CACHE_MAX_WAYS 64
+#define CACHE_MAX_WORDS (1 << 24)
+
+typedef struct {
+    int words;       // capacity in words, or 0 for no cache
+    int ways;
+    int line_words;
+    cache_write_policy write;
+    cache_replacement replace;
+    int hit_latency;
+    int miss_latency;
+} cache_options;
+
+// What an access did, for the memory stage to count
+typedef enum {
+    CACHE_HIT, CACHE_MISS, CACHE_MISS_WRITEBACK
+} cache_outcome;
+
+typedef struct {
+    uint32_t line;  // the number of the line of memory held
+    bool valid, dirty;
+
+    // Position in the set's replacement order, 0 for the line used (LRU) or filled (FIFO)
+    // most recently. The lines of a set always hold distinct ranks.
+    uint8_t rank;
+} cache_line;
+
+typedef struct {
+    cache_options options;
+    int sets;
+    cache_line *lines;  // the ways of each set in turn; NULL without a cache
+    uint32_t random;    // state of the random replacement
+
+    // The number of times a line was filled or made dirty, so a loop can tell that the
+    // lines held have settled.
+    long long changes;
+} data_cache;
+
+/**
+ * @return true if the options describe a cache whose capacity holds a whole number of sets
+ */
+bool cache_valid(const cache_options *options);
+
+/**
+ * Parses a comma-separated list of words=N, ways=N, line=N, write=back|through,
+ * replace=lru|fifo|random, hit=N and miss=N into options, over the defaults. "default"
+ * alone selects the defaults.
+ * @return false if the list is malformed or describes no valid cache
+ */
+bool cache_parse(const char *spec, cache_options *options);
+
+/**
+ * Sets up an empty cache, or no cache if options->words is 0.
+ */
+void cache_init(data_cache *cache, const cache_options *options);
+
+void cache_free(data_cache *cache);
+
+/**
+ * Looks up the word at address in the cache, filling its line on a miss.
+ * @param latency output; the cycles the access keeps the memory stage busy
+ */
+cache_outcome cache_access(data_cache *cache, int address, bool store, int *latency);
+
+#endif //LAB1_CACHE_H
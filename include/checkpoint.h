@@ -0,0 +1,29 @@
+#ifndef LAB1_CHECKPOINT_H
+#define LAB1_CHECKPOINT_H
+
+#include <stdbool.h>
+#include "processor.h"
+
+// A checkpoint holds the complete state of a processor in the host's byte order:
+// a header, every field of cpu_state in a fixed order, the program, and the pages
+// of data memory that hold anything but zeros. The version is raised whenever the
+// fields change, and older checkpoints are refused.
+#define CHECKPOINT_MAGIC "DLXCKPT"
+#define CHECKPOINT_VERSION 6
+
+/**
+ * Writes the complete state of a processor to path.
+ * @param functional true if the state was reached in functional mode
+ * @return false if the file cannot be written
+ */
+bool checkpoint_write(cpu_state *state, const char *path, bool functional);
+
+/**
+ * Restores the complete state of a processor from path, replacing its program and data
+ * memory. state must have been initialized with processor_init().
+ * @param functional output; true if the checkpoint was taken in functional mode
+ * @return false if the file cannot be read or is not a checkpoint of this version
+ */
+bool checkpoint_read(cpu_state *state, const char *path, bool *functional);
+
+#endif //LAB1_CHECKPOINT_H
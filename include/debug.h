@@ -1,35 +1,90 @@
 #ifndef LAB1_DEBUG_H
 #define LAB1_DEBUG_H
 
+#include <stdbool.h>
 #include <stdio.h>
 #include "processor.h"
+#include "stages.h"
+#include "superscalar.h"
+#include "tomasulo.h"
 
-void print_registers(int *register_file) {
-    for (int i = 0; i < 8; i++) {
-        printf("R%-2d: %-10d ", i, register_file[i]);
-    }
-    printf("\n");
-    for (int i = 0; i < 8; i++) {
-        printf("R%-2d: %-10d ", i + 8, register_file[i + 8]);
-    }
-    printf("\n");
-}
-
-void print_memory(int *data_memory) {
-    for (int i = 0; i < MAX_WORDS_OF_DATA; i += 20) {
-        printf("%4d ", i);
-        for (int j = 0; j < 20; j++) {
-            printf("%-4d ", data_memory[i + j]);
-        }
-        printf("\n");
-    }
-}
-
-void print_registers_original(int *register_file) {
-    for (int i = 0; i < 16; i += 4) {
-        printf("  R%-2d: %-10d  R%-2d: %-10d", i, register_file[i], i + 1, register_file[i + 1]);
-        printf("  R%-2d: %-10d  R%-2d: %-10d\n", i + 2, register_file[i + 2], i + 3, register_file[i + 3]);
-    }
-}
+void print_registers(FILE *out, int *register_file);
+
+// How -D prints data memory
+#define DUMP_DENSE 0   // every addressable word, 20 to a row: the format of the golden outputs
+#define DUMP_SPARSE 1  // only the rows holding a non-zero word, looking only at pages written
+#define DUMP_DIFF 2    // only the words that differ from the initial data, with their initial value
+
+// Data memories larger than this are printed without the rows of pages never written
+#define DEBUG_DENSE_WORDS (1 << 20)
+
+/**
+ * Prints data memory as a dump selects.
+ * @param initial the data memory as the program started, for DUMP_DIFF
+ */
+void print_memory(FILE *out, const data_memory *memory, int dump, const data_memory *initial);
+
+/**
+ * Prints the registers, data memory and counts of a processor, as sim -D does; the golden
+ * outputs of the tests are in this format with DUMP_DENSE. The whole is formatted in memory
+ * and written at once.
+ * @param cycles print the cycle count, which is not kept when executing functionally
+ * @param initial the data memory as the program started, for DUMP_DIFF
+ */
+void print_debug(FILE *out, cpu_state *state, bool cycles, int dump, const data_memory *initial);
+
+/**
+ * Writes every addressable word of data memory to path as raw 32-bit words in the host's
+ * byte order. Only the pages written are written to the file, so pages never written are
+ * left as holes that read as zero.
+ * @return false if the file cannot be written
+ */
+bool dump_raw(const data_memory *memory, const char *path);
+
+void print_registers_original(FILE *out, int *register_file);
+
+/**
+ * Prints an instruction in assembler syntax, with the target of a branch or jump as the
+ * index of the instruction it leads to.
+ * @param pc the index of the instruction in the program
+ * @return the number of characters printed
+ */
+int print_instruction(FILE *out, const struct instruction *inst, int pc);
+
+/**
+ * Prints how well the branch predictor did, and the flush cycles it saved over fetching
+ * the next instruction every time, which flushes after every taken branch or jump.
+ */
+void print_prediction(FILE *out, const cpu_state *state);
+
+/**
+ * Prints the hits and misses of the data cache, and the cycles the pipeline waited for it.
+ */
+void print_cache(FILE *out, const cpu_state *state);
+
+/**
+ * Prints how many instructions the wider core issued each cycle, and how often a pairing
+ * rule kept it from issuing every instruction waiting in decode.
+ */
+void print_issue(FILE *out, const superscalar *core);
+
+/**
+ * Prints the stages of a configured pipeline, and the cycles its hazards cost.
+ */
+void print_stages(FILE *out, const staged_pipeline *pipe);
+
+/**
+ * Prints the sizes of the out-of-order core, what kept it from dispatching, and how much
+ * work mispredicted branches cost it.
+ */
+void print_tomasulo(FILE *out, const tomasulo_core *core);
+
+/**
+ * Prints the CPI stack of a pipelined run: one cycle for each instruction, plus the cycles
+ * lost to each kind of hazard, as cycles per instruction. Forwarding is counted separately,
+ * as it costs no cycles.
+ * @param json print a JSON object instead of text
+ */
+void print_stats(FILE *out, const cpu_state *state, bool json);
 
 #endif //LAB1_DEBUG_H
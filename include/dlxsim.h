@@ -0,0 +1,98 @@
+#ifndef LAB1_DLXSIM_H
+#define LAB1_DLXSIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The simulator as a library, libdlxsim, for programs that run many simulations in-process.
+// Each simulation is a processor of its own, so simulations may run on several threads at once,
+// one thread per simulation at a time. No function exits or prints: each returns DLXSIM_OK or
+// an error, and dlxsim_message describes the last one. A fault of the simulated program stops
+// its simulation, which can then only be queried, reloaded or destroyed.
+//
+// The scalar pipeline is simulated as by sim, or with config.functional as by sim -F.
+
+#define DLXSIM_API __attribute__((visibility("default")))
+
+typedef enum {
+    DLXSIM_OK = 0,
+    DLXSIM_RUNAWAY,              // the program ran for config.max_cycles without halting
+    DLXSIM_INFINITE_LOOP,        // the program was found to loop forever
+    DLXSIM_ERROR_ARGUMENT,       // an argument is out of range
+    DLXSIM_ERROR_NO_PROGRAM,     // no program is loaded
+    DLXSIM_ERROR_OPEN,           // the program cannot be read
+    DLXSIM_ERROR_ASSEMBLY,       // the program does not assemble
+    DLXSIM_ERROR_DATA,           // the initialized data does not fit in data memory
+    DLXSIM_ERROR_ILLEGAL_REG_WRITE,
+    DLXSIM_ERROR_ILLEGAL_MEM_ACCESS,
+    DLXSIM_ERROR_ILLEGAL_JUMP,
+    DLXSIM_ERROR_DIVIDE_BY_ZERO,
+} dlxsim_error;
+
+typedef struct {
+    uint64_t memory_words;  // the size of data memory, or 0 for the default of sim
+    long long max_cycles;   // the limit of dlxsim_run, or 0 for none; instructions if functional
+    int exact;              // simulate every cycle instead of extrapolating loops
+    int functional;         // execute without modelling the pipeline
+    const char *cache;      // a data cache as with sim --cache, or NULL for none
+    const char *units;      // the functional units as with sim --units, or NULL for the default
+} dlxsim_config;
+
+typedef struct dlxsim dlxsim;
+
+/**
+ * Creates a simulation with no program loaded.
+ * @param config the configuration, or NULL for that of sim without arguments
+ * @param sim output; the simulation
+ */
+DLXSIM_API int dlxsim_create(const dlxsim_config *config, dlxsim **sim);
+
+/**
+ * Loads a program from a file, either source to assemble or an image written by sim -o,
+ * into a clean processor.
+ */
+DLXSIM_API int dlxsim_load(dlxsim *sim, const char *path);
+
+/**
+ * Assembles a program from length bytes of source text into a clean processor.
+ */
+DLXSIM_API int dlxsim_load_source(dlxsim *sim, const char *source, size_t length);
+
+/**
+ * Simulates count more cycles, or instructions if functional, stopping early if the program halts.
+ * @param done output, or NULL; the cycles or instructions simulated
+ */
+DLXSIM_API int dlxsim_step(dlxsim *sim, long long count, long long *done);
+
+/**
+ * Simulates until the program halts, or config.max_cycles have been simulated in all.
+ */
+DLXSIM_API int dlxsim_run(dlxsim *sim);
+
+/**
+ * @return 1 if the program has halted, 0 if not
+ */
+DLXSIM_API int dlxsim_halted(const dlxsim *sim);
+
+DLXSIM_API int dlxsim_register(const dlxsim *sim, int index, int *value);
+DLXSIM_API int dlxsim_memory(const dlxsim *sim, uint64_t address, int *value);
+
+/**
+ * @param cycles output, or NULL; 0 if functional
+ * @param instructions output, or NULL
+ */
+DLXSIM_API int dlxsim_counts(const dlxsim *sim, long long *cycles, long long *instructions);
+
+/**
+ * @return the message of the last error of the simulation, or "" if it has had none
+ */
+DLXSIM_API const char *dlxsim_message(const dlxsim *sim);
+
+/**
+ * @return the name of an error
+ */
+DLXSIM_API const char *dlxsim_error_name(int error);
+
+DLXSIM_API void dlxsim_destroy(dlxsim *sim);
+
+#endif //LAB1_DLXSIM_H
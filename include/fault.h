@@ -0,0 +1,40 @@
+#ifndef LAB1_FAULT_H
+#define LAB1_FAULT_H
+
+#include <setjmp.h>
+
+#define ERROR_ILLEGAL_REG_WRITE  (-1)
+#define ERROR_ILLEGAL_MEM_ACCESS (-2)
+#define ERROR_ILLEGAL_JUMP (-3)
+#define ERROR_DIVIDE_BY_ZERO (-4)
+
+#define FAULT_MESSAGE_SIZE 256
+
+// A fault of the simulated program stops the simulation. By default its message is printed
+// and the simulator exits with its error, as on the command line. A caller that must go on
+// catches the faults of its thread instead: it enters a handler with fault_enter, calls setjmp
+// on the handler's target, and fault_raise returns there with the error and message recorded.
+typedef struct fault_handler {
+    jmp_buf target;
+    int error;
+    char message[FAULT_MESSAGE_SIZE];
+    struct fault_handler *previous;
+} fault_handler;
+
+void fault_enter(fault_handler *handler);
+
+void fault_leave(fault_handler *handler);
+
+/**
+ * Stops the simulation with an error, printing the message and exiting unless the thread
+ * has a handler to return to.
+ */
+__attribute__((noreturn)) void fault_raise(int error, const char *format, ...);
+
+/**
+ * Raises the fault a handler caught again, for a caller that releases what it allocated
+ * before passing the fault on to the handler that was current before its own.
+ */
+__attribute__((noreturn)) void fault_forward(const fault_handler *handler);
+
+#endif //LAB1_FAULT_H
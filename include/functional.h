@@ -0,0 +1,29 @@
+#ifndef LAB1_FUNCTIONAL_H
+#define LAB1_FUNCTIONAL_H
+
+#include <stdio.h>
+#include "processor.h"
+#include "translate.h"
+
+/**
+ * Executes the program functionally from state->fetch_buffer.pc, running whole basic blocks
+ * from the translation cache. Only the architectural state (register_file, data_memory) and
+ * instructions_executed are updated; cycles_executed is left untouched. On return,
+ * fetch_buffer.pc holds the next instruction to execute, and halt is set if the program ended.
+ * @param state the processor state, with a predecoded program loaded
+ * @param cache the translations of the program in state's instruction memory
+ * @param max_instructions the maximum number of instructions to execute
+ * @return the number of instructions executed
+ */
+long long functional_execute(cpu_state *state, translation_cache *cache, long long max_instructions);
+
+/**
+ * Executes the whole program functionally, stopping a runaway program after max_instructions
+ * instructions.
+ * @param state the processor state, with a predecoded program loaded
+ * @param out where to report a runaway program
+ * @param max_instructions the number of instructions to allow, or 0 for no limit
+ */
+void functional_run(cpu_state *state, FILE *out, long long max_instructions);
+
+#endif //LAB1_FUNCTIONAL_H
@@ -1,6 +1,8 @@
 #ifndef LAB1_GLOBALS_H
 #define LAB1_GLOBALS_H
 
+#include <stdio.h>
+
 #define NOP 0
 #define ADDI 100
 #define ADD  101
@@ -11,6 +13,16 @@
 #define BEQZ 106
 #define BNEZ 107
 #define J    108
+#define MULT 109
+#define DIV  110
+#define AND  111
+#define OR   112
+#define XOR  113
+#define SLL  114
+#define SRL  115
+#define SLT  116
+#define LL   117
+#define SC   118
 
 #define R0   0
 #define R1   1
@@ -43,16 +55,52 @@ struct instruction {
     int rs;        /* rs register tag */
     int rt;        /* rt register tag */
     int imm;       /* actual immediate value in assembler inst */
+
+    /* filled in by instruction_predecode() after assembly */
+    int dest;      /* register written, or NOT_USED */
+    int dest_mask; /* bit of dest in a register mask, 0 if none */
+    int src_mask;  /* mask of the registers read */
+    int alu;       /* alu_op performed in the execute stage */
+    int memory;    /* mem_op performed in the memory stage */
+    int branch;    /* branch_kind resolved in the decode stage */
+    int flags;     /* INST_* classification flags */
+};
+
+/*
+** Initialized data assembled from .word directives, stored in
+** consecutive words starting at address.
+*/
+
+struct data_segment {
+    unsigned int address;  /* first word */
+    int length;            /* number of words */
+    int *words;
+};
+
+/*
+** An assembled program: its machine code and initialized data.
+** Labels are resolved during assembly, so none are kept.
+** Released with FreeProgram().
+*/
+
+struct program {
+    struct instruction *code;
+    int code_length;
+    struct data_segment *segments;
+    int segment_count;
 };
 
-#define MAX_LINES_OF_CODE    100
 #define NOT_USED        -1
-#define MAX_WORDS_OF_DATA    1000
 
-void AssembleSimpleDLX(char *, struct instruction *, int *);
+/* room for the message of an assembly error */
+#define ASSEMBLY_MESSAGE_SIZE 1024
+
+void AssembleSimpleDLX(char *, struct program *);
+int AssembleDLX(FILE *, struct program *, char *, int);
+void FreeProgram(struct program *);
 void ParseLineIntoTokens(char *, char *, char **, char **, char **);
 void ParseRegister(char *, int *);
 void ParseImmediate(char *, int *);
 void ParseAddress(char *, int *, int *);
 
-#endif LAB1_GLOBALS_H
\ No newline at end of file
+#endif //LAB1_GLOBALS_H
\ No newline at end of file
@@ -0,0 +1,76 @@
+#ifndef LAB1_IMAGE_H
+#define LAB1_IMAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "globals.h"
+#include "processor.h"
+
+// A program image holds an assembled program in the host's byte order:
+//
+//   image_header
+//   image_instruction[instructions]
+//   uint32_t[pages]: the page number of each data page, in increasing order
+//   (padding to IMAGE_ALIGNMENT)
+//   int32_t[pages][MEMORY_PAGE_WORDS]: the initialized data pages
+//
+// Data pages are aligned in the file to the size of a page, so that they can be
+// used in place from a mapping of the file.
+#define IMAGE_MAGIC "DLXIMAGE"
+#define IMAGE_VERSION 1
+#define IMAGE_ALIGNMENT (MEMORY_PAGE_WORDS * sizeof(int32_t))
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t instructions;
+    uint32_t pages;
+
+    // One past the highest address of initialized data
+    uint64_t data_words;
+
+    // File offsets of the sections
+    uint64_t instructions_offset;
+    uint64_t page_numbers_offset;
+    uint64_t pages_offset;
+} image_header;
+
+typedef struct {
+    int32_t op, rd, rs, rt, imm;
+} image_instruction;
+
+/**
+ * @return true if the file at path starts like a program image
+ */
+bool image_probe(const char *path);
+
+/**
+ * Loads a copy of an assembled program into instruction and data memory.
+ * @return false if the data does not fit in data memory
+ */
+bool program_load(cpu_state *state, const struct program *program);
+
+/**
+ * Writes an assembled program to path as an image.
+ * @return false if the file cannot be written
+ */
+bool image_write(const char *path, const struct program *program);
+
+/**
+ * Reads an image from size bytes at base into an assembled program, as if the program had
+ * been assembled from its source; its data pages become data segments.
+ * @return false if the image is malformed or its data does not fit in words words
+ */
+bool image_read_program(const char *base, size_t size, uint64_t words, struct program *program);
+
+/**
+ * Loads a program image into instruction and data memory. The file is mapped privately,
+ * and its data pages become pages of data memory without being copied; they are only
+ * copied, by the kernel, if the program writes to them.
+ * @return false if the image cannot be read, is malformed, or its data does not fit in
+ * data memory
+ */
+bool image_load(cpu_state *state, const char *path);
+
+#endif //LAB1_IMAGE_H
@@ -7,113 +7,54 @@
 // An enumeration of the possible ALU operations an
 // instruction can encode.
 typedef enum {
-    UNDEFINED, PLUS, MINUS
+    UNDEFINED, PLUS, MINUS, TIMES, DIVIDE, BITWISE_AND, BITWISE_OR, BITWISE_XOR, SHIFT_LEFT, SHIFT_RIGHT,
+    LESS_THAN
 } alu_op;
 
 typedef enum {
     READ, WRITE, NO_OPERATION
 } mem_op;
 
-const struct instruction nop = { .op = NOP, .rd = NOT_USED, .rt = NOT_USED, .rs = NOT_USED, .imm = 0 };
+// An enumeration of the ways an instruction can redirect
+// the program counter.
+typedef enum {
+    NOT_BRANCH, BRANCH_EQZ, BRANCH_NEZ, BRANCH_ALWAYS
+} branch_kind;
 
-/**
- * @return the number of the register the provided instruction writes to. If the
- * instruction does not write to a register, returns NOT_USED.
- */
-int instruction_get_output_register(struct instruction instruction) {
-    switch (instruction.op) {
-        case ADDI:
-        case SUBI:
-        case LW:
-            return instruction.rt;
-        case ADD:
-        case SUB:
-            return instruction.rd;
-        default:
-            return NOT_USED;
-    }
-}
+// Classification flags stored in instruction.flags by instruction_predecode,
+// so the pipeline stages can test them instead of switching on the op-code.
+#define INST_WRITES    (1 << 0)  // writes instruction.dest
+#define INST_IMMEDIATE (1 << 1)  // second ALU operand is instruction.imm
+#define INST_LOAD      (1 << 2)  // reads data memory
+#define INST_STORE     (1 << 3)  // writes data memory
+#define INST_BRANCH    (1 << 4)  // conditional branch (BEQZ, BNEZ)
+#define INST_JUMP      (1 << 5)  // unconditional jump (J)
+#define INST_UNIT      (1 << 6)  // executes on a multi-cycle functional unit (MULT, DIV)
+#define INST_ATOMIC    (1 << 7)  // load linked or store conditional (LL, SC)
 
-/**
- * @return true if the provided instruction has an immediate operand, false otherwise.
- */
-bool instruction_has_immediate(struct instruction instruction) {
-    switch (instruction.op) {
-        case ADDI:
-        case SUBI:
-        case LW:
-        case SW:
-            return true;
-        default:
-            return false;
-    }
-}
+#define INST_MEMORY    (INST_LOAD | INST_STORE)
 
-mem_op instruction_get_memory_operation(struct instruction instruction) {
-    switch (instruction.op) {
-        case LW: return READ;
-        case SW: return WRITE;
-        default: return NO_OPERATION;
-    }
-}
+extern const struct instruction nop;
 
-bool instruction_is_branch(struct instruction instruction) {
-    switch (instruction.op) {
-        case BEQZ:
-        case BNEZ:
-            return true;
-        default:
-            return false;
-    }
-}
+/**
+ * Fills in the predecoded fields of the provided instruction from its op-code
+ * and register tags.
+ */
+void instruction_predecode(struct instruction *instruction);
 
 /**
- * @return the ALU operation the provided instruction encodes for.
+ * Predecodes every instruction of an assembled program.
  */
-alu_op instruction_get_alu_op(struct instruction instruction) {
-    switch (instruction.op) {
-        case ADDI:
-        case ADD:
-        case LW:
-        case SW:
-            return PLUS;
-        case SUBI:
-        case SUB:
-            return MINUS;
-        default:
-            return UNDEFINED;
-    }
-}
+void instruction_predecode_program(struct instruction *code, int count);
 
 /**
  * @param reader the instruction executing after writer
  * @param writer the instruction executed before reader
  * @return the number of the register that will encounter a read-after-write data hazard. If no RAW hazard
- * occurs, returns NOT_USED.
+ * occurs, returns NOT_USED. Both instructions must have been predecoded.
  */
-int instruction_get_reg_read_after_write(struct instruction reader, struct instruction writer) {
-    int write_register = instruction_get_output_register(writer);
-
-    if (write_register == NOT_USED)
-        return NOT_USED;
-
-    switch (reader.op) {
-        case ADD:
-        case SUB:
-        case LW:
-        case SW:
-            if (reader.rs == write_register) return reader.rs;
-            if (reader.rt == write_register) return reader.rt;
-            return NOT_USED;
-        case ADDI:
-        case SUBI:
-        case BEQZ:
-        case BNEZ:
-            if (reader.rs == write_register) return reader.rs;
-            return NOT_USED;
-        default:
-            return NOT_USED;
-    }
+static inline int instruction_get_reg_read_after_write(struct instruction reader, struct instruction writer) {
+    return (reader.src_mask & writer.dest_mask) ? writer.dest : NOT_USED;
 }
 
 #endif //LAB1_INSTRUCTION_H
@@ -0,0 +1,29 @@
+#ifndef LAB1_LOCKSTEP_H
+#define LAB1_LOCKSTEP_H
+
+#include <stdbool.h>
+#include "processor.h"
+
+// The number of simulations stepped together. Each register, latch value and
+// data memory word holds one value per lane in a vector.
+#define LOCKSTEP_LANES 8
+
+// The exception a lane raised, which stops that lane alone
+typedef struct {
+    int error;  // 0 if the lane raised none
+    char message[FAULT_MESSAGE_SIZE];
+} lockstep_fault;
+
+/**
+ * Simulates lanes in lockstep until the program halts, every lane has diverged or faulted,
+ * or the program runs away. Every lane that did not fault is then scattered back into lanes:
+ * lanes that diverged still need to be simulated on their own from where they left off.
+ * @param lanes the initial state of each lane, holding the final or diverged states on return
+ * @param count the number of lanes used, at most LOCKSTEP_LANES
+ * @param max_cycles the number of cycles to allow, or 0 for no limit
+ * @param faults output; the exception of each lane, whose state is then left as it was
+ * @return true if the lanes still active ran away, as simulate() would report it
+ */
+bool lockstep_run(cpu_state *lanes, int count, long long max_cycles, lockstep_fault *faults);
+
+#endif //LAB1_LOCKSTEP_H
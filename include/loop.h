@@ -0,0 +1,35 @@
+#ifndef LAB1_LOOP_H
+#define LAB1_LOOP_H
+
+#include <stdbool.h>
+#include "processor.h"
+
+// Steady-state loop extrapolation: once the iterations of a loop advance the state of the
+// pipeline by the same amount, the simulation jumps ahead analytically to the last iteration
+// before a branch decision changes. The method is described in loop.c.
+typedef struct loop_engine loop_engine;
+
+/**
+ * Forgets every snapshot and event, after the state has been changed behind the engine's back.
+ */
+void loop_reset(loop_engine *engine);
+
+loop_engine *loop_engine_create(const cpu_state *state);
+
+void loop_engine_destroy(loop_engine *engine);
+
+/**
+ * Simulates the pipeline as loop_simulate_until, with an engine created for the program
+ * loaded. What the engine saw in earlier calls must still hold, or it must be reset.
+ */
+bool loop_engine_run(loop_engine *engine, cpu_state *state, long long cycles, int *loop);
+
+/**
+ * Simulates the pipeline cycle by cycle until the processor halts or has executed cycles
+ * cycles in total, extrapolating loops that reach a steady state.
+ * @param loop output; the pc of the loop header if an infinite loop is found
+ * @return true if the program is in an infinite loop
+ */
+bool loop_simulate_until(cpu_state *state, long long cycles, int *loop);
+
+#endif //LAB1_LOOP_H
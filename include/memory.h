@@ -0,0 +1,123 @@
+#ifndef LAB1_MEMORY_H
+#define LAB1_MEMORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Data memory covers a 32-bit word address space, split into pages of
+// MEMORY_PAGE_WORDS words (4 KiB). Pages are found through a two-level table
+// and only allocated when first written.
+#define MEMORY_PAGE_BITS   10
+#define MEMORY_TABLE_BITS  11
+#define MEMORY_PAGE_WORDS  (1 << MEMORY_PAGE_BITS)
+#define MEMORY_TABLE_SIZE  (1 << MEMORY_TABLE_BITS)
+#define MEMORY_MAX_WORDS   (1ULL << 32)
+
+// The default number of addressable words
+#define DEFAULT_WORDS_OF_DATA 1000
+
+// Unallocated pages and tables point at these, so that reads never need to check
+// whether a page exists; only the first write to a page allocates it.
+extern const int memory_zero_page[MEMORY_PAGE_WORDS];
+extern int *const memory_zero_table[MEMORY_TABLE_SIZE];
+
+typedef struct {
+    int **directory[MEMORY_TABLE_SIZE];
+
+    // The number of addressable words, at most MEMORY_MAX_WORDS. Accesses at or
+    // beyond it are out-of-bounds.
+    uint64_t words;
+
+    // The number of pages allocated
+    long pages;
+
+    // A file mapping that some pages point into, or NULL. Those pages are
+    // copied on write by the kernel, and released with the mapping.
+    char *mapping;
+    size_t mapping_size;
+
+    // The addresses stored to since the log was last emptied, in order, if log is not NULL
+    uint32_t *log;
+    long log_count, log_capacity;
+} data_memory;
+
+void memory_init(data_memory *memory, uint64_t words);
+
+void memory_free(data_memory *memory);
+
+/**
+ * Empties memory for reuse, zeroing the pages written instead of releasing them, so that
+ * the same pages serve the next program without being allocated again.
+ */
+void memory_clear(data_memory *memory);
+
+/**
+ * @return true if the word at address may be accessed. Addresses are interpreted as
+ * unsigned, so negative addresses are only valid in a full 32-bit address space.
+ */
+static inline bool memory_in_bounds(const data_memory *memory, int address) {
+    return (uint32_t) address < memory->words;
+}
+
+static inline int memory_load(const data_memory *memory, int address) {
+    const uint32_t word = address;
+    return memory->directory[word >> (MEMORY_PAGE_BITS + MEMORY_TABLE_BITS)]
+                            [(word >> MEMORY_PAGE_BITS) & (MEMORY_TABLE_SIZE - 1)]
+                            [word & (MEMORY_PAGE_WORDS - 1)];
+}
+
+/**
+ * @return the page with the provided page number, or NULL if it was never written
+ */
+int *memory_page(const data_memory *memory, uint32_t page_number);
+
+/**
+ * @return the page with the provided page number, allocating it zero-filled if necessary
+ */
+int *memory_page_for_write(data_memory *memory, uint32_t page_number);
+
+/**
+ * Makes page_number refer to a page of words inside a private, writable file mapping
+ * instead of copying them. The mapping is owned by the memory from then on; every page
+ * attached must come from the same mapping.
+ */
+void memory_attach_page(data_memory *memory, uint32_t page_number, int *page, char *mapping, size_t mapping_size);
+
+/**
+ * Starts logging the address of every store, as memory_store appends them to memory->log.
+ */
+void memory_log_start(data_memory *memory);
+
+void memory_log_append(data_memory *memory, uint32_t word);
+
+/**
+ * Stores a word without logging it.
+ */
+static inline void memory_write(data_memory *memory, int address, int value) {
+    const uint32_t word = address;
+    int *page = memory->directory[word >> (MEMORY_PAGE_BITS + MEMORY_TABLE_BITS)]
+                                 [(word >> MEMORY_PAGE_BITS) & (MEMORY_TABLE_SIZE - 1)];
+    if (page == memory_zero_page)
+        page = memory_page_for_write(memory, word >> MEMORY_PAGE_BITS);
+    page[word & (MEMORY_PAGE_WORDS - 1)] = value;
+}
+
+static inline void memory_store(data_memory *memory, int address, int value) {
+    if (memory->log != NULL)
+        memory_log_append(memory, address);
+    memory_write(memory, address, value);
+}
+
+/**
+ * @return the number of the first page at or after page_number that was written, or
+ * MEMORY_MAX_WORDS / MEMORY_PAGE_WORDS if there is none
+ */
+uint32_t memory_next_page(const data_memory *memory, uint64_t page_number);
+
+/**
+ * Initializes to as a copy of from, with a page of its own for each page written in from.
+ */
+void memory_copy(data_memory *to, const data_memory *from);
+
+#endif //LAB1_MEMORY_H
@@ -0,0 +1,66 @@
+#ifndef LAB1_MULTICORE_H
+#define LAB1_MULTICORE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include "processor.h"
+
+// A machine of cores running the same program, each a cpu_state with a pipeline of its own,
+// and each simulated on a thread of its own. The cores run a quantum of cycles at a time
+// and then meet at a barrier, where the machine merges what they stored. During a quantum
+// a core only sees its own stores. At the barrier the stores of every core are applied to
+// the data memory of all of them, core by core in order, so a word stored by several cores
+// ends with the value of the highest-numbered one. Data memory thus behaves as one memory
+// whose stores reach the other cores at the end of the quantum, and the machine is
+// deterministic however the threads are scheduled.
+//
+// A store conditional waits in the memory stage for the barrier. After the stores, the
+// machine performs the waiting ones core by core: one succeeds if its core's last load
+// linked reserved the word and nothing has cancelled the reservation since. A store by
+// another core to the word, plain or conditional, cancels it.
+//
+// Each core starts with its number in R15 and the number of cores in R14.
+#define MULTICORE_MAX_CORES 64
+#define DEFAULT_QUANTUM 100
+
+typedef struct {
+    int cores;          // 0 for a single processor
+    long long quantum;  // cycles between barriers
+} multicore_options;
+
+typedef struct {
+    multicore_options options;
+    cpu_state **cores;
+    long long until;   // the cycle the current quantum ends at
+    long long limit;   // the cycle to stop at, at the latest
+    bool done;
+    pthread_barrier_t barrier;
+
+    long long quanta;
+    long long conditionals;  // store conditionals performed
+    long long failed;        // of which did not store
+} multicore;
+
+/**
+ * Parses N or N,Q into options: N cores meeting every Q cycles.
+ * @return false if a number is malformed or out of range
+ */
+bool multicore_parse(const char *spec, multicore_options *options);
+
+/**
+ * Joins prepared processors into a machine. Each must hold the program and its initial data.
+ */
+void multicore_init(multicore *machine, const multicore_options *options, cpu_state **cores);
+
+/**
+ * Simulates the machine until every core halts or has executed cycles cycles in total,
+ * core 0 on the calling thread.
+ */
+void multicore_run(multicore *machine, long long cycles);
+
+/**
+ * @return the cycles the machine ran: those of its slowest core
+ */
+long long multicore_cycles(const multicore *machine);
+
+#endif //LAB1_MULTICORE_H
@@ -0,0 +1,31 @@
+#ifndef LAB1_PIPELINE_H
+#define LAB1_PIPELINE_H
+
+#include <stdbool.h>
+#include "processor.h"
+#include "trace.h"
+
+// The five stages of the scalar pipeline, and the loop simulating them cycle by cycle.
+
+void pipeline_fetch(cpu_state *state);
+
+void pipeline_decode(cpu_state *state);
+
+void pipeline_execute(cpu_state *state);
+
+void pipeline_memory(cpu_state *state);
+
+void pipeline_writeback(cpu_state *state);
+
+void simulate_cycle(cpu_state *state);
+
+/**
+ * Simulates the pipeline until the processor halts or has executed cycles cycles in total.
+ * Unless exact or traced, loops that reach a steady state are extrapolated rather than simulated.
+ * @param trace where to record every cycle, or NULL
+ * @param loop output; the pc of the loop header if the program loops forever
+ * @return true if the program loops forever
+ */
+bool simulate_until(cpu_state *state, long long cycles, bool exact, trace_writer *trace, int *loop);
+
+#endif //LAB1_PIPELINE_H
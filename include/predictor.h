@@ -0,0 +1,78 @@
+#ifndef LAB1_PREDICTOR_H
+#define LAB1_PREDICTOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "instruction.h"
+
+// Branch prediction for the fetch stage. Branches are resolved in decode, so without a
+// prediction every taken branch or jump costs the instruction fetched after it. The fetch
+// stage asks the predictor where to fetch next, and decode flushes only when the
+// prediction was wrong, then trains the predictor with the outcome.
+//
+// Targets are relative to the pc and predecoded, so the direction predictors redirect
+// fetch as soon as a branch is fetched. The BTB models a fetch stage that only knows the
+// targets of branches it has seen taken before.
+typedef enum {
+    PREDICT_NOT_TAKEN,  // always fetch the next instruction
+    PREDICT_BTFN,       // backward branches taken, forward branches not
+    PREDICT_BIMODAL,    // a table of 2-bit counters indexed by pc
+    PREDICT_GSHARE,     // a table of 2-bit counters indexed by pc xor the global history
+    PREDICT_BTB         // a direct-mapped branch target buffer with a 2-bit counter per entry
+} predictor_kind;
+
+#define DEFAULT_PREDICTOR_ENTRIES 1024
+#define PREDICTOR_MAX_ENTRIES (1 << 24)
+
+typedef struct {
+    predictor_kind kind;
+    int entries;       // entries of the table, a power of two
+    int history_bits;  // branch outcomes in the global history of gshare
+} predictor_options;
+
+typedef struct {
+    predictor_options options;
+    uint8_t *counters;  // 2-bit saturating counters, 2 and 3 predict taken
+    int *tags;          // the pc of each BTB entry, or -1
+    int *targets;       // the target of each BTB entry
+    uint32_t history;   // the latest history_bits outcomes, most recent in bit 0
+
+    // The number of times an entry of a table changed, so a loop can tell that the
+    // predictor has settled.
+    long long changes;
+} branch_predictor;
+
+/**
+ * Parses a predictor name.
+ * @return false if there is no such predictor
+ */
+bool predictor_parse(const char *name, predictor_kind *kind);
+
+const char *predictor_name(predictor_kind kind);
+
+/**
+ * @return true if the options name an existing predictor with a table of a valid size
+ */
+bool predictor_valid(const predictor_options *options);
+
+/**
+ * Allocates the tables of a predictor that has seen no branches. options must be valid.
+ */
+void predictor_init(branch_predictor *predictor, const predictor_options *options);
+
+void predictor_free(branch_predictor *predictor);
+
+/**
+ * Predicts whether the instruction just fetched at pc redirects fetch.
+ * @param target output; where to fetch next if the prediction is taken
+ * @return true if the instruction is predicted to be a taken branch or jump
+ */
+bool predictor_predict(const branch_predictor *predictor, const struct instruction *inst, int pc, int *target);
+
+/**
+ * Trains the predictor with the outcome of the branch or jump at pc, once decode has
+ * resolved it.
+ */
+void predictor_update(branch_predictor *predictor, const struct instruction *inst, int pc, bool taken, int target);
+
+#endif //LAB1_PREDICTOR_H
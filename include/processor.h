@@ -2,14 +2,25 @@
 #define LAB1_PROCESSOR_H
 
 #include <stdbool.h>
+#include <stdint.h>
+#include "fault.h"
 #include "instruction.h"
+#include "memory.h"
+#include "predictor.h"
+#include "cache.h"
+#include "scoreboard.h"
 
-// Max cycles simulator will execute -- to stop a runaway simulator
-#define MAX_CYCLES 500000
+// Default max cycles simulator will execute -- to stop a runaway simulator
+#define DEFAULT_MAX_CYCLES 500000
 
-#define ERROR_ILLEGAL_REG_WRITE  (-1)
-#define ERROR_ILLEGAL_MEM_ACCESS (-2)
-#define ERROR_ILLEGAL_JUMP (-3)
+// The number of instructions fetched past the end of the program while the
+// pipeline drains
+#define PIPELINE_DRAIN 4
+
+// The progress of a store conditional on a core of a multicore machine
+typedef enum {
+    CONDITIONAL_NONE, CONDITIONAL_WAITING, CONDITIONAL_FAILED, CONDITIONAL_SUCCEEDED
+} conditional_state;
 
 // An enumeration of pipeline stages from which data can be
 // forwarded
@@ -17,6 +28,37 @@ typedef enum {
     NO_FORWARDING, MEMORY, WRITEBACK
 } forwarding_source;
 
+// Events the pipeline stages record in cpu_state.events during a cycle
+#define EVENT_FLUSH          (1 << 2)  // a mispredicted branch or jump flushed the fetched instruction
+#define EVENT_FORWARD_BRANCH (1 << 3)  // a branch operand was forwarded to the decode stage
+#define EVENT_FORWARD_A_SHIFT 4        // the forwarding_source of operand a in the execute stage
+#define EVENT_FORWARD_B_SHIFT 6        // the forwarding_source of operand b in the execute stage
+#define EVENT_STALL          (1 << 8)  // the decode and fetch stages stalled
+#define EVENT_MEMORY_WAIT    (1 << 9)  // the memory stage waited for the data cache, holding the stages behind it
+
+// Counters of the cycles lost to hazards, of forwarding, of branches and of the data cache.
+// Every cycle is either spent on an instruction or lost to exactly one of load-use stalls,
+// branch stalls, flushes, memory stalls, unit stalls and drain cycles. The counters are only ever
+// incremented by conditions, without branching.
+typedef struct {
+    long long load_use_stalls;    // stalls for a value loaded from memory
+    long long branch_stalls;      // stalls for the operand of a branch, resolved in decode
+    long long flushes;            // fetches discarded after a mispredicted branch or jump
+    long long drain_cycles;       // cycles fetching past the end of the program
+    long long forward_memory;     // operands forwarded from the memory stage to execute
+    long long forward_writeback;  // operands forwarded from the writeback stage to execute
+    long long forward_branch;     // branch operands forwarded to decode
+    long long branches;           // branches and jumps resolved
+    long long taken;              // branches and jumps taken
+    long long memory_stalls;      // cycles the memory stage waited for the data cache
+    long long cache_hits;
+    long long cache_misses;
+    long long cache_writebacks;   // dirty lines written back to memory
+    long long unit_stalls;        // stalls in decode for the functional units
+} pipeline_stats;
+
+#define PIPELINE_STATS_COUNT (sizeof(pipeline_stats) / sizeof(long long))
+
 typedef struct {
     // Pipeline buffer for the fetch stage containing
     // persistent state related to the fetching of instructions
@@ -34,6 +76,7 @@ typedef struct {
         int pc_next;
         struct instruction inst;
         bool stall, should_jump;
+        bool predicted;  // fetch followed the instruction as a taken branch or jump
         bool forward;
         int data;
     } decode_buffer;
@@ -52,6 +95,9 @@ typedef struct {
     struct memory_buffer {
         int alu_out, write_data;
         struct instruction inst;
+        bool accessed;  // the instruction has looked up the data cache
+        int wait;       // cycles the instruction still has to wait for the data cache
+        bool waiting;   // the memory stage is waiting this cycle, holding the stages behind it
     } memory_buffer;
 
     // Pipeline buffer for the writeback stage containing persistent
@@ -62,47 +108,109 @@ typedef struct {
     } writeback_buffer;
 
     // The instruction memory, directly containing parsed
-    // instructions
-    struct instruction instruction_memory[MAX_LINES_OF_CODE];
+    // instructions, followed by PIPELINE_DRAIN empty instructions
+    struct instruction *instruction_memory;
 
-    // The number of instructions in instruction memory. The contents
-    // beyond instructions_count - 1 is undefined.
+    // The number of instructions in instruction memory
     int instructions_count;
 
     // Data memory, word-addressed
-    int data_memory[MAX_WORDS_OF_DATA];
+    data_memory data_memory;
 
     // The container for the 16 registers of the DLX processor. The first
     // register is always zero; writing to it will raise an error.
     int register_file[16];
 
     // The number of cycles the simulator has executed
-    int cycles_executed;
+    long long cycles_executed;
 
     // The number of instructions the simulator has executed
-    int instructions_executed;
+    long long instructions_executed;
 
     // If true, the simulator ceases execution of the program after
     // the current cycle.
     bool halt;
+
+    // The EVENT_* flags of the cycles since the last time they were cleared
+    int events;
+
+    pipeline_stats stats;
+
+    // Consulted by the fetch stage, and trained by the decode stage
+    branch_predictor predictor;
+
+    // Between the memory stage and data memory, if cache.lines is not NULL
+    data_cache cache;
+
+    // The multiplier and divider of the execute stage, and the hazards they raise in decode
+    scoreboard scoreboard;
+
+    // The word reserved by the last LL for a store conditional. On a core of a multicore
+    // machine, a store conditional waits in the memory stage for the machine to perform it.
+    struct reservation {
+        bool valid;
+        int address;
+        bool shared;                    // the core belongs to a multicore machine
+        conditional_state conditional;  // of the store conditional in the memory stage
+    } reservation;
 } cpu_state;
 
-void pipeline_fetch(cpu_state *state);
-void pipeline_decode(cpu_state *state);
-void pipeline_execute(cpu_state *state);
-void pipeline_memory(cpu_state *state);
-void pipeline_writeback(cpu_state *state);
+/**
+ * Performs an ALU operation, raising the division by zero exception.
+ * @return the result, wrapping around on overflow
+ */
+static inline int processor_alu(alu_op op, int a, int b) {
+    switch (op) {
+        case PLUS:        return (int) ((uint32_t) a + (uint32_t) b);
+        case MINUS:       return (int) ((uint32_t) a - (uint32_t) b);
+        case TIMES:       return (int) ((uint32_t) a * (uint32_t) b);
+        case BITWISE_AND: return a & b;
+        case BITWISE_OR:  return a | b;
+        case BITWISE_XOR: return a ^ b;
+        case SHIFT_LEFT:  return (int) ((uint32_t) a << (b & 31));
+        case SHIFT_RIGHT: return (int) ((uint32_t) a >> (b & 31));
+        case LESS_THAN:   return a < b;
+        case DIVIDE:
+            if (b == 0) {
+                fault_raise(ERROR_DIVIDE_BY_ZERO, "Exception: division by zero\n");
+            }
+            return b == -1 ? (int) (0u - (uint32_t) a) : a / b;
+        default:          return 0;
+    }
+}
+
+/**
+ * Reserves the word a load linked reads.
+ */
+static inline void processor_load_linked(cpu_state *state, int address) {
+    state->reservation.valid = true;
+    state->reservation.address = address;
+}
+
+/**
+ * Performs a store conditional on a processor with data memory of its own: the word is
+ * only stored if the last load linked reserved it, and the reservation is used up either way.
+ * @return 1 if the word was stored, 0 otherwise
+ */
+static inline int processor_store_conditional(cpu_state *state, int address, int value) {
+    const bool stored = state->reservation.valid && state->reservation.address == address;
+    if (stored)
+        memory_store(&state->data_memory, address, value);
+    state->reservation.valid = false;
+    return stored;
+}
 
 /**
  * Stalls the decode and fetch stages if a RAW data hazard occurs
  * @param state the processor state
  * @param reader the instruction executing after writer
  * @param writer the instruction executed before reader
+ * @return true if there is a hazard
  */
-void processor_stall_on_hazard(cpu_state *state, struct instruction reader, struct instruction writer) {
-    if (instruction_get_reg_read_after_write(reader, writer) != NOT_USED) {
-        state->decode_buffer.stall = true;
-    }
+static inline bool processor_stall_on_hazard(cpu_state *state, struct instruction reader, struct instruction writer) {
+    const bool hazard = (reader.src_mask & writer.dest_mask) != 0;
+    state->decode_buffer.stall |= hazard;
+    return hazard;
 }
 
 /**
@@ -113,24 +221,51 @@ void processor_stall_on_hazard(cpu_state *state, struct instruction reader, stru
  * @param writer the instruction executed before reader
  * @param source the source from which to forward
  */
-void processor_forward_on_hazard(cpu_state *state, forwarding_source *stage, struct instruction reader,
-                                 struct instruction writer, forwarding_source source, int data) {
-    int hazard_register = instruction_get_reg_read_after_write(reader, writer);
-    if (hazard_register != NOT_USED) {
-        if (hazard_register == reader.rs)
+static inline void processor_forward_on_hazard(cpu_state *state, forwarding_source *stage, struct instruction reader,
+                                               struct instruction writer, forwarding_source source, int data) {
+    if (reader.src_mask & writer.dest_mask) {
+        if (writer.dest == reader.rs)
             *stage = source;
-        if (hazard_register == reader.rt)
+        if (writer.dest == reader.rt)
             *(stage + 1) = source;
     }
 
-    if (instruction_is_branch(state->decode_buffer.inst)) {
-        if (instruction_get_output_register(writer) != NOT_USED) {
-            if (instruction_get_reg_read_after_write(state->decode_buffer.inst, writer) != NOT_USED) {
-                state->decode_buffer.forward = true;
-                state->decode_buffer.data = data;
-            }
-        }
+    const struct instruction branch = state->decode_buffer.inst;
+    if ((branch.flags & INST_BRANCH) && (branch.src_mask & writer.dest_mask)) {
+        state->decode_buffer.forward = true;
+        state->decode_buffer.data = data;
     }
 }
 
+/**
+ * Resets the processor to an empty state without a program.
+ * @param words the number of addressable words of data memory
+ */
+void processor_init(cpu_state *state, uint64_t words);
+
+/**
+ * Resets a processor that has run a program to an empty state, as processor_init, but keeping
+ * the pages of data memory allocated and only zeroing what was used.
+ */
+void processor_reset(cpu_state *state);
+
+/**
+ * Loads an assembled program into instruction memory, taking ownership of code.
+ * The program is predecoded and padded for the pipeline to drain.
+ */
+void processor_load_program(cpu_state *state, struct instruction *code, int count);
+
+/**
+ * Releases the program and data memory of the processor.
+ */
+void processor_free(cpu_state *state);
+
+/**
+ * Initializes data memory from a file of whitespace-separated integers, stored
+ * in consecutive words starting at address 0.
+ * @return false if the file cannot be read, holds something other than integers,
+ * or does not fit in data memory
+ */
+bool processor_load_data(cpu_state *state, const char *path);
+
 #endif //LAB1_PROCESSOR_H
@@ -0,0 +1,43 @@
+#ifndef LAB1_SAMPLING_H
+#define LAB1_SAMPLING_H
+
+#include <stdbool.h>
+#include "processor.h"
+
+// Sampled simulation in the spirit of SMARTS: the program runs functionally, and
+// once every period instructions the pipeline is simulated in detail for warmup
+// instructions, to refill it, and then measure instructions, whose CPI is one
+// sample. The pipeline is drained before returning to functional execution.
+typedef struct {
+    long long period;
+    long long warmup;
+    long long measure;
+} sample_options;
+
+#define DEFAULT_SAMPLE_WARMUP 100
+#define DEFAULT_SAMPLE_MEASURE 1000
+
+// The CPI samples taken during a run
+typedef struct {
+    long long samples;
+    double cpi_sum, cpi_squares;
+} sample_estimate;
+
+/**
+ * Runs the program with sampled detailed simulation. The architectural state is exact;
+ * cycles_executed only counts the cycles simulated in detail.
+ * @param max_instructions the number of instructions to allow, or 0 for no limit
+ * @param estimate output; the CPI samples taken
+ * @return false if the program ran away
+ */
+bool sample_run(cpu_state *state, const sample_options *options, long long max_instructions,
+                sample_estimate *estimate);
+
+/**
+ * @param half_width output; the half-width of the 95% confidence interval of the mean
+ * CPI, or 0 with fewer than two samples
+ * @return the mean CPI of the samples
+ */
+double sample_mean_cpi(const sample_estimate *estimate, double *half_width);
+
+#endif //LAB1_SAMPLING_H
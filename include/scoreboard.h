@@ -0,0 +1,155 @@
+#ifndef LAB1_SCOREBOARD_H
+#define LAB1_SCOREBOARD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "instruction.h"
+
+// Multi-cycle functional units beside the integer ALU of the execute stage: MULT runs on
+// the multiplier and DIV on the divider, for latency cycles each, while every other
+// instruction takes the single cycle of the ALU. A pipelined unit accepts an instruction
+// every cycle, an unpipelined one only once the one before has left it. An instruction
+// leaving its unit moves on to the memory stage in place of the execute stage's own, so
+// independent instructions keep flowing past it.
+//
+// Decode only issues an instruction once the scoreboard clears it of:
+// - structural hazards: its unit must accept it, and the cycle it would move on to the
+//   memory stage must not be reserved by an instruction leaving a unit;
+// - RAW hazards: no operand may still be computed by a unit. A result that has left its
+//   unit is forwarded from the memory and writeback stages like any other;
+// - WAW hazards: its destination must not be that of an instruction in a unit, which
+//   would otherwise be written back after it.
+typedef enum {
+    UNIT_MULTIPLIER, UNIT_DIVIDER, UNIT_KINDS
+} unit_kind;
+
+#define DEFAULT_MULTIPLY_LATENCY 4
+#define DEFAULT_DIVIDE_LATENCY 12
+#define UNIT_MAX_LATENCY 31
+
+// Every instruction in a unit leaves it in a different cycle, at most UNIT_MAX_LATENCY ahead.
+#define SCOREBOARD_MAX_OPERATIONS UNIT_MAX_LATENCY
+
+typedef struct {
+    int latency[UNIT_KINDS];
+    bool pipelined[UNIT_KINDS];
+} unit_options;
+
+// An instruction in a functional unit, whose result was computed as it entered
+typedef struct {
+    struct instruction inst;
+    int result;
+    int remaining;  // cycles until it moves on to the memory stage, 0 at the end of this one
+} unit_operation;
+
+typedef struct {
+    unit_options options;
+    int pending[16];        // cycles until the instruction computing each register leaves its unit, or 0
+    int busy[UNIT_KINDS];   // cycles until an unpipelined unit accepts another instruction
+    uint32_t reserved;      // bit d: an instruction leaves a unit for the memory stage d cycles from now
+    int count;
+    unit_operation operations[SCOREBOARD_MAX_OPERATIONS];  // in the units, in the order they entered
+} scoreboard;
+
+void units_default(unit_options *options);
+
+/**
+ * @return true if every unit has a latency the scoreboard can reserve cycles for
+ */
+bool units_valid(const unit_options *options);
+
+/**
+ * Parses a comma-separated list of mult=N, div=N, mult-pipelined=yes|no and
+ * div-pipelined=yes|no into options, over the defaults. "default" alone selects the
+ * defaults.
+ * @return false if the list is malformed or a latency is out of range
+ */
+bool units_parse(const char *spec, unit_options *options);
+
+/**
+ * Empties the functional units. options must be valid.
+ */
+void scoreboard_init(scoreboard *board, const unit_options *options);
+
+/**
+ * Copies a scoreboard without the unused entries of its operations.
+ */
+void scoreboard_copy(scoreboard *to, const scoreboard *from);
+
+/**
+ * @return the unit the instruction executes on, or -1 for the integer ALU
+ */
+static inline int scoreboard_unit(const struct instruction *inst) {
+    if (!(inst->flags & INST_UNIT))
+        return -1;
+    return inst->alu == TIMES ? UNIT_MULTIPLIER : UNIT_DIVIDER;
+}
+
+/**
+ * @return true if no instruction is in a unit or issued to one. Nothing else is then pending.
+ */
+static inline bool scoreboard_idle(const scoreboard *board) {
+    return board->reserved == 0;
+}
+
+/**
+ * @return true if an operand or the destination of inst is still being computed by a unit
+ */
+static inline bool scoreboard_waits(const scoreboard *board, const struct instruction *inst) {
+    for (int registers = inst->src_mask | inst->dest_mask; registers != 0; registers &= registers - 1) {
+        if (board->pending[__builtin_ctz(registers)] > 0)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @return true if decode must hold inst for a hazard with the functional units
+ */
+static inline bool scoreboard_blocked(const scoreboard *board, const struct instruction *inst) {
+    if (scoreboard_idle(board))
+        return false;
+    if (scoreboard_waits(board, inst))
+        return true;
+
+    const int unit = scoreboard_unit(inst);
+    if (unit < 0)
+        return inst->op != NOP && (board->reserved & 2);
+    return board->busy[unit] > 0 || (board->reserved >> board->options.latency[unit] & 1);
+}
+
+/**
+ * Reserves what an instruction decode issues to a unit will need.
+ */
+void scoreboard_issue(scoreboard *board, const struct instruction *inst);
+
+/**
+ * Advances the units by a cycle. Called by the execute stage before anything else, in
+ * every cycle the pipeline moves.
+ */
+static inline void scoreboard_tick(scoreboard *board) {
+    if (scoreboard_idle(board))
+        return;
+
+    board->reserved >>= 1;
+    for (int i = 0; i < 16; i++)
+        board->pending[i] -= board->pending[i] > 0;
+    for (int i = 0; i < UNIT_KINDS; i++)
+        board->busy[i] -= board->busy[i] > 0;
+    for (int i = 0; i < board->count; i++)
+        board->operations[i].remaining--;
+}
+
+/**
+ * Moves an instruction the execute stage has just computed into its unit.
+ */
+void scoreboard_start(scoreboard *board, const struct instruction *inst, int result);
+
+/**
+ * Takes the instruction leaving its unit at the end of this cycle, if any.
+ * @param done output; the instruction and its result
+ * @return false if no instruction leaves a unit
+ */
+bool scoreboard_finish(scoreboard *board, unit_operation *done);
+
+#endif //LAB1_SCOREBOARD_H
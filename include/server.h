@@ -0,0 +1,89 @@
+#ifndef LAB1_SERVER_H
+#define LAB1_SERVER_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "globals.h"
+#include "memory.h"
+
+// A simulation server takes jobs over a Unix domain socket. A client sends any number of
+// requests on a connection, and gets a reply to each in turn. Both are frames:
+//
+//   uint32_t kind (a request's SERVER_SOURCE or SERVER_IMAGE, a reply's SERVER_REPLY)
+//   uint32_t length
+//   char[length] payload: program source or an image written by sim -o, or the reply text
+//
+// in the host's byte order, as the socket is local.
+#define SERVER_SOURCE 1
+#define SERVER_IMAGE 2
+#define SERVER_REPLY 3
+
+// The largest payload accepted
+#define SERVER_MAX_PAYLOAD (64u << 20)
+
+// The number of assembled programs kept, the least recently used being dropped first
+#define SERVER_CACHE_PROGRAMS 256
+#define SERVER_CACHE_BUCKETS 512
+
+typedef struct server_frame {
+    uint32_t kind;
+    uint32_t length;
+} server_frame;
+
+// An assembled program, kept for requests with the same payload. An entry is shared by
+// the workers running it, and only freed once the last has released it.
+typedef struct cached_program {
+    uint64_t hash;
+    uint32_t kind;
+    char *payload;
+    uint32_t length;
+
+    struct program program;
+    data_memory initial;  // data memory as the program starts, to diff the final memory against
+
+    int references;
+    bool evicted;
+    struct cached_program *next;              // in the bucket
+    struct cached_program *newer, *older;     // in order of use
+} cached_program;
+
+typedef struct {
+    cached_program *buckets[SERVER_CACHE_BUCKETS];
+    cached_program *newest, *oldest;
+    int count;
+    uint64_t words;  // of data memory, which the data of programs must fit in
+    pthread_mutex_t lock;
+
+    long long hits, misses;
+} program_cache;
+
+/**
+ * Reads a request.
+ * @param payload output; the payload, to be freed by the caller
+ * @return false at the end of the connection, or if the frame is malformed
+ */
+bool server_read_frame(int fd, server_frame *frame, char **payload);
+
+bool server_write_frame(int fd, const char *payload, size_t length);
+
+/**
+ * Opens a listening socket at path, replacing any socket left there.
+ * @return the socket, or -1 if it cannot be opened
+ */
+int server_listen(const char *path);
+
+void program_cache_init(program_cache *cache, uint64_t words);
+
+/**
+ * Finds the program of a request, assembling it if it is not cached, and holds it until
+ * program_cache_release.
+ * @return the entry, or NULL with the reason in message if the program has an error
+ */
+cached_program *program_cache_get(program_cache *cache, uint32_t kind, const char *payload, uint32_t length,
+                                  char *message, size_t message_size);
+
+void program_cache_release(program_cache *cache, cached_program *entry);
+
+#endif //LAB1_SERVER_H
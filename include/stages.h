@@ -0,0 +1,85 @@
+#ifndef LAB1_STAGES_H
+#define LAB1_STAGES_H
+
+#include <stdbool.h>
+#include "processor.h"
+
+// An in-order pipeline of any depth, beside the five fixed stages of simulate_cycle. The
+// pipeline is a row of latches, one per stage, each holding the instruction in its stage
+// and the values it carries; a latch holding a NOP is a bubble. Fetch, execute and memory
+// may each span several stages, around a single decode and writeback stage:
+// - the first fetch stage fetches an instruction a cycle, and the others pass it on;
+// - decode reads the operands, resolves branches and jumps, and holds an instruction until
+//   its operands can be forwarded;
+// - the last execute stage computes the result, and holds MULT and DIV for the latency of
+//   their unit beyond the depth of execute;
+// - the first memory stage accesses data memory, holding for the data cache, and a loaded
+//   value is ready once the load reaches the last memory stage;
+// - writeback writes the register file.
+// Every stage after the one computing a result forwards it, to decode and so to the first
+// execute stage the next cycle. A branch needs its operand a cycle earlier, as it is
+// resolved in decode, and a taken one flushes every fetch stage. The stall and flush
+// penalties and the cycles to drain the pipeline all follow from the number of stages.
+#define STAGES_MAX_SPAN 4
+#define STAGES_MAX (3 * STAGES_MAX_SPAN + 2)
+#define STAGES_NAME_SIZE 16  // fits "MEM" and any int
+
+typedef enum {
+    STAGE_FETCH, STAGE_DECODE, STAGE_EXECUTE, STAGE_MEMORY, STAGE_WRITEBACK
+} stage_kind;
+
+// The stages of fetch, execute and memory; decode and writeback take one each. Fetch is
+// 0 for no configured pipeline.
+typedef struct {
+    int fetch, execute, memory;
+} stage_options;
+
+typedef struct {
+    struct instruction inst;
+    int pc;
+    int a, b;          // the operands, read in decode
+    int result;        // the value written to inst.dest, or the address of a load or store
+    long long ready;   // the cycle the value inst.dest gets was computed, or LLONG_MAX
+    int wait;          // cycles the instruction still holds its stage
+    bool done;         // the stage has performed its work on the instruction
+} stage_latch;
+
+typedef struct {
+    stage_options options;
+    int depth;
+    stage_kind kinds[STAGES_MAX];
+    int decode, execute, memory, writeback;  // the first stage of each
+    stage_latch latches[STAGES_MAX];
+    int pc;
+    bool redirected;  // decode redirected fetch this cycle
+
+    long long operand_stalls;  // cycles decode held an instruction for an operand
+    long long branch_stalls;   // cycles decode held a branch for its operand
+    long long flushed;         // instructions fetched after a taken branch or jump
+    long long memory_waits;    // cycles the first memory stage waited for the data cache
+    long long unit_waits;      // cycles the last execute stage held a MULT or DIV
+} staged_pipeline;
+
+/**
+ * Parses a comma-separated list of fetch=N, execute=N and memory=N into options, over the
+ * five stages of the classic pipeline. "default" alone selects those.
+ * @return false if the list is malformed or a span is out of range
+ */
+bool stages_parse(const char *spec, stage_options *options);
+
+/**
+ * @return the name of stage i, such as "EX2", into name
+ */
+const char *stages_name(const staged_pipeline *pipe, int i, char name[STAGES_NAME_SIZE]);
+
+/**
+ * Lays out the stages of a pipeline and empties it.
+ */
+void stages_init(staged_pipeline *pipe, const stage_options *options);
+
+/**
+ * Simulates the pipeline until the processor halts or has executed cycles cycles in total.
+ */
+void stages_run(cpu_state *state, staged_pipeline *pipe, long long cycles);
+
+#endif //LAB1_STAGES_H
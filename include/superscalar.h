@@ -0,0 +1,81 @@
+#ifndef LAB1_SUPERSCALAR_H
+#define LAB1_SUPERSCALAR_H
+
+#include <stdbool.h>
+#include "processor.h"
+
+// A wider core beside the scalar pipeline of simulate_cycle. Fetch and decode handle up to
+// width instructions a cycle, and every later stage has a latch for each of them, its
+// lanes. Instructions issue in order, and the lanes of a stage hold them in program order,
+// except for an instruction leaving a functional unit, which takes whichever lane is free.
+//
+// Decode issues the longest run of the instructions waiting in it that may pair:
+// - none reads or writes the destination of an instruction before it in the group;
+// - at most one accesses memory, which has a single port;
+// - at most one goes to a functional unit;
+// - a branch or jump ends the group, as what follows it is only known once it is resolved.
+// Otherwise the hazards are those of the scalar pipeline, checked against every lane: a
+// load stalls decode if an instruction in execute or in the group in decode reads it, and a
+// branch stalls while the instruction computing its operand is in execute. Results are
+// forwarded from every lane of the memory and writeback stages, the younger overriding the
+// older. Fetch always continues with the next instructions, so a taken branch or jump
+// flushes what follows it.
+#define SUPERSCALAR_MAX_WIDTH 4
+
+// The pairing rules that end a group before the instructions waiting in decode
+typedef enum {
+    PAIR_DEPENDENCE, PAIR_MEMORY, PAIR_UNIT, PAIR_BRANCH, PAIR_LIMITS
+} pairing_limit;
+
+typedef struct {
+    int width;
+
+    struct {
+        int pc, pc_branch;
+        bool stall, flush;
+    } fetch;
+
+    // The instructions fetched and not yet issued, oldest first
+    struct {
+        struct instruction inst[SUPERSCALAR_MAX_WIDTH];
+        int pc_next[SUPERSCALAR_MAX_WIDTH];
+        bool forward[SUPERSCALAR_MAX_WIDTH];  // the operand of a branch was forwarded into data
+        int data[SUPERSCALAR_MAX_WIDTH];
+        int count;
+        bool stall;
+    } decode;
+
+    // The operands are read in decode, and replaced by the later stages when they forward a result.
+    struct {
+        struct instruction inst[SUPERSCALAR_MAX_WIDTH];
+        int a[SUPERSCALAR_MAX_WIDTH], b[SUPERSCALAR_MAX_WIDTH];
+    } execute;
+
+    struct {
+        struct instruction inst[SUPERSCALAR_MAX_WIDTH];
+        int alu_out[SUPERSCALAR_MAX_WIDTH], write_data[SUPERSCALAR_MAX_WIDTH];
+        bool accessed;  // the lane accessing memory has looked up the data cache
+        int wait;       // cycles it still has to wait for the data cache
+        bool waiting;   // the memory stage is waiting this cycle, holding the stages behind it
+    } memory;
+
+    struct {
+        struct instruction inst[SUPERSCALAR_MAX_WIDTH];
+        int alu_out[SUPERSCALAR_MAX_WIDTH], read_data[SUPERSCALAR_MAX_WIDTH];
+    } writeback;
+
+    long long issued[SUPERSCALAR_MAX_WIDTH + 1];  // cycles issuing each number of instructions
+    long long limits[PAIR_LIMITS];                // groups ended by each rule before all waiting instructions
+} superscalar;
+
+/**
+ * Empties the core's pipeline. width must be from 1 to SUPERSCALAR_MAX_WIDTH.
+ */
+void superscalar_init(superscalar *core, int width);
+
+/**
+ * Simulates the core until the processor halts or has executed cycles cycles in total.
+ */
+void superscalar_run(cpu_state *state, superscalar *core, long long cycles);
+
+#endif //LAB1_SUPERSCALAR_H
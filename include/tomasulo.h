@@ -0,0 +1,103 @@
+#ifndef LAB1_TOMASULO_H
+#define LAB1_TOMASULO_H
+
+#include <stdbool.h>
+#include "processor.h"
+
+// An out-of-order core in the manner of Tomasulo's algorithm, beside the in-order
+// pipelines. Fetch follows the branch predictor for up to width instructions a cycle, and
+// redirects itself at jumps. Dispatch renames up to width instructions a cycle into the
+// reorder buffer: the register alias table maps each register to the entry that will
+// write it, and an operand not yet computed waits for that entry's result. An instruction
+// holds a reservation station until its operands are ready and a unit accepts it, oldest
+// first: width ALUs, the multiplier and divider of --units, and a memory port. A result is
+// broadcast to the instructions waiting for it in the cycle it completes, and up to width
+// instructions a cycle retire in order from the head of the reorder buffer, writing the
+// register file and data memory.
+//
+// Loads and stores hold an entry of the load/store queue from dispatch until they retire. A
+// load waits until the address of every older store is known, then takes the data of the
+// youngest older store to the same address, or reads data memory through the data cache.
+// Stores only write memory as they retire. A branch resolved differently from its
+// prediction squashes every younger instruction and redirects fetch. Exceptions are raised
+// as the instruction retires, so an instruction on a mispredicted path never raises one, and
+// the registers and memory end as in the in-order pipelines.
+#define DEFAULT_OOO_WIDTH 2
+#define DEFAULT_OOO_ROB 32
+#define DEFAULT_OOO_STATIONS 16
+#define DEFAULT_OOO_QUEUE 16
+#define OOO_MAX_WIDTH 8
+#define OOO_MAX_ENTRIES 1024
+
+typedef struct {
+    int width;     // instructions fetched, dispatched and retired a cycle, and ALUs; 0 for no out-of-order core
+    int rob;       // entries of the reorder buffer
+    int stations;  // reservation stations
+    int queue;     // entries of the load/store queue
+} tomasulo_options;
+
+typedef enum {
+    ENTRY_WAITING, ENTRY_EXECUTING, ENTRY_DONE
+} entry_state;
+
+// An instruction in the reorder buffer
+typedef struct {
+    struct instruction inst;
+    int pc;
+    int next_pc;          // where fetch went after it
+    entry_state state;
+    int operand[2];       // the values of rs and rt, once known
+    int tag[2];           // the entries computing rs and rt, or -1
+    int value;            // the result
+    int address;          // the address a load or store accesses
+    long long ready;      // the cycle the result is broadcast, or a store's address known
+    bool taken;           // a branch or jump was taken, to target
+    int target;
+    bool mispredicted;
+    int error;            // the exception raised as it retires, or 0
+} rob_entry;
+
+// An instruction fetched and waiting for dispatch
+typedef struct {
+    struct instruction inst;
+    int pc, next_pc;
+} fetched_instruction;
+
+typedef struct {
+    tomasulo_options options;
+
+    rob_entry *rob;
+    int head, count;
+    int alias[16];  // the entry that will write each register, or -1 for the register file
+
+    fetched_instruction fetched[2 * OOO_MAX_WIDTH];
+    int fetched_count;
+    int pc;
+
+    int stations_used, queue_used;
+    long long unit_free[UNIT_KINDS];  // the cycle each functional unit accepts another instruction
+
+    long long rob_full, stations_full, queue_full;  // cycles dispatch waited for each
+    long long mispredictions, squashed, forwarded;  // forwarded: loads given the data of a store
+} tomasulo_core;
+
+/**
+ * Parses a comma-separated list of width=N, rob=N, rs=N and lsq=N into options, over the
+ * defaults. "default" alone selects the defaults.
+ * @return false if the list is malformed or a size is out of range
+ */
+bool tomasulo_parse(const char *spec, tomasulo_options *options);
+
+/**
+ * Empties the core, and starts fetching at the first instruction.
+ */
+void tomasulo_init(tomasulo_core *core, const tomasulo_options *options);
+
+void tomasulo_free(tomasulo_core *core);
+
+/**
+ * Simulates the core until the processor halts or has executed cycles cycles in total.
+ */
+void tomasulo_run(cpu_state *state, tomasulo_core *core, long long cycles);
+
+#endif //LAB1_TOMASULO_H
@@ -0,0 +1,138 @@
+#ifndef LAB1_TRACE_H
+#define LAB1_TRACE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "processor.h"
+
+// A pipeline trace records what every latch held after every cycle:
+//
+//   trace_header
+//   image_instruction[instructions]: the program
+//   one record per cycle, starting with cycle first_cycle + 1
+//
+// A record is one byte: the TRACE_* kind of the instruction left in the decode latch
+// (bits 0-1) and the EVENT_* flags of the cycle other than EVENT_STALL (bits 2-7). A
+// TRACE_JUMPED record is followed by the instruction's pc, as a zigzag varint of its
+// distance from the instruction after the one fetched before. The other latches need no
+// record: a stall shows as TRACE_STALLED and puts a bubble into the execute latch, a
+// cycle the memory stage waited for the data cache is the single byte TRACE_MEMORY_WAIT
+// and puts a bubble into the writeback latch, otherwise every instruction moves on to the
+// next latch. A multiplication or division leaving the execute stage spends the latency
+// of its functional unit, from the header, there instead; the memory latch gets whichever
+// instruction leaves a unit that cycle, or a bubble.
+#define TRACE_MAGIC "DLXTRACE"
+#define TRACE_VERSION 3
+
+#define TRACE_BUBBLE 0   // a bubble was fetched
+#define TRACE_NEXT 1     // the instruction after the one fetched before was fetched
+#define TRACE_JUMPED 2   // an instruction elsewhere was fetched
+#define TRACE_STALLED 3  // the decode and fetch stages stalled
+
+// Decode never flushes fetch in a cycle it stalls, so this byte is free to mean a cycle
+// the memory stage waited.
+#define TRACE_MEMORY_WAIT (TRACE_STALLED | EVENT_FLUSH)
+
+// Records pass from the simulation to the writer thread through a ring of
+// TRACE_RING_SIZE bytes, in chunks of up to TRACE_CHUNK bytes.
+#define TRACE_RING_SIZE (1 << 22)
+#define TRACE_CHUNK 4096
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t instructions;
+    int64_t first_cycle;  // the cycle count before the first record
+    int32_t fetched;      // pc of the last instruction fetched before the first record, or -1
+    uint16_t latency[UNIT_KINDS];  // of each functional unit
+} trace_header;
+
+typedef struct {
+    FILE *file;
+    pthread_t thread;
+    bool ok;  // false once a write failed; written by the writer thread
+
+    // The ring is single-producer, single-consumer: the simulation only advances head,
+    // and the writer thread only advances tail.
+    uint8_t *ring;
+    _Atomic size_t head, tail;
+    _Atomic bool closing;
+
+    // Records not yet published to the ring
+    uint8_t chunk[TRACE_CHUNK];
+    size_t chunk_size;
+
+    int fetched;  // pc of the last instruction fetched
+} trace_writer;
+
+/**
+ * Creates path and starts a thread writing the trace of the processor's pipeline to it.
+ * The processor's events are cleared.
+ * @return the trace, or NULL if the file cannot be written
+ */
+trace_writer *trace_open(const char *path, cpu_state *state);
+
+/**
+ * Records the cycle the processor has just simulated, and clears its events.
+ */
+void trace_cycle(trace_writer *trace, cpu_state *state);
+
+/**
+ * Writes the remaining records, waits for the writer thread and closes the trace.
+ * @return false if any of the trace could not be written
+ */
+bool trace_close(trace_writer *trace);
+
+// One latch as reconstructed from a trace: the instruction and which fetch of it this is
+typedef struct {
+    long long id;  // fetches are numbered from 0 in the order they happen; -1 for a bubble
+    int pc;
+} trace_slot;
+
+// What every stage of the pipeline worked on in one cycle of a trace
+typedef struct {
+    long long cycle;
+    int events;  // EVENT_* flags
+    trace_slot fetch, decode, execute, memory, writeback;
+
+    // The latches after the cycle, from decode_buffer to writeback_buffer
+    trace_slot latches[4];
+
+    // The instructions in a functional unit during the cycle, other than the one entering
+    trace_slot units[SCOREBOARD_MAX_OPERATIONS];
+    int unit_count;
+} trace_cycle_record;
+
+typedef struct {
+    FILE *file;
+    trace_header header;
+    struct instruction *program;
+    long long fetches;
+    int fetched;  // pc of the last instruction fetched
+    trace_cycle_record last;
+
+    // The instructions in the functional units after the last cycle, and the cycles until
+    // each leaves for the memory latch
+    trace_slot units[SCOREBOARD_MAX_OPERATIONS];
+    int remaining[SCOREBOARD_MAX_OPERATIONS];
+    int unit_count;
+} trace_reader;
+
+/**
+ * Opens a trace for reading, starting with its program.
+ * @return false if path is not a trace of this version
+ */
+bool trace_read_open(trace_reader *reader, const char *path);
+
+/**
+ * Reads the record of the next cycle.
+ * @return false at the end of the trace
+ */
+bool trace_read_cycle(trace_reader *reader, trace_cycle_record *record);
+
+void trace_read_close(trace_reader *reader);
+
+#endif //LAB1_TRACE_H
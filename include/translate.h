@@ -0,0 +1,85 @@
+#ifndef LAB1_TRANSLATE_H
+#define LAB1_TRANSLATE_H
+
+#include <stdbool.h>
+#include "instruction.h"
+
+// An enumeration of the operations a basic block is translated into. Besides
+// one operation per instruction, common pairs are fused into superinstructions
+// so that a loop tail costs a single dispatch.
+typedef enum {
+    T_ADDI,          // dest = src1 + imm (SUBI is folded in by negating imm)
+    T_LOADI,         // dest = imm (ADDI/SUBI reading R0)
+    T_ADD,           // dest = src1 + src2
+    T_SUB,           // dest = src1 - src2
+    T_ALU,           // dest = src1 alu src2, for the other ALU operations
+    T_LW,            // dest = data_memory[src1 + imm]
+    T_SW,            // data_memory[src1 + imm] = src2
+    T_LL,            // T_LW, reserving the word
+    T_SC,            // data_memory[src1 + imm] = src2 if the word is reserved, dest = whether it was
+    T_NOP,           // does nothing
+    T_ILLEGAL_WRITE, // raises the R0 write exception when reached
+    T_BRANCH,        // leaves the block, taken if (test == 0) == if_zero
+    T_ADDI_BRANCH,   // T_ADDI followed by T_BRANCH
+    T_ADD_BRANCH,    // T_ADD followed by T_BRANCH
+    T_SUB_BRANCH,    // T_SUB followed by T_BRANCH
+    T_JUMP,          // leaves the block to its target
+    T_ADDI_JUMP,     // T_ADDI followed by T_JUMP
+    T_FALLTHROUGH,   // leaves the block to the instruction after it
+    T_KINDS
+} translated_kind;
+
+typedef struct {
+    // Address of the handler for kind when dispatching through computed gotos.
+    // Filled in by the executor, since label addresses are local to it.
+    const void *handler;
+    translated_kind kind;
+    alu_op alu;    // the operation of T_ALU
+    int dest, src1, src2, imm;
+    int test;      // the register a branch tests
+    bool if_zero;  // a branch is taken when test is zero
+} translated_op;
+
+typedef struct translated_block {
+    // The block covers the instructions [start_pc, end_pc)
+    int start_pc, end_pc;
+
+    // The target of the branch or jump ending the block, if any
+    int target;
+
+    // Successor blocks, chained the first time each exit is followed
+    struct translated_block *taken, *fallthrough;
+
+    int ops_count;
+    translated_op ops[];
+} translated_block;
+
+// A cache of translated basic blocks for one program, keyed by the pc
+// of the first instruction of each block.
+typedef struct {
+    const struct instruction *code;
+    int count;
+
+    // leaders[pc] is true if a basic block starts at pc
+    bool *leaders;
+
+    // blocks[pc] is the translation of the block starting at pc, or NULL
+    translated_block **blocks;
+} translation_cache;
+
+/**
+ * Creates an empty translation cache for the provided predecoded program. Translations are
+ * never invalidated, as no instruction is modified in place: a processor given another
+ * program, whether reset for a new job or restored from a checkpoint, needs a new cache.
+ */
+translation_cache *translation_cache_create(const struct instruction *code, int count);
+
+void translation_cache_destroy(translation_cache *cache);
+
+/**
+ * @return the translation of the basic block starting at pc, translating it first on a miss.
+ * pc must be within the program.
+ */
+translated_block *translation_lookup(translation_cache *cache, int pc);
+
+#endif //LAB1_TRANSLATE_H
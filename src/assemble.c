@@ -1,4 +1,7 @@
+#include <setjmp.h>
+#include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "../include/globals.h"
 
@@ -6,53 +9,212 @@
 
 
 	/*
-	** Parses program file and assembles (converts from assembler
-	** to machine code).
+	** A symbol table maps names (op-codes or labels) to values
+	** using open addressing.  A label that is referenced before
+	** it is defined keeps the list of instructions waiting for
+	** its address in fixups; the list is threaded through the
+	** imm fields of those instructions.
+	*/
+
+#define LABEL_UNDEFINED	0
+#define LABEL_CODE	1
+#define LABEL_DATA	2
+
+struct symbol {
+  char *name;		/* NULL for an empty slot */
+  int value;		/* op-code, or address of a label */
+  int kind;		/* LABEL_* once a label is defined */
+  int fixups;		/* first instruction waiting for the label, or NOT_USED */
+};
+
+struct symbol_table {
+  struct symbol *slots;
+  int capacity;		/* always a power of two */
+  int count;
+};
+
+	/*
+	** An error stops the assembly.  AssemblyError() formats its
+	** message into the caller's buffer and returns to
+	** AssembleDLX(), which releases what the assembly holds.
+	** Both are per thread, since programs may be assembled on
+	** several threads at once.
+	*/
+
+struct assembly {
+  struct instruction *code;
+  char *input,*line;		/* the line read, and a copy to tokenize */
+  struct symbol_table opcodes,labels;
+};
+
+static __thread jmp_buf	error_return;
+static __thread char	*error_message;
+static __thread int	error_size;
+
+static void Assemble(FILE *, struct assembly *, struct program *);
+static void AssemblyError(char *, ...);
+static void ReleaseTable(struct symbol_table *);
+static struct symbol *LookupSymbol(struct symbol_table *, char *, int);
+static void AddFixup(struct instruction *, int, struct symbol_table *, char *);
+static void DefineLabel(struct instruction *, int, int, struct symbol_table *, char *, char *);
+static void ParseDirective(char *, char *, char *, char *, unsigned int *,
+			   struct symbol_table *, struct program *);
+
+
+	/*
+	** Parses program file and assembles it, printing the error
+	** and exiting if it has one.  The caller frees the program
+	** with FreeProgram().
 	*/
 
 void AssembleSimpleDLX(char *filename,		/* filename of program */
-         struct instruction code[MAX_LINES_OF_CODE],  /* assembled code */
-                        int *code_length)	/* #lines in program */
+                       struct program *program)	/* output; assembled program */
 
 {
 FILE	*fpt;
-char	input[81],line[81],*field1,*field2,*field3,*oper1,*oper2,*oper3;
-char	opcode[20],operands[40],label[20];
-char	code_labels[MAX_LINES_OF_CODE][20],label_fields[MAX_LINES_OF_CODE][20];
-int	inst_count,i,j;
-
+char	message[ASSEMBLY_MESSAGE_SIZE];
 
 if ((fpt=fopen(filename,"r")) == NULL)
   {
   printf("Unable to open %s for reading\n",filename);
   exit(0);
   }
+if (AssembleDLX(fpt,program,message,sizeof(message)) != 0)
+  {
+  printf("%s",message);
+  exit(0);
+  }
+fclose(fpt);
+}
+
+
+	/*
+	** Assembles the program read from input.  Returns 0, or -1
+	** with the error in message, leaving the program empty.
+	*/
+
+int AssembleDLX(FILE *input,		/* input */
+                struct program *program,	/* output; assembled program */
+                char *message,		/* output; the error, if any */
+                int message_size)	/* input */
+
+{
+struct assembly	*assembly;
+int	result;
+
+memset(program,0,sizeof(*program));
+assembly=calloc(1,sizeof(*assembly));
+error_message=message;
+error_size=message_size;
+	/* result is set after setjmp, so that the longjmp cannot leave it stale */
+if (setjmp(error_return) == 0)
+  {
+  Assemble(input,assembly,program);
+  result=0;
+  }
+else
+  {
+  result=-1;
+  FreeProgram(program);
+  }
+free(assembly->code);
+free(assembly->input);
+free(assembly->line);
+ReleaseTable(&(assembly->labels));
+ReleaseTable(&(assembly->opcodes));
+free(assembly);
+return result;
+}
+
+
+	/*
+	** Assembles (converts from assembler to machine code).  The
+	** code array is allocated to fit the program and grown as
+	** lines are read, and handed to the program at the end.
+	** Each line is parsed once: labels are resolved as soon as
+	** they are defined, patching earlier references from their
+	** fixup lists.
+	*/
+
+static void Assemble(FILE *fpt,		/* input */
+                     struct assembly *assembly,	/* input/output; what to release */
+                     struct program *program)	/* output; assembled program */
+
+{
+static char	*opcode_names[]={"ADDI","ADD","SUBI","SUB","LW","SW","BEQZ","BNEZ","J",
+			     "MULT","DIV","AND","OR","XOR","SLL","SRL","SLT","LL","SC"};
+static int	opcode_values[]={ADDI,ADD,SUBI,SUB,LW,SW,BEQZ,BNEZ,J,
+			     MULT,DIV,AND,OR,XOR,SLL,SRL,SLT,LL,SC};
+char	*input,*line,*field1,*field2,*field3,*oper1,*oper2,*oper3;
+char	*opcode,*operands,*label;
+size_t	input_size,line_size;
+ssize_t	length;
+struct instruction	*code,*inst;
+struct symbol_table	*opcodes,*labels;
+struct symbol	*symbol;
+unsigned int	data_address;
+int	inst_count,capacity,first,i;
+
+
+opcodes=&(assembly->opcodes);
+labels=&(assembly->labels);
+for (i=0; i<(int) (sizeof(opcode_values)/sizeof(opcode_values[0])); i++)
+  LookupSymbol(opcodes,opcode_names[i],1)->value=opcode_values[i];
+
 	/* read and parse lines from file one line at a time */
 inst_count=0;
+data_address=0;
+capacity=64;
+code=assembly->code=malloc(capacity*sizeof(*code));
+input_size=0;
+line_size=256;
+line=assembly->line=malloc(line_size);
 if (DEBUG_ASSEMBLER)
   printf("PARSING:\n");
-while(fgets(input,80,fpt) != NULL)
+while((length=getline(&(assembly->input),&input_size,fpt)) != -1)
   {
+  input=assembly->input;
+  if (inst_count == capacity)
+    {	/* double the array when the program outgrows it */
+    capacity*=2;
+    code=assembly->code=realloc(code,capacity*sizeof(*code));
+    }
+  inst=&code[inst_count];
+  memset(inst,0,sizeof(*inst));
 	/* parse line into fields (text separated by whitespace) */
-  strcpy(line,input);
+  if ((size_t) length+1 > line_size)
+    {
+    line_size=length+1;
+    line=assembly->line=realloc(line,line_size);
+    }
+  memcpy(line,input,length+1);
   ParseLineIntoTokens(line," \t\n",&field1,&field2,&field3);
-  if (field2 == NULL)
+	/* directives start with a period, and may be labelled */
+  if (field1 != NULL  &&  field1[0] == '.')
     {
-    printf("Too few fields on the following line:\n");
-    printf("%s",input);
-    exit(0);
+    if (field3 != NULL)
+        AssemblyError("Too many fields for the following program line:\n%s\n",input);
+    ParseDirective(field1,field2,"",input,&data_address,labels,program);
+    continue;
     }
+  if (field2 != NULL  &&  field2[0] == '.')
+    {
+    ParseDirective(field2,field3,field1,input,&data_address,labels,program);
+    continue;
+    }
+  if (field2 == NULL)
+      AssemblyError("Too few fields on the following line:\n%s",input);
   if (field3 != NULL)
     {	/* program line had label */
-    strcpy(opcode,field2);
-    strcpy(operands,field3);
-    strcpy(label,field1);
+    opcode=field2;
+    operands=field3;
+    label=field1;
     }
   else
     {	/* program line did not have label */
-    strcpy(opcode,field1);
-    strcpy(operands,field2);
-    strcpy(label,"");
+    opcode=field1;
+    operands=field2;
+    label="";
     }
   if (DEBUG_ASSEMBLER)
     printf("%s\t%s\t%s",(label == NULL ? "   " : label),opcode,operands);
@@ -63,142 +225,351 @@ while(fgets(input,80,fpt) != NULL)
 		(oper2 == NULL ? "   " : oper2),
 		(oper3 == NULL ? "   " : oper3));
 	/* add instruction to machine code, deciphering operands */
-  if (strcmp(opcode,"ADDI") == 0  ||  strcmp(opcode,"SUBI") == 0)
+  symbol=LookupSymbol(opcodes,opcode,0);
+  inst->op=(symbol == NULL ? NOP : symbol->value);
+  switch (inst->op)
     {
-    if (strcmp(opcode,"ADDI") == 0)
-      code[inst_count].op=ADDI;
-    else
-      code[inst_count].op=SUBI;
-    code[inst_count].rd=NOT_USED;
-    strcpy(label_fields[inst_count],"");
-    ParseRegister(oper1,&(code[inst_count].rt));
-    ParseRegister(oper2,&(code[inst_count].rs));
-    ParseImmediate(oper3,&(code[inst_count].imm));
-    }
-  else if (strcmp(opcode,"ADD") == 0  ||  strcmp(opcode,"SUB") == 0)
-    {
-    if (strcmp(opcode,"ADD") == 0)
-      code[inst_count].op=ADD;
-    else
-      code[inst_count].op=SUB;
-    code[inst_count].imm=NOT_USED;
-    strcpy(label_fields[inst_count],"");
-    ParseRegister(oper1,&(code[inst_count].rd));
-    ParseRegister(oper2,&(code[inst_count].rs));
-    ParseRegister(oper3,&(code[inst_count].rt));
-    }
-  else if (strcmp(opcode,"BNEZ") == 0  ||  strcmp(opcode,"BEQZ") == 0)
-    {
-    if (strcmp(opcode,"BNEZ") == 0)
-      code[inst_count].op=BNEZ;
-    else
-      code[inst_count].op=BEQZ;
-    code[inst_count].imm=NOT_USED;
-    code[inst_count].rt=NOT_USED;
-    code[inst_count].rd=NOT_USED;
-    if (oper3 != NULL)
-      {
-      printf("Too many fields for the following program line:\n");
-      printf("%s\n",input);
-      exit(0);
-      }
-    ParseRegister(oper1,&(code[inst_count].rs));
-    strcpy(label_fields[inst_count],oper2);
-    }
-  else if (strcmp(opcode,"J") == 0)
-    {
-    code[inst_count].op=J;
-    code[inst_count].imm=NOT_USED;
-    code[inst_count].rs=NOT_USED;
-    code[inst_count].rt=NOT_USED;
-    code[inst_count].rd=NOT_USED;
-    if (oper3 != NULL  ||  oper2 != NULL)
-      {
-      printf("Too many fields for the following program line:\n");
-      printf("%s\n",input);
-      exit(0);
-      }
-    strcpy(label_fields[inst_count],oper1);
-    }
-  else if (strcmp(opcode,"LW") == 0)
-    {
-    code[inst_count].op=LW;
-    code[inst_count].imm=NOT_USED;
-    strcpy(label_fields[inst_count],"");
-    code[inst_count].rd=NOT_USED;
-    if (oper3 != NULL)
-      {
-      printf("Too many fields for the following program line:\n");
-      printf("%s\n",input);
-      exit(0);
-      }
-    ParseRegister(oper1,&(code[inst_count].rt));
-    ParseAddress(oper2,&(code[inst_count].rs),&(code[inst_count].imm));
-    }
-  else if (strcmp(opcode,"SW") == 0)
-    {
-    code[inst_count].op=SW;
-    code[inst_count].imm=NOT_USED;
-    strcpy(label_fields[inst_count],"");
-    code[inst_count].rd=NOT_USED;
-    if (oper3 != NULL)
-      {
-      printf("Too many fields for the following program line:\n");
-      printf("%s\n",input);
-      exit(0);
-      }
-    ParseAddress(oper1,&(code[inst_count].rs),&(code[inst_count].imm));
-    ParseRegister(oper2,&(code[inst_count].rt));
-    }
-  else
-    {
-    printf("Unrecognized op-code (%s) on the following line:\n",opcode);
-    printf("%s",input);
-    exit(0);
-    }
-  for (i=0; i<inst_count; i++)
-    if (label[0] != '\0'  &&  strcmp(code_labels[i],label) == 0)
+    case ADDI:
+    case SUBI:
+      inst->rd=NOT_USED;
+      ParseRegister(oper1,&(inst->rt));
+      ParseRegister(oper2,&(inst->rs));
+      ParseImmediate(oper3,&(inst->imm));
       break;
-  if (i < inst_count)
-    {
-    printf("Duplicate label on the following line:\n");
-    printf("%s\n",input);
-    exit(0);
+    case ADD:
+    case SUB:
+    case MULT:
+    case DIV:
+    case AND:
+    case OR:
+    case XOR:
+    case SLL:
+    case SRL:
+    case SLT:
+      inst->imm=NOT_USED;
+      ParseRegister(oper1,&(inst->rd));
+      ParseRegister(oper2,&(inst->rs));
+      ParseRegister(oper3,&(inst->rt));
+      break;
+    case BNEZ:
+    case BEQZ:
+      inst->imm=NOT_USED;
+      inst->rt=NOT_USED;
+      inst->rd=NOT_USED;
+      if (oper3 != NULL)
+          AssemblyError("Too many fields for the following program line:\n%s\n",input);
+      ParseRegister(oper1,&(inst->rs));
+      AddFixup(code,inst_count,labels,oper2);
+      break;
+    case J:
+      inst->imm=NOT_USED;
+      inst->rs=NOT_USED;
+      inst->rt=NOT_USED;
+      inst->rd=NOT_USED;
+      if (oper3 != NULL  ||  oper2 != NULL)
+          AssemblyError("Too many fields for the following program line:\n%s\n",input);
+      AddFixup(code,inst_count,labels,oper1);
+      break;
+    case LW:
+    case LL:
+      inst->imm=NOT_USED;
+      inst->rd=NOT_USED;
+      if (oper3 != NULL)
+          AssemblyError("Too many fields for the following program line:\n%s\n",input);
+      ParseRegister(oper1,&(inst->rt));
+      ParseAddress(oper2,&(inst->rs),&(inst->imm));
+      break;
+    case SW:
+    case SC:
+      inst->imm=NOT_USED;
+      inst->rd=NOT_USED;
+      if (oper3 != NULL)
+          AssemblyError("Too many fields for the following program line:\n%s\n",input);
+      ParseAddress(oper1,&(inst->rs),&(inst->imm));
+      ParseRegister(oper2,&(inst->rt));
+      break;
+    default:
+      AssemblyError("Unrecognized op-code (%s) on the following line:\n%s",opcode,input);
     }
-  strcpy(code_labels[inst_count],label);
+  if (label[0] != '\0')
+    DefineLabel(code,inst_count,LABEL_CODE,labels,label,input);
   inst_count++;
   }
-fclose(fpt);
 
-	/* 2nd pass assemble converts labels to address values */
-if (DEBUG_ASSEMBLER)
-  printf("SECOND PASS\n");
-for (i=0; i<inst_count; i++)
+	/* labels still undefined are reported for the earliest
+	** instruction referring to one */
+first=inst_count;
+label=NULL;
+for (i=0; i<labels->capacity; i++)
   {
-  if (strcmp(label_fields[i],"") != 0)
-    {
-    for (j=0; j<inst_count; j++)
-      if (strcmp(label_fields[i],code_labels[j]) == 0)
-	break;
-    if (j == inst_count)
+  symbol=&(labels->slots[i]);
+  if (symbol->name != NULL  &&  symbol->kind == LABEL_UNDEFINED  &&
+	symbol->fixups != NOT_USED)
+    {	/* the list is in decreasing order, so its last entry is the earliest */
+    int j;
+    for (j=symbol->fixups; code[j].imm != NOT_USED; j=code[j].imm)
+      ;
+    if (j < first)
       {
-      printf("No program line identified with the following label:\n");
-      printf("%s\n",label_fields[i]);
-      exit(0);
+      first=j;
+      label=symbol->name;
       }
-    code[i].imm=j-i-1;	    /* extra -1 for earlier NPC add+1 */
     }
-  if (DEBUG_ASSEMBLER)
+  }
+if (label != NULL)
+  AssemblyError("No program line identified with the following label:\n%s\n",label);
+if (DEBUG_ASSEMBLER)
+  for (i=0; i<inst_count; i++)
     printf("%d OPCODE %d   OP1 %d   OP2 %d   OP3 %d   IMMED %d\n",i,
 	code[i].op,code[i].rd,code[i].rs,code[i].rt,code[i].imm);
+
+program->code=code;
+program->code_length=inst_count;
+assembly->code=NULL;
+}
+
+
+	/*
+	** Formats the message of an error and stops the assembly.
+	*/
+
+static void AssemblyError(char *format,	/* input */
+                          ...)
+
+{
+va_list	arguments;
+
+va_start(arguments,format);
+vsnprintf(error_message,error_size,format,arguments);
+va_end(arguments);
+longjmp(error_return,1);
+}
+
+
+	/*
+	** Releases a symbol table and the names in it.
+	*/
+
+static void ReleaseTable(struct symbol_table *table)	/* input/output */
+
+{
+int	i;
+
+for (i=0; i<table->capacity; i++)
+  free(table->slots[i].name);
+free(table->slots);
+}
+
+
+	/*
+	** Releases everything held by an assembled program.
+	*/
+
+void FreeProgram(struct program *program)	/* input/output */
+
+{
+int	i;
+
+free(program->code);
+for (i=0; i<program->segment_count; i++)
+  free(program->segments[i].words);
+free(program->segments);
+memset(program,0,sizeof(*program));
+}
+
+
+	/*
+	** Finds the symbol with the provided name, adding it when
+	** insert is set.  New symbols have no value and no fixups.
+	** Returns NULL if the symbol is absent and not inserted.
+	*/
+
+static struct symbol *LookupSymbol(struct symbol_table *table,	/* input/output */
+                                   char *name,		/* input */
+                                   int insert)		/* input */
+
+{
+struct symbol	*old_slots;
+unsigned int	hash;
+char	*c;
+int	old_capacity,i;
+
+if (table->capacity == 0  ||  (insert  &&  2*(table->count+1) > table->capacity))
+  {	/* keep the table at most half full */
+  old_slots=table->slots;
+  old_capacity=table->capacity;
+  table->capacity=(old_capacity == 0 ? 16 : 2*old_capacity);
+  table->slots=calloc(table->capacity,sizeof(struct symbol));
+  table->count=0;
+  for (i=0; i<old_capacity; i++)
+    if (old_slots[i].name != NULL)
+      {
+      hash=2166136261u;
+      for (c=old_slots[i].name; *c != '\0'; c++)
+        hash=(hash ^ (unsigned char) *c)*16777619u;
+      while (table->slots[hash & (table->capacity-1)].name != NULL)
+        hash++;
+      table->slots[hash & (table->capacity-1)]=old_slots[i];
+      table->count++;
+      }
+  free(old_slots);
   }
 
-*code_length=inst_count;
+	/* FNV-1a hash with linear probing */
+hash=2166136261u;
+for (c=name; *c != '\0'; c++)
+  hash=(hash ^ (unsigned char) *c)*16777619u;
+while (table->slots[hash & (table->capacity-1)].name != NULL)
+  {
+  if (strcmp(table->slots[hash & (table->capacity-1)].name,name) == 0)
+    return &(table->slots[hash & (table->capacity-1)]);
+  hash++;
+  }
+if (!insert)
+  return NULL;
+table->slots[hash & (table->capacity-1)].name=strdup(name);
+table->slots[hash & (table->capacity-1)].value=NOT_USED;
+table->slots[hash & (table->capacity-1)].kind=LABEL_UNDEFINED;
+table->slots[hash & (table->capacity-1)].fixups=NOT_USED;
+table->count++;
+return &(table->slots[hash & (table->capacity-1)]);
+}
+
+
+	/*
+	** Sets the immediate of the branch or jump at index to the
+	** offset of the label, or adds it to the label's fixup list
+	** if the label is not yet defined.
+	*/
+
+static void AddFixup(struct instruction *code,	/* input/output */
+                     int index,		/* input */
+                     struct symbol_table *labels,	/* input/output */
+                     char *label)		/* input; may be NULL */
+
+{
+struct symbol	*symbol;
+
+symbol=LookupSymbol(labels,(label == NULL ? "" : label),1);
+if (symbol->kind == LABEL_DATA)
+    AssemblyError("No program line identified with the following label:\n%s\n",symbol->name);
+if (symbol->kind == LABEL_CODE)
+  code[index].imm=symbol->value-index-1;	/* extra -1 for earlier NPC add+1 */
+else
+  {
+  code[index].imm=symbol->fixups;
+  symbol->fixups=index;
+  }
+}
+
+
+	/*
+	** Defines a label as the address of an instruction or of a
+	** data word, patching every instruction waiting for it.
+	*/
+
+static void DefineLabel(struct instruction *code,	/* input/output */
+                        int address,		/* input */
+                        int kind,		/* input; LABEL_CODE or LABEL_DATA */
+                        struct symbol_table *labels,	/* input/output */
+                        char *label,		/* input */
+                        char *input)		/* input; line for errors */
+
+{
+struct symbol	*symbol;
+int	i,next;
+
+symbol=LookupSymbol(labels,label,1);
+if (symbol->kind != LABEL_UNDEFINED)
+    AssemblyError("Duplicate label on the following line:\n%s\n",input);
+if (kind == LABEL_DATA  &&  symbol->fixups != NOT_USED)
+  {	/* a branch was waiting for an instruction */
+  AssemblyError("No program line identified with the following label:\n%s\n",label);
+  }
+symbol->value=address;
+symbol->kind=kind;
+for (i=symbol->fixups; i != NOT_USED; i=next)
+  {
+  next=code[i].imm;
+  code[i].imm=address-i-1;	/* extra -1 for earlier NPC add+1 */
+  }
+symbol->fixups=NOT_USED;
+}
+
+
+	/*
+	** Assembles a directive into the program's initialized data:
+	**   .data [address]  continues data at address (or where it
+	**                    left off)
+	**   .word n[,n...]   stores consecutive words of data
+	**   .code, .text     mark the start of code, and are ignored
+	** A label on a directive names the current data address.
+	*/
+
+static void ParseDirective(char *directive,	/* input */
+                           char *operands,	/* input; may be NULL */
+                           char *label,		/* input */
+                           char *input,		/* input; line for errors */
+                           unsigned int *data_address,	/* input/output */
+                           struct symbol_table *labels,	/* input/output */
+                           struct program *program)	/* input/output */
+
+{
+struct data_segment	*segment;
+char	*word,*end,*save;
+long long	value;
+
+if (strcmp(directive,".data") == 0  &&  operands != NULL)
+  {
+  value=strtoll(operands,&end,10);
+  if (operands[0] < '0'  ||  operands[0] > '9'  ||  *end != '\0'  ||
+	value > 0xFFFFFFFFLL)
+      AssemblyError("Unrecognizable data address:\n%s\n",operands);
+  *data_address=(unsigned int) value;
+  }
+else if (strcmp(directive,".word") == 0  &&  operands == NULL)
+    AssemblyError("Too few fields on the following line:\n%s",input);
+else if (strcmp(directive,".data") != 0  &&  strcmp(directive,".word") != 0  &&
+	strcmp(directive,".code") != 0  &&  strcmp(directive,".text") != 0)
+    AssemblyError("Unrecognized directive (%s) on the following line:\n%s",directive,input);
+
+if (label[0] != '\0')
+  DefineLabel(NULL,(int) *data_address,LABEL_DATA,labels,label,input);
+if (strcmp(directive,".word") != 0)
+  return;
+
+	/* continue the last segment if it ends at the data address */
+segment=(program->segment_count == 0 ? NULL :
+	&(program->segments[program->segment_count-1]));
+if (segment == NULL  ||
+	segment->address+(unsigned int) segment->length != *data_address)
+  {
+  program->segments=realloc(program->segments,
+	(program->segment_count+1)*sizeof(struct data_segment));
+  segment=&(program->segments[program->segment_count++]);
+  segment->address=*data_address;
+  segment->length=0;
+  segment->words=NULL;
+  }
+for (word=strtok_r(operands,",",&save); word != NULL; word=strtok_r(NULL,",",&save))
+  {
+  value=strtoll(word,&end,10);
+  if (*end != '\0'  ||  end == word  ||  value < -2147483648LL  ||
+	value > 4294967295LL)
+      AssemblyError("Unrecognizable word:\n%s\n",word);
+  if ((segment->length & (segment->length-1)) == 0)
+    segment->words=realloc(segment->words,
+	(segment->length == 0 ? 1 : 2*segment->length)*sizeof(int));
+  segment->words[segment->length++]=(int) value;
+  }
+*data_address=segment->address+(unsigned int) segment->length;
 }
 
 
 	/*
 	** Separates a string into tokens.  Assumes zero-three tokens.
+	** The string is only modified once it is known to hold at
+	** most three, so that it can be reported intact otherwise.
 	*/
 
 void ParseLineIntoTokens(char *line,		/* input */
@@ -208,28 +579,29 @@ void ParseLineIntoTokens(char *line,		/* input */
                          char **field3)		/* output; may be NULL */
 
 {
-char	*field4,input[80];
+char	*start[4],*end[3],*c;
+int	count;
 
-strcpy(input,line);	/* only used for error reporting */
-*field1=strtok(line,parse_chars);
-if (*field1 != NULL)
-  *field2=strtok(NULL,parse_chars);
-else
-  *field2=NULL;
-if (*field2 != NULL)
-  *field3=strtok(NULL,parse_chars);
-else
-  *field3=NULL;
-if (*field3 != NULL)
-  field4=strtok(NULL,parse_chars);
-else
-  field4=NULL;
-if (field4 != NULL)
+count=0;
+c=line;
+while (count < 4)
   {
-  printf("Too many fields in the following line or operand field:\n");
-  printf("%s",input);
-  exit(0);
+  c+=strspn(c,parse_chars);
+  if (*c == '\0')
+    break;
+  start[count]=c;
+  c+=strcspn(c,parse_chars);
+  if (count < 3)
+    end[count]=c;
+  count++;
   }
+if (count == 4)
+    AssemblyError("Too many fields in the following line or operand field:\n%s",line);
+*field1=(count > 0 ? start[0] : NULL);
+*field2=(count > 1 ? start[1] : NULL);
+*field3=(count > 2 ? start[2] : NULL);
+while (count > 0)
+  *end[--count]='\0';
 }
 
 
@@ -241,27 +613,16 @@ void ParseRegister(char	*operand,	/* input */
                     int *reg_tag)	/* output */
 
 {
-if (strcmp(operand,"R0") == 0) *reg_tag=R0;
-else if (strcmp(operand,"R1") == 0) *reg_tag=R1;
-else if (strcmp(operand,"R2") == 0) *reg_tag=R2;
-else if (strcmp(operand,"R3") == 0) *reg_tag=R3;
-else if (strcmp(operand,"R4") == 0) *reg_tag=R4;
-else if (strcmp(operand,"R5") == 0) *reg_tag=R5;
-else if (strcmp(operand,"R6") == 0) *reg_tag=R6;
-else if (strcmp(operand,"R7") == 0) *reg_tag=R7;
-else if (strcmp(operand,"R8") == 0) *reg_tag=R8;
-else if (strcmp(operand,"R9") == 0) *reg_tag=R9;
-else if (strcmp(operand,"R10") == 0) *reg_tag=R10;
-else if (strcmp(operand,"R11") == 0) *reg_tag=R11;
-else if (strcmp(operand,"R12") == 0) *reg_tag=R12;
-else if (strcmp(operand,"R13") == 0) *reg_tag=R13;
-else if (strcmp(operand,"R14") == 0) *reg_tag=R14;
-else if (strcmp(operand,"R15") == 0) *reg_tag=R15;
+if (operand == NULL)
+  operand="";
+if (operand[0] == 'R'  &&  operand[1] >= '0'  &&  operand[1] <= '9'  &&
+	operand[2] == '\0')
+  *reg_tag=operand[1]-'0';
+else if (operand[0] == 'R'  &&  operand[1] == '1'  &&  operand[2] >= '0'  &&
+	operand[2] <= '5'  &&  operand[3] == '\0')
+  *reg_tag=10+operand[2]-'0';
 else
-  {
-  printf("Unrecognizable register field:\n%s\n",operand);
-  exit(0);
-  }
+    AssemblyError("Unrecognizable register field:\n%s\n",operand);
 }
 
 
@@ -275,21 +636,21 @@ void ParseImmediate(char *operand,	/* input */
 {
 int	i;
 
-i=-1;
-if (operand[0] == '#'  &&  strlen(operand) > 1  &&
-	!(operand[1] == '-'  &&  strlen(operand) == 2))
+if (operand == NULL)
+  operand="";
+i=1;
+if (operand[0] == '#'  &&  operand[1] == '-')
+  i++;
+if (operand[0] == '#'  &&  operand[i] != '\0')
   {
-  for (i=1; i<strlen(operand); i++)
-    if ((operand[i] < '0'  ||  operand[i] > '9')  &&
-	!(i == 1  &&  operand[i] == '-'))
-      break;
+  while (operand[i] >= '0'  &&  operand[i] <= '9')
+    i++;
   *value=atoi(&(operand[1]));
   }
-if (i < strlen(operand))
-  {
-  printf("Unrecognizable immediate field:\n%s\n",operand);
-  exit(0);
-  }
+else
+  i=0;
+if (i == 0  ||  operand[i] != '\0')
+    AssemblyError("Unrecognizable immediate field:\n%s\n",operand);
 }
 
 
@@ -303,31 +664,20 @@ void ParseAddress(char *operand,	/* input */
                    int *value)		/* output */
 
 {
-int	i;
-char	reg_string[80],immed_string[80];
+int	i,length;
 
+if (operand == NULL)
+  operand="";
+length=strlen(operand);
 i=0;
-while (i < strlen(operand)  &&  ((i == 0  &&  operand[i] == '-')  ||
+while (i < length  &&  ((i == 0  &&  operand[i] == '-')  ||
 			(operand[i] >= '0'  &&  operand[i] <= '9')))
   i++;
-if (i == 0  ||  i == strlen(operand)  ||  (i == 1  &&  operand[0] == '-'))
-  {
-  printf("Unrecognizable address field:\n%s\n",operand);
-  exit(0);
-  }
-strcpy(reg_string,&(operand[i]));
-strcpy(immed_string,operand);
-immed_string[i]='\0';
-*value=atoi(immed_string);
-if (reg_string[0] != '('  ||  reg_string[strlen(reg_string)-1] != ')')
-  {
-  printf("Unrecognizable address field:\n%s\n",operand);
-  exit(0);
-  }
-reg_string[strlen(reg_string)-1]='\0';
-ParseRegister(&(reg_string[1]),reg_tag);
+if (i == 0  ||  i == length  ||  (i == 1  &&  operand[0] == '-'))
+    AssemblyError("Unrecognizable address field:\n%s\n",operand);
+*value=atoi(operand);
+if (operand[i] != '('  ||  operand[length-1] != ')')
+    AssemblyError("Unrecognizable address field:\n%s\n",operand);
+operand[length-1]='\0';
+ParseRegister(&(operand[i+1]),reg_tag);
 }
-
-
-
-
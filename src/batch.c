@@ -0,0 +1,202 @@
+#include <ctype.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "batch.h"
+
+// A double-ended queue of job numbers owned by one worker. The owner takes
+// jobs from the bottom, while idle workers steal them from the top.
+typedef struct {
+    int *jobs;
+    int top, bottom;
+    pthread_mutex_t lock;
+} work_deque;
+
+typedef struct {
+    work_deque *deques;
+    int workers;
+    work_function run;
+    void *context;
+} work_pool;
+
+typedef struct {
+    work_pool *pool;
+    int worker;
+} work_thread;
+
+/**
+ * @return the next job for the worker, taken from its own deque or stolen from another
+ * worker's, or -1 if every deque is empty.
+ */
+static int work_pool_next(work_pool *pool, int worker) {
+    for (int i = 0; i < pool->workers; i++) {
+        work_deque *deque = &pool->deques[(worker + i) % pool->workers];
+        int job = -1;
+
+        pthread_mutex_lock(&deque->lock);
+        if (deque->top < deque->bottom) {
+            // Own jobs are run in order from the bottom, stolen ones from the far end.
+            job = i == 0 ? deque->jobs[--deque->bottom] : deque->jobs[deque->top++];
+        }
+        pthread_mutex_unlock(&deque->lock);
+
+        if (job != -1)
+            return job;
+    }
+    return -1;
+}
+
+static void *work_pool_worker(void *argument) {
+    work_thread *thread = argument;
+    int job;
+
+    while ((job = work_pool_next(thread->pool, thread->worker)) != -1)
+        thread->pool->run(thread->pool->context, job, thread->worker);
+
+    return NULL;
+}
+
+void work_pool_run(int jobs, int workers, work_function run, void *context) {
+    if (workers > jobs)
+        workers = jobs > 0 ? jobs : 1;
+
+    work_pool pool = { .deques = calloc(workers, sizeof(work_deque)), .workers = workers,
+                       .run = run, .context = context };
+    work_thread *threads = calloc(workers, sizeof(work_thread));
+    pthread_t *handles = calloc(workers, sizeof(pthread_t));
+
+    for (int i = 0; i < workers; i++) {
+        const int first = (int) ((long) jobs * i / workers);
+        const int last = (int) ((long) jobs * (i + 1) / workers);
+        work_deque *deque = &pool.deques[i];
+
+        // Jobs are pushed in reverse so the owner pops them in ascending order.
+        deque->jobs = malloc((last - first + 1) * sizeof(int));
+        for (int job = last - 1; job >= first; job--)
+            deque->jobs[deque->bottom++] = job;
+        pthread_mutex_init(&deque->lock, NULL);
+
+        threads[i].pool = &pool;
+        threads[i].worker = i;
+    }
+
+    // The calling thread works as worker 0.
+    for (int i = 1; i < workers; i++)
+        pthread_create(&handles[i], NULL, work_pool_worker, &threads[i]);
+    work_pool_worker(&threads[0]);
+    for (int i = 1; i < workers; i++)
+        pthread_join(handles[i], NULL);
+
+    for (int i = 0; i < workers; i++) {
+        pthread_mutex_destroy(&pool.deques[i].lock);
+        free(pool.deques[i].jobs);
+    }
+    free(pool.deques);
+    free(threads);
+    free(handles);
+}
+
+int work_pool_default_workers() {
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    return processors > 0 ? (int) processors : 1;
+}
+
+/**
+ * Orders file names as they are numbered: runs of digits compare by value, so that
+ * programs/2 comes before programs/10, and the rest of the names by character.
+ */
+static int batch_compare_names(const void *a, const void *b) {
+    const char *x = *(char *const *) a, *y = *(char *const *) b;
+
+    while (*x != '\0' || *y != '\0') {
+        if (isdigit((unsigned char) *x) && isdigit((unsigned char) *y)) {
+            while (*x == '0')
+                x++;
+            while (*y == '0')
+                y++;
+            const size_t x_digits = strspn(x, "0123456789"), y_digits = strspn(y, "0123456789");
+            if (x_digits != y_digits)
+                return x_digits < y_digits ? -1 : 1;
+            const int order = strncmp(x, y, x_digits);
+            if (order != 0)
+                return order;
+            x += x_digits;
+            y += y_digits;
+        } else if (*x != *y) {
+            return (unsigned char) *x - (unsigned char) *y;
+        } else {
+            x++;
+            y++;
+        }
+    }
+
+    // Names equal in value, such as 1 and 01, keep a fixed order.
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+char **batch_collect_files(const char *source, int *count) {
+    int capacity = 64;
+    char **files = malloc(capacity * sizeof(char *));
+    *count = 0;
+
+    struct stat info;
+    if (stat(source, &info) != 0) {
+        free(files);
+        return NULL;
+    }
+
+    if (S_ISDIR(info.st_mode)) {
+        DIR *dir = opendir(source);
+        if (dir == NULL) {
+            free(files);
+            return NULL;
+        }
+
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (entry->d_name[0] == '.')
+                continue;
+
+            char *path = malloc(strlen(source) + strlen(entry->d_name) + 2);
+            sprintf(path, "%s/%s", source, entry->d_name);
+            if (stat(path, &info) != 0 || !S_ISREG(info.st_mode)) {
+                free(path);
+                continue;
+            }
+
+            if (*count == capacity)
+                files = realloc(files, (capacity *= 2) * sizeof(char *));
+            files[(*count)++] = path;
+        }
+        closedir(dir);
+
+        qsort(files, *count, sizeof(char *), batch_compare_names);
+        return files;
+    }
+
+    FILE *list = fopen(source, "r");
+    if (list == NULL) {
+        free(files);
+        return NULL;
+    }
+
+    char *line = NULL;
+    size_t length = 0;
+    while (getline(&line, &length, list) != -1) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0')
+            continue;
+
+        if (*count == capacity)
+            files = realloc(files, (capacity *= 2) * sizeof(char *));
+        files[(*count)++] = strdup(line);
+    }
+    free(line);
+    fclose(list);
+
+    return files;
+}
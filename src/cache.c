@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cache.h"
+
+bool cache_valid(const cache_options *options) {
+    return options->words > 0 && options->words <= CACHE_MAX_WORDS && options->ways > 0
+            && options->ways <= CACHE_MAX_WAYS && options->line_words > 0
+            && options->words % (options->ways * options->line_words) == 0 && options->hit_latency > 0
+            && options->miss_latency >= 0;
+}
+
+bool cache_parse(const char *spec, cache_options *options) {
+    *options = (cache_options) { DEFAULT_CACHE_WORDS, DEFAULT_CACHE_WAYS, DEFAULT_CACHE_LINE, CACHE_WRITE_BACK,
+                                 CACHE_LRU, DEFAULT_CACHE_HIT, DEFAULT_CACHE_MISS };
+
+    while (*spec != '\0' && strcmp(spec, "default") != 0) {
+        char key[16], value[16];
+        int length = 0;
+        if (sscanf(spec, "%15[^=]=%15[^,]%n", key, value, &length) != 2)
+            return false;
+        spec += length;
+        if (*spec == ',')
+            spec++;
+
+        char *end;
+        const long number = strtol(value, &end, 10);
+        const bool numeric = *end == '\0' && number >= 0 && number <= CACHE_MAX_WORDS;
+
+        if (strcmp(key, "words") == 0 && numeric)
+            options->words = (int) number;
+        else if (strcmp(key, "ways") == 0 && numeric)
+            options->ways = (int) number;
+        else if (strcmp(key, "line") == 0 && numeric)
+            options->line_words = (int) number;
+        else if (strcmp(key, "hit") == 0 && numeric)
+            options->hit_latency = (int) number;
+        else if (strcmp(key, "miss") == 0 && numeric)
+            options->miss_latency = (int) number;
+        else if (strcmp(key, "write") == 0 && strcmp(value, "back") == 0)
+            options->write = CACHE_WRITE_BACK;
+        else if (strcmp(key, "write") == 0 && strcmp(value, "through") == 0)
+            options->write = CACHE_WRITE_THROUGH;
+        else if (strcmp(key, "replace") == 0 && strcmp(value, "lru") == 0)
+            options->replace = CACHE_LRU;
+        else if (strcmp(key, "replace") == 0 && strcmp(value, "fifo") == 0)
+            options->replace = CACHE_FIFO;
+        else if (strcmp(key, "replace") == 0 && strcmp(value, "random") == 0)
+            options->replace = CACHE_RANDOM;
+        else
+            return false;
+    }
+
+    return cache_valid(options);
+}
+
+void cache_init(data_cache *cache, const cache_options *options) {
+    memset(cache, 0, sizeof(*cache));
+    cache->options = *options;
+    if (options->words == 0)
+        return;
+
+    cache->sets = options->words / (options->ways * options->line_words);
+    cache->lines = calloc((size_t) cache->sets * options->ways, sizeof(cache_line));
+    cache->random = 1;
+    for (int i = 0; i < cache->sets * options->ways; i++)
+        cache->lines[i].rank = i % options->ways;
+}
+
+void cache_free(data_cache *cache) {
+    free(cache->lines);
+    cache->lines = NULL;
+}
+
+/**
+ * Moves a line of a set to the front of its replacement order.
+ */
+static void cache_promote(cache_line *set, int ways, cache_line *line) {
+    for (int i = 0; i < ways; i++)
+        set[i].rank += set[i].rank < line->rank;
+    line->rank = 0;
+}
+
+/**
+ * @return the line of a set to replace
+ */
+static cache_line *cache_victim(data_cache *cache, cache_line *set) {
+    const int ways = cache->options.ways;
+
+    // Unused lines always rank last, so LRU and FIFO take them first.
+    if (cache->options.replace == CACHE_RANDOM) {
+        for (int i = 0; i < ways; i++) {
+            if (!set[i].valid)
+                return &set[i];
+        }
+        cache->random ^= cache->random << 13;
+        cache->random ^= cache->random >> 17;
+        cache->random ^= cache->random << 5;
+        return &set[cache->random % ways];
+    }
+
+    for (int i = 0; i < ways; i++) {
+        if (set[i].rank == ways - 1)
+            return &set[i];
+    }
+    return &set[0];
+}
+
+cache_outcome cache_access(data_cache *cache, int address, bool store, int *latency) {
+    const cache_options *options = &cache->options;
+    const uint32_t number = (uint32_t) address / options->line_words;
+    cache_line *set = &cache->lines[(size_t) (number % cache->sets) * options->ways];
+    const bool write_back = options->write == CACHE_WRITE_BACK;
+
+    *latency = options->hit_latency;
+    for (int i = 0; i < options->ways; i++) {
+        cache_line *line = &set[i];
+        if (!line->valid || line->line != number)
+            continue;
+
+        if (options->replace == CACHE_LRU)
+            cache_promote(set, options->ways, line);
+        if (store && write_back && !line->dirty) {
+            line->dirty = true;
+            cache->changes++;
+        }
+        return CACHE_HIT;
+    }
+
+    // The write buffer takes a store that misses a write-through cache.
+    if (store && !write_back)
+        return CACHE_MISS;
+
+    cache_line *line = cache_victim(cache, set);
+    const bool writeback = line->valid && line->dirty;
+    *latency += options->miss_latency * (1 + writeback);
+
+    line->line = number;
+    line->valid = true;
+    line->dirty = store;
+    cache_promote(set, options->ways, line);
+    cache->changes++;
+    return writeback ? CACHE_MISS_WRITEBACK : CACHE_MISS;
+}
@@ -0,0 +1,350 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "checkpoint.h"
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+
+    // Non-zero if the checkpoint was taken in functional mode, where the pipeline is empty
+    uint32_t functional;
+} checkpoint_header;
+
+// One direction of a checkpoint. The same field list drives both writing and reading,
+// so the two cannot disagree on the layout.
+typedef struct {
+    FILE *file;
+    bool writing;
+    bool ok;
+} checkpoint_stream;
+
+static void checkpoint_bytes(checkpoint_stream *stream, void *bytes, size_t size) {
+    if (!stream->ok)
+        return;
+
+    if (stream->writing)
+        stream->ok = fwrite(bytes, size, 1, stream->file) == 1;
+    else
+        stream->ok = fread(bytes, size, 1, stream->file) == 1;
+}
+
+static void checkpoint_int(checkpoint_stream *stream, int *value) {
+    int32_t field = *value;
+    checkpoint_bytes(stream, &field, sizeof(field));
+    *value = field;
+}
+
+static void checkpoint_bool(checkpoint_stream *stream, bool *value) {
+    int field = *value;
+    checkpoint_int(stream, &field);
+    *value = field != 0;
+}
+
+static void checkpoint_long(checkpoint_stream *stream, long long *value) {
+    int64_t field = *value;
+    checkpoint_bytes(stream, &field, sizeof(field));
+    *value = field;
+}
+
+static void checkpoint_instruction(checkpoint_stream *stream, struct instruction *inst) {
+    checkpoint_int(stream, &inst->op);
+    checkpoint_int(stream, &inst->rd);
+    checkpoint_int(stream, &inst->rs);
+    checkpoint_int(stream, &inst->rt);
+    checkpoint_int(stream, &inst->imm);
+    checkpoint_int(stream, &inst->dest);
+    checkpoint_int(stream, &inst->dest_mask);
+    checkpoint_int(stream, &inst->src_mask);
+    checkpoint_int(stream, &inst->alu);
+    checkpoint_int(stream, &inst->memory);
+    checkpoint_int(stream, &inst->branch);
+    checkpoint_int(stream, &inst->flags);
+}
+
+/**
+ * Writes or reads the configuration and tables of a branch predictor. A predictor read
+ * replaces the one of the processor.
+ */
+static void checkpoint_predictor(checkpoint_stream *stream, branch_predictor *predictor) {
+    predictor_options options = predictor->options;
+    int kind = options.kind;
+    checkpoint_int(stream, &kind);
+    checkpoint_int(stream, &options.entries);
+    checkpoint_int(stream, &options.history_bits);
+    options.kind = kind;
+
+    if (!stream->writing) {
+        stream->ok &= predictor_valid(&options);
+        if (!stream->ok)
+            return;
+        predictor_free(predictor);
+        predictor_init(predictor, &options);
+    }
+
+    int history = (int) predictor->history;
+    checkpoint_int(stream, &history);
+    checkpoint_long(stream, &predictor->changes);
+    predictor->history = (uint32_t) history;
+
+    if (predictor->counters != NULL)
+        checkpoint_bytes(stream, predictor->counters, options.entries);
+    for (int i = 0; predictor->tags != NULL && i < options.entries; i++) {
+        checkpoint_int(stream, &predictor->tags[i]);
+        checkpoint_int(stream, &predictor->targets[i]);
+    }
+}
+
+/**
+ * Writes or reads the configuration and lines of a data cache. A cache read replaces the
+ * one of the processor.
+ */
+static void checkpoint_cache(checkpoint_stream *stream, data_cache *cache) {
+    cache_options options = cache->options;
+    int write = options.write, replace = options.replace;
+    checkpoint_int(stream, &options.words);
+    checkpoint_int(stream, &options.ways);
+    checkpoint_int(stream, &options.line_words);
+    checkpoint_int(stream, &write);
+    checkpoint_int(stream, &replace);
+    checkpoint_int(stream, &options.hit_latency);
+    checkpoint_int(stream, &options.miss_latency);
+    options.write = write;
+    options.replace = replace;
+
+    if (!stream->writing) {
+        stream->ok &= options.words == 0 || cache_valid(&options);
+        if (!stream->ok)
+            return;
+        cache_free(cache);
+        cache_init(cache, &options);
+    }
+
+    int random = (int) cache->random;
+    checkpoint_int(stream, &random);
+    checkpoint_long(stream, &cache->changes);
+    cache->random = (uint32_t) random;
+
+    for (int i = 0; cache->lines != NULL && i < cache->sets * options.ways; i++) {
+        cache_line *line = &cache->lines[i];
+        int number = (int) line->line, rank = line->rank;
+        checkpoint_int(stream, &number);
+        checkpoint_bool(stream, &line->valid);
+        checkpoint_bool(stream, &line->dirty);
+        checkpoint_int(stream, &rank);
+        line->line = (uint32_t) number;
+        line->rank = (uint8_t) rank;
+        stream->ok &= rank >= 0 && rank < options.ways;
+    }
+}
+
+/**
+ * Writes or reads the configuration of the functional units and the instructions in them.
+ */
+static void checkpoint_scoreboard(checkpoint_stream *stream, scoreboard *board) {
+    for (int i = 0; i < UNIT_KINDS; i++) {
+        checkpoint_int(stream, &board->options.latency[i]);
+        checkpoint_bool(stream, &board->options.pipelined[i]);
+        checkpoint_int(stream, &board->busy[i]);
+    }
+    for (int i = 0; i < 16; i++)
+        checkpoint_int(stream, &board->pending[i]);
+
+    int reserved = (int) board->reserved;
+    checkpoint_int(stream, &reserved);
+    checkpoint_int(stream, &board->count);
+    board->reserved = (uint32_t) reserved;
+
+    stream->ok &= units_valid(&board->options) && board->count >= 0 && board->count <= SCOREBOARD_MAX_OPERATIONS;
+    for (int i = 0; stream->ok && i < board->count; i++) {
+        unit_operation *operation = &board->operations[i];
+        checkpoint_instruction(stream, &operation->inst);
+        checkpoint_int(stream, &operation->result);
+        checkpoint_int(stream, &operation->remaining);
+        stream->ok &= operation->inst.dest >= R0 && operation->inst.dest <= R15;
+    }
+}
+
+/**
+ * Writes or reads every field of the pipeline latches, registers, counters, branch
+ * predictor, data cache and functional units.
+ */
+static void checkpoint_fields(checkpoint_stream *stream, cpu_state *state) {
+    struct fetch_buffer *fetch = &state->fetch_buffer;
+    checkpoint_int(stream, &fetch->pc);
+    checkpoint_int(stream, &fetch->pc_branch);
+    checkpoint_bool(stream, &fetch->stall);
+    checkpoint_bool(stream, &fetch->flush);
+
+    struct decode_buffer *decode = &state->decode_buffer;
+    checkpoint_int(stream, &decode->pc_next);
+    checkpoint_instruction(stream, &decode->inst);
+    checkpoint_bool(stream, &decode->stall);
+    checkpoint_bool(stream, &decode->should_jump);
+    checkpoint_bool(stream, &decode->predicted);
+    checkpoint_bool(stream, &decode->forward);
+    checkpoint_int(stream, &decode->data);
+
+    struct execute_buffer *execute = &state->execute_buffer;
+    int forward_a = execute->foward_a, forward_b = execute->forward_b;
+    checkpoint_int(stream, &execute->a);
+    checkpoint_int(stream, &execute->b);
+    checkpoint_int(stream, &execute->alu_out);
+    checkpoint_instruction(stream, &execute->inst);
+    checkpoint_int(stream, &forward_a);
+    checkpoint_int(stream, &forward_b);
+    execute->foward_a = forward_a;
+    execute->forward_b = forward_b;
+
+    struct memory_buffer *memory = &state->memory_buffer;
+    checkpoint_int(stream, &memory->alu_out);
+    checkpoint_int(stream, &memory->write_data);
+    checkpoint_instruction(stream, &memory->inst);
+    checkpoint_bool(stream, &memory->accessed);
+    checkpoint_int(stream, &memory->wait);
+    checkpoint_bool(stream, &memory->waiting);
+
+    struct writeback_buffer *writeback = &state->writeback_buffer;
+    checkpoint_int(stream, &writeback->read_data);
+    checkpoint_int(stream, &writeback->alu_out);
+    checkpoint_int(stream, &writeback->result);
+    checkpoint_instruction(stream, &writeback->inst);
+
+    for (int i = 0; i < 16; i++)
+        checkpoint_int(stream, &state->register_file[i]);
+
+    checkpoint_long(stream, &state->cycles_executed);
+    checkpoint_long(stream, &state->instructions_executed);
+    checkpoint_bool(stream, &state->halt);
+
+    long long *counters = (long long *) &state->stats;
+    for (size_t i = 0; i < PIPELINE_STATS_COUNT; i++)
+        checkpoint_long(stream, &counters[i]);
+
+    checkpoint_predictor(stream, &state->predictor);
+    checkpoint_cache(stream, &state->cache);
+    checkpoint_scoreboard(stream, &state->scoreboard);
+    checkpoint_bool(stream, &state->reservation.valid);
+    checkpoint_int(stream, &state->reservation.address);
+}
+
+/**
+ * @return true if every word of the page is zero
+ */
+static bool checkpoint_page_empty(const int *page) {
+    for (int i = 0; i < MEMORY_PAGE_WORDS; i++) {
+        if (page[i] != 0)
+            return false;
+    }
+    return true;
+}
+
+bool checkpoint_write(cpu_state *state, const char *path, bool functional) {
+    checkpoint_stream stream = { .file = fopen(path, "wb"), .writing = true, .ok = true };
+    if (stream.file == NULL)
+        return false;
+
+    checkpoint_header header = { .version = CHECKPOINT_VERSION, .functional = functional };
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    checkpoint_bytes(&stream, &header, sizeof(header));
+
+    checkpoint_fields(&stream, state);
+
+    // The program; predecoding is redone when it is read.
+    checkpoint_int(&stream, &state->instructions_count);
+    for (int i = 0; i < state->instructions_count; i++) {
+        struct instruction *inst = &state->instruction_memory[i];
+        checkpoint_int(&stream, &inst->op);
+        checkpoint_int(&stream, &inst->rd);
+        checkpoint_int(&stream, &inst->rs);
+        checkpoint_int(&stream, &inst->rt);
+        checkpoint_int(&stream, &inst->imm);
+    }
+
+    // Data memory, as its size followed by the numbers and contents of the pages in use
+    const data_memory *memory = &state->data_memory;
+    const uint32_t last_page = MEMORY_MAX_WORDS / MEMORY_PAGE_WORDS;
+    long long words = memory->words;
+    int pages = 0;
+
+    for (uint32_t page = memory_next_page(memory, 0); page < last_page; page = memory_next_page(memory, page + 1ULL))
+        pages += !checkpoint_page_empty(memory_page(memory, page));
+
+    checkpoint_long(&stream, &words);
+    checkpoint_int(&stream, &pages);
+    for (uint32_t page = memory_next_page(memory, 0); page < last_page; page = memory_next_page(memory, page + 1ULL)) {
+        int *contents = memory_page(memory, page);
+        int number = (int) page;
+        if (checkpoint_page_empty(contents))
+            continue;
+
+        checkpoint_int(&stream, &number);
+        checkpoint_bytes(&stream, contents, MEMORY_PAGE_WORDS * sizeof(int32_t));
+    }
+
+    stream.ok &= fclose(stream.file) == 0;
+    return stream.ok;
+}
+
+bool checkpoint_read(cpu_state *state, const char *path, bool *functional) {
+    checkpoint_stream stream = { .file = fopen(path, "rb"), .writing = false, .ok = true };
+    if (stream.file == NULL)
+        return false;
+
+    checkpoint_header header;
+    checkpoint_bytes(&stream, &header, sizeof(header));
+    stream.ok &= memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) == 0
+            && header.version == CHECKPOINT_VERSION;
+    *functional = header.functional != 0;
+
+    checkpoint_fields(&stream, state);
+
+    int count = 0;
+    checkpoint_int(&stream, &count);
+    stream.ok &= count >= 0;
+
+    struct instruction *code = calloc(stream.ok ? count + 1 : 1, sizeof(*code));
+    for (int i = 0; stream.ok && i < count; i++) {
+        checkpoint_int(&stream, &code[i].op);
+        checkpoint_int(&stream, &code[i].rd);
+        checkpoint_int(&stream, &code[i].rs);
+        checkpoint_int(&stream, &code[i].rt);
+        checkpoint_int(&stream, &code[i].imm);
+        stream.ok &= code[i].rd >= NOT_USED && code[i].rd <= R15 && code[i].rs >= NOT_USED && code[i].rs <= R15
+                && code[i].rt >= NOT_USED && code[i].rt <= R15;
+    }
+    processor_load_program(state, code, stream.ok ? count : 0);
+
+    long long words = 0;
+    int pages = 0;
+    checkpoint_long(&stream, &words);
+    checkpoint_int(&stream, &pages);
+    stream.ok &= words > 0 && (uint64_t) words <= MEMORY_MAX_WORDS && pages >= 0;
+
+    memory_free(&state->data_memory);
+    state->data_memory.words = stream.ok ? words : 0;
+    for (int i = 0; stream.ok && i < pages; i++) {
+        int number = 0;
+        checkpoint_int(&stream, &number);
+        stream.ok &= (uint32_t) number < MEMORY_MAX_WORDS / MEMORY_PAGE_WORDS;
+        if (!stream.ok)
+            break;
+
+        int *contents = memory_page_for_write(&state->data_memory, number);
+        checkpoint_bytes(&stream, contents, MEMORY_PAGE_WORDS * sizeof(int32_t));
+    }
+
+    // The pc and the register tags in the latches index the program and the register file.
+    stream.ok &= state->fetch_buffer.pc >= 0 && state->fetch_buffer.pc < state->instructions_count + PIPELINE_DRAIN;
+    const struct instruction *latched[] = { &state->decode_buffer.inst, &state->execute_buffer.inst,
+                                            &state->memory_buffer.inst, &state->writeback_buffer.inst };
+    for (int i = 0; i < 4; i++) {
+        stream.ok &= latched[i]->dest >= NOT_USED && latched[i]->dest <= R15
+                && latched[i]->rs >= NOT_USED && latched[i]->rs <= R15
+                && latched[i]->rt >= NOT_USED && latched[i]->rt <= R15;
+    }
+
+    fclose(stream.file);
+    return stream.ok;
+}
@@ -0,0 +1,335 @@
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "debug.h"
+
+// Text formatted in memory, to be written out at once
+typedef struct {
+    char *data;
+    size_t length, capacity;
+} text_buffer;
+
+static void text_reserve(text_buffer *text, size_t length) {
+    if (text->length + length <= text->capacity)
+        return;
+    while (text->length + length > text->capacity)
+        text->capacity = text->capacity > 0 ? text->capacity * 2 : 4096;
+    text->data = realloc(text->data, text->capacity);
+}
+
+static void text_append(text_buffer *text, const char *string) {
+    const size_t length = strlen(string);
+    text_reserve(text, length);
+    memcpy(text->data + text->length, string, length);
+    text->length += length;
+}
+
+/**
+ * Appends a number as printf's %d would, padded with spaces to width characters.
+ * @param left pad on the right, as %-d does
+ */
+static void text_number(text_buffer *text, long long value, int width, bool left) {
+    char digits[24];
+    int count = 0;
+    unsigned long long magnitude = value < 0 ? 0ULL - (unsigned long long) value : (unsigned long long) value;
+    do {
+        digits[count++] = (char) ('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+    if (value < 0)
+        digits[count++] = '-';
+
+    const int padding = width > count ? width - count : 0;
+    text_reserve(text, count + padding);
+    char *at = text->data + text->length;
+    if (!left) {
+        memset(at, ' ', padding);
+        at += padding;
+    }
+    for (int i = count - 1; i >= 0; i--)
+        *at++ = digits[i];
+    if (left) {
+        memset(at, ' ', padding);
+        at += padding;
+    }
+    text->length = at - text->data;
+}
+
+static void text_write(FILE *out, text_buffer *text) {
+    fwrite(text->data, 1, text->length, out);
+    free(text->data);
+    text->data = NULL;
+    text->length = text->capacity = 0;
+}
+
+static void format_registers(text_buffer *text, const int *register_file) {
+    for (int i = 0; i < 16; i++) {
+        text_append(text, "R");
+        text_number(text, i, 2, true);
+        text_append(text, ": ");
+        text_number(text, register_file[i], 10, true);
+        text_append(text, i % 8 == 7 ? " \n" : " ");
+    }
+}
+
+void print_registers(FILE *out, int *register_file) {
+    text_buffer text = {};
+    format_registers(&text, register_file);
+    text_write(out, &text);
+}
+
+static void format_memory_row(text_buffer *text, const data_memory *memory, uint64_t row) {
+    text_number(text, (long long) row, 4, false);
+    text_append(text, " ");
+    for (uint64_t i = row; i < row + 20 && i < memory->words; i++) {
+        text_number(text, memory_load(memory, (int) i), 4, true);
+        text_append(text, " ");
+    }
+    text_append(text, "\n");
+}
+
+static void format_memory(text_buffer *text, const data_memory *memory) {
+    uint64_t row = 0;
+
+    while (row < memory->words) {
+        if (memory->words > DEBUG_DENSE_WORDS) {
+            const uint64_t first = (uint64_t) memory_next_page(memory, row / MEMORY_PAGE_WORDS) * MEMORY_PAGE_WORDS;
+            if (first >= memory->words)
+                break;
+            if (first > row)
+                row = first / 20 * 20;
+        }
+
+        format_memory_row(text, memory, row);
+        row += 20;
+    }
+}
+
+/**
+ * Formats the rows of the dense dump that hold a non-zero word; words not listed are zero.
+ * Pages never written are zero, so only the rows overlapping a written page are looked at.
+ */
+static void format_memory_sparse(text_buffer *text, const data_memory *memory) {
+    const uint64_t pages = (memory->words + MEMORY_PAGE_WORDS - 1) / MEMORY_PAGE_WORDS;
+    uint64_t next = 0;  // the first row not yet looked at
+
+    for (uint64_t page = memory_next_page(memory, 0); page < pages; page = memory_next_page(memory, page + 1)) {
+        const uint64_t end = (page + 1) * MEMORY_PAGE_WORDS;
+        uint64_t row = page * MEMORY_PAGE_WORDS / 20 * 20;
+        for (row = row > next ? row : next; row < end && row < memory->words; row += 20) {
+            bool written = false;
+            for (uint64_t i = row; i < row + 20 && i < memory->words && !written; i++)
+                written = memory_load(memory, (int) i) != 0;
+            if (written)
+                format_memory_row(text, memory, row);
+        }
+        next = row;
+    }
+}
+
+/**
+ * Formats every word that differs from its value in initial, one per line as
+ * "address: initial -> final". Only the pages written in either memory are compared.
+ */
+static void format_memory_diff(text_buffer *text, const data_memory *memory, const data_memory *initial) {
+    const uint64_t pages = (memory->words + MEMORY_PAGE_WORDS - 1) / MEMORY_PAGE_WORDS;
+    uint64_t page = memory_next_page(memory, 0), other = memory_next_page(initial, 0);
+
+    while (page < pages || other < pages) {
+        const uint64_t current = page < other ? page : other;
+        const uint64_t end = (current + 1) * MEMORY_PAGE_WORDS;
+        for (uint64_t i = current * MEMORY_PAGE_WORDS; i < end && i < memory->words; i++) {
+            const int before = memory_load(initial, (int) i), after = memory_load(memory, (int) i);
+            if (before == after)
+                continue;
+            text_number(text, (long long) i, 4, false);
+            text_append(text, ": ");
+            text_number(text, before, 0, true);
+            text_append(text, " -> ");
+            text_number(text, after, 0, true);
+            text_append(text, "\n");
+        }
+
+        if (page == current)
+            page = memory_next_page(memory, page + 1);
+        if (other == current)
+            other = memory_next_page(initial, other + 1);
+    }
+}
+
+static void format_memory_dump(text_buffer *text, const data_memory *memory, int dump, const data_memory *initial) {
+    if (dump == DUMP_SPARSE)
+        format_memory_sparse(text, memory);
+    else if (dump == DUMP_DIFF)
+        format_memory_diff(text, memory, initial);
+    else
+        format_memory(text, memory);
+}
+
+void print_memory(FILE *out, const data_memory *memory, int dump, const data_memory *initial) {
+    text_buffer text = {};
+    format_memory_dump(&text, memory, dump, initial);
+    text_write(out, &text);
+}
+
+void print_debug(FILE *out, cpu_state *state, bool cycles, int dump, const data_memory *initial) {
+    text_buffer text = {};
+
+    text_append(&text, "Registers:\n");
+    format_registers(&text, state->register_file);
+    text_append(&text, "Memory:\n");
+    format_memory_dump(&text, &state->data_memory, dump, initial);
+    text_append(&text, "Instructions: ");
+    text_number(&text, state->instructions_executed, 0, true);
+    text_append(&text, "\n");
+    if (cycles) {
+        text_append(&text, "Cycles: ");
+        text_number(&text, state->cycles_executed, 0, true);
+        text_append(&text, "\n");
+    }
+    text_write(out, &text);
+}
+
+bool dump_raw(const data_memory *memory, const char *path) {
+    const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1)
+        return false;
+
+    bool written = ftruncate(fd, (off_t) (memory->words * sizeof(int32_t))) == 0;
+    const uint64_t pages = (memory->words + MEMORY_PAGE_WORDS - 1) / MEMORY_PAGE_WORDS;
+    for (uint64_t page = memory_next_page(memory, 0); written && page < pages; page = memory_next_page(memory, page + 1)) {
+        const uint64_t first = page * MEMORY_PAGE_WORDS;
+        const uint64_t count = memory->words - first < MEMORY_PAGE_WORDS ? memory->words - first : MEMORY_PAGE_WORDS;
+        const size_t size = count * sizeof(int32_t);
+        written = pwrite(fd, memory_page(memory, (uint32_t) page), size, (off_t) (first * sizeof(int32_t)))
+                == (ssize_t) size;
+    }
+
+    return close(fd) == 0 && written;
+}
+
+void print_registers_original(FILE *out, int *register_file) {
+    for (int i = 0; i < 16; i += 4) {
+        fprintf(out, "  R%-2d: %-10d  R%-2d: %-10d", i, register_file[i], i + 1, register_file[i + 1]);
+        fprintf(out, "  R%-2d: %-10d  R%-2d: %-10d\n", i + 2, register_file[i + 2], i + 3, register_file[i + 3]);
+    }
+}
+
+int print_instruction(FILE *out, const struct instruction *inst, int pc) {
+    switch (inst->op) {
+        case ADDI: return fprintf(out, "ADDI R%d,R%d,#%d", inst->rt, inst->rs, inst->imm);
+        case SUBI: return fprintf(out, "SUBI R%d,R%d,#%d", inst->rt, inst->rs, inst->imm);
+        case ADD:  return fprintf(out, "ADD R%d,R%d,R%d", inst->rd, inst->rs, inst->rt);
+        case SUB:  return fprintf(out, "SUB R%d,R%d,R%d", inst->rd, inst->rs, inst->rt);
+        case MULT: return fprintf(out, "MULT R%d,R%d,R%d", inst->rd, inst->rs, inst->rt);
+        case DIV:  return fprintf(out, "DIV R%d,R%d,R%d", inst->rd, inst->rs, inst->rt);
+        case AND:  return fprintf(out, "AND R%d,R%d,R%d", inst->rd, inst->rs, inst->rt);
+        case OR:   return fprintf(out, "OR R%d,R%d,R%d", inst->rd, inst->rs, inst->rt);
+        case XOR:  return fprintf(out, "XOR R%d,R%d,R%d", inst->rd, inst->rs, inst->rt);
+        case SLL:  return fprintf(out, "SLL R%d,R%d,R%d", inst->rd, inst->rs, inst->rt);
+        case SRL:  return fprintf(out, "SRL R%d,R%d,R%d", inst->rd, inst->rs, inst->rt);
+        case SLT:  return fprintf(out, "SLT R%d,R%d,R%d", inst->rd, inst->rs, inst->rt);
+        case LW:   return fprintf(out, "LW R%d,%d(R%d)", inst->rt, inst->imm, inst->rs);
+        case SW:   return fprintf(out, "SW %d(R%d),R%d", inst->imm, inst->rs, inst->rt);
+        case LL:   return fprintf(out, "LL R%d,%d(R%d)", inst->rt, inst->imm, inst->rs);
+        case SC:   return fprintf(out, "SC %d(R%d),R%d", inst->imm, inst->rs, inst->rt);
+        case BEQZ: return fprintf(out, "BEQZ R%d,%d", inst->rs, pc + 1 + inst->imm);
+        case BNEZ: return fprintf(out, "BNEZ R%d,%d", inst->rs, pc + 1 + inst->imm);
+        case J:    return fprintf(out, "J %d", pc + 1 + inst->imm);
+        default:   return fprintf(out, "NOP");
+    }
+}
+
+void print_prediction(FILE *out, const cpu_state *state) {
+    const pipeline_stats *stats = &state->stats;
+    const long long correct = stats->branches - stats->flushes;
+
+    fprintf(out, "Branch prediction (%s): %lld of %lld correct (%.1f%%), %lld flush cycles saved\n",
+            predictor_name(state->predictor.options.kind), correct, stats->branches,
+            stats->branches > 0 ? 100.0 * correct / stats->branches : 100.0, stats->taken - stats->flushes);
+}
+
+void print_cache(FILE *out, const cpu_state *state) {
+    const pipeline_stats *stats = &state->stats;
+    const long long accesses = stats->cache_hits + stats->cache_misses;
+
+    fprintf(out, "Data cache: %lld hits, %lld misses (%.1f%% hits), %lld write-backs, %lld stall cycles\n",
+            stats->cache_hits, stats->cache_misses, accesses > 0 ? 100.0 * stats->cache_hits / accesses : 100.0,
+            stats->cache_writebacks, stats->memory_stalls);
+}
+
+void print_issue(FILE *out, const superscalar *core) {
+    fprintf(out, "Issue width %d:", core->width);
+    for (int i = 0; i <= core->width; i++)
+        fprintf(out, "%s %lld cycles issuing %d", i > 0 ? "," : "", core->issued[i], i);
+    fprintf(out, "\nGroups split: %lld by a dependence, %lld by the memory port, %lld by a functional unit, "
+            "%lld by a branch\n", core->limits[PAIR_DEPENDENCE], core->limits[PAIR_MEMORY], core->limits[PAIR_UNIT],
+            core->limits[PAIR_BRANCH]);
+}
+
+void print_stages(FILE *out, const staged_pipeline *pipe) {
+    char name[STAGES_NAME_SIZE];
+
+    fprintf(out, "Pipeline of %d stages:", pipe->depth);
+    for (int i = 0; i < pipe->depth; i++)
+        fprintf(out, " %s", stages_name(pipe, i, name));
+    fprintf(out, "\nStalls: %lld cycles for operands, %lld for the operands of branches, %lld for the data cache, "
+            "%lld for functional units; %lld instructions flushed\n", pipe->operand_stalls, pipe->branch_stalls,
+            pipe->memory_waits, pipe->unit_waits, pipe->flushed);
+}
+
+void print_tomasulo(FILE *out, const tomasulo_core *core) {
+    const tomasulo_options *options = &core->options;
+
+    fprintf(out, "Out-of-order core: width %d, %d reorder buffer entries, %d reservation stations, "
+            "%d load/store queue entries\n", options->width, options->rob, options->stations, options->queue);
+    fprintf(out, "Dispatch stalls: %lld cycles with the reorder buffer full, %lld with the reservation stations full, "
+            "%lld with the load/store queue full\n", core->rob_full, core->stations_full, core->queue_full);
+    fprintf(out, "Mispredictions: %lld, squashing %lld instructions; %lld loads forwarded from stores\n",
+            core->mispredictions, core->squashed, core->forwarded);
+}
+
+void print_stats(FILE *out, const cpu_state *state, bool json) {
+    const pipeline_stats *stats = &state->stats;
+    const long long instructions = state->instructions_executed;
+    const double per = instructions > 0 ? 1.0 / (double) instructions : 0;
+
+    // Any cycle not explained by the counters, such as those of a checkpoint from before they existed
+    const long long other = state->cycles_executed - instructions - stats->load_use_stalls - stats->branch_stalls
+            - stats->flushes - stats->memory_stalls - stats->unit_stalls - stats->drain_cycles;
+
+    const char *names[] = { "base", "load_use_stalls", "branch_stalls", "flushes", "memory_stalls", "unit_stalls",
+                            "drain", "other" };
+    const char *labels[] = { "Base", "Load-use stalls", "Branch stalls", "Control flushes", "Memory stalls",
+                             "Unit stalls", "Pipeline drain", "Other" };
+    const long long cycles[] = { instructions, stats->load_use_stalls, stats->branch_stalls, stats->flushes,
+                                 stats->memory_stalls, stats->unit_stalls, stats->drain_cycles, other };
+    const int count = other != 0 ? 8 : 7;
+
+    if (json) {
+        fprintf(out, "{\"cycles\": %lld, \"instructions\": %lld, \"cpi\": %.6f, \"stack\": {",
+                state->cycles_executed, instructions, state->cycles_executed * per);
+        for (int i = 0; i < count; i++)
+            fprintf(out, "%s\"%s\": {\"cycles\": %lld, \"cpi\": %.6f}", i > 0 ? ", " : "", names[i], cycles[i],
+                    cycles[i] * per);
+        fprintf(out, "}, \"forwarding\": {\"memory\": %lld, \"writeback\": %lld, \"branch\": %lld}",
+                stats->forward_memory, stats->forward_writeback, stats->forward_branch);
+        fprintf(out, ", \"branches\": {\"resolved\": %lld, \"taken\": %lld, \"mispredicted\": %lld, "
+                "\"flush_cycles_saved\": %lld}", stats->branches, stats->taken, stats->flushes,
+                stats->taken - stats->flushes);
+        fprintf(out, ", \"cache\": {\"hits\": %lld, \"misses\": %lld, \"writebacks\": %lld, \"stall_cycles\": %lld}}\n",
+                stats->cache_hits, stats->cache_misses, stats->cache_writebacks, stats->memory_stalls);
+        return;
+    }
+
+    fprintf(out, "\nCPI stack:\n");
+    for (int i = 0; i < count; i++)
+        fprintf(out, "  %-16s %6.3f  (%lld cycles)\n", labels[i], cycles[i] * per, cycles[i]);
+    fprintf(out, "  %-16s %6.3f  (%lld cycles)\n", "Total", state->cycles_executed * per, state->cycles_executed);
+    fprintf(out, "Forwarding: %lld from memory, %lld from writeback, %lld branch operands to decode\n",
+            stats->forward_memory, stats->forward_writeback, stats->forward_branch);
+    print_prediction(out, state);
+    if (state->cache.lines != NULL)
+        print_cache(out, state);
+}
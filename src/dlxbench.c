@@ -0,0 +1,444 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_REPETITIONS 5
+#define DEFAULT_WARMUP 1
+#define DEFAULT_SCALE 1
+#define MAX_REPETITIONS 100
+#define MAX_ARGUMENTS 16
+
+// A change of throughput against the baseline is reported as a regression or an improvement
+// when it is larger than this, and than twice the spread of the measurements.
+#define SIGNIFICANT_CHANGE 0.05
+
+typedef struct {
+    const char *name;
+    const char *description;
+    void (*generate)(FILE *file, long scale);
+} workload;
+
+typedef struct {
+    const char *name;
+    const char *arguments;  // passed to sim before the program, separated by spaces
+} mode;
+
+typedef struct {
+    long long cycles;        // simulated, or -1 if the mode does not model them
+    long long instructions;
+    double seconds[MAX_REPETITIONS];
+    int repetitions;
+} measurement;
+
+typedef struct {
+    char workload[32];
+    char mode[32];
+    double instructions_per_second;
+} baseline_entry;
+
+/**
+ * A long counted loop of dependent ALU instructions, nested so each iteration of the outer
+ * loop runs a thousand of the inner one.
+ */
+void generate_loop(FILE *file, long scale) {
+    fprintf(file, "        ADDI    R5,R0,#%ld\n", 250 * scale);
+    fprintf(file, "outer   ADDI    R1,R0,#1000\n");
+    fprintf(file, "inner   ADDI    R2,R2,#3\n");
+    fprintf(file, "        ADD     R3,R3,R2\n");
+    fprintf(file, "        XOR     R4,R4,R3\n");
+    fprintf(file, "        SUB     R6,R4,R2\n");
+    fprintf(file, "        OR      R7,R7,R6\n");
+    fprintf(file, "        SUBI    R1,R1,#1\n");
+    fprintf(file, "        BNEZ    R1,inner\n");
+    fprintf(file, "        SUBI    R5,R5,#1\n");
+    fprintf(file, "        BNEZ    R5,outer\n");
+}
+
+/**
+ * Sweeps of loads and stores over all of the default data memory, each word read,
+ * updated and written back.
+ */
+void generate_memory(FILE *file, long scale) {
+    fprintf(file, "        ADDI    R5,R0,#%ld\n", 250 * scale);
+    fprintf(file, "outer   ADDI    R1,R0,#500\n");
+    fprintf(file, "inner   SUBI    R1,R1,#1\n");
+    fprintf(file, "        LW      R2,0(R1)\n");
+    fprintf(file, "        LW      R3,500(R1)\n");
+    fprintf(file, "        ADDI    R2,R2,#1\n");
+    fprintf(file, "        ADD     R4,R4,R3\n");
+    fprintf(file, "        SW      0(R1),R2\n");
+    fprintf(file, "        SW      500(R1),R4\n");
+    fprintf(file, "        BNEZ    R1,inner\n");
+    fprintf(file, "        SUBI    R5,R5,#1\n");
+    fprintf(file, "        BNEZ    R5,outer\n");
+}
+
+/**
+ * Branches on the bits of a xorshift generator, taken or not with no pattern a predictor
+ * or the steady state of a loop can follow.
+ */
+void generate_branch(FILE *file, long scale) {
+    fprintf(file, "        ADDI    R1,R0,#%ld\n", 250000 * scale);
+    fprintf(file, "        ADDI    R2,R0,#2463534\n");
+    fprintf(file, "        ADDI    R10,R0,#13\n");
+    fprintf(file, "        ADDI    R11,R0,#17\n");
+    fprintf(file, "        ADDI    R12,R0,#5\n");
+    fprintf(file, "        ADDI    R13,R0,#1\n");
+    fprintf(file, "        ADDI    R14,R0,#2\n");
+    fprintf(file, "loop    SLL     R3,R2,R10\n");
+    fprintf(file, "        XOR     R2,R2,R3\n");
+    fprintf(file, "        SRL     R3,R2,R11\n");
+    fprintf(file, "        XOR     R2,R2,R3\n");
+    fprintf(file, "        SLL     R3,R2,R12\n");
+    fprintf(file, "        XOR     R2,R2,R3\n");
+    fprintf(file, "        AND     R4,R2,R13\n");
+    fprintf(file, "        BEQZ    R4,even\n");
+    fprintf(file, "        ADDI    R6,R6,#1\n");
+    fprintf(file, "even    AND     R4,R2,R14\n");
+    fprintf(file, "        BNEZ    R4,next\n");
+    fprintf(file, "        ADDI    R7,R7,#1\n");
+    fprintf(file, "        J       next\n");
+    fprintf(file, "next    SUBI    R1,R1,#1\n");
+    fprintf(file, "        BNEZ    R1,loop\n");
+}
+
+/**
+ * Every instruction depends on the one before it: loads used at once, branches on loaded
+ * words, and products and quotients of them.
+ */
+void generate_hazard(FILE *file, long scale) {
+    fprintf(file, "        ADDI    R5,R0,#%ld\n", 250 * scale);
+    fprintf(file, "        ADDI    R9,R0,#7\n");
+    fprintf(file, "outer   ADDI    R1,R0,#999\n");
+    fprintf(file, "inner   LW      R2,0(R1)\n");
+    fprintf(file, "        ADD     R3,R2,R1\n");
+    fprintf(file, "        SW      0(R1),R3\n");
+    fprintf(file, "        LW      R4,0(R1)\n");
+    fprintf(file, "        BEQZ    R4,skip\n");
+    fprintf(file, "        MULT    R6,R4,R9\n");
+    fprintf(file, "        DIV     R7,R6,R9\n");
+    fprintf(file, "        ADD     R8,R8,R7\n");
+    fprintf(file, "skip    SUBI    R1,R1,#1\n");
+    fprintf(file, "        BNEZ    R1,inner\n");
+    fprintf(file, "        SUBI    R5,R5,#1\n");
+    fprintf(file, "        BNEZ    R5,outer\n");
+}
+
+static const workload workloads[] = {
+    { "loop", "long loops of ALU instructions", generate_loop },
+    { "memory", "loads and stores over all of data memory", generate_memory },
+    { "branch", "unpredictable branches", generate_branch },
+    { "hazard", "load-use, branch and unit hazards", generate_hazard },
+};
+
+static const mode modes[] = {
+    { "pipeline", "" },
+    { "exact", "--exact" },
+    { "functional", "-F" },
+    { "cache", "--exact --cache default" },
+    { "predictor", "--exact --predictor gshare" },
+    { "sample", "--sample 10000" },
+    { "width", "--width=2" },
+    { "ooo", "--ooo default" },
+    { "stages", "--pipeline fetch=2,execute=2,memory=2" },
+    { "cores", "--cores 4" },
+};
+
+#define WORKLOADS ((int) (sizeof(workloads) / sizeof(workloads[0])))
+#define MODES ((int) (sizeof(modes) / sizeof(modes[0])))
+
+void print_usage() {
+    printf("Usage: dlxbench [args]\n\n");
+    printf("Generates a corpus of workloads, simulates each with every mode of sim, and prints the\n");
+    printf("host throughput: simulated cycles and instructions per second of wall-clock time.\n\n");
+    printf("Arguments:\n");
+    printf("\t--sim PATH\tthe simulator to measure (default: ./sim)\n");
+    printf("\t-r N\tmeasure N runs of each workload and mode, reporting the median (default: %d)\n",
+           DEFAULT_REPETITIONS);
+    printf("\t-w N\trun each workload and mode N times more first, unmeasured (default: %d)\n", DEFAULT_WARMUP);
+    printf("\t-s N\tscale the workloads to N times their length (default: %d)\n", DEFAULT_SCALE);
+    printf("\t--baseline FILE\tcompare the throughput with that saved in FILE\n");
+    printf("\t--save FILE\tsave the throughput to FILE as a baseline\n");
+    printf("\nWorkloads:\n");
+    for (int i = 0; i < WORKLOADS; i++)
+        printf("\t%s\t%s\n", workloads[i].name, workloads[i].description);
+    printf("\nModes:\n");
+    for (int i = 0; i < MODES; i++)
+        printf("\t%s\tsim %s\n", modes[i].name, modes[i].arguments);
+}
+
+double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/**
+ * Runs sim on a program in a mode, with debug output to read the counts from.
+ * @return the seconds the run took, or -1 if sim failed; output holds what it printed
+ */
+double run_sim(const char *sim, const mode *mode, const char *program, char **output) {
+    char arguments[256];
+    char *argv[MAX_ARGUMENTS];
+    int argc = 0;
+
+    snprintf(arguments, sizeof(arguments), "%s", mode->arguments);
+    argv[argc++] = (char *) sim;
+    argv[argc++] = "-D";
+    argv[argc++] = "--max-cycles";
+    argv[argc++] = "0";
+    for (char *token = strtok(arguments, " "); token != NULL && argc < MAX_ARGUMENTS - 2; token = strtok(NULL, " "))
+        argv[argc++] = token;
+    argv[argc++] = (char *) program;
+    argv[argc] = NULL;
+
+    int channel[2];
+    if (pipe(channel) != 0)
+        return -1;
+
+    const double start = now();
+    const pid_t child = fork();
+    if (child == 0) {
+        dup2(channel[1], STDOUT_FILENO);
+        close(channel[0]);
+        close(channel[1]);
+        execv(sim, argv);
+        _exit(127);
+    }
+    close(channel[1]);
+
+    size_t length = 0, capacity = 1 << 16;
+    char *text = malloc(capacity);
+    ssize_t count;
+    while ((count = read(channel[0], text + length, capacity - length - 1)) > 0) {
+        length += count;
+        if (capacity - length < 2)
+            text = realloc(text, capacity *= 2);
+    }
+    text[length] = '\0';
+    close(channel[0]);
+
+    int status;
+    waitpid(child, &status, 0);
+    const double seconds = now() - start;
+
+    *output = text;
+    return child > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0 ? seconds : -1;
+}
+
+/**
+ * Reads the simulated cycles and instructions from the output of sim -D. Those of a
+ * multicore machine are its totals.
+ * @return false if the output has no count of instructions
+ */
+bool read_counts(const char *output, measurement *result) {
+    const char *line;
+    int cores;
+
+    result->cycles = -1;
+    result->instructions = -1;
+    if ((line = strstr(output, "\nInstructions: ")) != NULL)
+        sscanf(line, "\nInstructions: %lld", &result->instructions);
+    if ((line = strstr(output, "\nCycles: ")) != NULL)
+        sscanf(line, "\nCycles: %lld", &result->cycles);
+    else if ((line = strstr(output, "\nCycles executed (estimated): ")) != NULL)
+        sscanf(line, "\nCycles executed (estimated): %lld", &result->cycles);
+    if ((line = strstr(output, "\nMachine of ")) != NULL)
+        sscanf(line, "\nMachine of %d cores: %lld cycles, %lld instructions", &cores, &result->cycles,
+               &result->instructions);
+    return result->instructions >= 0;
+}
+
+int compare_doubles(const void *a, const void *b) {
+    const double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @return the median of the measured run times
+ */
+double median_seconds(const measurement *result) {
+    double sorted[MAX_REPETITIONS];
+    memcpy(sorted, result->seconds, result->repetitions * sizeof(double));
+    qsort(sorted, result->repetitions, sizeof(double), compare_doubles);
+    const int middle = result->repetitions / 2;
+    return result->repetitions % 2 ? sorted[middle] : (sorted[middle - 1] + sorted[middle]) / 2;
+}
+
+/**
+ * @return the standard deviation of the run times relative to their mean, from their sample variance
+ */
+double spread(const measurement *result) {
+    if (result->repetitions < 2)
+        return 0;
+
+    double mean = 0, variance = 0;
+    for (int i = 0; i < result->repetitions; i++)
+        mean += result->seconds[i] / result->repetitions;
+    for (int i = 0; i < result->repetitions; i++)
+        variance += (result->seconds[i] - mean) * (result->seconds[i] - mean) / (result->repetitions - 1);
+    return sqrt(variance) / mean;
+}
+
+/**
+ * Formats a rate with a metric prefix, e.g. 12.3M.
+ */
+const char *format_rate(char *buffer, double rate) {
+    static const char prefixes[] = " kMGT";
+    int prefix = 0;
+
+    if (rate < 0)
+        return "-";
+    while (rate >= 1000 && prefix < 4) {
+        rate /= 1000;
+        prefix++;
+    }
+    sprintf(buffer, "%.3g%c", rate, prefixes[prefix]);
+    return buffer;
+}
+
+/**
+ * Reads a baseline saved by --save.
+ * @return the number of entries read into entries, or -1 if the file cannot be read
+ */
+int read_baseline(const char *name, baseline_entry *entries, int capacity) {
+    FILE *file = fopen(name, "r");
+    if (file == NULL)
+        return -1;
+
+    int count = 0;
+    while (count < capacity && fscanf(file, "%31s %31s %lf", entries[count].workload, entries[count].mode,
+                                      &entries[count].instructions_per_second) == 3)
+        count++;
+    fclose(file);
+    return count;
+}
+
+/**
+ * @return the baseline throughput of a workload in a mode, or -1 if it has none
+ */
+double baseline_rate(const baseline_entry *entries, int count, const char *workload, const char *mode) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(entries[i].workload, workload) == 0 && strcmp(entries[i].mode, mode) == 0)
+            return entries[i].instructions_per_second;
+    }
+    return -1;
+}
+
+int main(int argc, char **argv) {
+    const char *sim = "./sim";
+    const char *baseline = NULL;
+    const char *save = NULL;
+    int repetitions = DEFAULT_REPETITIONS, warmup = DEFAULT_WARMUP;
+    long scale = DEFAULT_SCALE;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--sim") == 0 && i + 1 < argc) {
+            sim = argv[++i];
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            repetitions = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            warmup = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            scale = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline = argv[++i];
+        } else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc) {
+            save = argv[++i];
+        } else {
+            print_usage();
+            exit(0);
+        }
+    }
+    if (repetitions < 1 || repetitions > MAX_REPETITIONS || warmup < 0 || scale < 1) {
+        print_usage();
+        exit(0);
+    }
+
+    baseline_entry entries[WORKLOADS * MODES];
+    int baseline_count = 0;
+    if (baseline != NULL && (baseline_count = read_baseline(baseline, entries, WORKLOADS * MODES)) < 0)
+        printf("No baseline in %s: save one with --save (make bench-baseline).\n\n", baseline);
+
+    FILE *saved = NULL;
+    if (save != NULL && (saved = fopen(save, "w")) == NULL) {
+        printf("Could not open %s\n", save);
+        exit(1);
+    }
+
+    char directory[] = "/tmp/dlxbench.XXXXXX";
+    if (mkdtemp(directory) == NULL) {
+        printf("Could not create a directory for the workloads\n");
+        exit(1);
+    }
+
+    printf("%d runs of each after %d of warm-up, at scale %ld\n\n", repetitions, warmup, scale);
+    printf("%-8s %-11s %12s %12s %10s %14s %7s %8s\n", "Workload", "Mode", "Cycles", "Instructions", "Cycles/s",
+           "Instructions/s", "Spread", "Baseline");
+
+    int regressions = 0, improvements = 0;
+    for (int w = 0; w < WORKLOADS; w++) {
+        char program[64];
+        snprintf(program, sizeof(program), "%s/%s", directory, workloads[w].name);
+        FILE *file = fopen(program, "w");
+        workloads[w].generate(file, scale);
+        fclose(file);
+
+        for (int m = 0; m < MODES; m++) {
+            measurement result = { .repetitions = repetitions };
+
+            for (int i = -warmup; i < repetitions; i++) {
+                char *output;
+                const double seconds = run_sim(sim, &modes[m], program, &output);
+                if (seconds < 0 || !read_counts(output, &result)) {
+                    printf("%s failed on workload %s in mode %s:\n%s\n", sim, workloads[w].name, modes[m].name,
+                           output);
+                    exit(1);
+                }
+                free(output);
+                if (i >= 0)
+                    result.seconds[i] = seconds;
+            }
+
+            const double seconds = median_seconds(&result);
+            const double cycles_per_second = result.cycles >= 0 ? result.cycles / seconds : -1;
+            const double instructions_per_second = result.instructions / seconds;
+            const double variation = spread(&result);
+            char total[24] = "-", cycles[16], instructions[16], change[16] = "-";
+            if (result.cycles >= 0)
+                snprintf(total, sizeof(total), "%lld", result.cycles);
+
+            const double before = baseline_rate(entries, baseline_count, workloads[w].name, modes[m].name);
+            if (before > 0) {
+                const double ratio = instructions_per_second / before - 1;
+                const bool significant = fabs(ratio) > SIGNIFICANT_CHANGE && fabs(ratio) > 2 * variation;
+                snprintf(change, sizeof(change), "%+.1f%%%s", 100 * ratio, significant ? "!" : "");
+                regressions += significant && ratio < 0;
+                improvements += significant && ratio > 0;
+            }
+
+            printf("%-8s %-11s %12s %12lld %10s %14s %6.1f%% %8s\n", workloads[w].name, modes[m].name,
+                   total, result.instructions, format_rate(cycles, cycles_per_second),
+                   format_rate(instructions, instructions_per_second), 100 * variation, change);
+            fflush(stdout);
+            if (saved != NULL)
+                fprintf(saved, "%s %s %.0f\n", workloads[w].name, modes[m].name, instructions_per_second);
+        }
+        remove(program);
+    }
+    rmdir(directory);
+
+    if (baseline_count > 0)
+        printf("\nAgainst the baseline: %d slower and %d faster beyond the noise (marked !)\n", regressions,
+               improvements);
+    if (saved != NULL) {
+        fclose(saved);
+        printf("\nSaved the baseline to %s\n", save);
+    }
+    return 0;
+}
@@ -0,0 +1,305 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dlxsim.h"
+#include "processor.h"
+#include "functional.h"
+#include "image.h"
+#include "loop.h"
+#include "pipeline.h"
+
+struct dlxsim {
+    dlxsim_config config;
+    predictor_options predictor;
+    cache_options cache;
+    unit_options units;
+
+    cpu_state state;
+    bool loaded;
+    translation_cache *translations;  // of the program loaded, if functional
+    loop_engine *engine;              // of the program loaded, unless exact or functional
+    int fault;                        // the error that stopped the simulation, or DLXSIM_OK
+    char message[ASSEMBLY_MESSAGE_SIZE];
+};
+
+/**
+ * Records the error of a call for dlxsim_message.
+ * @return error
+ */
+static int dlxsim_fail(dlxsim *sim, int error, const char *message) {
+    snprintf(sim->message, sizeof(sim->message), "%s", message);
+    return error;
+}
+
+/**
+ * @return the error of the library for an error a fault was raised with
+ */
+static int dlxsim_fault_error(int error) {
+    switch (error) {
+        case ERROR_ILLEGAL_REG_WRITE:
+            return DLXSIM_ERROR_ILLEGAL_REG_WRITE;
+        case ERROR_ILLEGAL_MEM_ACCESS:
+            return DLXSIM_ERROR_ILLEGAL_MEM_ACCESS;
+        case ERROR_ILLEGAL_JUMP:
+            return DLXSIM_ERROR_ILLEGAL_JUMP;
+        default:
+            return DLXSIM_ERROR_DIVIDE_BY_ZERO;
+    }
+}
+
+/**
+ * Replaces the program of the simulation with an empty processor.
+ */
+static void dlxsim_unload(dlxsim *sim) {
+    if (sim->translations != NULL)
+        translation_cache_destroy(sim->translations);
+    sim->translations = NULL;
+    if (sim->engine != NULL)
+        loop_engine_destroy(sim->engine);
+    sim->engine = NULL;
+    if (sim->loaded)
+        processor_free(&sim->state);
+    sim->loaded = false;
+    sim->fault = DLXSIM_OK;
+    sim->message[0] = '\0';
+}
+
+/**
+ * Loads an assembled program, or the image at path if program is NULL, into a clean
+ * processor set up as by prepare_program.
+ */
+static int dlxsim_start(dlxsim *sim, const struct program *program, const char *path) {
+    cpu_state *state = &sim->state;
+
+    dlxsim_unload(sim);
+    processor_init(state, sim->config.memory_words);
+    sim->loaded = true;
+
+    if (program == NULL && !image_load(state, path)) {
+        dlxsim_unload(sim);
+        return dlxsim_fail(sim, DLXSIM_ERROR_OPEN, "Unable to load image");
+    }
+    if (program != NULL && !program_load(state, program)) {
+        dlxsim_unload(sim);
+        return dlxsim_fail(sim, DLXSIM_ERROR_DATA, "Initialized data does not fit in data memory");
+    }
+
+    predictor_init(&state->predictor, &sim->predictor);
+    cache_init(&state->cache, &sim->cache);
+    scoreboard_init(&state->scoreboard, &sim->units);
+    state->cycles_executed = 0;
+    state->instructions_executed = 0;
+    state->register_file[R0] = 0;
+
+    if (sim->config.functional)
+        sim->translations = translation_cache_create(state->instruction_memory, state->instructions_count);
+    else if (!sim->config.exact)
+        sim->engine = loop_engine_create(state);
+    return DLXSIM_OK;
+}
+
+/**
+ * Simulates the pipeline until the program halts or cycles cycles in total, as simulate_until.
+ * The engine is kept by the simulation, so a fault cannot leak it.
+ * @return true if the program loops forever
+ */
+static bool dlxsim_simulate(dlxsim *sim, long long cycles, int *loop) {
+    if (sim->engine == NULL)
+        return simulate_until(&sim->state, cycles, true, NULL, loop);
+
+    loop_reset(sim->engine);
+    return loop_engine_run(sim->engine, &sim->state, cycles, loop);
+}
+
+/**
+ * Assembles the program read from input and loads it.
+ */
+static int dlxsim_assemble(dlxsim *sim, FILE *input) {
+    struct program program;
+
+    dlxsim_unload(sim);
+    if (AssembleDLX(input, &program, sim->message, sizeof(sim->message)) != 0)
+        return DLXSIM_ERROR_ASSEMBLY;
+
+    const int error = dlxsim_start(sim, &program, NULL);
+    FreeProgram(&program);
+    return error;
+}
+
+int dlxsim_create(const dlxsim_config *config, dlxsim **sim) {
+    static const dlxsim_config defaults = { .memory_words = DEFAULT_WORDS_OF_DATA, .max_cycles = DEFAULT_MAX_CYCLES };
+    if (config == NULL)
+        config = &defaults;
+    if (sim == NULL || config->memory_words > MEMORY_MAX_WORDS || config->max_cycles < 0)
+        return DLXSIM_ERROR_ARGUMENT;
+
+    dlxsim *created = calloc(1, sizeof(dlxsim));
+    created->config = *config;
+    if (created->config.memory_words == 0)
+        created->config.memory_words = DEFAULT_WORDS_OF_DATA;
+    created->predictor = (predictor_options) { PREDICT_NOT_TAKEN, DEFAULT_PREDICTOR_ENTRIES, 0 };
+    units_default(&created->units);
+
+    if ((config->cache != NULL && !cache_parse(config->cache, &created->cache))
+            || (config->units != NULL && !units_parse(config->units, &created->units))) {
+        free(created);
+        return DLXSIM_ERROR_ARGUMENT;
+    }
+
+    // The configuration keeps no pointers to the caller's strings.
+    created->config.cache = NULL;
+    created->config.units = NULL;
+    *sim = created;
+    return DLXSIM_OK;
+}
+
+int dlxsim_load(dlxsim *sim, const char *path) {
+    if (image_probe(path))
+        return dlxsim_start(sim, NULL, path);
+
+    FILE *input = fopen(path, "r");
+    if (input == NULL) {
+        dlxsim_unload(sim);
+        return dlxsim_fail(sim, DLXSIM_ERROR_OPEN, "Unable to open the program for reading");
+    }
+    const int error = dlxsim_assemble(sim, input);
+    fclose(input);
+    return error;
+}
+
+int dlxsim_load_source(dlxsim *sim, const char *source, size_t length) {
+    if (length == 0) {
+        dlxsim_unload(sim);
+        return dlxsim_fail(sim, DLXSIM_ERROR_ASSEMBLY, "The program is empty");
+    }
+
+    FILE *input = fmemopen((void *) source, length, "r");
+    if (input == NULL) {
+        dlxsim_unload(sim);
+        return dlxsim_fail(sim, DLXSIM_ERROR_OPEN, "Unable to read the program");
+    }
+    const int error = dlxsim_assemble(sim, input);
+    fclose(input);
+    return error;
+}
+
+int dlxsim_step(dlxsim *sim, long long count, long long *done) {
+    cpu_state *state = &sim->state;
+    if (!sim->loaded)
+        return DLXSIM_ERROR_NO_PROGRAM;
+    if (count < 0)
+        return DLXSIM_ERROR_ARGUMENT;
+    if (sim->fault != DLXSIM_OK)
+        return sim->fault;
+
+    const long long before = sim->config.functional ? state->instructions_executed : state->cycles_executed;
+    fault_handler handler;
+    fault_enter(&handler);
+    if (setjmp(handler.target) != 0) {
+        sim->fault = dlxsim_fault_error(handler.error);
+        return dlxsim_fail(sim, sim->fault, handler.message);
+    }
+
+    if (state->halt || count == 0) {
+        // Nothing is left to simulate.
+    } else if (sim->config.functional) {
+        functional_execute(state, sim->translations, count);
+    } else {
+        int loop;
+        dlxsim_simulate(sim, state->cycles_executed + count, &loop);
+    }
+    fault_leave(&handler);
+
+    if (done != NULL)
+        *done = (sim->config.functional ? state->instructions_executed : state->cycles_executed) - before;
+    return DLXSIM_OK;
+}
+
+int dlxsim_run(dlxsim *sim) {
+    cpu_state *state = &sim->state;
+    if (!sim->loaded)
+        return DLXSIM_ERROR_NO_PROGRAM;
+    if (sim->fault != DLXSIM_OK)
+        return sim->fault;
+
+    const long long limit = sim->config.max_cycles > 0 ? sim->config.max_cycles : LLONG_MAX;
+    fault_handler handler;
+    fault_enter(&handler);
+    if (setjmp(handler.target) != 0) {
+        sim->fault = dlxsim_fault_error(handler.error);
+        return dlxsim_fail(sim, sim->fault, handler.message);
+    }
+
+    int loop;
+    bool infinite = false;
+    if (state->halt) {
+        // Nothing is left to simulate.
+    } else if (sim->config.functional) {
+        if (limit > state->instructions_executed)
+            functional_execute(state, sim->translations, limit - state->instructions_executed);
+    } else {
+        infinite = dlxsim_simulate(sim, limit, &loop);
+    }
+    fault_leave(&handler);
+
+    if (infinite)
+        return dlxsim_fail(sim, DLXSIM_INFINITE_LOOP, "The program loops forever");
+    if (!state->halt)
+        return dlxsim_fail(sim, DLXSIM_RUNAWAY, "The program ran for the maximum number of cycles");
+    return DLXSIM_OK;
+}
+
+int dlxsim_halted(const dlxsim *sim) {
+    return sim->loaded && sim->state.halt;
+}
+
+int dlxsim_register(const dlxsim *sim, int index, int *value) {
+    if (!sim->loaded)
+        return DLXSIM_ERROR_NO_PROGRAM;
+    if (index < R0 || index > R15)
+        return DLXSIM_ERROR_ARGUMENT;
+    *value = sim->state.register_file[index];
+    return DLXSIM_OK;
+}
+
+int dlxsim_memory(const dlxsim *sim, uint64_t address, int *value) {
+    if (!sim->loaded)
+        return DLXSIM_ERROR_NO_PROGRAM;
+    if (address >= sim->state.data_memory.words)
+        return DLXSIM_ERROR_ARGUMENT;
+    *value = memory_load(&sim->state.data_memory, (int) address);
+    return DLXSIM_OK;
+}
+
+int dlxsim_counts(const dlxsim *sim, long long *cycles, long long *instructions) {
+    if (!sim->loaded)
+        return DLXSIM_ERROR_NO_PROGRAM;
+    if (cycles != NULL)
+        *cycles = sim->state.cycles_executed;
+    if (instructions != NULL)
+        *instructions = sim->state.instructions_executed;
+    return DLXSIM_OK;
+}
+
+const char *dlxsim_message(const dlxsim *sim) {
+    return sim->message;
+}
+
+const char *dlxsim_error_name(int error) {
+    static const char *const names[] = {
+        "ok", "runaway program", "infinite loop", "invalid argument", "no program loaded",
+        "unable to read program", "assembly error", "data does not fit in memory",
+        "attempt to overwrite R0", "out-of-bounds data memory access", "out-of-bounds jump", "division by zero",
+    };
+    if (error < 0 || error >= (int) (sizeof(names) / sizeof(names[0])))
+        return "unknown error";
+    return names[error];
+}
+
+void dlxsim_destroy(dlxsim *sim) {
+    if (sim == NULL)
+        return;
+    dlxsim_unload(sim);
+    free(sim);
+}
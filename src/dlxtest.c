@@ -0,0 +1,650 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "processor.h"
+#include "debug.h"
+#include "batch.h"
+#include "checkpoint.h"
+#include "image.h"
+#include "loop.h"
+#include "pipeline.h"
+
+// Lines of differing output shown for a failed case beyond its registers, memory and counts
+#define DIFF_MAX_LINES 8
+
+// The simulator run by the cases of GOLDEN/sim
+#define SIM_COMMAND "./sim"
+
+// The files the variants of a case write and read back
+#define TEMP_TEMPLATE "/tmp/dlxtest-XXXXXX"
+
+void print_usage() {
+    printf("Usage: dlxtest [-j N] [-v] [PROGRAMS [GOLDEN]]\n\n");
+    printf("Simulates every program of PROGRAMS (default: programs) that has an output of the same\n");
+    printf("name in GOLDEN (default: test) as sim -D does, on N threads (default: one per processor),\n");
+    printf("and compares the outputs, listing the registers, memory words and counts that differ.\n");
+    printf("A program that passes is simulated again in other ways, which must print the same output:\n");
+    printf("from its image, as written by sim -o; restored from a checkpoint taken halfway through its\n");
+    printf("cycles; with a sparse dump of data memory, compared field by field; and with data memory\n");
+    printf("read back from its raw dump, as written by sim --dump-raw.\n");
+    printf("With -v, every case is listed, not only those that fail.\n\n");
+    printf("Each file of GOLDEN/sim is a case of sim itself: a first line \"$ sim ARGS\", then the output\n");
+    printf("expected of %s ARGS, followed by \"status N\" if it exits with N other than 0.\n", SIM_COMMAND);
+}
+
+// One program and the output sim -D is expected to print for it, or a case of GOLDEN/sim
+typedef struct {
+    char *program;
+    char *golden;
+    bool command;  // the golden starts with the arguments of sim, which is run instead
+
+    char *expected, *actual;
+    size_t expected_size, actual_size;
+    bool passed;
+    char *diff;  // the differences found, if not passed
+    size_t diff_size;
+} test_case;
+
+typedef struct {
+    test_case *cases;
+    cpu_state *states;  // one per worker
+} test_suite;
+
+// The output of sim -D taken apart, so that two outputs can be compared field by field
+typedef struct {
+    int registers[16];
+    bool has_registers;
+    long long instructions, cycles;  // -1 if not printed
+
+    // The words of the memory dump, in increasing order of address
+    uint64_t *addresses;
+    int *words;
+    long word_count, word_capacity;
+
+    // Any other lines, such as the report of a runaway program or a fault
+    char **lines;
+    int line_count, line_capacity;
+} test_dump;
+
+/**
+ * Reads the whole of a file.
+ * @return the contents, or NULL if the file cannot be read
+ */
+char *read_file(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+
+    char *contents = NULL;
+    *size = 0;
+    FILE *out = open_memstream(&contents, size);
+    char buffer[4096];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        fwrite(buffer, 1, count, out);
+    fclose(out);
+    fclose(file);
+    return contents;
+}
+
+/**
+ * Assembles a program, or loads it if it is an image, into a processor reset as sim -D
+ * prepares it. Assembler errors are written where sim prints them.
+ * @return false if the program cannot be loaded, with the reason written to out
+ */
+bool load_program(FILE *out, cpu_state *state, const char *path) {
+    static const predictor_options predictor = { PREDICT_NOT_TAKEN, DEFAULT_PREDICTOR_ENTRIES, 0 };
+    static const cache_options cache = {};
+    char message[ASSEMBLY_MESSAGE_SIZE];
+    struct program program;
+    unit_options units;
+
+    processor_reset(state);
+
+    if (image_probe(path)) {
+        if (!image_load(state, path)) {
+            fprintf(out, "Unable to load image %s\n", path);
+            return false;
+        }
+    } else {
+        FILE *input = fopen(path, "r");
+        if (input == NULL) {
+            fprintf(out, "Unable to open %s for reading\n", path);
+            return false;
+        }
+        const int assembled = AssembleDLX(input, &program, message, sizeof(message));
+        fclose(input);
+        if (assembled != 0) {
+            fprintf(out, "%s", message);
+            return false;
+        }
+        const bool loaded = program_load(state, &program);
+        FreeProgram(&program);
+        if (!loaded) {
+            fprintf(out, "Initialized data of %s does not fit in data memory\n", path);
+            return false;
+        }
+    }
+
+    units_default(&units);
+    predictor_init(&state->predictor, &predictor);
+    cache_init(&state->cache, &cache);
+    scoreboard_init(&state->scoreboard, &units);
+    state->cycles_executed = 0;
+    state->instructions_executed = 0;
+    state->register_file[R0] = 0;
+    return true;
+}
+
+/**
+ * Simulates a loaded program until it halts or has run cycles cycles in total, writing an
+ * infinite loop or a runaway program to out as sim does. Faults are written where sim
+ * prints them, instead of ending the process.
+ * @return false if the program faulted
+ */
+bool simulate_program(FILE *out, cpu_state *state, long long cycles) {
+    // The engine is created before the handler, so that a fault cannot leak it.
+    loop_engine *engine = loop_engine_create(state);
+    fault_handler handler;
+    fault_enter(&handler);
+    if (setjmp(handler.target) != 0) {
+        fprintf(out, "%s", handler.message);
+        loop_engine_destroy(engine);
+        return false;
+    }
+
+    int loop;
+    if (loop_engine_run(engine, state, cycles, &loop))
+        fprintf(out, "\n\n *** Infinite loop at instruction %d (Program halted.) ***\n\n", loop);
+    else if (state->cycles_executed > DEFAULT_MAX_CYCLES)
+        fprintf(out, "\n\n *** Runaway program? (Program halted.) ***\n\n");
+    fault_leave(&handler);
+    loop_engine_destroy(engine);
+    return true;
+}
+
+/**
+ * Simulates a loaded program to the end as sim -D does, writing the same output to out.
+ * @param dump how data memory is printed
+ */
+void finish_program(FILE *out, cpu_state *state, int dump) {
+    if (simulate_program(out, state, DEFAULT_MAX_CYCLES + 1))
+        print_debug(out, state, true, dump, NULL);
+}
+
+/**
+ * Simulates a program as sim -D programs/N does, writing the same output to out.
+ */
+void run_program(FILE *out, cpu_state *state, char *path) {
+    if (load_program(out, state, path))
+        finish_program(out, state, DUMP_DENSE);
+}
+
+/**
+ * Creates an empty temporary file, for a variant to write and read back.
+ * @param path output; the path of the file, of TEMP_TEMPLATE's size
+ * @return false if the file cannot be created, with the reason written to out
+ */
+bool temp_create(FILE *out, char *path) {
+    strcpy(path, TEMP_TEMPLATE);
+    const int fd = mkstemp(path);
+    if (fd == -1) {
+        fprintf(out, "Unable to create a temporary file\n");
+        return false;
+    }
+    close(fd);
+    return true;
+}
+
+/**
+ * Assembles a program into an image, and simulates the image as run_program does.
+ */
+void run_image(FILE *out, cpu_state *state, char *path, const char *expected) {
+    char message[ASSEMBLY_MESSAGE_SIZE], image[sizeof(TEMP_TEMPLATE)];
+    struct program program;
+    (void) expected;
+
+    FILE *input = fopen(path, "r");
+    if (input == NULL) {
+        fprintf(out, "Unable to open %s for reading\n", path);
+        return;
+    }
+    const int assembled = AssembleDLX(input, &program, message, sizeof(message));
+    fclose(input);
+    if (assembled != 0) {
+        fprintf(out, "%s", message);
+        return;
+    }
+
+    if (!temp_create(out, image))
+        return;
+    if (image_write(image, &program))
+        run_program(out, state, image);
+    else
+        fprintf(out, "Unable to write image %s\n", image);
+    FreeProgram(&program);
+    unlink(image);
+}
+
+/**
+ * Simulates a program halfway through the cycles of its expected output, writes a
+ * checkpoint there, and restores the checkpoint to simulate the rest, as sim --checkpoint-at
+ * and --restore do. A program expected to stop before printing its cycles is run as is.
+ */
+void run_checkpoint(FILE *out, cpu_state *state, char *path, const char *expected) {
+    const char *cycles = strstr(expected, "\nCycles: ");
+    char checkpoint[sizeof(TEMP_TEMPLATE)];
+    bool functional;
+
+    if (!load_program(out, state, path))
+        return;
+    if (cycles == NULL) {
+        finish_program(out, state, DUMP_DENSE);
+        return;
+    }
+
+    if (!simulate_program(out, state, atoll(cycles + strlen("\nCycles: ")) / 2) || !temp_create(out, checkpoint))
+        return;
+    const bool written = checkpoint_write(state, checkpoint, false);
+    processor_reset(state);
+    if (!written || !checkpoint_read(state, checkpoint, &functional))
+        fprintf(out, "Unable to %s checkpoint %s\n", written ? "restore" : "write", checkpoint);
+    else
+        finish_program(out, state, DUMP_DENSE);
+    unlink(checkpoint);
+}
+
+/**
+ * Simulates a program as run_program does, printing only the rows of data memory that hold
+ * a non-zero word, as sim -D --dump sparse does.
+ */
+void run_sparse(FILE *out, cpu_state *state, char *path, const char *expected) {
+    (void) expected;
+    if (load_program(out, state, path))
+        finish_program(out, state, DUMP_SPARSE);
+}
+
+/**
+ * Simulates a program as run_program does, writes data memory as sim --dump-raw does, and
+ * prints the memory read back from the raw words in its place, which must be the same.
+ */
+void run_raw(FILE *out, cpu_state *state, char *path, const char *expected) {
+    char raw[sizeof(TEMP_TEMPLATE)];
+    (void) expected;
+
+    if (!load_program(out, state, path) || !simulate_program(out, state, DEFAULT_MAX_CYCLES + 1)
+            || !temp_create(out, raw))
+        return;
+    FILE *input = dump_raw(&state->data_memory, raw) ? fopen(raw, "rb") : NULL;
+    if (input == NULL) {
+        fprintf(out, "Unable to write memory dump %s\n", raw);
+        unlink(raw);
+        return;
+    }
+
+    memory_clear(&state->data_memory);
+    int word;
+    for (int address = 0; fread(&word, sizeof(word), 1, input) == 1; address++) {
+        if (word != 0)
+            memory_write(&state->data_memory, address, word);
+    }
+    fclose(input);
+    unlink(raw);
+    print_debug(out, state, true, DUMP_DENSE, NULL);
+}
+
+// The other ways each program is simulated, all expected to print its golden output
+static const struct {
+    const char *name;
+    void (*run)(FILE *out, cpu_state *state, char *path, const char *expected);  // expected: the golden output
+    bool parsed;  // the output is compared field by field, as its layout differs
+} variants[] = {
+    { "from its image (sim -o)", run_image, false },
+    { "from a checkpoint halfway (sim --checkpoint-at and --restore)", run_checkpoint, false },
+    { "with a sparse dump (sim --dump sparse)", run_sparse, true },
+    { "from its raw memory dump (sim --dump-raw)", run_raw, false },
+};
+
+/**
+ * Takes apart an output of sim -D, which must end in a NUL.
+ */
+void dump_parse(test_dump *dump, char *text) {
+    enum { SECTION_NONE, SECTION_REGISTERS, SECTION_MEMORY } section = SECTION_NONE;
+    memset(dump, 0, sizeof(*dump));
+    dump->instructions = dump->cycles = -1;
+
+    for (char *saved, *line = strtok_r(text, "\n", &saved); line != NULL; line = strtok_r(NULL, "\n", &saved)) {
+        int n, index, value;
+        unsigned long long address;
+
+        if (strcmp(line, "Registers:") == 0) {
+            section = SECTION_REGISTERS;
+            dump->has_registers = true;
+        } else if (strcmp(line, "Memory:") == 0) {
+            section = SECTION_MEMORY;
+        } else if (sscanf(line, "Instructions: %lld", &dump->instructions) == 1) {
+            section = SECTION_NONE;
+        } else if (sscanf(line, "Cycles: %lld", &dump->cycles) == 1) {
+            section = SECTION_NONE;
+        } else if (section == SECTION_REGISTERS && sscanf(line, " R%d : %d", &index, &value) == 2) {
+            for (char *at = line; sscanf(at, " R%d : %d%n", &index, &value, &n) == 2; at += n) {
+                if (index >= R0 && index <= R15)
+                    dump->registers[index] = value;
+            }
+        } else if (section == SECTION_MEMORY && sscanf(line, "%llu%n", &address, &n) == 1) {
+            for (char *at = line + n; sscanf(at, " %d%n", &value, &n) == 1; at += n, address++) {
+                if (dump->word_count == dump->word_capacity) {
+                    dump->word_capacity = dump->word_capacity > 0 ? dump->word_capacity * 2 : 1024;
+                    dump->addresses = realloc(dump->addresses, dump->word_capacity * sizeof(uint64_t));
+                    dump->words = realloc(dump->words, dump->word_capacity * sizeof(int));
+                }
+                dump->addresses[dump->word_count] = address;
+                dump->words[dump->word_count++] = value;
+            }
+        } else {
+            section = SECTION_NONE;
+            if (dump->line_count == dump->line_capacity) {
+                dump->line_capacity = dump->line_capacity > 0 ? dump->line_capacity * 2 : 8;
+                dump->lines = realloc(dump->lines, dump->line_capacity * sizeof(char *));
+            }
+            dump->lines[dump->line_count++] = line;
+        }
+    }
+}
+
+void dump_free(test_dump *dump) {
+    free(dump->addresses);
+    free(dump->words);
+    free(dump->lines);
+}
+
+void diff_count(FILE *out, const char *name, long long expected, long long actual) {
+    if (expected == actual)
+        return;
+    if (expected == -1)
+        fprintf(out, "  %s: not expected, got %lld\n", name, actual);
+    else if (actual == -1)
+        fprintf(out, "  %s: expected %lld, got none\n", name, expected);
+    else
+        fprintf(out, "  %s: expected %lld, got %lld\n", name, expected, actual);
+}
+
+/**
+ * Writes what differs between two outputs of sim -D: registers, memory words as if words
+ * missing from a dump were zero, counts, and any other lines.
+ */
+void dump_diff(FILE *out, const test_dump *expected, const test_dump *actual) {
+    if (expected->has_registers != actual->has_registers)
+        fprintf(out, "  registers: %s\n", expected->has_registers ? "expected, got none" : "not expected");
+    for (int i = R0; expected->has_registers && actual->has_registers && i <= R15; i++) {
+        if (expected->registers[i] != actual->registers[i])
+            fprintf(out, "  R%d: expected %d, got %d\n", i, expected->registers[i], actual->registers[i]);
+    }
+
+    long i = 0, j = 0;
+    while (i < expected->word_count || j < actual->word_count) {
+        const uint64_t a = i < expected->word_count ? expected->addresses[i] : UINT64_MAX;
+        const uint64_t b = j < actual->word_count ? actual->addresses[j] : UINT64_MAX;
+        const uint64_t address = a < b ? a : b;
+        const int before = a == address ? expected->words[i++] : 0;
+        const int after = b == address ? actual->words[j++] : 0;
+        if (before != after)
+            fprintf(out, "  memory[%llu]: expected %d, got %d\n", (unsigned long long) address, before, after);
+    }
+
+    diff_count(out, "instructions", expected->instructions, actual->instructions);
+    diff_count(out, "cycles", expected->cycles, actual->cycles);
+
+    int shown = 0;
+    for (int k = 0; k < expected->line_count || k < actual->line_count; k++) {
+        const char *before = k < expected->line_count ? expected->lines[k] : NULL;
+        const char *after = k < actual->line_count ? actual->lines[k] : NULL;
+        if (before != NULL && after != NULL && strcmp(before, after) == 0)
+            continue;
+        if (shown++ == DIFF_MAX_LINES) {
+            fprintf(out, "  ...\n");
+            break;
+        }
+        if (before != NULL)
+            fprintf(out, "  - %s\n", before);
+        if (after != NULL)
+            fprintf(out, "  + %s\n", after);
+    }
+}
+
+/**
+ * @return true if two outputs of sim -D hold the same registers, memory words, counts and
+ * other lines, whatever their layout
+ */
+bool dump_equal(const char *expected, const char *actual) {
+    char *expected_copy = strdup(expected), *actual_copy = strdup(actual), *diff = NULL;
+    size_t diff_size = 0;
+    test_dump expected_dump, actual_dump;
+
+    dump_parse(&expected_dump, expected_copy);
+    dump_parse(&actual_dump, actual_copy);
+    FILE *out = open_memstream(&diff, &diff_size);
+    dump_diff(out, &expected_dump, &actual_dump);
+    fclose(out);
+
+    dump_free(&expected_dump);
+    dump_free(&actual_dump);
+    free(expected_copy);
+    free(actual_copy);
+    free(diff);
+    return diff_size == 0;
+}
+
+/**
+ * Runs sim with the arguments of a case of GOLDEN/sim, writing its output to out, and its
+ * exit status if not 0.
+ */
+void run_command(FILE *out, const char *arguments) {
+    char *command = malloc(strlen(SIM_COMMAND) + strlen(arguments) + 2);
+    sprintf(command, "%s %s", SIM_COMMAND, arguments);
+
+    FILE *sim = popen(command, "r");
+    free(command);
+    if (sim == NULL) {
+        fprintf(out, "Unable to run %s\n", SIM_COMMAND);
+        return;
+    }
+    char buffer[4096];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), sim)) > 0)
+        fwrite(buffer, 1, count, out);
+
+    const int status = pclose(sim);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        fprintf(out, "status %d\n", WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+}
+
+/**
+ * Writes the lines that differ between two outputs, which must end in a NUL, up to
+ * DIFF_MAX_LINES of them.
+ */
+void text_diff(FILE *out, char *expected, char *actual) {
+    char *saved_expected, *saved_actual;
+    char *before = strtok_r(expected, "\n", &saved_expected);
+    char *after = strtok_r(actual, "\n", &saved_actual);
+    int shown = 0;
+
+    for (int line = 1; before != NULL || after != NULL; line++) {
+        if (before == NULL || after == NULL || strcmp(before, after) != 0) {
+            if (shown++ == DIFF_MAX_LINES) {
+                fprintf(out, "  ...\n");
+                break;
+            }
+            fprintf(out, "  line %d:\n", line);
+            if (before != NULL)
+                fprintf(out, "  - %s\n", before);
+            if (after != NULL)
+                fprintf(out, "  + %s\n", after);
+        }
+        if (before != NULL)
+            before = strtok_r(NULL, "\n", &saved_expected);
+        if (after != NULL)
+            after = strtok_r(NULL, "\n", &saved_actual);
+    }
+}
+
+void run_case(void *context, int job, int worker) {
+    test_suite *suite = context;
+    test_case *test = &suite->cases[job];
+
+    test->expected = read_file(test->golden, &test->expected_size);
+
+    // A case of sim is expected to print what follows its first line.
+    char *expected = test->expected;
+    size_t expected_size = test->expected_size;
+    const char *arguments = NULL;
+    if (test->command && expected != NULL && strncmp(expected, "$ sim ", 6) == 0 && strchr(expected, '\n') != NULL) {
+        arguments = expected + 6;
+        expected = strchr(expected, '\n');
+        *expected++ = '\0';
+        expected_size -= expected - test->expected;
+    }
+
+    FILE *out = open_memstream(&test->actual, &test->actual_size);
+    if (arguments != NULL)
+        run_command(out, arguments);
+    else if (!test->command)
+        run_program(out, &suite->states[worker], test->program);
+    fclose(out);
+
+    test->passed = expected != NULL && (arguments != NULL || !test->command) && expected_size == test->actual_size
+            && memcmp(expected, test->actual, test->actual_size) == 0;
+
+    // A program that passes is simulated again in every variant, until one differs.
+    const char *variant = NULL;
+    for (size_t i = 0; test->passed && !test->command && i < sizeof(variants) / sizeof(variants[0]); i++) {
+        free(test->actual);
+        out = open_memstream(&test->actual, &test->actual_size);
+        variants[i].run(out, &suite->states[worker], test->program, expected);
+        fclose(out);
+
+        variant = variants[i].name;
+        if (variants[i].parsed)
+            test->passed = dump_equal(expected, test->actual);
+        else
+            test->passed = expected_size == test->actual_size && memcmp(expected, test->actual, test->actual_size) == 0;
+    }
+    if (test->passed)
+        return;
+
+    out = open_memstream(&test->diff, &test->diff_size);
+    if (variant != NULL)
+        fprintf(out, "  simulated %s:\n", variant);
+    if (test->expected == NULL) {
+        fprintf(out, "  unable to read %s\n", test->golden);
+    } else if (test->command && arguments == NULL) {
+        fprintf(out, "  %s does not start with a line \"$ sim ARGS\"\n", test->golden);
+    } else if (test->command) {
+        text_diff(out, expected, test->actual);
+    } else {
+        test_dump expected, actual;
+        dump_parse(&expected, test->expected);
+        dump_parse(&actual, test->actual);
+        dump_diff(out, &expected, &actual);
+        dump_free(&expected);
+        dump_free(&actual);
+    }
+
+    // Outputs alike in every field differ in their layout.
+    fflush(out);
+    if (test->diff_size == 0)
+        fprintf(out, "  the output differs only in its formatting\n");
+    fclose(out);
+}
+
+int main(int argc, char **argv) {
+    const char *programs = "programs", *goldens = "test";
+    int workers = 0, directories = 0;
+    bool verbose = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            workers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-v") == 0) {
+            verbose = true;
+        } else if (argv[i][0] != '-' && directories < 2) {
+            if (directories++ == 0)
+                programs = argv[i];
+            else
+                goldens = argv[i];
+        } else {
+            print_usage();
+            exit(0);
+        }
+    }
+    if (workers <= 0)
+        workers = work_pool_default_workers();
+
+    int count;
+    char **files = batch_collect_files(goldens, &count);
+    if (files == NULL) {
+        printf("Unable to read %s\n", goldens);
+        return 1;
+    }
+
+    // A case is a golden output with a program of the same name.
+    test_case *cases = calloc(count > 0 ? count : 1, sizeof(test_case));
+    int found = 0;
+    for (int i = 0; i < count; i++) {
+        const char *name = strrchr(files[i], '/') + 1;
+        char *program = malloc(strlen(programs) + strlen(name) + 2);
+        sprintf(program, "%s/%s", programs, name);
+        if (access(program, R_OK) != 0) {
+            free(program);
+            free(files[i]);
+            continue;
+        }
+        cases[found].program = program;
+        cases[found++].golden = files[i];
+    }
+    free(files);
+
+    // Every file of GOLDEN/sim is a case of sim itself.
+    char *commands = malloc(strlen(goldens) + 5);
+    sprintf(commands, "%s/sim", goldens);
+    files = access(commands, R_OK) == 0 ? batch_collect_files(commands, &count) : NULL;
+    if (files != NULL) {
+        cases = realloc(cases, (found + count > 0 ? found + count : 1) * sizeof(test_case));
+        for (int i = 0; i < count; i++)
+            cases[found++] = (test_case) { .program = strdup(files[i]), .golden = files[i], .command = true };
+        free(files);
+    }
+    free(commands);
+
+    test_suite suite = { cases, malloc(workers * sizeof(cpu_state)) };
+    for (int i = 0; i < workers; i++)
+        processor_init(&suite.states[i], DEFAULT_WORDS_OF_DATA);
+    work_pool_run(found, workers, run_case, &suite);
+
+    int failed = 0;
+    for (int i = 0; i < found; i++) {
+        test_case *test = &cases[i];
+        if (!test->passed) {
+            failed++;
+            printf("FAIL %s\n", test->program);
+            fwrite(test->diff, 1, test->diff_size, stdout);
+        } else if (verbose) {
+            printf("ok   %s\n", test->program);
+        }
+        free(test->program);
+        free(test->golden);
+        free(test->expected);
+        free(test->actual);
+        free(test->diff);
+    }
+    printf("%d of %d cases passed\n", found - failed, found);
+
+    for (int i = 0; i < workers; i++)
+        processor_free(&suite.states[i]);
+    free(suite.states);
+    free(cases);
+    return failed > 0 || found == 0 ? 1 : 0;
+}
@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "trace.h"
+#include "debug.h"
+
+// The default number of cycles in a diagram
+#define DIAGRAM_CYCLES 32
+
+// Width of the column naming the instructions of a diagram
+#define DIAGRAM_LABEL 28
+
+void print_usage() {
+    printf("Usage: dlxtrace FILE [FIRST [CYCLES]]\n\n");
+    printf("Prints the pipeline diagram of CYCLES cycles (default: %d) of a trace written by\n", DIAGRAM_CYCLES);
+    printf("sim --trace, starting at cycle FIRST (default: the first cycle traced), followed by\n");
+    printf("totals over the whole trace.\n");
+}
+
+/**
+ * @return the name of the stage fetch id was in during a cycle, or NULL
+ */
+const char *diagram_stage(const trace_cycle_record *record, long long id) {
+    if (record->fetch.id == id)
+        return "IF";
+    if (record->decode.id == id)
+        return "ID";
+    if ((record->events & EVENT_STALL) && record->latches[0].id == id)
+        return "st";
+    if ((record->events & EVENT_MEMORY_WAIT) && (record->latches[0].id == id || record->latches[1].id == id))
+        return "st";
+    for (int i = 0; i < record->unit_count; i++) {
+        if (record->units[i].id == id)
+            return record->events & EVENT_MEMORY_WAIT ? "st" : "EX";
+    }
+    if (record->execute.id == id)
+        return "EX";
+    if (record->memory.id == id)
+        return "MEM";
+    if (record->writeback.id == id)
+        return "WB";
+    return NULL;
+}
+
+/**
+ * Prints one row of events below a diagram, with a mark in the cycles the event happened.
+ */
+void diagram_events(const trace_cycle_record *records, int count, const char *name, int event) {
+    printf("%-*s", DIAGRAM_LABEL, name);
+    for (int i = 0; i < count; i++)
+        printf("%-5s", records[i].events & event ? "*" : "");
+    printf("\n");
+}
+
+/**
+ * Prints the forwarding of each cycle: operand a or b of the execute stage from the
+ * memory (M) or writeback (W) stage, and branch operands forwarded to decode (br).
+ */
+void diagram_forwarding(const trace_cycle_record *records, int count) {
+    static const char sources[] = { 0, 'M', 'W', '?' };
+
+    printf("%-*s", DIAGRAM_LABEL, "forward");
+    for (int i = 0; i < count; i++) {
+        char cell[8] = "";
+        int length = 0;
+        const int a = records[i].events >> EVENT_FORWARD_A_SHIFT & 3;
+        const int b = records[i].events >> EVENT_FORWARD_B_SHIFT & 3;
+
+        if (a) {
+            cell[length++] = 'a';
+            cell[length++] = sources[a];
+        }
+        if (b) {
+            cell[length++] = 'b';
+            cell[length++] = sources[b];
+        }
+        if ((records[i].events & EVENT_FORWARD_BRANCH) && length == 0) {
+            cell[length++] = 'b';
+            cell[length++] = 'r';
+        }
+        cell[length] = '\0';
+        printf("%-5s", cell);
+    }
+    printf("\n");
+}
+
+void print_diagram(const trace_reader *reader, const trace_cycle_record *records, int count) {
+    long long first = -1, last = -1;
+    for (int i = 0; i < count; i++) {
+        const trace_slot slots[] = { records[i].fetch, records[i].decode, records[i].latches[0],
+                                     records[i].execute, records[i].memory, records[i].writeback };
+        for (int j = 0; j < 6; j++) {
+            if (slots[j].id == -1)
+                continue;
+            if (first == -1 || slots[j].id < first)
+                first = slots[j].id;
+            if (slots[j].id > last)
+                last = slots[j].id;
+        }
+    }
+
+    printf("%-*s", DIAGRAM_LABEL, "cycle");
+    for (int i = 0; i < count; i++)
+        printf("%-5lld", records[i].cycle);
+    printf("\n");
+
+    for (long long id = first; id != -1 && id <= last; id++) {
+        int pc = -1;
+        for (int i = 0; i < count && pc == -1; i++) {
+            const trace_slot slots[] = { records[i].fetch, records[i].latches[0], records[i].latches[1],
+                                         records[i].latches[2], records[i].latches[3], records[i].writeback };
+            for (int j = 0; j < 6; j++) {
+                if (slots[j].id == id)
+                    pc = slots[j].pc;
+            }
+        }
+
+        int width = printf("%5d  ", pc);
+        if (pc >= 0 && (uint32_t) pc < reader->header.instructions)
+            width += print_instruction(stdout, &reader->program[pc], pc);
+        printf("%*s", width < DIAGRAM_LABEL ? DIAGRAM_LABEL - width : 1, "");
+
+        for (int i = 0; i < count; i++) {
+            const char *stage = diagram_stage(&records[i], id);
+            printf("%-5s", stage == NULL ? "" : stage);
+        }
+        printf("\n");
+    }
+
+    printf("\n");
+    diagram_events(records, count, "stall", EVENT_STALL);
+    diagram_events(records, count, "flush", EVENT_FLUSH);
+    diagram_events(records, count, "memory wait", EVENT_MEMORY_WAIT);
+    diagram_forwarding(records, count);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2 || argc > 4) {
+        print_usage();
+        return 1;
+    }
+
+    trace_reader reader;
+    if (!trace_read_open(&reader, argv[1])) {
+        printf("Unable to read trace %s\n", argv[1]);
+        return 1;
+    }
+
+    const long long first = argc > 2 ? strtoll(argv[2], NULL, 10) : reader.header.first_cycle + 1;
+    const int cycles = argc > 3 ? atoi(argv[3]) : DIAGRAM_CYCLES;
+    if (cycles <= 0) {
+        print_usage();
+        return 1;
+    }
+
+    trace_cycle_record *records = malloc(cycles * sizeof(*records));
+    trace_cycle_record record;
+    int count = 0;
+    long long traced = 0, stalls = 0, flushes = 0, forwards = 0, waits = 0;
+    const int forwarding = 3 << EVENT_FORWARD_A_SHIFT | 3 << EVENT_FORWARD_B_SHIFT | EVENT_FORWARD_BRANCH;
+
+    while (trace_read_cycle(&reader, &record)) {
+        if (record.cycle >= first && count < cycles)
+            records[count++] = record;
+
+        traced++;
+        stalls += (record.events & EVENT_STALL) != 0;
+        flushes += (record.events & EVENT_FLUSH) != 0;
+        waits += (record.events & EVENT_MEMORY_WAIT) != 0;
+        forwards += (record.events & forwarding) != 0;
+    }
+
+    if (count > 0)
+        print_diagram(&reader, records, count);
+    else
+        printf("No cycles traced from cycle %lld\n", first);
+
+    printf("\nCycles traced: %lld (from cycle %lld)\n", traced, (long long) reader.header.first_cycle + 1);
+    printf("Instructions fetched: %lld\n", reader.fetches - (reader.header.fetched != -1));
+    printf("Stall cycles: %lld\n", stalls);
+    printf("Flushes: %lld\n", flushes);
+    printf("Memory wait cycles: %lld\n", waits);
+    printf("Cycles forwarding: %lld\n", forwards);
+
+    free(records);
+    trace_read_close(&reader);
+    return 0;
+}
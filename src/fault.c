@@ -0,0 +1,40 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "fault.h"
+
+// The handler the faults of this thread return to, or NULL
+static __thread fault_handler *fault_current;
+
+void fault_enter(fault_handler *handler) {
+    handler->error = 0;
+    handler->message[0] = '\0';
+    handler->previous = fault_current;
+    fault_current = handler;
+}
+
+void fault_leave(fault_handler *handler) {
+    fault_current = handler->previous;
+}
+
+__attribute__((noreturn)) void fault_raise(int error, const char *format, ...) {
+    va_list arguments;
+    va_start(arguments, format);
+
+    fault_handler *handler = fault_current;
+    if (handler == NULL) {
+        vprintf(format, arguments);
+        va_end(arguments);
+        exit(error);
+    }
+
+    vsnprintf(handler->message, sizeof(handler->message), format, arguments);
+    va_end(arguments);
+    handler->error = error;
+    fault_current = handler->previous;
+    longjmp(handler->target, 1);
+}
+
+__attribute__((noreturn)) void fault_forward(const fault_handler *handler) {
+    fault_raise(handler->error, "%s", handler->message);
+}
@@ -0,0 +1,291 @@
+#include <limits.h>
+#include <stdlib.h>
+#include "functional.h"
+
+/**
+ * Executes the single instruction at pc without modelling the pipeline. Errors are reported
+ * exactly as the pipeline reports them.
+ * @param state the processor state, with a predecoded program loaded
+ * @param pc the instruction to execute, within the program
+ * @return the pc of the next instruction to execute
+ */
+static int functional_step(cpu_state *state, int pc) {
+    const struct instruction inst = state->instruction_memory[pc];
+    int *regs = state->register_file;
+
+    if (inst.flags & (INST_BRANCH | INST_JUMP)) {
+        const bool taken = (inst.flags & INST_JUMP) || (regs[inst.rs] == 0) == (inst.branch == BRANCH_EQZ);
+        const int target = pc + 1 + inst.imm;
+
+        if (!taken)
+            return pc + 1;
+
+        if (target < 0 || target > state->instructions_count - 1) {
+            fault_raise(ERROR_ILLEGAL_JUMP, "out-of-bounds should_jump to %d\n", target);
+        }
+        return target;
+    }
+
+    const int a = regs[inst.rs];
+    const int b = (inst.flags & INST_IMMEDIATE) ? inst.imm : regs[inst.rt];
+    int result = processor_alu(inst.alu, a, b);
+
+    if (inst.flags & INST_MEMORY) {
+        if (!memory_in_bounds(&state->data_memory, result)) {
+            fault_raise(ERROR_ILLEGAL_MEM_ACCESS, "Exception: out-of-bounds data memory access at %d\n", result);
+        }
+
+        if ((inst.flags & INST_STORE) && (inst.flags & INST_ATOMIC)) {
+            result = processor_store_conditional(state, result, regs[inst.rt]);
+        } else if (inst.flags & INST_STORE) {
+            memory_store(&state->data_memory, result, regs[inst.rt]);
+        } else {
+            if (inst.flags & INST_ATOMIC)
+                processor_load_linked(state, result);
+            result = memory_load(&state->data_memory, result);
+        }
+    }
+
+    if (inst.flags & INST_WRITES) {
+        if (inst.dest == R0) {
+            fault_raise(ERROR_ILLEGAL_REG_WRITE, "Exception: Attempt to overwrite R0\n");
+        }
+        regs[inst.dest] = result;
+    }
+
+    return pc + 1;
+}
+
+// Dispatch through the handler addresses stored in the translated ops when the
+// compiler supports computed gotos, falling back to a switch otherwise.
+#ifdef __GNUC__
+#define FUNCTIONAL_DISPATCH() goto *op->handler
+#else
+#define FUNCTIONAL_DISPATCH() goto dispatch
+#endif
+
+long long functional_execute(cpu_state *state, translation_cache *cache, long long max_instructions) {
+#ifdef __GNUC__
+    static const void *const handlers[T_KINDS] = {
+        [T_ADDI] = &&t_addi, [T_LOADI] = &&t_loadi, [T_ADD] = &&t_add, [T_SUB] = &&t_sub,
+        [T_ALU] = &&t_alu, [T_LW] = &&t_lw, [T_SW] = &&t_sw, [T_LL] = &&t_ll, [T_SC] = &&t_sc, [T_NOP] = &&t_nop, [T_ILLEGAL_WRITE] = &&t_illegal_write,
+        [T_BRANCH] = &&t_branch, [T_ADDI_BRANCH] = &&t_addi_branch, [T_ADD_BRANCH] = &&t_add_branch,
+        [T_SUB_BRANCH] = &&t_sub_branch, [T_JUMP] = &&t_jump, [T_ADDI_JUMP] = &&t_addi_jump,
+        [T_FALLTHROUGH] = &&t_fallthrough,
+    };
+#endif
+
+    int *regs = state->register_file;
+    data_memory *mem = &state->data_memory;
+    const int count = cache->count;
+
+    int pc = state->fetch_buffer.pc;
+    long long retired = 0;
+    int address = 0;
+    bool taken = false;
+
+    translated_block *block = NULL;
+    translated_block *next = NULL;
+    const translated_op *op = NULL;
+
+    if (pc >= count)
+        goto done;
+
+    next = translation_lookup(cache, pc);
+    goto bind;
+
+enter:
+    // Blocks only run whole, so a budget ending inside one is finished an instruction at a time.
+    if (block->end_pc - block->start_pc > max_instructions - retired)
+        goto single_step;
+
+    retired += block->end_pc - block->start_pc;
+    op = block->ops;
+    FUNCTIONAL_DISPATCH();
+
+#ifndef __GNUC__
+dispatch:
+    switch (op->kind) {
+        case T_ADDI:          goto t_addi;
+        case T_LOADI:         goto t_loadi;
+        case T_ADD:           goto t_add;
+        case T_SUB:           goto t_sub;
+        case T_ALU:           goto t_alu;
+        case T_LW:            goto t_lw;
+        case T_SW:            goto t_sw;
+        case T_LL:            goto t_ll;
+        case T_SC:            goto t_sc;
+        case T_NOP:           goto t_nop;
+        case T_ILLEGAL_WRITE: goto t_illegal_write;
+        case T_BRANCH:        goto t_branch;
+        case T_ADDI_BRANCH:   goto t_addi_branch;
+        case T_ADD_BRANCH:    goto t_add_branch;
+        case T_SUB_BRANCH:    goto t_sub_branch;
+        case T_JUMP:          goto t_jump;
+        case T_ADDI_JUMP:     goto t_addi_jump;
+        default:              goto t_fallthrough;
+    }
+#endif
+
+t_addi:
+    regs[op->dest] = processor_alu(PLUS, regs[op->src1], op->imm);
+    op++;
+    FUNCTIONAL_DISPATCH();
+
+t_loadi:
+    regs[op->dest] = op->imm;
+    op++;
+    FUNCTIONAL_DISPATCH();
+
+t_add:
+    regs[op->dest] = processor_alu(PLUS, regs[op->src1], regs[op->src2]);
+    op++;
+    FUNCTIONAL_DISPATCH();
+
+t_sub:
+    regs[op->dest] = processor_alu(MINUS, regs[op->src1], regs[op->src2]);
+    op++;
+    FUNCTIONAL_DISPATCH();
+
+t_alu:
+    regs[op->dest] = processor_alu(op->alu, regs[op->src1], regs[op->src2]);
+    op++;
+    FUNCTIONAL_DISPATCH();
+
+t_lw:
+    address = processor_alu(PLUS, regs[op->src1], op->imm);
+    if (!memory_in_bounds(mem, address)) goto illegal_access;
+    regs[op->dest] = memory_load(mem, address);
+    op++;
+    FUNCTIONAL_DISPATCH();
+
+t_sw:
+    address = processor_alu(PLUS, regs[op->src1], op->imm);
+    if (!memory_in_bounds(mem, address)) goto illegal_access;
+    memory_store(mem, address, regs[op->src2]);
+    op++;
+    FUNCTIONAL_DISPATCH();
+
+t_ll:
+    address = processor_alu(PLUS, regs[op->src1], op->imm);
+    if (!memory_in_bounds(mem, address)) goto illegal_access;
+    processor_load_linked(state, address);
+    regs[op->dest] = memory_load(mem, address);
+    op++;
+    FUNCTIONAL_DISPATCH();
+
+t_sc:
+    address = processor_alu(PLUS, regs[op->src1], op->imm);
+    if (!memory_in_bounds(mem, address)) goto illegal_access;
+    regs[op->dest] = processor_store_conditional(state, address, regs[op->src2]);
+    op++;
+    FUNCTIONAL_DISPATCH();
+
+t_nop:
+    op++;
+    FUNCTIONAL_DISPATCH();
+
+t_illegal_write:
+    fault_raise(ERROR_ILLEGAL_REG_WRITE, "Exception: Attempt to overwrite R0\n");
+
+t_addi_branch:
+    regs[op->dest] = processor_alu(PLUS, regs[op->src1], op->imm);
+    goto t_branch;
+
+t_add_branch:
+    regs[op->dest] = processor_alu(PLUS, regs[op->src1], regs[op->src2]);
+    goto t_branch;
+
+t_sub_branch:
+    regs[op->dest] = processor_alu(MINUS, regs[op->src1], regs[op->src2]);
+
+t_branch:
+    taken = (regs[op->test] == 0) == op->if_zero;
+    goto leave;
+
+t_addi_jump:
+    regs[op->dest] = processor_alu(PLUS, regs[op->src1], op->imm);
+
+t_jump:
+    taken = true;
+    goto leave;
+
+t_fallthrough:
+    taken = false;
+
+leave:
+    // Follow the chained successor, resolving and chaining it on first use.
+    if (taken) {
+        next = block->taken;
+        if (next != NULL) {
+            block = next;
+            goto enter;
+        }
+
+        if (block->target < 0 || block->target > count - 1) {
+            fault_raise(ERROR_ILLEGAL_JUMP, "out-of-bounds should_jump to %d\n", block->target);
+        }
+        next = block->taken = translation_lookup(cache, block->target);
+    } else {
+        next = block->fallthrough;
+        if (next != NULL) {
+            block = next;
+            goto enter;
+        }
+
+        if (block->end_pc == count) {
+            pc = count;
+            goto done;
+        }
+        next = block->fallthrough = translation_lookup(cache, block->end_pc);
+    }
+
+bind:
+#ifdef __GNUC__
+    if (next->ops[0].handler == NULL) {
+        for (int i = 0; i < next->ops_count; i++)
+            next->ops[i].handler = handlers[next->ops[i].kind];
+    }
+#endif
+    block = next;
+    goto enter;
+
+illegal_access:
+    fault_raise(ERROR_ILLEGAL_MEM_ACCESS, "Exception: out-of-bounds data memory access at %d\n", address);
+
+single_step:
+    pc = block->start_pc;
+    while (retired < max_instructions && pc < count) {
+        pc = functional_step(state, pc);
+        retired++;
+    }
+    if (pc < count)
+        goto out;
+
+done:
+    state->halt = true;
+
+out:
+    state->fetch_buffer.pc = pc;
+    state->instructions_executed += retired;
+    return retired;
+}
+
+void functional_run(cpu_state *state, FILE *out, long long max_instructions) {
+    translation_cache *cache = translation_cache_create(state->instruction_memory, state->instructions_count);
+    fault_handler handler;
+    fault_enter(&handler);
+    if (setjmp(handler.target) != 0) {
+        translation_cache_destroy(cache);
+        fault_forward(&handler);
+    }
+
+    functional_execute(state, cache, max_instructions > 0 ? max_instructions : LLONG_MAX);
+    fault_leave(&handler);
+    if (!state->halt) {
+        fprintf(out, "\n\n *** Runaway program? (Program halted.) ***\n\n");
+        state->halt = true;
+    }
+
+    translation_cache_destroy(cache);
+}
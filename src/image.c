@@ -0,0 +1,250 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "image.h"
+
+bool image_probe(const char *path) {
+    char magic[sizeof(((image_header *) NULL)->magic)];
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return false;
+
+    const bool image = fread(magic, sizeof(magic), 1, file) == 1 && memcmp(magic, IMAGE_MAGIC, sizeof(magic)) == 0;
+    fclose(file);
+    return image;
+}
+
+/**
+ * Stores the initialized data of an assembled program into data memory.
+ * @return false if the data does not fit in data memory
+ */
+static bool program_load_data(cpu_state *state, const struct program *program) {
+    for (int i = 0; i < program->segment_count; i++) {
+        const struct data_segment *segment = &program->segments[i];
+        if ((uint64_t) segment->address + segment->length > state->data_memory.words)
+            return false;
+
+        for (int j = 0; j < segment->length; j++)
+            memory_store(&state->data_memory, (int) (segment->address + j), segment->words[j]);
+    }
+    return true;
+}
+
+bool program_load(cpu_state *state, const struct program *program) {
+    struct instruction *code = malloc(program->code_length * sizeof(*code) + 1);
+    memcpy(code, program->code, program->code_length * sizeof(*code));
+    processor_load_program(state, code, program->code_length);
+
+    return program_load_data(state, program);
+}
+
+bool image_write(const char *path, const struct program *program) {
+    image_header header = {};
+    memcpy(header.magic, IMAGE_MAGIC, sizeof(header.magic));
+    header.version = IMAGE_VERSION;
+    header.instructions = program->code_length;
+
+    // Lay the data out in pages, as it will be in data memory.
+    data_memory data;
+    memory_init(&data, MEMORY_MAX_WORDS);
+    for (int i = 0; i < program->segment_count; i++) {
+        const struct data_segment *segment = &program->segments[i];
+        for (int j = 0; j < segment->length; j++)
+            memory_store(&data, (int) (segment->address + j), segment->words[j]);
+
+        if ((uint64_t) segment->address + segment->length > header.data_words)
+            header.data_words = (uint64_t) segment->address + segment->length;
+    }
+    header.pages = data.pages;
+
+    header.instructions_offset = sizeof(header);
+    header.page_numbers_offset = header.instructions_offset + header.instructions * sizeof(image_instruction);
+    header.pages_offset = header.pages == 0 ? header.page_numbers_offset
+            : (header.page_numbers_offset + header.pages * sizeof(uint32_t) + IMAGE_ALIGNMENT - 1)
+              / IMAGE_ALIGNMENT * IMAGE_ALIGNMENT;
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        memory_free(&data);
+        return false;
+    }
+
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    for (int i = 0; i < program->code_length; i++) {
+        const struct instruction *inst = &program->code[i];
+        const image_instruction packed = { inst->op, inst->rd, inst->rs, inst->rt, inst->imm };
+        written &= fwrite(&packed, sizeof(packed), 1, file) == 1;
+    }
+
+    const uint32_t last_page = MEMORY_MAX_WORDS / MEMORY_PAGE_WORDS;
+    for (uint32_t page = memory_next_page(&data, 0); page < last_page; page = memory_next_page(&data, page + 1ULL))
+        written &= fwrite(&page, sizeof(page), 1, file) == 1;
+    const char padding[IMAGE_ALIGNMENT] = {};
+    const size_t padding_size = header.pages_offset - header.page_numbers_offset - header.pages * sizeof(uint32_t);
+    written &= fwrite(padding, 1, padding_size, file) == padding_size;
+
+    for (uint32_t page = memory_next_page(&data, 0); page < last_page; page = memory_next_page(&data, page + 1ULL))
+        written &= fwrite(memory_page(&data, page), IMAGE_ALIGNMENT, 1, file) == 1;
+
+    written &= fclose(file) == 0;
+    memory_free(&data);
+    return written;
+}
+
+/**
+ * @return true if the section [offset, offset + size) lies within a file of file_size bytes
+ */
+static bool image_section_valid(uint64_t offset, uint64_t size, uint64_t file_size) {
+    return offset <= file_size && size <= file_size - offset;
+}
+
+/**
+ * @return true if an instruction has an opcode the assembler produces, and a real register
+ * for every operand its opcode reads or writes. Operands it does not use may be NOT_USED.
+ */
+static bool image_instruction_valid(const image_instruction *inst) {
+    int used;  // bits 0, 1 and 2 for rd, rs and rt
+    switch (inst->op) {
+        case ADD: case SUB: case MULT: case DIV: case AND: case OR: case XOR: case SLL: case SRL: case SLT:
+            used = 7;
+            break;
+        case ADDI: case SUBI: case LW: case SW: case LL: case SC:
+            used = 6;
+            break;
+        case BEQZ: case BNEZ:
+            used = 2;
+            break;
+        case J:
+            used = 0;
+            break;
+        default:
+            return false;
+    }
+
+    const int32_t tags[] = { inst->rd, inst->rs, inst->rt };
+    for (int i = 0; i < 3; i++) {
+        if (tags[i] < (used & 1 << i ? R0 : NOT_USED) || tags[i] > R15)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Checks that size bytes at base hold an image whose data fits in words words, and whose
+ * sections and instructions can be used as they are.
+ */
+static bool image_valid(const char *base, size_t size, uint64_t words) {
+    if (size < sizeof(image_header))
+        return false;
+
+    const image_header *header = (const image_header *) base;
+    bool valid = memcmp(header->magic, IMAGE_MAGIC, sizeof(header->magic)) == 0
+            && header->version == IMAGE_VERSION
+            && header->instructions <= INT32_MAX
+            && header->data_words <= words
+            && header->instructions_offset % sizeof(int32_t) == 0
+            && header->page_numbers_offset % sizeof(uint32_t) == 0
+            && (header->pages == 0 || header->pages_offset % IMAGE_ALIGNMENT == 0)
+            && image_section_valid(header->instructions_offset,
+                                   (uint64_t) header->instructions * sizeof(image_instruction), size)
+            && image_section_valid(header->page_numbers_offset, (uint64_t) header->pages * sizeof(uint32_t), size)
+            && image_section_valid(header->pages_offset, (uint64_t) header->pages * IMAGE_ALIGNMENT, size);
+
+    const image_instruction *packed = (const image_instruction *) (base + header->instructions_offset);
+    const uint32_t *page_numbers = (const uint32_t *) (base + header->page_numbers_offset);
+
+    // Opcodes select the work of every stage, and register tags index the register file, so
+    // they are checked before anything runs.
+    for (uint32_t i = 0; valid && i < header->instructions; i++)
+        valid = image_instruction_valid(&packed[i]);
+    for (uint32_t i = 0; valid && i < header->pages; i++) {
+        valid = page_numbers[i] < MEMORY_MAX_WORDS / MEMORY_PAGE_WORDS
+                && (i == 0 || page_numbers[i] > page_numbers[i - 1]);
+    }
+    return valid;
+}
+
+bool image_read_program(const char *base, size_t size, uint64_t words, struct program *program) {
+    memset(program, 0, sizeof(*program));
+    if (!image_valid(base, size, words))
+        return false;
+
+    const image_header *header = (const image_header *) base;
+    const image_instruction *packed = (const image_instruction *) (base + header->instructions_offset);
+    const uint32_t *page_numbers = (const uint32_t *) (base + header->page_numbers_offset);
+    const int32_t *data = (const int32_t *) (base + header->pages_offset);
+
+    program->code = calloc(header->instructions + 1, sizeof(struct instruction));
+    program->code_length = (int) header->instructions;
+    for (uint32_t i = 0; i < header->instructions; i++) {
+        program->code[i].op = packed[i].op;
+        program->code[i].rd = packed[i].rd;
+        program->code[i].rs = packed[i].rs;
+        program->code[i].rt = packed[i].rt;
+        program->code[i].imm = packed[i].imm;
+    }
+
+    program->segments = calloc(header->pages, sizeof(struct data_segment));
+    program->segment_count = (int) header->pages;
+    for (uint32_t i = 0; i < header->pages; i++) {
+        struct data_segment *segment = &program->segments[i];
+        segment->address = page_numbers[i] * MEMORY_PAGE_WORDS;
+        segment->length = MEMORY_PAGE_WORDS;
+        if (segment->address + (uint64_t) segment->length > words)
+            segment->length = (int) (words - segment->address);
+        segment->words = malloc(MEMORY_PAGE_WORDS * sizeof(int));
+        memcpy(segment->words, data + (size_t) i * MEMORY_PAGE_WORDS, MEMORY_PAGE_WORDS * sizeof(int));
+    }
+    return true;
+}
+
+bool image_load(cpu_state *state, const char *path) {
+    const int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t) sizeof(image_header)) {
+        close(fd);
+        return false;
+    }
+
+    const size_t size = info.st_size;
+    char *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return false;
+
+    if (!image_valid(base, size, state->data_memory.words)) {
+        munmap(base, size);
+        return false;
+    }
+
+    const image_header *header = (const image_header *) base;
+    const image_instruction *packed = (const image_instruction *) (base + header->instructions_offset);
+    const uint32_t *page_numbers = (const uint32_t *) (base + header->page_numbers_offset);
+
+    struct instruction *code = calloc(header->instructions + 1, sizeof(*code));
+    for (uint32_t i = 0; i < header->instructions; i++) {
+        code[i].op = packed[i].op;
+        code[i].rd = packed[i].rd;
+        code[i].rs = packed[i].rs;
+        code[i].rt = packed[i].rt;
+        code[i].imm = packed[i].imm;
+    }
+    processor_load_program(state, code, (int) header->instructions);
+
+    const uint32_t pages = header->pages;
+    int *data = (int *) (base + header->pages_offset);
+    for (uint32_t i = 0; i < pages; i++)
+        memory_attach_page(&state->data_memory, page_numbers[i], data + (size_t) i * MEMORY_PAGE_WORDS, base, size);
+
+    if (pages == 0)
+        munmap(base, size);
+    return true;
+}
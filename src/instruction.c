@@ -0,0 +1,164 @@
+#include "instruction.h"
+
+const struct instruction nop = { .op = NOP, .rd = NOT_USED, .rt = NOT_USED, .rs = NOT_USED, .imm = 0,
+                                 .dest = NOT_USED, .alu = UNDEFINED, .memory = NO_OPERATION,
+                                 .branch = NOT_BRANCH };
+
+/**
+ * @return the number of the register the provided instruction writes to. If the
+ * instruction does not write to a register, returns NOT_USED.
+ */
+static int instruction_get_output_register(struct instruction instruction) {
+    switch (instruction.op) {
+        case ADDI:
+        case SUBI:
+        case LW:
+        case LL:
+        case SC:
+            return instruction.rt;
+        case ADD:
+        case SUB:
+        case MULT:
+        case DIV:
+        case AND:
+        case OR:
+        case XOR:
+        case SLL:
+        case SRL:
+        case SLT:
+            return instruction.rd;
+        default:
+            return NOT_USED;
+    }
+}
+
+/**
+ * @return true if the provided instruction has an immediate operand, false otherwise.
+ */
+static bool instruction_has_immediate(struct instruction instruction) {
+    switch (instruction.op) {
+        case ADDI:
+        case SUBI:
+        case LW:
+        case SW:
+        case LL:
+        case SC:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static mem_op instruction_get_memory_operation(struct instruction instruction) {
+    switch (instruction.op) {
+        case LW:
+        case LL: return READ;
+        case SW:
+        case SC: return WRITE;
+        default: return NO_OPERATION;
+    }
+}
+
+static bool instruction_is_branch(struct instruction instruction) {
+    switch (instruction.op) {
+        case BEQZ:
+        case BNEZ:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @return the ALU operation the provided instruction encodes for.
+ */
+static alu_op instruction_get_alu_op(struct instruction instruction) {
+    switch (instruction.op) {
+        case ADDI:
+        case ADD:
+        case LW:
+        case SW:
+        case LL:
+        case SC:
+            return PLUS;
+        case SUBI:
+        case SUB:
+            return MINUS;
+        case MULT: return TIMES;
+        case DIV:  return DIVIDE;
+        case AND:  return BITWISE_AND;
+        case OR:   return BITWISE_OR;
+        case XOR:  return BITWISE_XOR;
+        case SLL:  return SHIFT_LEFT;
+        case SRL:  return SHIFT_RIGHT;
+        case SLT:  return LESS_THAN;
+        default:
+            return UNDEFINED;
+    }
+}
+
+static branch_kind instruction_get_branch_kind(struct instruction instruction) {
+    switch (instruction.op) {
+        case BEQZ: return BRANCH_EQZ;
+        case BNEZ: return BRANCH_NEZ;
+        case J:    return BRANCH_ALWAYS;
+        default:   return NOT_BRANCH;
+    }
+}
+
+/**
+ * @return a mask with one bit set for every register the provided instruction
+ * is considered to read when detecting data hazards.
+ */
+static int instruction_get_source_registers(struct instruction instruction) {
+    switch (instruction.op) {
+        case ADD:
+        case SUB:
+        case MULT:
+        case DIV:
+        case AND:
+        case OR:
+        case XOR:
+        case SLL:
+        case SRL:
+        case SLT:
+        case LW:
+        case SW:
+        case LL:
+        case SC:
+            return (1 << instruction.rs) | (1 << instruction.rt);
+        case ADDI:
+        case SUBI:
+        case BEQZ:
+        case BNEZ:
+            return 1 << instruction.rs;
+        default:
+            return 0;
+    }
+}
+
+void instruction_predecode(struct instruction *instruction) {
+    const struct instruction inst = *instruction;
+
+    instruction->dest = instruction_get_output_register(inst);
+    instruction->dest_mask = instruction->dest == NOT_USED ? 0 : 1 << instruction->dest;
+    instruction->src_mask = instruction_get_source_registers(inst);
+    instruction->alu = instruction_get_alu_op(inst);
+    instruction->memory = instruction_get_memory_operation(inst);
+    instruction->branch = instruction_get_branch_kind(inst);
+
+    instruction->flags = 0;
+    if (instruction->dest != NOT_USED)         instruction->flags |= INST_WRITES;
+    if (instruction_has_immediate(inst))       instruction->flags |= INST_IMMEDIATE;
+    if (instruction->memory == READ)           instruction->flags |= INST_LOAD;
+    if (instruction->memory == WRITE)          instruction->flags |= INST_STORE;
+    if (instruction_is_branch(inst))           instruction->flags |= INST_BRANCH;
+    if (instruction->branch == BRANCH_ALWAYS)  instruction->flags |= INST_JUMP;
+    if (instruction->alu == TIMES || instruction->alu == DIVIDE) instruction->flags |= INST_UNIT;
+    if (inst.op == LL || inst.op == SC)        instruction->flags |= INST_ATOMIC;
+}
+
+void instruction_predecode_program(struct instruction *code, int count) {
+    for (int i = 0; i < count; i++)
+        instruction_predecode(&code[i]);
+}
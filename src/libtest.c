@@ -0,0 +1,170 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include "dlxsim.h"
+
+// Checks libdlxsim through dlxsim.h alone, as a program linking the library would use it.
+
+#define THREADS 4
+
+static int checks, failures;
+
+#define CHECK(condition) check(condition, #condition, __LINE__)
+
+static void check(int passed, const char *condition, int line) {
+    __atomic_fetch_add(&checks, 1, __ATOMIC_RELAXED);
+    if (!passed) {
+        __atomic_fetch_add(&failures, 1, __ATOMIC_RELAXED);
+        printf("FAIL line %d: %s\n", line, condition);
+    }
+}
+
+// Stores 6 * 7 to word 5 and loads it back, in 5 instructions and 12 cycles
+static const char product[] =
+        "        ADDI R1,R0,#6\n"
+        "        ADDI R2,R0,#7\n"
+        "        MULT R3,R1,R2\n"
+        "        SW 5(R0),R3\n"
+        "        LW R4,5(R0)\n";
+
+static int load(dlxsim *sim, const char *source) {
+    return dlxsim_load_source(sim, source, strlen(source));
+}
+
+static int register_value(const dlxsim *sim, int index) {
+    int value = -1;
+    CHECK(dlxsim_register(sim, index, &value) == DLXSIM_OK);
+    return value;
+}
+
+static void test_pipeline() {
+    dlxsim *sim;
+    int value;
+    long long done, cycles, instructions;
+
+    CHECK(dlxsim_create(NULL, &sim) == DLXSIM_OK);
+    CHECK(dlxsim_register(sim, 1, &value) == DLXSIM_ERROR_NO_PROGRAM);
+    CHECK(dlxsim_run(sim) == DLXSIM_ERROR_NO_PROGRAM);
+
+    CHECK(load(sim, product) == DLXSIM_OK);
+    CHECK(dlxsim_step(sim, 3, &done) == DLXSIM_OK);
+    CHECK(done == 3);
+    CHECK(!dlxsim_halted(sim));
+    CHECK(dlxsim_counts(sim, &cycles, NULL) == DLXSIM_OK && cycles == 3);
+
+    CHECK(dlxsim_run(sim) == DLXSIM_OK);
+    CHECK(dlxsim_halted(sim));
+    CHECK(register_value(sim, 3) == 42);
+    CHECK(register_value(sim, 4) == 42);
+    CHECK(dlxsim_memory(sim, 5, &value) == DLXSIM_OK && value == 42);
+    CHECK(dlxsim_memory(sim, 6, &value) == DLXSIM_OK && value == 0);
+    CHECK(dlxsim_counts(sim, &cycles, &instructions) == DLXSIM_OK);
+    CHECK(cycles == 12 && instructions == 5);
+
+    // A halted program is not simulated further.
+    CHECK(dlxsim_step(sim, 10, &done) == DLXSIM_OK && done == 0);
+
+    CHECK(dlxsim_register(sim, 16, &value) == DLXSIM_ERROR_ARGUMENT);
+    CHECK(dlxsim_memory(sim, 1000, &value) == DLXSIM_ERROR_ARGUMENT);
+    CHECK(dlxsim_step(sim, -1, NULL) == DLXSIM_ERROR_ARGUMENT);
+
+    // Loading again starts from a clean processor.
+    CHECK(load(sim, "        ADDI R1,R0,#1\n") == DLXSIM_OK);
+    CHECK(dlxsim_run(sim) == DLXSIM_OK);
+    CHECK(register_value(sim, 1) == 1);
+    CHECK(register_value(sim, 3) == 0);
+    CHECK(dlxsim_memory(sim, 5, &value) == DLXSIM_OK && value == 0);
+    dlxsim_destroy(sim);
+}
+
+static void test_functional() {
+    const dlxsim_config config = { .functional = 1 };
+    dlxsim *sim;
+    long long done, cycles, instructions;
+
+    CHECK(dlxsim_create(&config, &sim) == DLXSIM_OK);
+    CHECK(load(sim, product) == DLXSIM_OK);
+    CHECK(dlxsim_step(sim, 2, &done) == DLXSIM_OK && done == 2);
+    CHECK(register_value(sim, 2) == 7);
+    CHECK(register_value(sim, 3) == 0);
+    CHECK(dlxsim_run(sim) == DLXSIM_OK);
+    CHECK(register_value(sim, 4) == 42);
+    CHECK(dlxsim_counts(sim, &cycles, &instructions) == DLXSIM_OK);
+    CHECK(cycles == 0 && instructions == 5);
+
+    // Each program is translated afresh, whatever the simulation ran before.
+    CHECK(load(sim, "        ADDI R1,R0,#3\nLoop    ADDI R2,R2,#5\n        SUBI R1,R1,#1\n        BNEZ R1,Loop\n") == DLXSIM_OK);
+    CHECK(dlxsim_run(sim) == DLXSIM_OK);
+    CHECK(register_value(sim, 2) == 15);
+    CHECK(dlxsim_counts(sim, NULL, &instructions) == DLXSIM_OK && instructions == 10);
+    CHECK(load(sim, product) == DLXSIM_OK);
+    CHECK(dlxsim_run(sim) == DLXSIM_OK);
+    CHECK(register_value(sim, 2) == 7);
+    CHECK(register_value(sim, 4) == 42);
+    dlxsim_destroy(sim);
+}
+
+static void test_errors() {
+    const dlxsim_config bad_cache = { .cache = "ways=3" };
+    const dlxsim_config limited = { .max_cycles = 100, .exact = 1 };
+    dlxsim *sim;
+
+    CHECK(dlxsim_create(&bad_cache, &sim) == DLXSIM_ERROR_ARGUMENT);
+
+    CHECK(dlxsim_create(NULL, &sim) == DLXSIM_OK);
+    CHECK(load(sim, "        ADDI R1,R0\n") == DLXSIM_ERROR_ASSEMBLY);
+    CHECK(dlxsim_message(sim)[0] != '\0');
+    CHECK(dlxsim_step(sim, 1, NULL) == DLXSIM_ERROR_NO_PROGRAM);
+    CHECK(dlxsim_load(sim, "programs/missing") == DLXSIM_ERROR_OPEN);
+
+    // A fault stops the simulation, which keeps returning it.
+    CHECK(load(sim, "        ADDI R1,R0,#5\n        ADDI R0,R0,#1\n        ADDI R2,R0,#5\n") == DLXSIM_OK);
+    CHECK(dlxsim_run(sim) == DLXSIM_ERROR_ILLEGAL_REG_WRITE);
+    CHECK(strstr(dlxsim_message(sim), "R0") != NULL);
+    CHECK(dlxsim_step(sim, 1, NULL) == DLXSIM_ERROR_ILLEGAL_REG_WRITE);
+    CHECK(register_value(sim, 1) == 5);
+    CHECK(register_value(sim, 2) == 0);
+
+    CHECK(load(sim, "        LW R1,1000(R0)\n") == DLXSIM_OK);
+    CHECK(dlxsim_run(sim) == DLXSIM_ERROR_ILLEGAL_MEM_ACCESS);
+
+    // The loop engine finds that the loop never ends; simulating every cycle runs away.
+    CHECK(load(sim, "Loop    J Loop\n") == DLXSIM_OK);
+    CHECK(dlxsim_run(sim) == DLXSIM_INFINITE_LOOP);
+    dlxsim_destroy(sim);
+
+    CHECK(dlxsim_create(&limited, &sim) == DLXSIM_OK);
+    CHECK(load(sim, "Loop    J Loop\n") == DLXSIM_OK);
+    CHECK(dlxsim_run(sim) == DLXSIM_RUNAWAY);
+    dlxsim_destroy(sim);
+}
+
+static void *test_thread(void *unused) {
+    dlxsim *sim;
+    for (int i = 0; i < 100; i++) {
+        CHECK(dlxsim_create(NULL, &sim) == DLXSIM_OK);
+        CHECK(load(sim, i % 2 ? product : "        ADDI R0,R0,#1\n") == DLXSIM_OK);
+        CHECK(dlxsim_run(sim) == (i % 2 ? DLXSIM_OK : DLXSIM_ERROR_ILLEGAL_REG_WRITE));
+        CHECK(register_value(sim, 3) == (i % 2 ? 42 : 0));
+        dlxsim_destroy(sim);
+    }
+    return unused;
+}
+
+static void test_threads() {
+    pthread_t threads[THREADS];
+    for (int i = 0; i < THREADS; i++)
+        pthread_create(&threads[i], NULL, test_thread, NULL);
+    for (int i = 0; i < THREADS; i++)
+        pthread_join(threads[i], NULL);
+}
+
+int main() {
+    test_pipeline();
+    test_functional();
+    test_errors();
+    test_threads();
+
+    printf("%d of %d library checks passed\n", checks - failures, checks);
+    return failures > 0;
+}
@@ -0,0 +1,522 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lockstep.h"
+#include "pipeline.h"
+
+typedef int lane_vector __attribute__((vector_size(LOCKSTEP_LANES * sizeof(int))));
+
+// A structure-of-arrays variant of cpu_state for simulating the same program on
+// LOCKSTEP_LANES different initial states. Hazard detection and control flow only
+// depend on the instructions in flight, so all control state is shared; only the
+// data flowing through the pipeline is kept per lane. A lane whose branch outcome
+// disagrees with the others is masked off and continued as an ordinary cpu_state.
+typedef struct {
+    struct fetch_buffer fetch_buffer;
+
+    struct {
+        int pc_next;
+        struct instruction inst;
+        bool stall, should_jump;
+        bool forward;
+        lane_vector data;
+    } decode_buffer;
+
+    struct {
+        lane_vector a, b, alu_out;
+        struct instruction inst;
+        forwarding_source forward_a, forward_b;
+    } execute_buffer;
+
+    struct {
+        lane_vector alu_out, write_data;
+        struct instruction inst;
+    } memory_buffer;
+
+    struct {
+        lane_vector read_data, alu_out, result;
+        struct instruction inst;
+    } writeback_buffer;
+
+    // The program, shared with the per-lane states
+    const struct instruction *instruction_memory;
+    int instructions_count;
+
+    // Data memory, word-addressed, holding every lane's copy of each word together. The
+    // pages mirror those of data_memory and are allocated on first write; NULL pages read as zero.
+    lane_vector **data_pages;
+    uint64_t words;
+
+    lane_vector register_file[16];
+
+    // -1 in lanes still simulated in lockstep, 0 in lanes that were masked off
+    lane_vector active;
+    lockstep_fault *faults;  // where lanes that fault on their own record it
+
+    long long cycles_executed;
+    long long instructions_executed;
+    bool halt;
+} lockstep_state;
+
+static const lane_vector lockstep_zero_word;
+
+/**
+ * @return every lane's copy of the word at address, which must be in bounds
+ */
+static inline const lane_vector *lockstep_load(const lockstep_state *ls, uint32_t address) {
+    const lane_vector *page = ls->data_pages[address >> MEMORY_PAGE_BITS];
+    return page != NULL ? &page[address & (MEMORY_PAGE_WORDS - 1)] : &lockstep_zero_word;
+}
+
+/**
+ * @return every lane's copy of the word at address, which must be in bounds, allocating
+ * its page if necessary
+ */
+static inline lane_vector *lockstep_word(lockstep_state *ls, uint32_t address) {
+    lane_vector **page = &ls->data_pages[address >> MEMORY_PAGE_BITS];
+    // Vectors are accessed with aligned loads and stores, which malloc does not guarantee.
+    if (*page == NULL) {
+        *page = aligned_alloc(sizeof(lane_vector), MEMORY_PAGE_WORDS * sizeof(lane_vector));
+        memset(*page, 0, MEMORY_PAGE_WORDS * sizeof(lane_vector));
+    }
+    return &(*page)[address & (MEMORY_PAGE_WORDS - 1)];
+}
+
+/**
+ * @return the number of pages covering the lockstep data memory
+ */
+static uint64_t lockstep_pages(const lockstep_state *ls) {
+    return (ls->words + MEMORY_PAGE_WORDS - 1) / MEMORY_PAGE_WORDS;
+}
+
+/**
+ * Gathers the provided lanes' initial states into a lockstep state. All lanes must hold
+ * the same program.
+ * @param lanes the initial state of each lane
+ * @param count the number of lanes used, at most LOCKSTEP_LANES
+ */
+static void lockstep_init(lockstep_state *ls, const cpu_state *lanes, int count) {
+    memset(ls, 0, sizeof(*ls));
+    ls->instruction_memory = lanes[0].instruction_memory;
+    ls->instructions_count = lanes[0].instructions_count;
+    ls->words = lanes[0].data_memory.words;
+    ls->data_pages = calloc(lockstep_pages(ls), sizeof(lane_vector *));
+
+    for (int lane = 0; lane < count; lane++) {
+        const data_memory *memory = &lanes[lane].data_memory;
+
+        ls->active[lane] = -1;
+        for (int i = 0; i < 16; i++)
+            ls->register_file[i][lane] = lanes[lane].register_file[i];
+
+        for (uint64_t page = memory_next_page(memory, 0); page < lockstep_pages(ls); page = memory_next_page(memory, page + 1)) {
+            const int *words = memory_page(memory, page);
+            for (int i = 0; i < MEMORY_PAGE_WORDS; i++)
+                (*lockstep_word(ls, page * MEMORY_PAGE_WORDS + i))[lane] = words[i];
+        }
+    }
+}
+
+static void lockstep_free(lockstep_state *ls) {
+    for (uint64_t page = 0; page < lockstep_pages(ls); page++)
+        free(ls->data_pages[page]);
+    free(ls->data_pages);
+}
+
+/**
+ * Scatters one lane of a lockstep state back into an ordinary processor state, which
+ * continues exactly as if it had been simulated on its own.
+ */
+static void lockstep_extract(const lockstep_state *ls, int lane, cpu_state *state) {
+    state->fetch_buffer = ls->fetch_buffer;
+
+    state->decode_buffer.pc_next = ls->decode_buffer.pc_next;
+    state->decode_buffer.inst = ls->decode_buffer.inst;
+    state->decode_buffer.stall = ls->decode_buffer.stall;
+    state->decode_buffer.should_jump = ls->decode_buffer.should_jump;
+    state->decode_buffer.forward = ls->decode_buffer.forward;
+    state->decode_buffer.data = ls->decode_buffer.data[lane];
+
+    state->execute_buffer.a = ls->execute_buffer.a[lane];
+    state->execute_buffer.b = ls->execute_buffer.b[lane];
+    state->execute_buffer.alu_out = ls->execute_buffer.alu_out[lane];
+    state->execute_buffer.inst = ls->execute_buffer.inst;
+    state->execute_buffer.foward_a = ls->execute_buffer.forward_a;
+    state->execute_buffer.forward_b = ls->execute_buffer.forward_b;
+
+    state->memory_buffer.alu_out = ls->memory_buffer.alu_out[lane];
+    state->memory_buffer.write_data = ls->memory_buffer.write_data[lane];
+    state->memory_buffer.inst = ls->memory_buffer.inst;
+
+    state->writeback_buffer.read_data = ls->writeback_buffer.read_data[lane];
+    state->writeback_buffer.alu_out = ls->writeback_buffer.alu_out[lane];
+    state->writeback_buffer.result = ls->writeback_buffer.result[lane];
+    state->writeback_buffer.inst = ls->writeback_buffer.inst;
+
+    for (int i = 0; i < 16; i++)
+        state->register_file[i] = ls->register_file[i][lane];
+    for (uint64_t page = 0; page < lockstep_pages(ls); page++) {
+        const lane_vector *words = ls->data_pages[page];
+        if (words == NULL)
+            continue;
+
+        int *copy = memory_page_for_write(&state->data_memory, page);
+        for (int i = 0; i < MEMORY_PAGE_WORDS; i++)
+            copy[i] = words[i][lane];
+    }
+
+    state->cycles_executed = ls->cycles_executed;
+    state->instructions_executed = ls->instructions_executed;
+    state->halt = ls->halt;
+}
+
+/**
+ * Records the exception of a lane that faulted on its own, which leaves the lockstep
+ * simulation while the others go on.
+ */
+static void lockstep_fault_lane(lockstep_state *ls, int lane, int error, const char *message) {
+    ls->faults[lane].error = error;
+    snprintf(ls->faults[lane].message, sizeof(ls->faults[lane].message), "%s", message);
+    ls->active[lane] = 0;
+}
+
+/**
+ * Records an out-of-bounds access of one lane. Kept out of line, as it is rarely taken.
+ */
+static __attribute__((cold, noinline)) void lockstep_fault_access(lockstep_state *ls, int lane, int address) {
+    char message[FAULT_MESSAGE_SIZE];
+    snprintf(message, sizeof(message), "Exception: out-of-bounds data memory access at %d\n", address);
+    lockstep_fault_lane(ls, lane, ERROR_ILLEGAL_MEM_ACCESS, message);
+}
+
+/**
+ * @return true if any lane of the mask is set
+ */
+static inline bool lockstep_any(const lane_vector *mask) {
+    int any = 0;
+    for (int lane = 0; lane < LOCKSTEP_LANES; lane++)
+        any |= (*mask)[lane];
+    return any != 0;
+}
+
+/**
+ * The lockstep counterpart of processor_forward_on_hazard: the forwarding decisions are
+ * shared by all lanes, while the forwarded data is per lane.
+ */
+static inline void lockstep_forward_on_hazard(lockstep_state *ls, struct instruction reader,
+                                              struct instruction writer, forwarding_source source,
+                                              const lane_vector *data) {
+    if (reader.src_mask & writer.dest_mask) {
+        if (writer.dest == reader.rs)
+            ls->execute_buffer.forward_a = source;
+        if (writer.dest == reader.rt)
+            ls->execute_buffer.forward_b = source;
+    }
+
+    const struct instruction branch = ls->decode_buffer.inst;
+    if ((branch.flags & INST_BRANCH) && (branch.src_mask & writer.dest_mask)) {
+        ls->decode_buffer.forward = true;
+        ls->decode_buffer.data = *data;
+    }
+}
+
+static inline void lockstep_fetch(lockstep_state *ls) {
+    struct fetch_buffer *fetch = &ls->fetch_buffer;
+
+    if (fetch->stall) {
+        fetch->stall = false;
+        return;
+    }
+
+    if (fetch->flush) {
+        if (fetch->pc_branch < 0 || fetch->pc_branch > ls->instructions_count - 1) {
+            fault_raise(ERROR_ILLEGAL_JUMP, "out-of-bounds should_jump to %d\n", fetch->pc_branch);
+        }
+
+        ls->decode_buffer.inst = nop;
+        fetch->flush = false;
+        fetch->pc = fetch->pc_branch;
+        return;
+    }
+
+    const int pc = fetch->pc;
+
+    if (pc > ls->instructions_count - 1) {
+        if (pc >= ls->instructions_count + 3) {
+            ls->halt = true;
+        } else {
+            ls->decode_buffer.inst = nop;
+        }
+    }
+
+    const int next_pc = fetch->pc + 1;
+
+    ls->decode_buffer.inst = ls->instruction_memory[pc];
+    ls->decode_buffer.pc_next = next_pc;
+
+    fetch->pc = ls->decode_buffer.should_jump ? fetch->pc_branch : next_pc;
+}
+
+/**
+ * Masks off a lane whose branch went the other way in decode, and scatters it into state,
+ * where its own fetch stage completes the cycle. Kept out of lockstep_decode, as a
+ * function calling setjmp is not inlined.
+ */
+static void lockstep_diverge(lockstep_state *ls, int lane, cpu_state *state, bool should_jump) {
+    lockstep_extract(ls, lane, state);
+    state->decode_buffer.should_jump = should_jump;
+    state->fetch_buffer.flush = should_jump;
+    ls->active[lane] = 0;
+
+    // Only this lane takes its jump, so only this lane faults if it leaves the program. The
+    // jump was resolved by lockstep_decode, so the check pipeline_decode makes of the target
+    // of a jump it takes is made here; pipeline_fetch follows the target unchecked.
+    fault_handler handler;
+    fault_enter(&handler);
+    if (setjmp(handler.target) != 0) {
+        lockstep_fault_lane(ls, lane, handler.error, handler.message);
+        return;
+    }
+    const int target = state->fetch_buffer.pc_branch;
+    if (should_jump && (target < 0 || target > state->instructions_count - 1)) {
+        fault_raise(ERROR_ILLEGAL_JUMP, "out-of-bounds should_jump to %d\n", target);
+    }
+    pipeline_fetch(state);
+    fault_leave(&handler);
+    state->cycles_executed++;
+}
+
+/**
+ * Decodes the shared instruction for every lane. Lanes resolving a branch differently from
+ * the first active lane are masked off and scattered into lanes, where their own fetch
+ * stage completes the cycle.
+ */
+static inline void lockstep_decode(lockstep_state *ls, cpu_state *lanes) {
+    const struct instruction inst = ls->decode_buffer.inst;
+
+    if (ls->decode_buffer.stall) {
+        ls->decode_buffer.stall = false;
+        ls->fetch_buffer.stall = true;
+        ls->execute_buffer.inst = nop;
+        return;
+    }
+
+    // Unused register tags are NOT_USED; any register will do for them.
+    const lane_vector a = ls->decode_buffer.forward ? ls->decode_buffer.data : ls->register_file[inst.rs & 15];
+    const lane_vector b = ls->register_file[inst.rt & 15];
+    ls->decode_buffer.forward = false;
+
+    lane_vector taken = {};
+    if (inst.flags & INST_JUMP)
+        taken = ls->active;
+    else if (inst.flags & INST_BRANCH)
+        taken = (inst.branch == BRANCH_EQZ ? a == 0 : a != 0) & ls->active;
+
+    bool should_jump = false;
+    for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+        if (ls->active[lane]) {
+            should_jump = taken[lane] != 0;
+            break;
+        }
+    }
+
+    ls->decode_buffer.should_jump = should_jump;
+    ls->fetch_buffer.flush = should_jump;
+    ls->fetch_buffer.pc_branch = inst.imm + ls->decode_buffer.pc_next;
+
+    ls->execute_buffer.inst = inst;
+    ls->execute_buffer.a = a;
+    ls->execute_buffer.b = b;
+
+    const lane_vector diverged = (should_jump ? ~taken : taken) & ls->active;
+    if (!lockstep_any(&diverged))
+        return;
+
+    for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+        if (diverged[lane])
+            lockstep_diverge(ls, lane, &lanes[lane], !should_jump);
+    }
+}
+
+static inline void lockstep_execute(lockstep_state *ls) {
+    const struct instruction inst = ls->execute_buffer.inst;
+    const lane_vector forwarded_memory = (ls->memory_buffer.inst.flags & INST_LOAD)
+            ? ls->writeback_buffer.read_data
+            : ls->memory_buffer.alu_out;
+
+    lane_vector a = ls->execute_buffer.a;
+    lane_vector write_data = ls->execute_buffer.b;
+
+    if (ls->execute_buffer.forward_a == MEMORY)
+        a = forwarded_memory;
+    else if (ls->execute_buffer.forward_a == WRITEBACK)
+        a = ls->writeback_buffer.result;
+
+    if (ls->execute_buffer.forward_b == MEMORY)
+        write_data = forwarded_memory;
+    else if (ls->execute_buffer.forward_b == WRITEBACK)
+        write_data = ls->writeback_buffer.result;
+
+    ls->execute_buffer.forward_a = NO_FORWARDING;
+    ls->execute_buffer.forward_b = NO_FORWARDING;
+
+    const lane_vector zero = {};
+    const lane_vector b = (inst.flags & INST_IMMEDIATE) ? zero + inst.imm : write_data;
+
+    // Shifts and comparisons of vectors yield vectors, so shifts go through unsigned lanes and
+    // a comparison's -1 for true becomes 1.
+    typedef unsigned int lane_bits __attribute__((vector_size(sizeof(lane_vector))));
+    lane_vector alu_out = {};
+    switch (inst.alu) {
+        case PLUS:        alu_out = a + b; break;
+        case MINUS:       alu_out = a - b; break;
+        case BITWISE_AND: alu_out = a & b; break;
+        case BITWISE_OR:  alu_out = a | b; break;
+        case BITWISE_XOR: alu_out = a ^ b; break;
+        case SHIFT_LEFT:  alu_out = (lane_vector) ((lane_bits) a << (lane_bits) (b & 31)); break;
+        case SHIFT_RIGHT: alu_out = (lane_vector) ((lane_bits) a >> (lane_bits) (b & 31)); break;
+        case LESS_THAN:   alu_out = -(a < b); break;
+    }
+
+    if (ls->decode_buffer.inst.flags & INST_BRANCH)
+        ls->decode_buffer.stall |= (ls->decode_buffer.inst.src_mask & inst.dest_mask) != 0;
+
+    ls->memory_buffer.alu_out = alu_out;
+    ls->memory_buffer.write_data = write_data;
+    ls->memory_buffer.inst = inst;
+}
+
+static inline void lockstep_memory(lockstep_state *ls) {
+    const struct instruction inst = ls->memory_buffer.inst;
+    const lane_vector alu_out = ls->memory_buffer.alu_out;
+    lane_vector data = alu_out;
+
+    if (inst.flags & INST_MEMORY) {
+        // Masked-off lanes no longer hold meaningful addresses.
+        lane_vector address = alu_out & ls->active;
+        bool uniform = true;
+
+        for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+            if ((uint32_t) address[lane] >= ls->words) {
+                lockstep_fault_access(ls, lane, address[lane]);
+                address[lane] = 0;
+            }
+            uniform &= address[lane] == address[0] || !ls->active[lane];
+        }
+
+        if (inst.flags & INST_LOAD) {
+            // Loop-invariant addresses read one vector of data memory; otherwise the lanes are gathered.
+            if (uniform) {
+                data = *lockstep_load(ls, address[0]);
+            } else {
+                for (int lane = 0; lane < LOCKSTEP_LANES; lane++)
+                    data[lane] = (*lockstep_load(ls, address[lane]))[lane];
+            }
+            ls->writeback_buffer.read_data = data;
+
+            ls->decode_buffer.stall |= (ls->decode_buffer.inst.src_mask & inst.dest_mask) != 0;
+            ls->decode_buffer.stall |= (ls->execute_buffer.inst.src_mask & inst.dest_mask) != 0;
+        } else {
+            const lane_vector write_data = ls->memory_buffer.write_data;
+            if (uniform) {
+                lane_vector *word = lockstep_word(ls, address[0]);
+                *word = (write_data & ls->active) | (*word & ~ls->active);
+            } else {
+                for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+                    if (ls->active[lane])
+                        (*lockstep_word(ls, address[lane]))[lane] = write_data[lane];
+                }
+            }
+        }
+    }
+
+    lockstep_forward_on_hazard(ls, ls->execute_buffer.inst, inst, MEMORY, &data);
+
+    ls->writeback_buffer.inst = inst;
+    ls->writeback_buffer.alu_out = alu_out;
+}
+
+static inline void lockstep_writeback(lockstep_state *ls) {
+    const struct instruction inst = ls->writeback_buffer.inst;
+    lane_vector data = {};
+
+    if (inst.flags & INST_WRITES) {
+        if (inst.dest == R0) {
+            fault_raise(ERROR_ILLEGAL_REG_WRITE, "Exception: Attempt to overwrite R0\n");
+        }
+
+        data = (inst.flags & INST_LOAD) ? ls->writeback_buffer.read_data : ls->writeback_buffer.alu_out;
+        ls->register_file[inst.dest] = data;
+    }
+
+    lockstep_forward_on_hazard(ls, ls->execute_buffer.inst, inst, WRITEBACK, &data);
+
+    ls->writeback_buffer.result = data;
+
+    if (inst.op != nop.op) {
+        ls->instructions_executed++;
+    }
+}
+
+/**
+ * Simulates one cycle of every active lane. On x86, a copy of this function using AVX2
+ * is selected at load time when the processor supports it.
+ */
+#if defined(__GNUC__) && defined(__x86_64__)
+static __attribute__((target_clones("avx2", "default")))
+#endif
+void lockstep_cycle(lockstep_state *ls, cpu_state *lanes) {
+    lockstep_writeback(ls);
+    lockstep_memory(ls);
+    lockstep_execute(ls);
+    lockstep_decode(ls, lanes);
+    lockstep_fetch(ls);
+}
+
+bool lockstep_run(cpu_state *lanes, int count, long long max_cycles, lockstep_fault *faults) {
+    for (int lane = 0; lane < count; lane++)
+        faults[lane].error = 0;
+
+    // The functional units and reservations are not stepped across lanes, so a program
+    // using them leaves every lane to run on its own.
+    for (int i = 0; i < lanes[0].instructions_count; i++) {
+        if (lanes[0].instruction_memory[i].flags & (INST_UNIT | INST_ATOMIC))
+            return false;
+    }
+
+    lockstep_state *ls = aligned_alloc(sizeof(lane_vector), sizeof(*ls));
+    volatile bool runaway = false;
+
+    lockstep_init(ls, lanes, count);
+    ls->faults = faults;
+
+    // A fault of the instructions shared by the lanes is raised by every lane still in lockstep.
+    fault_handler handler;
+    fault_enter(&handler);
+    if (setjmp(handler.target) == 0) {
+        while (!ls->halt && lockstep_any(&ls->active)) {
+            lockstep_cycle(ls, lanes);
+            ls->cycles_executed++;
+
+            if (max_cycles > 0 && ls->cycles_executed > max_cycles) {
+                runaway = true;
+                ls->halt = true;
+            }
+        }
+        fault_leave(&handler);
+    } else {
+        for (int lane = 0; lane < count; lane++) {
+            if (ls->active[lane])
+                lockstep_fault_lane(ls, lane, handler.error, handler.message);
+        }
+    }
+
+    for (int lane = 0; lane < count; lane++) {
+        if (ls->active[lane])
+            lockstep_extract(ls, lane, &lanes[lane]);
+    }
+
+    lockstep_free(ls);
+    free(ls);
+    return runaway;
+}
@@ -0,0 +1,494 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "loop.h"
+#include "pipeline.h"
+
+// Steady-state loop extrapolation. Whenever a backward branch redirects fetch to a
+// loop header, the pipeline latches and registers are snapshotted. When the last
+// three snapshots a period of k iterations apart have identical control state (the
+// instructions in flight, stalls, flushes, forwarding, program counters, the functional
+// units, and a branch predictor and data cache whose tables have not changed), every number in the state
+// has advanced by the same delta d both times, and both periods made the same branch decisions and
+// memory accesses, the loop has reached a steady state:
+//
+// With one path through the period, and only additions and subtractions on the way,
+// a period maps the state x to A x + c for a fixed matrix A. Two equal deltas mean
+// A d = d, so every later period also advances by exactly d, for as long as no
+// branch decision changes. A branch tests a value that also advances by a fixed
+// delta, so the first period in which it changes is found by solving a congruence
+// modulo 2^32, and the processor jumps straight to the end of the period before it.
+//
+// Loads must read the same addresses every period; the words there are part of the
+// state. Stores may stride through memory, and are then replayed. A loop whose
+// branches can never change and that never strides through memory runs forever.
+#define LOOP_CANDIDATES 8    // loop headers tracked at once
+#define LOOP_MAX_PERIOD 4    // the most iterations of a loop one period may span
+#define LOOP_HISTORY (2 * LOOP_MAX_PERIOD + 1)
+#define LOOP_LOG_SIZE (1 << 16)     // branch decisions and memory accesses remembered
+#define LOOP_MAX_ADDRESSES 64       // distinct fixed addresses one period may access
+
+// The numbers in the pipeline latches (9) and the register file (16)
+#define LOOP_NUMBERS 25
+
+#define LOOP_NEVER UINT64_MAX
+
+typedef enum {
+    LOOP_BRANCH, LOOP_LOAD, LOOP_STORE
+} loop_event_kind;
+
+// A branch decision or memory access made by the pipeline
+typedef struct {
+    loop_event_kind kind;
+    uint32_t value;    // the value tested, loaded or stored
+    uint32_t address;
+    uint32_t old;      // for stores, the word overwritten
+} loop_event;
+
+// The state of the processor at a visit to a loop header
+typedef struct {
+    struct fetch_buffer fetch;
+    struct decode_buffer decode;
+    struct execute_buffer execute;
+    struct memory_buffer memory;
+    struct writeback_buffer writeback;
+    int registers[16];
+    long long cycles, instructions;
+    pipeline_stats stats;
+    uint32_t history;            // of the branch predictor
+    long long predictor_changes;
+    long long cache_changes;
+    scoreboard units;
+    int event;  // the number of events logged before the visit
+} loop_snapshot;
+
+typedef struct {
+    int header;  // pc of the loop header, or -1 if unused
+    long long last_visit;
+    int count;   // snapshots taken, up to LOOP_HISTORY
+    int next;    // where the next snapshot goes in history
+    loop_snapshot history[LOOP_HISTORY];
+} loop_candidate;
+
+struct loop_engine {
+    loop_candidate candidates[LOOP_CANDIDATES];
+    loop_event *log;
+    int events;
+
+    // The word a store in the memory stage is about to overwrite
+    uint32_t overwritten;
+
+    // False if the program has an instruction that is not an addition or a subtraction,
+    // in which case only loops that repeat their state exactly are recognized.
+    bool linear;
+};
+
+typedef enum {
+    LOOP_NO_MATCH, LOOP_SKIPPED, LOOP_INFINITE
+} loop_result;
+
+void loop_reset(loop_engine *engine) {
+    for (int i = 0; i < LOOP_CANDIDATES; i++) {
+        engine->candidates[i].header = -1;
+        engine->candidates[i].count = 0;
+        engine->candidates[i].next = 0;
+    }
+    engine->events = 0;
+}
+
+loop_engine *loop_engine_create(const cpu_state *state) {
+    loop_engine *engine = malloc(sizeof(*engine));
+    engine->log = malloc(LOOP_LOG_SIZE * sizeof(loop_event));
+    engine->linear = true;
+    for (int i = 0; i < state->instructions_count; i++) {
+        const alu_op alu = state->instruction_memory[i].alu;
+        engine->linear &= alu == UNDEFINED || alu == PLUS || alu == MINUS;
+    }
+
+    loop_reset(engine);
+    return engine;
+}
+
+void loop_engine_destroy(loop_engine *engine) {
+    free(engine->log);
+    free(engine);
+}
+
+/**
+ * Collects pointers to the numbers among the pipeline latches and registers.
+ */
+static void loop_numbers(struct decode_buffer *decode, struct execute_buffer *execute, struct memory_buffer *memory,
+                  struct writeback_buffer *writeback, int *registers, int **numbers) {
+    numbers[0] = &decode->data;
+    numbers[1] = &execute->a;
+    numbers[2] = &execute->b;
+    numbers[3] = &execute->alu_out;
+    numbers[4] = &memory->alu_out;
+    numbers[5] = &memory->write_data;
+    numbers[6] = &writeback->read_data;
+    numbers[7] = &writeback->alu_out;
+    numbers[8] = &writeback->result;
+    for (int i = 0; i < 16; i++)
+        numbers[9 + i] = &registers[i];
+}
+
+/**
+ * @return true if the two instructions are the same; the rest of an instruction is predecoded from these
+ */
+static bool loop_same_instruction(const struct instruction *a, const struct instruction *b) {
+    return a->op == b->op && a->rd == b->rd && a->rs == b->rs && a->rt == b->rt && a->imm == b->imm;
+}
+
+/**
+ * @return true if the two scoreboards hold the same instructions, results and reservations.
+ * Only programs with multiplications or divisions use the units, and their loops are only
+ * extrapolated when they repeat exactly, so the results are compared as well.
+ */
+static bool loop_same_units(const scoreboard *a, const scoreboard *b) {
+    if (a->count != b->count || a->reserved != b->reserved
+            || memcmp(a->pending, b->pending, sizeof(a->pending)) != 0 || memcmp(a->busy, b->busy, sizeof(a->busy)) != 0)
+        return false;
+
+    for (int i = 0; i < a->count; i++) {
+        const unit_operation *x = &a->operations[i], *y = &b->operations[i];
+        if (!loop_same_instruction(&x->inst, &y->inst) || x->result != y->result || x->remaining != y->remaining)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @return true if the two snapshots have the same control state, whatever their numbers
+ */
+static bool loop_same_control(const loop_snapshot *a, const loop_snapshot *b) {
+    return a->fetch.pc == b->fetch.pc && a->fetch.pc_branch == b->fetch.pc_branch
+            && a->fetch.stall == b->fetch.stall && a->fetch.flush == b->fetch.flush
+            && a->decode.pc_next == b->decode.pc_next && loop_same_instruction(&a->decode.inst, &b->decode.inst)
+            && a->decode.stall == b->decode.stall && a->decode.should_jump == b->decode.should_jump
+            && a->decode.forward == b->decode.forward && a->decode.predicted == b->decode.predicted
+            && a->history == b->history && a->predictor_changes == b->predictor_changes
+            && loop_same_instruction(&a->execute.inst, &b->execute.inst)
+            && a->execute.foward_a == b->execute.foward_a && a->execute.forward_b == b->execute.forward_b
+            && loop_same_instruction(&a->memory.inst, &b->memory.inst) && a->memory.accessed == b->memory.accessed
+            && a->memory.wait == b->memory.wait && a->memory.waiting == b->memory.waiting
+            && a->cache_changes == b->cache_changes && loop_same_units(&a->units, &b->units)
+            && loop_same_instruction(&a->writeback.inst, &b->writeback.inst);
+}
+
+/**
+ * @return the snapshot taken back visits before the latest one
+ */
+static loop_snapshot *loop_back(loop_candidate *candidate, int back) {
+    return &candidate->history[(candidate->next - 1 - back + 2 * LOOP_HISTORY) % LOOP_HISTORY];
+}
+
+/**
+ * @return the first period t >= 1 after which value + t * delta differs from value in being
+ * zero, modulo 2^32, or LOOP_NEVER
+ */
+static uint64_t loop_first_flip(uint32_t value, uint32_t delta) {
+    if (delta == 0)
+        return LOOP_NEVER;
+    if (value == 0)
+        return 1;
+
+    // Solve t * delta = -value (mod 2^32) with delta = 2^shift * odd.
+    const int shift = __builtin_ctz(delta);
+    if (value & ((1u << shift) - 1))
+        return LOOP_NEVER;
+
+    const uint32_t odd = delta >> shift;
+    uint32_t inverse = odd;
+    for (int i = 0; i < 5; i++)
+        inverse *= 2 - odd * inverse;
+
+    const uint64_t modulus = 1ULL << (32 - shift);
+    return (uint64_t) (uint32_t) ((0u - (value >> shift)) * inverse) & (modulus - 1);
+}
+
+/**
+ * @return the last period t >= 0 for which address + t * stride lies within data memory
+ */
+static uint64_t loop_last_in_bounds(uint32_t address, int32_t stride, uint64_t words) {
+    return stride > 0 ? (words - 1 - address) / stride : address / (uint64_t) -(int64_t) stride;
+}
+
+/**
+ * Tries to extrapolate a loop whose last three snapshots are period visits apart, and
+ * jumps the processor ahead if it is in a steady state.
+ * @param limit the cycle count not to go beyond
+ */
+static loop_result loop_analyze(loop_engine *engine, cpu_state *state, loop_candidate *candidate, int period,
+                         long long limit) {
+    loop_snapshot *s0 = loop_back(candidate, 2 * period);
+    loop_snapshot *s1 = loop_back(candidate, period);
+    loop_snapshot *s2 = loop_back(candidate, 0);
+
+    const long long cycles = s2->cycles - s1->cycles;
+    const long long instructions = s2->instructions - s1->instructions;
+    const int events = s2->event - s1->event;
+    if (cycles != s1->cycles - s0->cycles || instructions != s1->instructions - s0->instructions
+            || events != s1->event - s0->event || !loop_same_control(s0, s1) || !loop_same_control(s1, s2))
+        return LOOP_NO_MATCH;
+
+    int *n0[LOOP_NUMBERS], *n1[LOOP_NUMBERS], *n2[LOOP_NUMBERS];
+    uint32_t delta[LOOP_NUMBERS];
+    bool still = true;
+    loop_numbers(&s0->decode, &s0->execute, &s0->memory, &s0->writeback, s0->registers, n0);
+    loop_numbers(&s1->decode, &s1->execute, &s1->memory, &s1->writeback, s1->registers, n1);
+    loop_numbers(&s2->decode, &s2->execute, &s2->memory, &s2->writeback, s2->registers, n2);
+    for (int i = 0; i < LOOP_NUMBERS; i++) {
+        delta[i] = (uint32_t) *n2[i] - (uint32_t) *n1[i];
+        if (delta[i] != (uint32_t) *n1[i] - (uint32_t) *n0[i])
+            return LOOP_NO_MATCH;
+        still &= delta[i] == 0;
+    }
+
+    // Both periods must take the same path, and only stores may stride through memory.
+    const loop_event *first = &engine->log[s0->event];
+    const loop_event *second = &engine->log[s1->event];
+    uint32_t addresses[LOOP_MAX_ADDRESSES];
+    int address_count = 0;
+    bool strided = false;
+    uint64_t periods = LOOP_NEVER;
+
+    for (int i = 0; i < events; i++) {
+        if (first[i].kind != second[i].kind)
+            return LOOP_NO_MATCH;
+
+        const uint32_t change = second[i].value - first[i].value;
+        if (first[i].kind == LOOP_BRANCH) {
+            if ((first[i].value == 0) != (second[i].value == 0))
+                return LOOP_NO_MATCH;
+
+            const uint64_t flip = loop_first_flip(second[i].value, change);
+            if (flip != LOOP_NEVER && flip - 1 < periods)
+                periods = flip - 1;
+            continue;
+        }
+
+        const int32_t stride = (int32_t) (second[i].address - first[i].address);
+        if (stride != 0) {
+            // Whether a data cache hits depends on the address, so its timing would not repeat.
+            if (first[i].kind == LOOP_LOAD || state->cache.lines != NULL)
+                return LOOP_NO_MATCH;
+
+            const uint64_t last = loop_last_in_bounds(second[i].address, stride, state->data_memory.words);
+            if (last < periods)
+                periods = last;
+            strided = true;
+            continue;
+        }
+
+        int known = 0;
+        while (known < address_count && addresses[known] != second[i].address)
+            known++;
+        if (known == address_count) {
+            if (address_count == LOOP_MAX_ADDRESSES)
+                return LOOP_NO_MATCH;
+            addresses[address_count++] = second[i].address;
+        }
+    }
+
+    // The words at fixed addresses at each snapshot, recovered from what the first store
+    // to each overwrote.
+    uint32_t words[LOOP_MAX_ADDRESSES], changes[LOOP_MAX_ADDRESSES];
+    for (int j = 0; j < address_count; j++) {
+        const uint32_t w2 = memory_load(&state->data_memory, (int) addresses[j]);
+        uint32_t w1 = w2, w0;
+        int i = 0;
+        while (i < events && !(second[i].kind == LOOP_STORE && second[i].address == addresses[j]))
+            i++;
+        if (i < events)
+            w1 = second[i].old;
+
+        w0 = w1;
+        i = 0;
+        while (i < events && !(first[i].kind == LOOP_STORE && first[i].address == addresses[j]))
+            i++;
+        if (i < events)
+            w0 = first[i].old;
+
+        words[j] = w2;
+        changes[j] = w2 - w1;
+        if (changes[j] != w1 - w0)
+            return LOOP_NO_MATCH;
+        still &= changes[j] == 0;
+    }
+
+    // A strided store must not reach a fixed address in any period, observed or skipped.
+    for (int i = 0; strided && i < events; i++) {
+        const int32_t stride = (int32_t) (second[i].address - first[i].address);
+        if (second[i].kind != LOOP_STORE || stride == 0)
+            continue;
+
+        for (int j = 0; j < address_count; j++) {
+            const int64_t distance = (int64_t) addresses[j] - second[i].address;
+            if (distance % stride != 0)
+                continue;
+
+            const int64_t when = distance / stride;
+            if (when >= -1 && when <= 0)
+                return LOOP_NO_MATCH;
+            if (when > 0 && (uint64_t) when - 1 < periods)
+                periods = when - 1;
+        }
+    }
+
+    // Without the affine argument, only a state that repeats exactly can be relied on.
+    if (!engine->linear && (!still || strided))
+        return LOOP_NO_MATCH;
+
+    if (periods == LOOP_NEVER && !strided)
+        return LOOP_INFINITE;
+
+    const uint64_t affordable = (uint64_t) (limit - state->cycles_executed) / cycles;
+    if (affordable < periods)
+        periods = affordable;
+    if (periods == 0)
+        return LOOP_NO_MATCH;
+
+    // Replay the strided stores of the skipped periods in order, then advance the state.
+    for (uint64_t t = 1; strided && t <= periods; t++) {
+        for (int i = 0; i < events; i++) {
+            const int32_t stride = (int32_t) (second[i].address - first[i].address);
+            if (second[i].kind == LOOP_STORE && stride != 0) {
+                memory_store(&state->data_memory, (int) (second[i].address + (int64_t) t * stride),
+                             (int) (second[i].value + (uint32_t) t * (second[i].value - first[i].value)));
+            }
+        }
+    }
+
+    for (int j = 0; j < address_count; j++)
+        memory_store(&state->data_memory, (int) addresses[j], (int) (words[j] + (uint32_t) periods * changes[j]));
+
+    int *numbers[LOOP_NUMBERS];
+    loop_numbers(&state->decode_buffer, &state->execute_buffer, &state->memory_buffer, &state->writeback_buffer,
+                 state->register_file, numbers);
+    for (int i = 0; i < LOOP_NUMBERS; i++)
+        *numbers[i] = (int) ((uint32_t) *numbers[i] + (uint32_t) periods * delta[i]);
+
+    state->cycles_executed += periods * cycles;
+    state->instructions_executed += periods * instructions;
+
+    // The counters depend only on the path through the loop, so they advance as steadily.
+    long long *counters = (long long *) &state->stats;
+    const long long *before = (const long long *) &s1->stats, *after = (const long long *) &s2->stats;
+    for (size_t i = 0; i < PIPELINE_STATS_COUNT; i++)
+        counters[i] += periods * (after[i] - before[i]);
+
+    loop_reset(engine);
+    return LOOP_SKIPPED;
+}
+
+/**
+ * Records a visit to the loop header at fetch_buffer.pc and extrapolates the loop if it
+ * has reached a steady state.
+ */
+static loop_result loop_visit(loop_engine *engine, cpu_state *state, long long limit) {
+    const int header = state->fetch_buffer.pc;
+    loop_candidate *candidate = NULL;
+
+    for (int i = 0; i < LOOP_CANDIDATES; i++) {
+        loop_candidate *c = &engine->candidates[i];
+        if (c->header == header) {
+            candidate = c;
+            break;
+        }
+        if (candidate == NULL || c->header == -1 || (candidate->header != -1 && c->last_visit < candidate->last_visit))
+            candidate = c;
+    }
+    if (candidate->header != header) {
+        candidate->header = header;
+        candidate->count = 0;
+        candidate->next = 0;
+    }
+    candidate->last_visit = state->cycles_executed;
+
+    loop_snapshot *snapshot = &candidate->history[candidate->next];
+    snapshot->fetch = state->fetch_buffer;
+    snapshot->decode = state->decode_buffer;
+    snapshot->execute = state->execute_buffer;
+    snapshot->memory = state->memory_buffer;
+    snapshot->writeback = state->writeback_buffer;
+    memcpy(snapshot->registers, state->register_file, sizeof(snapshot->registers));
+    snapshot->cycles = state->cycles_executed;
+    snapshot->instructions = state->instructions_executed;
+    snapshot->stats = state->stats;
+    snapshot->history = state->predictor.history;
+    snapshot->predictor_changes = state->predictor.changes;
+    snapshot->cache_changes = state->cache.changes;
+    scoreboard_copy(&snapshot->units, &state->scoreboard);
+    snapshot->event = engine->events;
+
+    candidate->next = (candidate->next + 1) % LOOP_HISTORY;
+    if (candidate->count < LOOP_HISTORY)
+        candidate->count++;
+
+    for (int period = 1; period <= LOOP_MAX_PERIOD && 2 * period < candidate->count; period++) {
+        const loop_result result = loop_analyze(engine, state, candidate, period, limit);
+        if (result != LOOP_NO_MATCH)
+            return result;
+    }
+    return LOOP_NO_MATCH;
+}
+
+/**
+ * Appends an event to the log, forgetting everything once it is full.
+ */
+static void loop_log(loop_engine *engine, loop_event_kind kind, uint32_t value, uint32_t address, uint32_t old) {
+    if (engine->events == LOOP_LOG_SIZE)
+        loop_reset(engine);
+
+    engine->log[engine->events++] = (loop_event) { kind, value, address, old };
+}
+
+bool loop_engine_run(loop_engine *engine, cpu_state *state, long long cycles, int *loop) {
+    bool infinite = false;
+
+    while (!state->halt && state->cycles_executed < cycles) {
+        const int pc = state->fetch_buffer.pc;
+        const struct memory_buffer *memory = &state->memory_buffer;
+        if ((memory->inst.flags & INST_STORE) && memory_in_bounds(&state->data_memory, memory->alu_out))
+            engine->overwritten = memory_load(&state->data_memory, memory->alu_out);
+
+        simulate_cycle(state);
+        state->cycles_executed++;
+
+        // The latches now hold what the memory and decode stages did this cycle.
+        // A store conditional depends on the reservation, which no snapshot holds.
+        const struct writeback_buffer *writeback = &state->writeback_buffer;
+        if (writeback->inst.flags & INST_ATOMIC)
+            loop_reset(engine);
+        else if (writeback->inst.flags & INST_LOAD)
+            loop_log(engine, LOOP_LOAD, writeback->read_data, writeback->alu_out, 0);
+        else if (writeback->inst.flags & INST_STORE)
+            loop_log(engine, LOOP_STORE, memory_load(&state->data_memory, writeback->alu_out), writeback->alu_out,
+                     engine->overwritten);
+        if (state->execute_buffer.inst.flags & INST_BRANCH)
+            loop_log(engine, LOOP_BRANCH, state->execute_buffer.a, 0, 0);
+
+        if (state->fetch_buffer.pc < pc && loop_visit(engine, state, cycles) == LOOP_INFINITE) {
+            *loop = state->fetch_buffer.pc;
+            infinite = true;
+            break;
+        }
+    }
+
+    return infinite;
+}
+
+bool loop_simulate_until(cpu_state *state, long long cycles, int *loop) {
+    loop_engine *engine = loop_engine_create(state);
+    fault_handler handler;
+    fault_enter(&handler);
+    if (setjmp(handler.target) != 0) {
+        loop_engine_destroy(engine);
+        fault_forward(&handler);
+    }
+
+    const bool infinite = loop_engine_run(engine, state, cycles, loop);
+    fault_leave(&handler);
+    loop_engine_destroy(engine);
+    return infinite;
+}
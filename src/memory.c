@@ -0,0 +1,139 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "memory.h"
+
+const int memory_zero_page[MEMORY_PAGE_WORDS];
+int *const memory_zero_table[MEMORY_TABLE_SIZE] = {
+    [0 ... MEMORY_TABLE_SIZE - 1] = (int *) memory_zero_page
+};
+
+void memory_init(data_memory *memory, uint64_t words) {
+    for (int i = 0; i < MEMORY_TABLE_SIZE; i++)
+        memory->directory[i] = (int **) memory_zero_table;
+    memory->words = words;
+    memory->pages = 0;
+    memory->mapping = NULL;
+    memory->mapping_size = 0;
+    memory->log = NULL;
+    memory->log_count = 0;
+    memory->log_capacity = 0;
+}
+
+void memory_free(data_memory *memory) {
+    for (int i = 0; i < MEMORY_TABLE_SIZE; i++) {
+        int **table = memory->directory[i];
+        if (table == memory_zero_table)
+            continue;
+
+        for (int j = 0; j < MEMORY_TABLE_SIZE; j++) {
+            const char *page = (const char *) table[j];
+            const bool mapped = page >= memory->mapping && page < memory->mapping + memory->mapping_size;
+            if (page != (const char *) memory_zero_page && !mapped)
+                free(table[j]);
+        }
+        free(table);
+    }
+    if (memory->mapping != NULL)
+        munmap(memory->mapping, memory->mapping_size);
+    free(memory->log);
+    memory_init(memory, memory->words);
+}
+
+void memory_clear(data_memory *memory) {
+    if (memory->mapping != NULL) {
+        memory_free(memory);
+        return;
+    }
+
+    long cleared = 0;
+    for (int i = 0; i < MEMORY_TABLE_SIZE && cleared < memory->pages; i++) {
+        int **table = memory->directory[i];
+        if (table == memory_zero_table)
+            continue;
+        for (int j = 0; j < MEMORY_TABLE_SIZE; j++) {
+            if (table[j] != memory_zero_page) {
+                memset(table[j], 0, MEMORY_PAGE_WORDS * sizeof(int));
+                cleared++;
+            }
+        }
+    }
+    memory->log_count = 0;
+}
+
+int *memory_page(const data_memory *memory, uint32_t page_number) {
+    int *page = memory->directory[page_number >> MEMORY_TABLE_BITS][page_number & (MEMORY_TABLE_SIZE - 1)];
+    return page == memory_zero_page ? NULL : page;
+}
+
+int *memory_page_for_write(data_memory *memory, uint32_t page_number) {
+    int ***table = &memory->directory[page_number >> MEMORY_TABLE_BITS];
+    if (*table == memory_zero_table) {
+        *table = malloc(sizeof(memory_zero_table));
+        memcpy(*table, memory_zero_table, sizeof(memory_zero_table));
+    }
+
+    int **page = &(*table)[page_number & (MEMORY_TABLE_SIZE - 1)];
+    if (*page == memory_zero_page) {
+        *page = calloc(MEMORY_PAGE_WORDS, sizeof(int));
+        memory->pages++;
+    }
+    return *page;
+}
+
+void memory_attach_page(data_memory *memory, uint32_t page_number, int *page, char *mapping, size_t mapping_size) {
+    int ***table = &memory->directory[page_number >> MEMORY_TABLE_BITS];
+    if (*table == memory_zero_table) {
+        *table = malloc(sizeof(memory_zero_table));
+        memcpy(*table, memory_zero_table, sizeof(memory_zero_table));
+    }
+
+    int **entry = &(*table)[page_number & (MEMORY_TABLE_SIZE - 1)];
+    if (*entry == memory_zero_page)
+        memory->pages++;
+    else
+        free(*entry);
+    *entry = page;
+
+    memory->mapping = mapping;
+    memory->mapping_size = mapping_size;
+}
+
+void memory_log_start(data_memory *memory) {
+    memory->log_capacity = 1024;
+    memory->log = malloc(memory->log_capacity * sizeof(uint32_t));
+    memory->log_count = 0;
+}
+
+void memory_log_append(data_memory *memory, uint32_t word) {
+    if (memory->log_count == memory->log_capacity) {
+        memory->log_capacity *= 2;
+        memory->log = realloc(memory->log, memory->log_capacity * sizeof(uint32_t));
+    }
+    memory->log[memory->log_count++] = word;
+}
+
+uint32_t memory_next_page(const data_memory *memory, uint64_t page_number) {
+    const uint64_t pages = MEMORY_MAX_WORDS / MEMORY_PAGE_WORDS;
+
+    while (page_number < pages) {
+        int **table = memory->directory[page_number >> MEMORY_TABLE_BITS];
+        if (table == memory_zero_table) {
+            page_number = ((page_number >> MEMORY_TABLE_BITS) + 1) << MEMORY_TABLE_BITS;
+            continue;
+        }
+        if (table[page_number & (MEMORY_TABLE_SIZE - 1)] != memory_zero_page)
+            return (uint32_t) page_number;
+        page_number++;
+    }
+    return (uint32_t) pages;
+}
+
+void memory_copy(data_memory *to, const data_memory *from) {
+    const uint64_t pages = MEMORY_MAX_WORDS / MEMORY_PAGE_WORDS;
+
+    memory_init(to, from->words);
+    for (uint64_t page = memory_next_page(from, 0); page < pages; page = memory_next_page(from, page + 1))
+        memcpy(memory_page_for_write(to, (uint32_t) page), memory_page(from, (uint32_t) page),
+               MEMORY_PAGE_WORDS * sizeof(int));
+}
@@ -0,0 +1,155 @@
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "multicore.h"
+#include "pipeline.h"
+
+typedef struct {
+    multicore *machine;
+    int core;
+} multicore_thread;
+
+bool multicore_parse(const char *spec, multicore_options *options) {
+    char *end;
+    if (!isdigit((unsigned char) spec[0]))
+        return false;
+    errno = 0;
+    const long cores = strtol(spec, &end, 10);
+
+    options->quantum = DEFAULT_QUANTUM;
+    if (*end == ',') {
+        const char *quantum = end + 1;
+        if (!isdigit((unsigned char) quantum[0]))
+            return false;
+        options->quantum = strtoll(quantum, &end, 10);
+    }
+    options->cores = cores >= 1 && cores <= MULTICORE_MAX_CORES ? (int) cores : 0;
+    return *end == '\0' && errno == 0 && options->cores > 0 && options->quantum >= 1;
+}
+
+void multicore_init(multicore *machine, const multicore_options *options, cpu_state **cores) {
+    memset(machine, 0, sizeof(*machine));
+    machine->options = *options;
+    machine->cores = cores;
+
+    for (int i = 0; i < options->cores; i++) {
+        cores[i]->reservation.shared = true;
+        cores[i]->register_file[R15] = i;
+        cores[i]->register_file[R14] = options->cores;
+        memory_log_start(&cores[i]->data_memory);
+    }
+}
+
+/**
+ * Writes a word to the data memory of every core, cancelling the reservations of it of
+ * every core but the one storing it.
+ */
+static void multicore_broadcast(multicore *machine, int core, int address, int value) {
+    for (int i = 0; i < machine->options.cores; i++) {
+        cpu_state *state = machine->cores[i];
+        memory_write(&state->data_memory, address, value);
+        if (i != core && state->reservation.valid && state->reservation.address == address)
+            state->reservation.valid = false;
+    }
+}
+
+/**
+ * Merges the stores of the quantum into every core, performs the store conditionals
+ * waiting for it, and sets up the next quantum. Called by one thread while the others
+ * wait at the barrier.
+ */
+static void multicore_synchronize(multicore *machine) {
+    const int count = machine->options.cores;
+
+    // Each core's stores are taken with the values it left, before any other core's overwrite them.
+    int **values = malloc(count * sizeof(int *));
+    for (int i = 0; i < count; i++) {
+        const data_memory *memory = &machine->cores[i]->data_memory;
+        values[i] = malloc((memory->log_count + 1) * sizeof(int));
+        for (long j = 0; j < memory->log_count; j++)
+            values[i][j] = memory_load(memory, (int) memory->log[j]);
+    }
+    for (int i = 0; i < count; i++) {
+        data_memory *memory = &machine->cores[i]->data_memory;
+        for (long j = 0; j < memory->log_count; j++)
+            multicore_broadcast(machine, i, (int) memory->log[j], values[i][j]);
+        memory->log_count = 0;
+        free(values[i]);
+    }
+    free(values);
+
+    for (int i = 0; i < count; i++) {
+        cpu_state *state = machine->cores[i];
+        if (state->reservation.conditional != CONDITIONAL_WAITING)
+            continue;
+
+        const int address = state->memory_buffer.alu_out;
+        const bool stored = state->reservation.valid && state->reservation.address == address;
+        if (stored)
+            multicore_broadcast(machine, i, address, state->memory_buffer.write_data);
+        state->reservation.valid = false;
+        state->reservation.conditional = stored ? CONDITIONAL_SUCCEEDED : CONDITIONAL_FAILED;
+        machine->conditionals++;
+        machine->failed += !stored;
+    }
+
+    machine->quanta++;
+    machine->done = true;
+    for (int i = 0; i < count; i++)
+        machine->done &= machine->cores[i]->halt || machine->cores[i]->cycles_executed >= machine->limit;
+
+    machine->until = machine->until + machine->options.quantum < machine->limit
+            ? machine->until + machine->options.quantum : machine->limit;
+}
+
+static void *multicore_work(void *argument) {
+    const multicore_thread *thread = argument;
+    multicore *machine = thread->machine;
+    cpu_state *state = machine->cores[thread->core];
+
+    while (!machine->done) {
+        while (!state->halt && state->cycles_executed < machine->until) {
+            simulate_cycle(state);
+            state->cycles_executed++;
+        }
+
+        if (pthread_barrier_wait(&machine->barrier) == PTHREAD_BARRIER_SERIAL_THREAD)
+            multicore_synchronize(machine);
+        pthread_barrier_wait(&machine->barrier);
+    }
+    return NULL;
+}
+
+void multicore_run(multicore *machine, long long cycles) {
+    const int count = machine->options.cores;
+    pthread_t *handles = calloc(count, sizeof(pthread_t));
+    multicore_thread *threads = calloc(count, sizeof(multicore_thread));
+
+    machine->limit = cycles;
+    machine->until = machine->options.quantum < cycles ? machine->options.quantum : cycles;
+    machine->done = false;
+    pthread_barrier_init(&machine->barrier, NULL, count);
+
+    for (int i = 0; i < count; i++)
+        threads[i] = (multicore_thread) { machine, i };
+    for (int i = 1; i < count; i++)
+        pthread_create(&handles[i], NULL, multicore_work, &threads[i]);
+    multicore_work(&threads[0]);
+    for (int i = 1; i < count; i++)
+        pthread_join(handles[i], NULL);
+
+    pthread_barrier_destroy(&machine->barrier);
+    free(threads);
+    free(handles);
+}
+
+long long multicore_cycles(const multicore *machine) {
+    long long cycles = 0;
+    for (int i = 0; i < machine->options.cores; i++) {
+        if (machine->cores[i]->cycles_executed > cycles)
+            cycles = machine->cores[i]->cycles_executed;
+    }
+    return cycles;
+}
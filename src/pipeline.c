@@ -0,0 +1,360 @@
+#include "pipeline.h"
+#include "loop.h"
+
+void pipeline_fetch(cpu_state *state) {
+    struct fetch_buffer *fetch = &state->fetch_buffer;
+
+    // Hold the fetched instruction while the memory stage waits.
+    if (state->memory_buffer.waiting)
+        return;
+
+    // Do nothing if stalling is requested. The fetch stage always stalls
+    // alongside the decode_buffer stage, which handles injecting a NOP into the execute stage.
+    if (fetch->stall) {
+        fetch->stall = false;
+        return;
+    }
+
+    // Flush if requested. This adds a NOP into the decode stage in order
+    // to account for mispredicted jumps.
+    if (fetch->flush) {
+        state->decode_buffer.inst = nop;
+        state->decode_buffer.predicted = false;
+        fetch->flush = false;
+        fetch->pc = fetch->pc_branch;
+        state->events |= EVENT_FLUSH;
+        return;
+    }
+
+    const int pc = fetch->pc;
+    state->stats.drain_cycles += pc > state->instructions_count - 1;
+
+    // A pipelined processor is not done executing until the last instruction reaches the writeback stage.
+    // To facilitate this, we fill the pipeline with NOPs when accessing out-of-bounds instructions not caused
+    // by a should_jump instruction (i.e., jumping out-of-bounds will still result in an error being thrown).
+    // Instruction memory is padded with PIPELINE_DRAIN empty instructions for this.
+    if (pc > state->instructions_count - 1) {
+        // If the last instruction has reached the writeback stage, we should halt the processor. This occurs when
+        // four additional instructions have been fetched by the processor, unless an instruction is still in a
+        // functional unit or on its way from one to the writeback stage.
+        if (pc >= state->instructions_count + 3) {
+            state->halt = scoreboard_idle(&state->scoreboard) && state->memory_buffer.inst.op == NOP
+                    && state->writeback_buffer.inst.op == NOP;
+        } else {
+            // Otherwise, we keep injecting NOPs.
+            state->decode_buffer.inst = nop;
+        }
+    }
+
+    // Fetch stays on the last padding instruction while the functional units drain.
+    const int next_pc = pc < state->instructions_count + 3 ? pc + 1 : pc;
+
+    state->decode_buffer.inst = state->instruction_memory[pc];
+    state->decode_buffer.pc_next = next_pc;
+
+    // Update the program counter for the next cycle, following the branch predictor. A
+    // target outside the program is left for decode to report.
+    int target = next_pc;
+    bool predicted = false;
+    if (state->decode_buffer.inst.flags & (INST_BRANCH | INST_JUMP)) {
+        predicted = predictor_predict(&state->predictor, &state->decode_buffer.inst, pc, &target)
+                && target >= 0 && target < state->instructions_count;
+    }
+    state->decode_buffer.predicted = predicted;
+    fetch->pc = predicted ? target : next_pc;
+}
+
+void pipeline_decode(cpu_state *state) {
+    struct decode_buffer *decode = &state->decode_buffer;
+    const struct instruction inst = state->decode_buffer.inst;
+
+    if (state->memory_buffer.waiting)
+        return;
+
+    // Inject a NOP into the execute stage when requested to stall. Instruct the fetch stage to stall.
+    if (decode->stall) {
+        decode->stall = false;
+        state->fetch_buffer.stall = true;
+        state->execute_buffer.inst = nop;
+        state->events |= EVENT_STALL;
+        return;
+    }
+
+    // Hold the instruction, as for a stall, until the scoreboard clears it of hazards with
+    // the functional units.
+    if (scoreboard_blocked(&state->scoreboard, &inst)) {
+        state->fetch_buffer.stall = true;
+        state->execute_buffer.inst = nop;
+        state->events |= EVENT_STALL;
+        state->stats.unit_stalls++;
+        return;
+    }
+    if (inst.flags & INST_UNIT)
+        scoreboard_issue(&state->scoreboard, &inst);
+
+    int a, b;
+
+    if (decode->forward)
+        state->events |= EVENT_FORWARD_BRANCH;
+    state->stats.forward_branch += decode->forward;
+
+    // Access register file. Use the forwarded value for avoiding control hazards, if necessary.
+    a = decode->forward ? decode->data : state->register_file[inst.rs];
+    b = state->register_file[inst.rt];
+    decode->forward = false;
+
+    // Resolve should_jump instructions
+    const bool should_jump = (inst.flags & INST_JUMP)
+            || ((inst.flags & INST_BRANCH) && (a == 0) == (inst.branch == BRANCH_EQZ));
+
+    // Again, there should be a shift here, but since instruction memory is not byte-addressed,
+    // it is omitted.
+    const int target = inst.imm + decode->pc_next;
+
+    // If we are jumping to an out-of-bounds address, halt the simulator with an error.
+    if (should_jump && (target < 0 || target > state->instructions_count - 1)) {
+        fault_raise(ERROR_ILLEGAL_JUMP, "out-of-bounds should_jump to %d\n", target);
+    }
+
+    // Fetch only has to be corrected if it did not follow the branch as resolved.
+    const bool mispredicted = should_jump != decode->predicted;
+    decode->should_jump = should_jump;
+    state->fetch_buffer.flush = mispredicted;
+    state->fetch_buffer.pc_branch = should_jump ? target : decode->pc_next;
+
+    const bool branch = (inst.flags & (INST_BRANCH | INST_JUMP)) != 0;
+    if (branch)
+        predictor_update(&state->predictor, &inst, decode->pc_next - 1, should_jump, target);
+    state->stats.flushes += mispredicted;
+    state->stats.branches += branch;
+    state->stats.taken += should_jump;
+
+    state->execute_buffer.inst = inst;
+    state->execute_buffer.a = a;
+    state->execute_buffer.b = b;
+}
+
+void pipeline_execute(cpu_state *state) {
+    struct execute_buffer *execute = &state->execute_buffer;
+    const struct instruction inst = execute->inst;
+
+    // Hold the instruction while the memory stage waits. An operand forwarded from the
+    // writeback stage now would have left the pipeline by the time it resumes, so it is
+    // taken into the latch.
+    if (state->memory_buffer.waiting) {
+        if (execute->foward_a == WRITEBACK)
+            execute->a = state->writeback_buffer.result;
+        if (execute->forward_b == WRITEBACK)
+            execute->b = state->writeback_buffer.result;
+        execute->foward_a = NO_FORWARDING;
+        execute->forward_b = NO_FORWARDING;
+        return;
+    }
+
+    scoreboard_tick(&state->scoreboard);
+
+    int a = execute->a;
+    int write_data = execute->b;
+
+    // Handle forwarding from the memory and writeback stages for
+    // the two operands.
+    if(execute->foward_a == MEMORY)
+        // If the instruction reads from memory, we want the value read from memory, not
+        // the calculated address.
+        a = (state->memory_buffer.inst.flags & INST_LOAD)
+                ? state->writeback_buffer.read_data
+                : state->memory_buffer.alu_out;
+    else if(execute->foward_a == WRITEBACK)
+        a = state->writeback_buffer.result;
+
+    if(execute->forward_b == MEMORY)
+        // See above.
+        write_data = (state->memory_buffer.inst.flags & INST_LOAD)
+                ? state->writeback_buffer.read_data
+                : state->memory_buffer.alu_out;
+    else if(execute->forward_b == WRITEBACK)
+        write_data = state->writeback_buffer.result;
+
+    state->events |= execute->foward_a << EVENT_FORWARD_A_SHIFT | execute->forward_b << EVENT_FORWARD_B_SHIFT;
+    state->stats.forward_memory += (execute->foward_a == MEMORY) + (execute->forward_b == MEMORY);
+    state->stats.forward_writeback += (execute->foward_a == WRITEBACK) + (execute->forward_b == WRITEBACK);
+    execute->foward_a  = NO_FORWARDING;
+    execute->forward_b = NO_FORWARDING;
+
+    int b = (inst.flags & INST_IMMEDIATE) ? inst.imm : write_data;
+
+    int alu_out = processor_alu(inst.alu, a, b);
+
+    // A multiplication or division moves into its unit. Whatever leaves a unit this cycle
+    // moves on to the memory stage instead of the instruction executed; the scoreboard has
+    // kept that from being anything but a bubble.
+    struct instruction out = inst;
+    if (inst.flags & INST_UNIT) {
+        scoreboard_start(&state->scoreboard, &inst, alu_out);
+        out = nop;
+    }
+
+    unit_operation done;
+    if (state->scoreboard.count > 0 && scoreboard_finish(&state->scoreboard, &done)) {
+        out = done.inst;
+        alu_out = done.result;
+    }
+
+    // We don't forward to avoid control hazards in the execute stage. A stall already
+    // requested for a load is not counted again.
+    if (state->decode_buffer.inst.flags & INST_BRANCH) {
+        const bool stalled = state->decode_buffer.stall;
+        state->stats.branch_stalls += processor_stall_on_hazard(state, state->decode_buffer.inst, out) & !stalled;
+    }
+
+    state->memory_buffer.alu_out = alu_out;
+    state->memory_buffer.write_data = write_data;
+    state->memory_buffer.inst = out;
+    state->memory_buffer.accessed = false;
+}
+
+void pipeline_memory(cpu_state *state) {
+    struct memory_buffer *memory = &state->memory_buffer;
+
+    const int alu_out = memory->alu_out;
+    int data = alu_out;
+    const struct instruction inst = memory->inst;
+
+    // Validate the address to be accessed, if necessary.
+    if (inst.flags & INST_MEMORY) {
+        if (!memory_in_bounds(&state->data_memory, alu_out)) {
+            fault_raise(ERROR_ILLEGAL_MEM_ACCESS, "Exception: out-of-bounds data memory access at %d\n", alu_out);
+        }
+    }
+
+    // The first cycle of an access looks it up in the data cache. Until the access
+    // completes, the instruction stays here, a bubble moves on to writeback, and the
+    // stages behind hold their instructions.
+    memory->waiting = false;
+    if (state->cache.lines != NULL && (inst.flags & INST_MEMORY)) {
+        if (!memory->accessed) {
+            int latency;
+            const cache_outcome outcome = cache_access(&state->cache, alu_out, inst.flags & INST_STORE, &latency);
+            state->stats.cache_hits += outcome == CACHE_HIT;
+            state->stats.cache_misses += outcome != CACHE_HIT;
+            state->stats.cache_writebacks += outcome == CACHE_MISS_WRITEBACK;
+            memory->accessed = true;
+            memory->wait = latency - 1;
+        }
+
+        if (memory->wait > 0) {
+            memory->wait--;
+            memory->waiting = true;
+            state->writeback_buffer.inst = nop;
+            state->stats.memory_stalls++;
+            state->events |= EVENT_MEMORY_WAIT;
+            return;
+        }
+    }
+
+    // On a multicore machine a store conditional waits here as well, until the machine
+    // performs it at the end of the quantum.
+    const bool conditional = (inst.flags & (INST_ATOMIC | INST_STORE)) == (INST_ATOMIC | INST_STORE);
+    if (conditional && state->reservation.shared) {
+        if (state->reservation.conditional == CONDITIONAL_NONE)
+            state->reservation.conditional = CONDITIONAL_WAITING;
+        if (state->reservation.conditional == CONDITIONAL_WAITING) {
+            memory->waiting = true;
+            state->writeback_buffer.inst = nop;
+            state->stats.memory_stalls++;
+            state->events |= EVENT_MEMORY_WAIT;
+            return;
+        }
+    }
+
+    // Perform the necessary memory operation
+    switch (inst.flags & INST_MEMORY) {
+        case INST_LOAD:
+            data = memory_load(&state->data_memory, alu_out);
+            state->writeback_buffer.read_data = data;
+            if (inst.flags & INST_ATOMIC)
+                processor_load_linked(state, alu_out);
+
+            // If we are reading from memory, we have to stall if either the execute or decode
+            // read from the register this operation writes to
+            state->stats.load_use_stalls += processor_stall_on_hazard(state, state->decode_buffer.inst, inst)
+                    | processor_stall_on_hazard(state, state->execute_buffer.inst, inst);
+            break;
+        case INST_STORE:
+            if (!conditional) {
+                memory_store(&state->data_memory, alu_out, memory->write_data);
+                break;
+            }
+
+            // A store conditional writes whether it stored in place of its address, and is
+            // waited for like a load.
+            if (state->reservation.shared) {
+                data = state->reservation.conditional == CONDITIONAL_SUCCEEDED;
+                state->reservation.conditional = CONDITIONAL_NONE;
+            } else {
+                data = processor_store_conditional(state, alu_out, memory->write_data);
+            }
+            memory->alu_out = data;
+            state->stats.load_use_stalls += processor_stall_on_hazard(state, state->decode_buffer.inst, inst)
+                    | processor_stall_on_hazard(state, state->execute_buffer.inst, inst);
+            break;
+    }
+
+    processor_forward_on_hazard(state, &state->execute_buffer.foward_a,
+                                state->execute_buffer.inst, inst, MEMORY, data);
+
+    state->writeback_buffer.inst = inst;
+    state->writeback_buffer.alu_out = conditional ? data : alu_out;
+}
+
+void pipeline_writeback(cpu_state *state) {
+    struct writeback_buffer *writeback = &state->writeback_buffer;
+    const struct instruction inst = writeback->inst;
+
+    int data = 0;
+
+    if (inst.flags & INST_WRITES) {
+        if (inst.dest == R0) {
+            fault_raise(ERROR_ILLEGAL_REG_WRITE, "Exception: Attempt to overwrite R0\n");
+        }
+
+        data = (inst.flags & INST_LOAD) ? writeback->read_data : writeback->alu_out;
+        state->register_file[inst.dest] = data;
+    }
+
+    processor_forward_on_hazard(state, &state->execute_buffer.foward_a,
+                                state->execute_buffer.inst, inst, WRITEBACK, data);
+
+    writeback->result = data;
+
+    // Only increment counter if the instruction executed was not a NOP
+    if (inst.op != nop.op) {
+        state->instructions_executed++;
+    }
+}
+
+void simulate_cycle(cpu_state *state) {
+    // Simulate each pipeline stage every cycle.
+    // This is done in reverse to ensure that each
+    // stage's change to the state of the processor
+    // only affects it after the current cycle ends.
+    pipeline_writeback(state);
+    pipeline_memory(state);
+    pipeline_execute(state);
+    pipeline_decode(state);
+    pipeline_fetch(state);
+}
+
+bool simulate_until(cpu_state *state, long long cycles, bool exact, trace_writer *trace, int *loop) {
+    if (!exact && trace == NULL)
+        return loop_simulate_until(state, cycles, loop);
+
+    // Execute the simulator until it is halted
+    while (!state->halt && state->cycles_executed < cycles) {
+        simulate_cycle(state);     /* simulate one cycle */
+        state->cycles_executed++;  /* update cycle count */
+        if (trace != NULL)
+            trace_cycle(trace, state);
+    }
+    return false;
+}
@@ -0,0 +1,124 @@
+#include <stdlib.h>
+#include <string.h>
+#include "predictor.h"
+
+bool predictor_parse(const char *name, predictor_kind *kind) {
+    static const char *names[] = { "not-taken", "btfn", "bimodal", "gshare", "btb" };
+    for (int i = 0; i < (int) (sizeof(names) / sizeof(names[0])); i++) {
+        if (strcmp(name, names[i]) == 0) {
+            *kind = (predictor_kind) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *predictor_name(predictor_kind kind) {
+    switch (kind) {
+        case PREDICT_BTFN:    return "backward taken, forward not taken";
+        case PREDICT_BIMODAL: return "bimodal";
+        case PREDICT_GSHARE:  return "gshare";
+        case PREDICT_BTB:     return "BTB";
+        default:              return "not taken";
+    }
+}
+
+bool predictor_valid(const predictor_options *options) {
+    return options->kind >= PREDICT_NOT_TAKEN && options->kind <= PREDICT_BTB
+            && options->entries > 0 && options->entries <= PREDICTOR_MAX_ENTRIES
+            && (options->entries & (options->entries - 1)) == 0
+            && options->history_bits >= 0 && options->history_bits <= 31;
+}
+
+void predictor_init(branch_predictor *predictor, const predictor_options *options) {
+    memset(predictor, 0, sizeof(*predictor));
+    predictor->options = *options;
+
+    if (options->kind == PREDICT_BIMODAL || options->kind == PREDICT_GSHARE || options->kind == PREDICT_BTB) {
+        predictor->counters = malloc(options->entries);
+        memset(predictor->counters, 1, options->entries);
+    }
+    if (options->kind == PREDICT_BTB) {
+        predictor->tags = malloc(options->entries * sizeof(int));
+        predictor->targets = calloc(options->entries, sizeof(int));
+        memset(predictor->tags, 0xFF, options->entries * sizeof(int));
+    }
+}
+
+void predictor_free(branch_predictor *predictor) {
+    free(predictor->counters);
+    free(predictor->tags);
+    free(predictor->targets);
+    predictor->counters = NULL;
+    predictor->tags = NULL;
+    predictor->targets = NULL;
+}
+
+/**
+ * @return the entry of the counter table predicting the branch at pc
+ */
+static int predictor_index(const branch_predictor *predictor, int pc) {
+    uint32_t index = (uint32_t) pc;
+    if (predictor->options.kind == PREDICT_GSHARE)
+        index ^= predictor->history;
+    return (int) (index & (uint32_t) (predictor->options.entries - 1));
+}
+
+bool predictor_predict(const branch_predictor *predictor, const struct instruction *inst, int pc, int *target) {
+    if (!(inst->flags & (INST_BRANCH | INST_JUMP)))
+        return false;
+
+    *target = pc + 1 + inst->imm;
+    switch (predictor->options.kind) {
+        case PREDICT_BTFN:
+            return (inst->flags & INST_JUMP) || inst->imm < 0;
+        case PREDICT_BIMODAL:
+        case PREDICT_GSHARE:
+            return (inst->flags & INST_JUMP) || predictor->counters[predictor_index(predictor, pc)] >= 2;
+        case PREDICT_BTB: {
+            const int entry = pc & (predictor->options.entries - 1);
+            *target = predictor->targets[entry];
+            return predictor->tags[entry] == pc && predictor->counters[entry] >= 2;
+        }
+        default:
+            return false;
+    }
+}
+
+/**
+ * Saturating update of a 2-bit counter, counting the change.
+ */
+static void predictor_count(branch_predictor *predictor, uint8_t *counter, bool taken) {
+    const uint8_t next = taken ? (*counter < 3 ? *counter + 1 : 3) : (*counter > 0 ? *counter - 1 : 0);
+    predictor->changes += next != *counter;
+    *counter = next;
+}
+
+void predictor_update(branch_predictor *predictor, const struct instruction *inst, int pc, bool taken, int target) {
+    switch (predictor->options.kind) {
+        case PREDICT_BIMODAL:
+        case PREDICT_GSHARE:
+            if (inst->flags & INST_BRANCH) {
+                predictor_count(predictor, &predictor->counters[predictor_index(predictor, pc)], taken);
+                predictor->history = (predictor->history << 1 | taken) & ((1u << predictor->options.history_bits) - 1);
+            }
+            break;
+        case PREDICT_BTB: {
+            const int entry = pc & (predictor->options.entries - 1);
+            if (predictor->tags[entry] != pc) {
+                // Only taken branches are worth an entry.
+                if (!taken)
+                    break;
+                predictor->tags[entry] = pc;
+                predictor->counters[entry] = 1;
+                predictor->changes++;
+            }
+            predictor->changes += predictor->targets[entry] != target;
+            predictor->targets[entry] = target;
+            predictor_count(predictor, &predictor->counters[entry], taken);
+            break;
+        }
+        default:
+            break;
+    }
+}
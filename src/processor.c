@@ -0,0 +1,61 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "processor.h"
+
+void processor_init(cpu_state *state, uint64_t words) {
+    memset(state, 0, sizeof(*state));
+    memory_init(&state->data_memory, words);
+    units_default(&state->scoreboard.options);
+}
+
+void processor_reset(cpu_state *state) {
+    free(state->instruction_memory);
+    predictor_free(&state->predictor);
+    cache_free(&state->cache);
+    memory_clear(&state->data_memory);
+
+    // Everything but data memory is cleared.
+    const size_t before = offsetof(cpu_state, data_memory);
+    const size_t after = before + sizeof(data_memory);
+    memset(state, 0, before);
+    memset((char *) state + after, 0, sizeof(*state) - after);
+    units_default(&state->scoreboard.options);
+}
+
+void processor_load_program(cpu_state *state, struct instruction *code, int count) {
+    code = realloc(code, (count + PIPELINE_DRAIN) * sizeof(*code));
+    memset(&code[count], 0, PIPELINE_DRAIN * sizeof(*code));
+    instruction_predecode_program(code, count);
+
+    state->instruction_memory = code;
+    state->instructions_count = count;
+}
+
+void processor_free(cpu_state *state) {
+    free(state->instruction_memory);
+    state->instruction_memory = NULL;
+    state->instructions_count = 0;
+    memory_free(&state->data_memory);
+    predictor_free(&state->predictor);
+    cache_free(&state->cache);
+}
+
+bool processor_load_data(cpu_state *state, const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        return false;
+
+    uint64_t address = 0;
+    int value;
+    int matched;
+    while ((matched = fscanf(file, "%d", &value)) == 1) {
+        if (address == state->data_memory.words)
+            break;
+        memory_store(&state->data_memory, (int) address++, value);
+    }
+
+    fclose(file);
+    return matched == EOF;
+}
@@ -0,0 +1,132 @@
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+#include "sampling.h"
+#include "functional.h"
+#include "pipeline.h"
+
+/**
+ * The fetch stage while draining: it still follows a flush, but fetches nothing new.
+ */
+static void sample_fetch_nothing(cpu_state *state) {
+    if (state->memory_buffer.waiting)
+        return;
+    if (state->fetch_buffer.stall || state->fetch_buffer.flush) {
+        pipeline_fetch(state);
+        return;
+    }
+    state->decode_buffer.inst = nop;
+    state->decode_buffer.predicted = false;
+}
+
+/**
+ * @return true if no instruction remains in flight
+ */
+static bool sample_drained(const cpu_state *state) {
+    return state->decode_buffer.inst.op == NOP && state->execute_buffer.inst.op == NOP
+            && state->memory_buffer.inst.op == NOP && state->writeback_buffer.inst.op == NOP
+            && scoreboard_idle(&state->scoreboard) && !state->fetch_buffer.flush && !state->fetch_buffer.stall && !state->decode_buffer.stall;
+}
+
+/**
+ * Completes every instruction in flight without fetching more, then empties the pipeline
+ * latches. fetch_buffer.pc is left at the next instruction to execute.
+ */
+static void sample_drain(cpu_state *state) {
+    while (!state->halt && !sample_drained(state)) {
+        pipeline_writeback(state);
+        pipeline_memory(state);
+        pipeline_execute(state);
+        pipeline_decode(state);
+        sample_fetch_nothing(state);
+        state->cycles_executed++;
+    }
+
+    const int pc = state->fetch_buffer.pc;
+    memset(&state->fetch_buffer, 0, sizeof(state->fetch_buffer));
+    memset(&state->decode_buffer, 0, sizeof(state->decode_buffer));
+    memset(&state->execute_buffer, 0, sizeof(state->execute_buffer));
+    memset(&state->memory_buffer, 0, sizeof(state->memory_buffer));
+    memset(&state->writeback_buffer, 0, sizeof(state->writeback_buffer));
+    state->fetch_buffer.pc = pc;
+}
+
+/**
+ * Simulates the pipeline in detail until instructions more instructions have completed.
+ */
+static void sample_detailed(cpu_state *state, long long instructions) {
+    const long long target = state->instructions_executed + instructions;
+    while (!state->halt && state->instructions_executed < target) {
+        simulate_cycle(state);
+        state->cycles_executed++;
+    }
+}
+
+bool sample_run(cpu_state *state, const sample_options *options, long long max_instructions,
+                sample_estimate *estimate) {
+    translation_cache *cache = translation_cache_create(state->instruction_memory, state->instructions_count);
+    memset(estimate, 0, sizeof(*estimate));
+    fault_handler handler;
+    fault_enter(&handler);
+    if (setjmp(handler.target) != 0) {
+        translation_cache_destroy(cache);
+        fault_forward(&handler);
+    }
+
+    const long long limit = max_instructions > 0 ? max_instructions : LLONG_MAX;
+    const long long fast_forward = options->period - options->warmup - options->measure;
+
+    while (!state->halt && state->instructions_executed < limit) {
+        long long budget = limit - state->instructions_executed;
+        functional_execute(state, cache, fast_forward < budget ? fast_forward : budget);
+        if (state->halt || state->instructions_executed >= limit)
+            break;
+
+        sample_detailed(state, options->warmup);
+
+        const long long cycles = state->cycles_executed;
+        const long long instructions = state->instructions_executed;
+        sample_detailed(state, options->measure);
+
+        // A window cut short by the end of the program includes draining the pipeline,
+        // which would bias the sample, so it is dropped.
+        if (!state->halt && state->instructions_executed > instructions) {
+            const double cpi = (double) (state->cycles_executed - cycles)
+                    / (double) (state->instructions_executed - instructions);
+            estimate->samples++;
+            estimate->cpi_sum += cpi;
+            estimate->cpi_squares += cpi * cpi;
+        }
+
+        sample_drain(state);
+    }
+
+    fault_leave(&handler);
+    translation_cache_destroy(cache);
+    return state->halt;
+}
+
+/**
+ * @return the two-sided 95% quantile of Student's t distribution with the provided
+ * degrees of freedom, using the normal distribution beyond 30
+ */
+static double sample_t_quantile(long long degrees) {
+    static const double quantiles[] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+    };
+    return degrees >= 1 && degrees <= 30 ? quantiles[degrees - 1] : 1.960;
+}
+
+double sample_mean_cpi(const sample_estimate *estimate, double *half_width) {
+    const long long n = estimate->samples;
+    const double mean = n > 0 ? estimate->cpi_sum / n : 0;
+
+    *half_width = 0;
+    if (n > 1) {
+        const double variance = (estimate->cpi_squares - n * mean * mean) / (n - 1);
+        *half_width = sample_t_quantile(n - 1) * sqrt(variance > 0 ? variance : 0) / sqrt((double) n);
+    }
+    return mean;
+}
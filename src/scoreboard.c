@@ -0,0 +1,90 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "scoreboard.h"
+
+void units_default(unit_options *options) {
+    *options = (unit_options) { { DEFAULT_MULTIPLY_LATENCY, DEFAULT_DIVIDE_LATENCY }, { true, false } };
+}
+
+bool units_valid(const unit_options *options) {
+    for (int i = 0; i < UNIT_KINDS; i++) {
+        if (options->latency[i] < 1 || options->latency[i] > UNIT_MAX_LATENCY)
+            return false;
+    }
+    return true;
+}
+
+bool units_parse(const char *spec, unit_options *options) {
+    static const char *names[] = { "mult", "div" };
+    units_default(options);
+
+    while (*spec != '\0' && strcmp(spec, "default") != 0) {
+        char key[24], value[16];
+        int length = 0;
+        if (sscanf(spec, "%23[^=]=%15[^,]%n", key, value, &length) != 2)
+            return false;
+        spec += length;
+        if (*spec == ',')
+            spec++;
+
+        char *end;
+        const long number = strtol(value, &end, 10);
+        bool known = false;
+
+        for (int i = 0; i < UNIT_KINDS; i++) {
+            char pipelined[24];
+            snprintf(pipelined, sizeof(pipelined), "%s-pipelined", names[i]);
+
+            if (strcmp(key, names[i]) == 0 && *end == '\0' && number >= 1 && number <= UNIT_MAX_LATENCY) {
+                options->latency[i] = (int) number;
+                known = true;
+            } else if (strcmp(key, pipelined) == 0 && (strcmp(value, "yes") == 0 || strcmp(value, "no") == 0)) {
+                options->pipelined[i] = strcmp(value, "yes") == 0;
+                known = true;
+            }
+        }
+        if (!known)
+            return false;
+    }
+
+    return units_valid(options);
+}
+
+void scoreboard_init(scoreboard *board, const unit_options *options) {
+    memset(board, 0, sizeof(*board));
+    board->options = *options;
+}
+
+void scoreboard_copy(scoreboard *to, const scoreboard *from) {
+    memcpy(to, from, offsetof(scoreboard, operations) + from->count * sizeof(unit_operation));
+}
+
+void scoreboard_issue(scoreboard *board, const struct instruction *inst) {
+    const int unit = scoreboard_unit(inst);
+    const int latency = board->options.latency[unit];
+
+    board->reserved |= 1u << latency;
+    board->pending[inst->dest] = latency;
+    board->busy[unit] = board->options.pipelined[unit] ? 0 : latency;
+}
+
+void scoreboard_start(scoreboard *board, const struct instruction *inst, int result) {
+    board->operations[board->count++] = (unit_operation) {
+        *inst, result, board->options.latency[scoreboard_unit(inst)] - 1
+    };
+}
+
+bool scoreboard_finish(scoreboard *board, unit_operation *done) {
+    for (int i = 0; i < board->count; i++) {
+        if (board->operations[i].remaining > 0)
+            continue;
+
+        *done = board->operations[i];
+        memmove(&board->operations[i], &board->operations[i + 1], (board->count - i - 1) * sizeof(unit_operation));
+        board->count--;
+        return true;
+    }
+    return false;
+}
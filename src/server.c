@@ -0,0 +1,243 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "server.h"
+#include "image.h"
+
+/**
+ * Reads exactly length bytes, unless the connection ends or fails first.
+ */
+static bool server_read(int fd, void *buffer, size_t length) {
+    char *at = buffer;
+    while (length > 0) {
+        const ssize_t count = read(fd, at, length);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return false;
+        at += count;
+        length -= count;
+    }
+    return true;
+}
+
+static bool server_write(int fd, const void *buffer, size_t length) {
+    const char *at = buffer;
+    while (length > 0) {
+        const ssize_t count = send(fd, at, length, MSG_NOSIGNAL);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return false;
+        at += count;
+        length -= count;
+    }
+    return true;
+}
+
+bool server_read_frame(int fd, server_frame *frame, char **payload) {
+    if (!server_read(fd, frame, sizeof(*frame)) || frame->length > SERVER_MAX_PAYLOAD
+            || (frame->kind != SERVER_SOURCE && frame->kind != SERVER_IMAGE))
+        return false;
+
+    *payload = malloc(frame->length + 1);
+    if (!server_read(fd, *payload, frame->length)) {
+        free(*payload);
+        return false;
+    }
+    (*payload)[frame->length] = '\0';
+    return true;
+}
+
+bool server_write_frame(int fd, const char *payload, size_t length) {
+    const server_frame frame = { SERVER_REPLY, (uint32_t) length };
+    return server_write(fd, &frame, sizeof(frame)) && server_write(fd, payload, length);
+}
+
+int server_listen(const char *path) {
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(address.sun_path))
+        return -1;
+    strcpy(address.sun_path, path);
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1)
+        return -1;
+    unlink(path);
+    if (bind(fd, (struct sockaddr *) &address, sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @return the FNV-1a hash of a request
+ */
+static uint64_t server_hash(uint32_t kind, const char *payload, uint32_t length) {
+    uint64_t hash = 14695981039346656037ull ^ kind;
+    for (uint32_t i = 0; i < length; i++)
+        hash = (hash ^ (unsigned char) payload[i]) * 1099511628211ull;
+    return hash;
+}
+
+void program_cache_init(program_cache *cache, uint64_t words) {
+    memset(cache, 0, sizeof(*cache));
+    cache->words = words;
+    pthread_mutex_init(&cache->lock, NULL);
+}
+
+static void cached_program_free(cached_program *entry) {
+    FreeProgram(&entry->program);
+    memory_free(&entry->initial);
+    free(entry->payload);
+    free(entry);
+}
+
+/**
+ * Takes an entry out of the order of use. Called with the lock held.
+ */
+static void program_cache_unlink(program_cache *cache, cached_program *entry) {
+    if (entry->newer != NULL)
+        entry->newer->older = entry->older;
+    else
+        cache->newest = entry->older;
+    if (entry->older != NULL)
+        entry->older->newer = entry->newer;
+    else
+        cache->oldest = entry->newer;
+    entry->newer = entry->older = NULL;
+}
+
+/**
+ * Makes an entry the most recently used. Called with the lock held.
+ */
+static void program_cache_touch(program_cache *cache, cached_program *entry) {
+    if (cache->newest == entry)
+        return;
+    if (entry->newer != NULL || entry->older != NULL || cache->oldest == entry)
+        program_cache_unlink(cache, entry);
+    entry->older = cache->newest;
+    if (cache->newest != NULL)
+        cache->newest->newer = entry;
+    cache->newest = entry;
+    if (cache->oldest == NULL)
+        cache->oldest = entry;
+}
+
+/**
+ * Drops the least recently used entry. Called with the lock held.
+ */
+static void program_cache_evict(program_cache *cache) {
+    cached_program *entry = cache->oldest;
+    cached_program **link = &cache->buckets[entry->hash % SERVER_CACHE_BUCKETS];
+    while (*link != entry)
+        link = &(*link)->next;
+    *link = entry->next;
+
+    program_cache_unlink(cache, entry);
+    cache->count--;
+    entry->evicted = true;
+    if (entry->references == 0)
+        cached_program_free(entry);
+}
+
+/**
+ * Assembles or reads a program for the cache, outside its lock.
+ * @return the entry, or NULL with the reason in message
+ */
+static cached_program *program_cache_build(const program_cache *cache, uint32_t kind, const char *payload,
+                                    uint32_t length, char *message, size_t message_size) {
+    cached_program *entry = calloc(1, sizeof(cached_program));
+    bool built;
+
+    if (kind == SERVER_IMAGE) {
+        built = image_read_program(payload, length, cache->words, &entry->program);
+        if (!built)
+            snprintf(message, message_size, "Malformed image, or its data does not fit in data memory");
+    } else {
+        FILE *input = fmemopen((void *) payload, length, "r");
+        built = input != NULL && AssembleDLX(input, &entry->program, message, (int) message_size) == 0;
+        if (input != NULL)
+            fclose(input);
+        else
+            snprintf(message, message_size, "Empty program");
+    }
+
+    memory_init(&entry->initial, cache->words);
+    for (int i = 0; built && i < entry->program.segment_count; i++) {
+        const struct data_segment *segment = &entry->program.segments[i];
+        built = (uint64_t) segment->address + segment->length <= cache->words;
+        for (int j = 0; built && j < segment->length; j++)
+            memory_write(&entry->initial, (int) (segment->address + j), segment->words[j]);
+        if (!built)
+            snprintf(message, message_size, "Initialized data does not fit in data memory");
+    }
+
+    if (!built) {
+        cached_program_free(entry);
+        return NULL;
+    }
+    entry->kind = kind;
+    entry->length = length;
+    entry->payload = malloc(length + 1);
+    memcpy(entry->payload, payload, length);
+    return entry;
+}
+
+cached_program *program_cache_get(program_cache *cache, uint32_t kind, const char *payload, uint32_t length,
+                                  char *message, size_t message_size) {
+    const uint64_t hash = server_hash(kind, payload, length);
+
+    pthread_mutex_lock(&cache->lock);
+    for (cached_program *entry = cache->buckets[hash % SERVER_CACHE_BUCKETS]; entry != NULL; entry = entry->next) {
+        if (entry->hash == hash && entry->kind == kind && entry->length == length
+                && memcmp(entry->payload, payload, length) == 0) {
+            entry->references++;
+            program_cache_touch(cache, entry);
+            cache->hits++;
+            pthread_mutex_unlock(&cache->lock);
+            return entry;
+        }
+    }
+    cache->misses++;
+    pthread_mutex_unlock(&cache->lock);
+
+    // Programs are assembled outside the lock; if two workers assemble the same one, both
+    // run their own, and the cache keeps the first.
+    cached_program *entry = program_cache_build(cache, kind, payload, length, message, message_size);
+    if (entry == NULL)
+        return NULL;
+    entry->hash = hash;
+    entry->references = 1;
+
+    pthread_mutex_lock(&cache->lock);
+    cached_program **bucket = &cache->buckets[hash % SERVER_CACHE_BUCKETS];
+    bool present = false;
+    for (cached_program *other = *bucket; other != NULL; other = other->next)
+        present |= other->hash == hash && other->kind == kind && other->length == length
+                && memcmp(other->payload, payload, length) == 0;
+    if (present) {
+        entry->evicted = true;
+    } else {
+        entry->next = *bucket;
+        *bucket = entry;
+        program_cache_touch(cache, entry);
+        if (++cache->count > SERVER_CACHE_PROGRAMS)
+            program_cache_evict(cache);
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return entry;
+}
+
+void program_cache_release(program_cache *cache, cached_program *entry) {
+    pthread_mutex_lock(&cache->lock);
+    const bool unused = --entry->references == 0 && entry->evicted;
+    pthread_mutex_unlock(&cache->lock);
+    if (unused)
+        cached_program_free(entry);
+}
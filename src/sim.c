@@ -1,294 +1,1133 @@
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
 #include "processor.h"
 #include "debug.h"
+#include "functional.h"
+#include "batch.h"
+#include "lockstep.h"
+#include "image.h"
+#include "checkpoint.h"
+#include "sampling.h"
+#include "loop.h"
+#include "trace.h"
+#include "superscalar.h"
+#include "tomasulo.h"
+#include "multicore.h"
+#include "pipeline.h"
+#include "server.h"
 
-void pipeline_fetch(cpu_state *state) {
-    struct fetch_buffer *fetch = &state->fetch_buffer;
+// Options selected on the command line, applying to every program simulated
+typedef struct {
+    bool debug;
+    bool functional;
+    char *data;  // file initializing data memory, or NULL
+    char *image; // file to write the assembled program to, or NULL
+    uint64_t memory_words;  // the size of data memory
+    long long max_cycles;   // the runaway limit, or 0 for none
+    char *checkpoint;       // file to write a checkpoint to, or NULL
+    long long checkpoint_at;   // the cycle (instruction with -F) to write the checkpoint after
+    bool restore;           // the program is a checkpoint to resume
+    sample_options sample;  // sampled simulation, if sample.period is not 0
+    bool exact;             // simulate every cycle, without extrapolating loops
+    char *trace;            // file to write a pipeline trace to, or NULL
+    int stats;              // STATS_NONE, or how to print the CPI stack
+    predictor_options predictor;
+    cache_options cache;    // no data cache if cache.words is 0
+    unit_options units;
+    int width;              // instructions issued per cycle; 1 for the scalar pipeline
+    tomasulo_options ooo;   // no out-of-order core if ooo.width is 0
+    stage_options pipeline; // the fixed five stages if pipeline.fetch is 0
+    multicore_options cores;  // a single processor if cores.cores is 0
+    int dump;               // how -D prints data memory: DUMP_DENSE, DUMP_SPARSE or DUMP_DIFF
+    char *dump_raw;         // file to write data memory to as raw words, or NULL
+} sim_options;
 
-    // Do nothing if stalling is requested. The fetch stage always stalls
-    // alongside the decode_buffer stage, which handles injecting a NOP into the execute stage.
-    if (fetch->stall) {
-        fetch->stall = false;
-        return;
+#define STATS_NONE 0
+#define STATS_TEXT 1
+#define STATS_JSON 2
+
+/**
+ * Simulates the pipeline until the processor halts, stopping a program found to loop
+ * forever, or a runaway program after max_cycles cycles.
+ * @param out where to report a program stopped
+ * @param max_cycles the number of cycles to allow, or 0 for no limit
+ */
+void simulate(cpu_state *state, FILE *out, long long max_cycles, bool exact, trace_writer *trace) {
+    int loop;
+
+    /* check if simulator is stuck in an infinite loop */
+    if (simulate_until(state, max_cycles > 0 ? max_cycles + 1 : LLONG_MAX, exact, trace, &loop))
+        fprintf(out, "\n\n *** Infinite loop at instruction %d (Program halted.) ***\n\n", loop);
+    else if (max_cycles > 0 && state->cycles_executed > max_cycles)
+        fprintf(out, "\n\n *** Runaway program? (Program halted.) ***\n\n");
+}
+
+/**
+ * @param initial the data memory as the program started, for options->dump of DUMP_DIFF
+ */
+void print_results(FILE *out, cpu_state *state, const sim_options *options, const data_memory *initial) {
+    if (options->debug) {
+        print_debug(out, state, !options->functional, options->dump, initial);
+    } else if (options->functional) {
+        fprintf(out, "Final register file values:\n");
+        print_registers_original(out, state->register_file);
+        fprintf(out, "\nInstructions retired: %lld\n", state->instructions_executed);
+    } else {
+        fprintf(out, "Final register file values:\n");
+        print_registers_original(out, state->register_file);
+        fprintf(out, "\nCycles executed: %lld\n", state->cycles_executed);
+        fprintf(out, "IPC:  %6.3f\n", (float) state->instructions_executed / (float) state->cycles_executed);
+        fprintf(out, "CPI:  %6.3f\n", (float) state->cycles_executed / (float) state->instructions_executed);
+    }
+
+    // Fetching the next instruction is the pipeline as it always was, which needs no report.
+    if (!options->functional && options->stats == STATS_NONE && state->predictor.options.kind != PREDICT_NOT_TAKEN)
+        print_prediction(out, state);
+    if (!options->functional && options->stats == STATS_NONE && state->cache.lines != NULL)
+        print_cache(out, state);
+}
+
+/**
+ * Prints the registers and counts of every core of a machine, then its shared data memory,
+ * and what the machine did as a whole.
+ * @param initial the data memory as the program started, for options->dump of DUMP_DIFF
+ */
+void print_multicore(FILE *out, const multicore *machine, const sim_options *options, const data_memory *initial) {
+    const long long cycles = multicore_cycles(machine);
+    long long instructions = 0;
+
+    for (int i = 0; i < machine->options.cores; i++) {
+        const cpu_state *state = machine->cores[i];
+        instructions += state->instructions_executed;
+
+        fprintf(out, "==> core %d <==\n", i);
+        if (options->debug) {
+            fprintf(out, "Registers:\n");
+            print_registers(out, (int *) state->register_file);
+            fprintf(out, "Instructions: %lld\nCycles: %lld\n", state->instructions_executed, state->cycles_executed);
+        } else {
+            fprintf(out, "Final register file values:\n");
+            print_registers_original(out, (int *) state->register_file);
+            fprintf(out, "\nCycles executed: %lld\n", state->cycles_executed);
+        }
+    }
+
+    if (options->debug) {
+        fprintf(out, "Memory:\n");
+        print_memory(out, &machine->cores[0]->data_memory, options->dump, initial);
+    }
+    fprintf(out, "Machine of %d cores: %lld cycles, %lld instructions (IPC %.3f), %lld quanta of %lld cycles; "
+            "%lld store conditionals, %lld failed\n", machine->options.cores, cycles, instructions,
+            cycles > 0 ? (double) instructions / cycles : 0.0, machine->quanta, machine->options.quantum,
+            machine->conditionals, machine->failed);
+}
+
+/**
+ * Prints the results of a sampled simulation: the architectural state is exact, while
+ * cycles are estimated from the CPI of the samples, with a 95% confidence interval.
+ */
+void print_sampled_results(FILE *out, cpu_state *state, const sim_options *options,
+                           const sample_estimate *estimate, const data_memory *initial) {
+    double half_width;
+    const double cpi = sample_mean_cpi(estimate, &half_width);
+
+    if (options->debug) {
+        print_debug(out, state, false, options->dump, initial);
+    } else {
+        fprintf(out, "Final register file values:\n");
+        print_registers_original(out, state->register_file);
+        fprintf(out, "\nInstructions retired: %lld\n", state->instructions_executed);
     }
 
-    // Flush if requested. This adds a NOP into the decode stage in order
-    // to account for mispredicted jumps.
-    if (fetch->flush) {
-        state->decode_buffer.inst = nop;
-        fetch->flush = false;
-        fetch->pc = fetch->pc_branch;
+    if (estimate->samples == 0) {
+        fprintf(out, "No samples taken: the program is shorter than the sampling period of %lld instructions\n",
+                options->sample.period);
         return;
     }
 
-    const int pc = fetch->pc;
+    // IPC is the reciprocal of CPI, so its interval is the reciprocal of CPI's.
+    const double low = cpi - half_width, high = cpi + half_width;
+    fprintf(out, "Cycles executed (estimated): %.0f\n", cpi * state->instructions_executed);
+    fprintf(out, "IPC:  %6.3f  (95%% confidence: %.3f to %.3f)\n", 1 / cpi, 1 / high, low > 0 ? 1 / low : INFINITY);
+    fprintf(out, "CPI:  %6.3f  (95%% confidence: %.3f to %.3f)\n", cpi, low, high);
+    fprintf(out, "Samples: %lld of %lld instructions, one every %lld\n", estimate->samples,
+            options->sample.measure, options->sample.period);
+}
 
-    // A pipelined processor is not done executing until the last instruction reaches the writeback stage.
-    // To facilitate this, we fill the pipeline with NOPs when accessing out-of-bounds instructions not caused
-    // by a should_jump instruction (i.e., jumping out-of-bounds will still result in an error being thrown).
-    if (pc > state->instructions_count - 1) {
-        // If the last instruction has reached the writeback stage, we should halt the processor. This occurs when
-        // four additional instructions have been fetched by the processor.
-        if (pc >= state->instructions_count + 3) {
-            state->halt = true;
-        } else {
-            // Otherwise, we keep injecting NOPs.
-            state->decode_buffer.inst = nop;
+/**
+ * Loads a program into a freshly initialized processor: a program image is mapped, and
+ * anything else is assembled, unless it was assembled beforehand.
+ * @param assembled the program already assembled from program_name, or NULL
+ * @return false if the program cannot be loaded, with the reason written to out
+ */
+bool load_program(FILE *out, cpu_state *state, char *program_name, const struct program *assembled) {
+    char message[ASSEMBLY_MESSAGE_SIZE];
+    struct program program;
+
+    if (assembled == NULL && image_probe(program_name)) {
+        if (!image_load(state, program_name)) {
+            fprintf(out, "Unable to load image %s\n", program_name);
+            return false;
         }
+        return true;
     }
 
-    const int next_pc = fetch->pc + 1;
+    if (assembled == NULL) {
+        FILE *input = fopen(program_name, "r");
+        if (input == NULL) {
+            fprintf(out, "Unable to open %s for reading\n", program_name);
+            return false;
+        }
+        const int result = AssembleDLX(input, &program, message, sizeof(message));
+        fclose(input);
+        if (result != 0) {
+            fprintf(out, "%s", message);
+            return false;
+        }
+        assembled = &program;
+    }
 
-    state->decode_buffer.inst = state->instruction_memory[pc];
-    state->decode_buffer.pc_next = next_pc;
+    const bool loaded = program_load(state, assembled);
+    if (!loaded)
+        fprintf(out, "Initialized data of %s does not fit in data memory\n", program_name);
+
+    if (assembled == &program)
+        FreeProgram(&program);
+    return loaded;
+}
+
+/**
+ * Executes the program functionally up to instruction until, unless it halts first.
+ */
+void execute_until(cpu_state *state, long long until) {
+    translation_cache *cache = translation_cache_create(state->instruction_memory, state->instructions_count);
+    fault_handler handler;
+    fault_enter(&handler);
+    if (setjmp(handler.target) != 0) {
+        translation_cache_destroy(cache);
+        fault_forward(&handler);
+    }
+    if (until > state->instructions_executed)
+        functional_execute(state, cache, until - state->instructions_executed);
+    fault_leave(&handler);
+    translation_cache_destroy(cache);
+}
+
+/**
+ * Runs the program up to options->checkpoint_at and writes a checkpoint there, unless the
+ * program halts or runs away first.
+ * @return true if the checkpoint was written
+ */
+bool simulate_checkpoint(FILE *out, cpu_state *state, const sim_options *options, trace_writer *trace) {
+    long long until = options->checkpoint_at;
+    if (options->max_cycles > 0 && until > options->max_cycles)
+        until = options->max_cycles;
+
+    if (options->functional) {
+        execute_until(state, until);
+    } else {
+        int loop;
+        simulate_until(state, until, options->exact, trace, &loop);
+    }
 
-    // Update the program counter for the next cycle. If we are jumping to an out-of-bounds address,
-    // halt the simulator with an error.
-    if (state->decode_buffer.should_jump && (fetch->pc_branch < 0 || fetch->pc_branch > state->instructions_count - 1)) {
-        printf("out-of-bounds should_jump to %d\n", fetch->pc_branch);
-        exit(ERROR_ILLEGAL_JUMP);
+    const long long reached = options->functional ? state->instructions_executed : state->cycles_executed;
+    if (state->halt || reached != options->checkpoint_at) {
+        fprintf(out, "No checkpoint written: the program %s before %s %lld\n",
+                state->halt ? "halted" : "ran away", options->functional ? "instruction" : "cycle",
+                options->checkpoint_at);
+        return false;
     }
 
-    fetch->pc = state->decode_buffer.should_jump ? fetch->pc_branch : next_pc;
+    if (!checkpoint_write(state, options->checkpoint, options->functional)) {
+        printf("Unable to write checkpoint %s\n", options->checkpoint);
+        exit(0);
+    }
+    fprintf(out, "Checkpoint written to %s after %s %lld\n", options->checkpoint,
+            options->functional ? "instruction" : "cycle", options->checkpoint_at);
+    return true;
 }
 
-void pipeline_decode(cpu_state *state) {
-    struct decode_buffer *decode = &state->decode_buffer;
-    const struct instruction inst = state->decode_buffer.inst;
+/**
+ * Sets up the branch predictor, data cache and functional units of a processor with a
+ * program loaded, and zeroes its counters.
+ */
+void prepare_processor(cpu_state *state, const sim_options *options) {
+    predictor_init(&state->predictor, &options->predictor);
+    cache_init(&state->cache, &options->cache);
+    scoreboard_init(&state->scoreboard, &options->units);
 
-    // Inject a NOP into the execute stage when requested to stall. Instruct the fetch stage to stall.
-    if (decode->stall) {
-        decode->stall = false;
-        state->fetch_buffer.stall = true;
-        state->execute_buffer.inst = nop;
-        return;
+    /* set initial simulator values */
+    state->cycles_executed = 0;       /* simulator cycle count */
+    state->instructions_executed = 0; /* simulator instruction count */
+    state->register_file[R0] = 0;     /* register R0 is alway zero */
+}
+
+/**
+ * Assembles a program into a clean processor, with its initial data, branch predictor,
+ * data cache and functional units.
+ * @return false if the program cannot be loaded, with the reason written to out
+ */
+bool prepare_program(FILE *out, cpu_state *state, char *program_name, const sim_options *options) {
+    /* assemble input program */
+    if (!load_program(out, state, program_name, NULL))
+        return false;
+
+    if (options->data != NULL && !processor_load_data(state, options->data)) {
+        printf("Unable to read data from %s\n", options->data);
+        exit(0);
     }
 
-    int a, b;
+    prepare_processor(state, options);
+    return true;
+}
 
-    // Access register file. Use the forwarded value for avoiding control hazards, if necessary.
-    a = decode->forward ? decode->data : state->register_file[inst.rs];
-    b = state->register_file[inst.rt];
-    decode->forward = false;
+/**
+ * Frees the cores of a multicore machine but the first, up to count.
+ */
+void free_cores(cpu_state **cores, int count) {
+    for (int i = 1; i < count; i++) {
+        processor_free(cores[i]);
+        free(cores[i]);
+    }
+    free(cores);
+}
+
+/**
+ * Simulates a multicore machine whose first core is state, prepared with the program, and
+ * writes the results of every core to out.
+ * @return false if the program cannot be loaded on another core, with the reason written to out
+ */
+bool simulate_machine(FILE *out, char *program_name, const sim_options *options, cpu_state *state,
+                      const data_memory *initial) {
+    const int count = options->cores.cores;
+    cpu_state **cores = calloc(count, sizeof(cpu_state *));
+    multicore machine;
 
-    // Resolve should_jump instructions
-    bool should_jump = false;
-    switch (inst.op) {
-        case BEQZ:
-            should_jump = a == 0;
-            break;
-        case BNEZ:
-            should_jump = a != 0;
-            break;
-        case J:
-            should_jump = true;
-            break;
+    cores[0] = state;
+    for (int i = 1; i < count; i++) {
+        cores[i] = malloc(sizeof(cpu_state));
+        processor_init(cores[i], options->memory_words);
+        if (!prepare_program(out, cores[i], program_name, options)) {  // loads, as the first core did
+            free_cores(cores, i + 1);
+            return false;
+        }
     }
 
-    decode->should_jump = should_jump;
-    state->fetch_buffer.flush = should_jump;
+    multicore_init(&machine, &options->cores, cores);
+    multicore_run(&machine, options->max_cycles > 0 ? options->max_cycles + 1 : LLONG_MAX);
+    if (options->max_cycles > 0 && multicore_cycles(&machine) > options->max_cycles)
+        fprintf(out, "\n\n *** Runaway program? (Program halted.) ***\n\n");
+    print_multicore(out, &machine, options, initial);
 
-    // Again, there should be a shift here, but since instruction memory is not byte-addressed,
-    // it is omitted.
-    state->fetch_buffer.pc_branch = inst.imm + decode->pc_next;
+    free_cores(cores, count);
+    return true;
+}
 
-    state->execute_buffer.inst = inst;
-    state->execute_buffer.a = a;
-    state->execute_buffer.b = b;
+/**
+ * Writes data memory to the file of options->dump_raw, if any.
+ */
+void write_raw_dump(const cpu_state *state, const sim_options *options) {
+    if (options->dump_raw != NULL && !dump_raw(&state->data_memory, options->dump_raw)) {
+        printf("Unable to write memory dump %s\n", options->dump_raw);
+        exit(0);
+    }
 }
 
-void pipeline_execute(cpu_state *state) {
-    struct execute_buffer *execute = &state->execute_buffer;
-    const struct instruction inst = execute->inst;
+/**
+ * Assembles and simulates one program from a clean processor state, writing the results to out.
+ * With options->restore, the program is a checkpoint and the simulation resumes from it instead.
+ * An exception of the program ends its simulation, and is written to out in place of the
+ * results, except on a multicore machine, whose cores raise theirs on threads of their own.
+ * @return 0, the error of the exception the program raised, or 1 if it cannot be loaded
+ */
+int simulate_program(FILE *out, char *program_name, const sim_options *options, cpu_state *state) {
+    processor_init(state, options->memory_words);
 
-    int a = execute->a;
-    int write_data = execute->b;
+    if (options->restore) {
+        bool functional;
+        if (!checkpoint_read(state, program_name, &functional)) {
+            fprintf(out, "Unable to restore checkpoint %s\n", program_name);
+            processor_free(state);
+            return 1;
+        }
+        if (functional != options->functional) {
+            fprintf(out, "Checkpoint %s was taken %s -F\n", program_name, functional ? "with" : "without");
+            processor_free(state);
+            return 1;
+        }
+    } else if (!prepare_program(out, state, program_name, options)) {
+        processor_free(state);
+        return 1;
+    }
 
-    // Handle forwarding from the memory and writeback stages for
-    // the two operands.
-    if(execute->foward_a == MEMORY)
-        // If the instruction reads from memory, we want the value read from memory, not
-        // the calculated address.
-        a = instruction_get_memory_operation(state->memory_buffer.inst) == READ
-                ? state->writeback_buffer.read_data
-                : state->memory_buffer.alu_out;
-    else if(execute->foward_a == WRITEBACK)
-        a = state->writeback_buffer.result;
+    // Only a diff needs the data memory as the program starts.
+    data_memory initial;
+    if (options->dump == DUMP_DIFF)
+        memory_copy(&initial, &state->data_memory);
+    else
+        memory_init(&initial, options->memory_words);
 
-    if(execute->forward_b == MEMORY)
-        // See above.
-        write_data = instruction_get_memory_operation(state->memory_buffer.inst) == READ
-                ? state->writeback_buffer.read_data
-                : state->memory_buffer.alu_out;
-    else if(execute->forward_b == WRITEBACK)
-        write_data = state->writeback_buffer.result;
+    if (options->cores.cores > 0) {
+        const bool loaded = simulate_machine(out, program_name, options, state, &initial);
+        if (loaded)
+            write_raw_dump(state, options);
+        memory_free(&initial);
+        processor_free(state);
+        return loaded ? 0 : 1;
+    }
 
-    execute->foward_a  = NO_FORWARDING;
-    execute->forward_b = NO_FORWARDING;
+    trace_writer *trace = NULL;
+    if (options->trace != NULL && (trace = trace_open(options->trace, state)) == NULL) {
+        printf("Unable to write trace %s\n", options->trace);
+        exit(0);
+    }
 
-    int b = instruction_has_immediate(inst) ? execute->inst.imm : write_data;
+    // What the simulation allocates is created before the handler, so that a fault cannot leak it.
+    sample_estimate estimate;
+    superscalar core;
+    tomasulo_core ooo;
+    staged_pipeline pipe;
+    if (options->ooo.width > 0)
+        tomasulo_init(&ooo, &options->ooo);
 
-    int alu_out = 0;
+    volatile bool stopped = false;
+    fault_handler handler;
+    fault_enter(&handler);
+    if (setjmp(handler.target) == 0) {
+        stopped = options->checkpoint != NULL && simulate_checkpoint(out, state, options, trace);
+        if (stopped) {
+            // The checkpoint is all this run produces.
+        } else if (options->sample.period > 0) {
+            if (!sample_run(state, &options->sample, options->max_cycles, &estimate))
+                fprintf(out, "\n\n *** Runaway program? (Program halted.) ***\n\n");
+        } else if (options->functional) {
+            functional_run(state, out, options->max_cycles);
+        } else if (options->ooo.width > 0) {
+            tomasulo_run(state, &ooo, options->max_cycles > 0 ? options->max_cycles + 1 : LLONG_MAX);
+            if (options->max_cycles > 0 && state->cycles_executed > options->max_cycles)
+                fprintf(out, "\n\n *** Runaway program? (Program halted.) ***\n\n");
+        } else if (options->pipeline.fetch > 0) {
+            stages_init(&pipe, &options->pipeline);
+            stages_run(state, &pipe, options->max_cycles > 0 ? options->max_cycles + 1 : LLONG_MAX);
+            if (options->max_cycles > 0 && state->cycles_executed > options->max_cycles)
+                fprintf(out, "\n\n *** Runaway program? (Program halted.) ***\n\n");
+        } else if (options->width > 1) {
+            superscalar_init(&core, options->width);
+            superscalar_run(state, &core, options->max_cycles > 0 ? options->max_cycles + 1 : LLONG_MAX);
+            if (options->max_cycles > 0 && state->cycles_executed > options->max_cycles)
+                fprintf(out, "\n\n *** Runaway program? (Program halted.) ***\n\n");
+        } else {
+            simulate(state, out, options->max_cycles, options->exact, trace);
+        }
+        fault_leave(&handler);
+    }
 
-    switch (instruction_get_alu_op(inst)) {
-        case PLUS:  alu_out = a + b; break;
-        case MINUS: alu_out = a - b; break;
+    if (trace != NULL && !trace_close(trace)) {
+        printf("Unable to write trace %s\n", options->trace);
+        exit(0);
     }
 
-    // We don't forward to avoid control hazards in the execute stage.
-    if (instruction_is_branch(state->decode_buffer.inst)) {
-        processor_stall_on_hazard(state, state->decode_buffer.inst, inst);
+    if (handler.error != 0) {
+        fprintf(out, "%s", handler.message);
+    } else if (!stopped) {
+        if (options->sample.period > 0)
+            print_sampled_results(out, state, options, &estimate, &initial);
+        else
+            print_results(out, state, options, &initial);
+        write_raw_dump(state, options);
+        if (options->width > 1)
+            print_issue(out, &core);
+        if (options->pipeline.fetch > 0)
+            print_stages(out, &pipe);
+        if (options->ooo.width > 0)
+            print_tomasulo(out, &ooo);
+        if (options->stats != STATS_NONE)
+            print_stats(out, state, options->stats == STATS_JSON);
     }
+    if (options->ooo.width > 0)
+        tomasulo_free(&ooo);
+    memory_free(&initial);
+    processor_free(state);
+    return handler.error;
+}
+
+// A batch of programs simulated in parallel, each writing its results into its own buffer
+typedef struct {
+    char **programs;
+    char **outputs;
+    size_t *output_sizes;
+    int *statuses;      // what simulate_program returned for each program
+    cpu_state *states;  // one per worker
+    const sim_options *options;
+} sim_batch;
+
+void simulate_batch_job(void *context, int job, int worker) {
+    sim_batch *batch = context;
+    FILE *out = open_memstream(&batch->outputs[job], &batch->output_sizes[job]);
 
-    state->memory_buffer.alu_out = alu_out;
-    state->memory_buffer.write_data = write_data;
-    state->memory_buffer.inst = inst;
+    batch->statuses[job] = simulate_program(out, batch->programs[job], batch->options, &batch->states[worker]);
+    fclose(out);
 }
 
-void pipeline_memory(cpu_state *state) {
-    const struct memory_buffer *memory = &state->memory_buffer;
+/**
+ * Simulates every program of a batch on a pool of worker threads and prints their results
+ * in the order the programs were collected. A program that cannot be loaded or raises an
+ * exception has the reason printed in place of its results, and the others go on.
+ * @return 0 on success, or 1 if the batch cannot be read or one of its programs failed
+ */
+int simulate_batch(const char *source, int workers, const sim_options *options) {
+    int count;
+    char **programs = batch_collect_files(source, &count);
+    if (programs == NULL) {
+        printf("Unable to read batch %s\n", source);
+        return 1;
+    }
 
-    const int alu_out = memory->alu_out;
-    int data = alu_out;
-    const struct instruction inst = memory->inst;
-    const mem_op op = instruction_get_memory_operation(inst);
+    if (workers <= 0)
+        workers = work_pool_default_workers();
 
-    // Validate the address to be accessed, if necessary.
-    if (op != NO_OPERATION) {
-        if (alu_out < 0 || alu_out >= MAX_WORDS_OF_DATA) {
-            printf("Exception: out-of-bounds data memory access at %d\n", alu_out);
-            exit(ERROR_ILLEGAL_MEM_ACCESS);
-        }
+    sim_batch batch = {
+        .programs = programs,
+        .outputs = calloc(count, sizeof(char *)),
+        .output_sizes = calloc(count, sizeof(size_t)),
+        .statuses = calloc(count, sizeof(int)),
+        .states = malloc(workers * sizeof(cpu_state)),
+        .options = options,
+    };
+    work_pool_run(count, workers, simulate_batch_job, &batch);
+
+    int status = 0;
+    for (int i = 0; i < count; i++) {
+        printf("==> %s <==\n", programs[i]);
+        fwrite(batch.outputs[i], 1, batch.output_sizes[i], stdout);
+        if (batch.statuses[i] != 0)
+            status = 1;
+        free(batch.outputs[i]);
+        free(programs[i]);
     }
 
-    // Perform the necessary memory operation
-    switch (op) {
-        case READ:
-            data = state->data_memory[alu_out];
-            state->writeback_buffer.read_data = state->data_memory[alu_out];
+    free(batch.outputs);
+    free(batch.output_sizes);
+    free(batch.statuses);
+    free(batch.states);
+    free(programs);
+    return status;
+}
+
+/**
+ * Simulates a lane that diverged from the others on its own, from where it left off.
+ * @param fault output; the exception the lane raised, if any
+ */
+void simulate_lane(cpu_state *state, const sim_options *options, lockstep_fault *fault) {
+    fault_handler handler;
+    fault_enter(&handler);
+    if (setjmp(handler.target) != 0) {
+        fault->error = handler.error;
+        snprintf(fault->message, sizeof(fault->message), "%s", handler.message);
+        return;
+    }
+    simulate(state, stdout, options->max_cycles, options->exact, NULL);
+    fault_leave(&handler);
+}
 
-            // If we are reading from memory, we have to stall if either the execute or decode
-            // read from the register this operation writes to
-            processor_stall_on_hazard(state, state->decode_buffer.inst, inst);
-            processor_stall_on_hazard(state, state->execute_buffer.inst, inst);
-            break;
-        case WRITE:
-            state->data_memory[alu_out] = memory->write_data;
-            break;
+/**
+ * Simulates one program on every data set of a batch, LOCKSTEP_LANES data sets at a time,
+ * and prints their results in the order the data sets were collected. A lane that raises an
+ * exception has it printed in place of its results, and the others go on.
+ * @return 0 on success, or 1 if the batch cannot be read or a lane raised an exception
+ */
+int simulate_lockstep(char *program_name, const char *source, const sim_options *options) {
+    int count;
+    char **datasets = batch_collect_files(source, &count);
+    if (datasets == NULL) {
+        printf("Unable to read batch %s\n", source);
+        return 1;
     }
 
-    processor_forward_on_hazard(state, &state->execute_buffer.foward_a,
-                                state->execute_buffer.inst, inst, MEMORY, data);
+    cpu_state *lanes = malloc(LOCKSTEP_LANES * sizeof(cpu_state));
+    const bool image = image_probe(program_name);
+    struct program program = {};
+    int status = 0;
 
-    state->writeback_buffer.inst = inst;
-    state->writeback_buffer.alu_out = alu_out;
+    // Images are cheap to map for every lane, while source is only assembled once.
+    if (!image)
+        AssembleSimpleDLX(program_name, &program);
+
+    for (int first = 0; first < count; first += LOCKSTEP_LANES) {
+        const int used = count - first < LOCKSTEP_LANES ? count - first : LOCKSTEP_LANES;
+
+        for (int lane = 0; lane < used; lane++) {
+            processor_init(&lanes[lane], options->memory_words);
+            if (!load_program(stdout, &lanes[lane], program_name, image ? NULL : &program))
+                exit(0);
+
+            if (!processor_load_data(&lanes[lane], datasets[first + lane])) {
+                printf("Unable to read data from %s\n", datasets[first + lane]);
+                exit(0);
+            }
+        }
+
+        lockstep_fault faults[LOCKSTEP_LANES];
+        const bool runaway = lockstep_run(lanes, used, options->max_cycles, faults);
+
+        // Lanes that diverged finish on their own.
+        for (int lane = 0; lane < used; lane++) {
+            printf("==> %s <==\n", datasets[first + lane]);
+            if (faults[lane].error == 0 && !lanes[lane].halt)
+                simulate_lane(&lanes[lane], options, &faults[lane]);
+            else if (faults[lane].error == 0 && runaway)
+                printf("\n\n *** Runaway program? (Program halted.) ***\n\n");
+
+            if (faults[lane].error != 0) {
+                printf("%s", faults[lane].message);
+                status = 1;
+            } else {
+                print_results(stdout, &lanes[lane], options, NULL);
+            }
+            processor_free(&lanes[lane]);
+        }
+    }
+
+    for (int i = 0; i < count; i++)
+        free(datasets[i]);
+    free(datasets);
+    FreeProgram(&program);
+    free(lanes);
+    return status;
+}
+
+// A server answering jobs from a socket, each worker serving one connection at a time on a
+// processor of its own that is reset between jobs rather than initialized again
+typedef struct {
+    int socket;
+    program_cache programs;
+    cpu_state *states;  // one per worker
+    const sim_options *options;
+} sim_server;
+
+/**
+ * Writes a message on a single line of a reply, as messages end in or contain line breaks.
+ */
+void serve_message(FILE *out, const char *message) {
+    size_t length = strlen(message);
+    while (length > 0 && (message[length - 1] == '\n' || message[length - 1] == ' '))
+        length--;
+    for (size_t i = 0; i < length; i++)
+        fputc(message[i] == '\n' ? ' ' : message[i], out);
+    fputc('\n', out);
 }
 
-void pipeline_writeback(cpu_state *state) {
-    struct writeback_buffer *writeback = &state->writeback_buffer;
-    const struct instruction inst = writeback->inst;
+/**
+ * Simulates a program of the cache on a processor reset from an earlier job, and writes
+ * the reply: how the program stopped, its counts and registers, every word of data memory
+ * that differs from the program's initial data, and the CPI stack unless functional.
+ */
+void serve_job(FILE *out, cpu_state *state, const cached_program *entry, const sim_options *options) {
+    processor_reset(state);
+    program_load(state, &entry->program);  // the cache has checked the data fits
+    prepare_processor(state, options);
 
-    int *dest = NULL;
-    int data = 0;
+    // Both are created before the handler, so that a fault cannot leak them.
+    translation_cache *translations = NULL;
+    loop_engine *engine = NULL;
+    if (options->functional)
+        translations = translation_cache_create(state->instruction_memory, state->instructions_count);
+    else if (!options->exact)
+        engine = loop_engine_create(state);
 
-    if (inst.op == ADD || inst.op == SUB)
-        dest = &state->register_file[inst.rd];
-    if (inst.op == ADDI || inst.op == SUBI || inst.op == LW)
-        dest = &state->register_file[inst.rt];
+    const long long limit = options->max_cycles > 0 ? options->max_cycles + 1 : LLONG_MAX;
+    volatile bool infinite = false;
+    int loop;
+    fault_handler handler;
+    fault_enter(&handler);
+    if (setjmp(handler.target) == 0) {
+        if (options->functional)
+            functional_execute(state, translations, options->max_cycles > 0 ? options->max_cycles : LLONG_MAX);
+        else if (engine != NULL)
+            infinite = loop_engine_run(engine, state, limit, &loop);
+        else
+            infinite = simulate_until(state, limit, true, NULL, &loop);
+        fault_leave(&handler);
+    }
+
+    if (translations != NULL)
+        translation_cache_destroy(translations);
+    if (engine != NULL)
+        loop_engine_destroy(engine);
 
-    if (inst.op >= ADDI && inst.op <= SUB)
-        data = writeback->alu_out;
-    if (inst.op == LW)
-        data = writeback->read_data;
+    if (handler.error != 0) {
+        fprintf(out, "status fault %d ", handler.error);
+        serve_message(out, handler.message);
+    } else if (infinite) {
+        fprintf(out, "status loop %d\n", loop);
+    } else if (!state->halt) {
+        fprintf(out, "status runaway\n");
+    } else {
+        fprintf(out, "status ok\n");
+    }
+    fprintf(out, "cycles %lld\ninstructions %lld\nregisters", state->cycles_executed, state->instructions_executed);
+    for (int i = R0; i <= R15; i++)
+        fprintf(out, " %d", state->register_file[i]);
+    fputc('\n', out);
 
-    if (dest != NULL) {
-        if (dest == state->register_file + R0) {
-            printf("Exception: Attempt to overwrite R0");
-            exit(ERROR_ILLEGAL_REG_WRITE);
+    const data_memory *memory = &state->data_memory;
+    const uint32_t pages = (uint32_t) ((memory->words + MEMORY_PAGE_WORDS - 1) / MEMORY_PAGE_WORDS);
+    for (uint32_t page = memory_next_page(memory, 0); page < pages; page = memory_next_page(memory, page + 1)) {
+        const int *final = memory_page(memory, page);
+        const int *initial = memory_page(&entry->initial, page);
+        for (int i = 0; i < MEMORY_PAGE_WORDS; i++) {
+            const int before = initial != NULL ? initial[i] : 0;
+            if (final[i] != before)
+                fprintf(out, "memory %u %d\n", page * MEMORY_PAGE_WORDS + i, final[i]);
         }
+    }
 
-        *dest = data;
+    if (!options->functional) {
+        fprintf(out, "stats ");
+        print_stats(out, state, true);
     }
+}
+
+/**
+ * Serves connections one after another on a worker, until the socket fails.
+ */
+void serve_connections(void *context, int job, int worker) {
+    sim_server *server = context;
+    char message[ASSEMBLY_MESSAGE_SIZE];
+    int client;
+    (void) job;  // there is one job per worker, so the worker alone picks the processor
+
+    while ((client = accept(server->socket, NULL, NULL)) != -1 || errno == EINTR || errno == ECONNABORTED) {
+        server_frame frame;
+        char *payload;
+
+        while (client != -1 && server_read_frame(client, &frame, &payload)) {
+            char *reply = NULL;
+            size_t reply_size = 0;
+            FILE *out = open_memstream(&reply, &reply_size);
 
-    processor_forward_on_hazard(state, &state->execute_buffer.foward_a,
-                                state->execute_buffer.inst, inst, WRITEBACK, data);
+            cached_program *entry = program_cache_get(&server->programs, frame.kind, payload, frame.length,
+                                                      message, sizeof(message));
+            if (entry == NULL) {
+                fprintf(out, "status error ");
+                serve_message(out, message);
+            } else {
+                serve_job(out, &server->states[worker], entry, server->options);
+                program_cache_release(&server->programs, entry);
+            }
+            fclose(out);
+
+            const bool sent = server_write_frame(client, reply, reply_size);
+            free(reply);
+            free(payload);
+            if (!sent)
+                break;
+        }
+        if (client != -1)
+            close(client);
+    }
+}
 
-    writeback->result = data;
+/**
+ * Serves simulation jobs on a Unix domain socket at path until killed, with a worker per thread.
+ * @return 1 if the socket cannot be opened
+ */
+int serve(const char *path, int workers, const sim_options *options) {
+    if (workers <= 0)
+        workers = work_pool_default_workers();
 
-    // Only increment counter if the instruction executed was not a NOP
-    if (inst.op != nop.op) {
-        state->instructions_executed++;
+    sim_server server = { .socket = server_listen(path), .states = malloc(workers * sizeof(cpu_state)),
+                          .options = options };
+    if (server.socket == -1) {
+        printf("Unable to listen on %s\n", path);
+        free(server.states);
+        return 1;
     }
+    program_cache_init(&server.programs, options->memory_words);
+    for (int i = 0; i < workers; i++)
+        processor_init(&server.states[i], options->memory_words);
+
+    printf("Serving on %s with %d workers\n", path, workers);
+    fflush(stdout);
+
+    // Every worker takes one job, which never ends while the socket is open.
+    work_pool_run(workers, workers, serve_connections, &server);
+
+    for (int i = 0; i < workers; i++)
+        processor_free(&server.states[i]);
+    free(server.states);
+    close(server.socket);
+    return 0;
+}
+
+void print_usage() {
+    printf("Usage: sim [args] [program]\n");
+    printf("       sim [args] --batch [directory|list]\n");
+    printf("       sim [args] --lockstep [directory|list] [program]\n");
+    printf("       sim [args] --serve SOCKET\n\n");
+    printf("Arguments:\n");
+    printf("\t-D\toutput additional information about simulator state\n");
+    printf("\t-F\texecute functionally, without modelling the pipeline\n");
+    printf("\t-j N\tsimulate a batch, or serve jobs, on N threads (default: one per processor)\n");
+    printf("\t--data FILE\tinitialize data memory with the integers in FILE\n");
+    printf("\t--memory N\taddress N words of data memory, or \"full\" for 2^32 (default: %d)\n", DEFAULT_WORDS_OF_DATA);
+    printf("\t--max-cycles N\tstop a runaway program after N cycles, or never if 0 (default: %d)\n", DEFAULT_MAX_CYCLES);
+    printf("\t--lockstep\tsimulate the program on each data file of a batch, several at once\n");
+    printf("\t--serve SOCKET\tsimulate the programs sent to a Unix domain socket, caching them, until killed\n");
+    printf("\t-o FILE\twrite the assembled program to FILE as an image instead of simulating it\n");
+    printf("\t--checkpoint-at N FILE\tstop after cycle N (instruction N with -F) and save the state to FILE\n");
+    printf("\t--restore FILE\tresume the simulation saved in FILE\n");
+    printf("\t--trace FILE\trecord the pipeline latches and events of every cycle in FILE, for dlxtrace\n");
+    printf("\t--predictor NAME[,N[,H]]\tpredict branches in fetch with not-taken (the default), btfn, bimodal,\n"
+           "\t\tgshare or btb, with a table of N entries (default: %d) and H bits of history for gshare\n",
+           DEFAULT_PREDICTOR_ENTRIES);
+    printf("\t--cache SPEC\tplace a data cache before memory; SPEC is \"default\" or a comma-separated list of\n"
+           "\t\twords=N, ways=N, line=N, write=back|through, replace=lru|fifo|random, hit=N and miss=N\n"
+           "\t\t(default: %d words, %d ways, %d-word lines, write-back, LRU, %d-cycle hits, %d cycles per miss)\n",
+           DEFAULT_CACHE_WORDS, DEFAULT_CACHE_WAYS, DEFAULT_CACHE_LINE, DEFAULT_CACHE_HIT, DEFAULT_CACHE_MISS);
+    printf("\t--units SPEC\tconfigure the functional units of MULT and DIV; SPEC is \"default\" or a comma-separated\n"
+           "\t\tlist of mult=N, div=N, mult-pipelined=yes|no and div-pipelined=yes|no\n"
+           "\t\t(default: %d-cycle pipelined multiplier, %d-cycle unpipelined divider)\n",
+           DEFAULT_MULTIPLY_LATENCY, DEFAULT_DIVIDE_LATENCY);
+    printf("\t--width=N\tfetch, decode and issue up to N instructions per cycle, in order (default: 1, at most %d)\n",
+           SUPERSCALAR_MAX_WIDTH);
+    printf("\t--ooo SPEC\tsimulate an out-of-order core; SPEC is \"default\" or a comma-separated list of width=N,\n"
+           "\t\trob=N, rs=N and lsq=N (default: width %d, %d reorder buffer entries, %d reservation stations,\n"
+           "\t\t%d load/store queue entries)\n", DEFAULT_OOO_WIDTH, DEFAULT_OOO_ROB, DEFAULT_OOO_STATIONS,
+           DEFAULT_OOO_QUEUE);
+    printf("\t--pipeline SPEC\tsimulate an in-order pipeline of configured depth; SPEC is \"default\" or a\n"
+           "\t\tcomma-separated list of fetch=N, execute=N and memory=N stages (default: 1 each, at most %d)\n",
+           STAGES_MAX_SPAN);
+    printf("\t--cores N[,Q]\tsimulate N cores sharing data memory, on a thread each, meeting every Q cycles\n"
+           "\t\t(default: %d, at most %d cores)\n", DEFAULT_QUANTUM, MULTICORE_MAX_CORES);
+    printf("\t--stats[=json]\tprint a CPI stack of the stalls and flushes, and the forwarding counts\n");
+    printf("\t--dump MODE\tprint data memory with -D as dense (every word, the default), sparse (only rows holding a\n"
+           "\t\tnon-zero word) or diff (only words changed from the initial data)\n");
+    printf("\t--dump-raw FILE\twrite data memory to FILE as raw 32-bit words after the program halts\n");
+    printf("\t--exact\tsimulate every cycle instead of extrapolating loops in a steady state\n");
+    printf("\t--sample P[,W,M]\tsimulate the pipeline in detail for W instructions of warm-up and M measured\n"
+           "\t\tinstructions out of every P, executing the rest functionally (default: W=%d, M=%d)\n",
+           DEFAULT_SAMPLE_WARMUP, DEFAULT_SAMPLE_MEASURE);
 }
 
-void simulate_cycle(cpu_state *state) {
-    // Simulate each pipeline stage every cycle.
-    // This is done in reverse to ensure that each
-    // stage's change to the state of the processor
-    // only affects it after the current cycle ends.
-    pipeline_writeback(state);
-    pipeline_memory(state);
-    pipeline_execute(state);
-    pipeline_decode(state);
-    pipeline_fetch(state);
+/**
+ * Parses the number of an option, which must be decimal digits, after an optional minus
+ * sign, and nothing else.
+ * @return false if text is not a number from minimum to maximum
+ */
+bool parse_number(const char *text, long long minimum, long long maximum, long long *number) {
+    char *end;
+    if (!isdigit((unsigned char) text[text[0] == '-']))
+        return false;
+    errno = 0;
+    *number = strtoll(text, &end, 10);
+    return *end == '\0' && errno == 0 && *number >= minimum && *number <= maximum;
 }
 
+/**
+ * Parses the comma-separated numbers of an option, each as parse_number does.
+ * @param numbers output; room for count numbers
+ * @return how many numbers text holds, or 0 if it is malformed or holds more than count
+ */
+int parse_numbers(const char *text, long long minimum, long long maximum, long long *numbers, int count) {
+    char field[32];
+    for (int parsed = 0; parsed < count; parsed++) {
+        const size_t length = strcspn(text, ",");
+        if (length >= sizeof(field))
+            return 0;
+        memcpy(field, text, length);
+        field[length] = '\0';
+        if (!parse_number(field, minimum, maximum, &numbers[parsed]))
+            return 0;
+        if (text[length] == '\0')
+            return parsed + 1;
+        text += length + 1;
+    }
+    return 0;
+}
 
 int main(int argc, char **argv) {
-    bool debug;
-    char* program_name;
-
-    switch (argc) {
-        case 3:
-            debug = (strcmp(argv[1], "-D") == 0);
-            program_name = argv[2];
-            break;
-        case 2:
-            program_name = argv[1];
-            break;
-        default:
-            printf("Usage: sim [args] [program]\n\n");
-            printf("Arguments:\n");
-            printf("\t-D\toutput additional information about simulator state\n");
+    sim_options options = { .memory_words = DEFAULT_WORDS_OF_DATA, .max_cycles = DEFAULT_MAX_CYCLES,
+                            .predictor = { PREDICT_NOT_TAKEN, DEFAULT_PREDICTOR_ENTRIES, 0 }, .width = 1 };
+    bool predictor = false, units = false;
+    char* program_name = NULL;
+    char* batch = NULL;
+    char* datasets = NULL;
+    char* socket_path = NULL;
+    int workers = 0;
+    long long number;
+
+    units_default(&options.units);
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-D") == 0) {
+            options.debug = true;
+        } else if (strcmp(argv[i], "-F") == 0) {
+            options.functional = true;
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batch = argv[++i];
+        } else if (strcmp(argv[i], "--checkpoint-at") == 0 && i + 2 < argc) {
+            if (!parse_number(argv[++i], 0, LLONG_MAX, &options.checkpoint_at)) {
+                print_usage();
+                exit(0);
+            }
+            options.checkpoint = argv[++i];
+        } else if (strcmp(argv[i], "--restore") == 0 && i + 1 < argc && program_name == NULL) {
+            options.restore = true;
+            program_name = argv[++i];
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            options.image = argv[++i];
+        } else if (strcmp(argv[i], "--data") == 0 && i + 1 < argc) {
+            options.data = argv[++i];
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (strcmp(argv[i], "--lockstep") == 0 && i + 1 < argc) {
+            datasets = argv[++i];
+        } else if (strcmp(argv[i], "--memory") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "full") == 0) {
+                options.memory_words = MEMORY_MAX_WORDS;
+            } else if (parse_number(argv[i], 1, MEMORY_MAX_WORDS, &number)) {
+                options.memory_words = number;
+            } else {
+                print_usage();
+                exit(0);
+            }
+        } else if (strcmp(argv[i], "--max-cycles") == 0 && i + 1 < argc) {
+            // The limit is run to one cycle past, to tell a program halting on it from a runaway.
+            if (!parse_number(argv[++i], 0, LLONG_MAX - 1, &options.max_cycles)) {
+                print_usage();
+                exit(0);
+            }
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            options.trace = argv[++i];
+        } else if (strcmp(argv[i], "--predictor") == 0 && i + 1 < argc) {
+            // NAME[,ENTRIES[,HISTORY]]
+            const char *spec = argv[++i];
+            const size_t length = strcspn(spec, ",");
+            char name[16] = "";
+            long long numbers[2];
+            const int count = spec[length] == ',' ? parse_numbers(spec + length + 1, 0, INT_MAX, numbers, 2) : 0;
+            if (length < sizeof(name))
+                memcpy(name, spec, length);
+            if (count > 0)
+                options.predictor.entries = (int) numbers[0];
+            options.predictor.history_bits = count > 1 ? (int) numbers[1]
+                    : __builtin_ctz(options.predictor.entries | PREDICTOR_MAX_ENTRIES);
+            if (length >= sizeof(name) || (spec[length] == ',' && count == 0)
+                    || !predictor_parse(name, &options.predictor.kind) || !predictor_valid(&options.predictor)) {
+                print_usage();
+                exit(0);
+            }
+            predictor = true;
+        } else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            if (!cache_parse(argv[++i], &options.cache)) {
+                print_usage();
+                exit(0);
+            }
+        } else if (strcmp(argv[i], "--units") == 0 && i + 1 < argc) {
+            if (!units_parse(argv[++i], &options.units)) {
+                print_usage();
+                exit(0);
+            }
+            units = true;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            options.stats = STATS_TEXT;
+        } else if (strcmp(argv[i], "--stats=json") == 0) {
+            options.stats = STATS_JSON;
+        } else if (strncmp(argv[i], "--width=", 8) == 0) {
+            if (!parse_number(argv[i] + 8, 1, SUPERSCALAR_MAX_WIDTH, &number)) {
+                print_usage();
+                exit(0);
+            }
+            options.width = (int) number;
+        } else if (strcmp(argv[i], "--ooo") == 0 && i + 1 < argc) {
+            if (!tomasulo_parse(argv[++i], &options.ooo)) {
+                print_usage();
+                exit(0);
+            }
+        } else if (strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc) {
+            if (!stages_parse(argv[++i], &options.pipeline)) {
+                print_usage();
+                exit(0);
+            }
+        } else if (strcmp(argv[i], "--cores") == 0 && i + 1 < argc) {
+            if (!multicore_parse(argv[++i], &options.cores)) {
+                print_usage();
+                exit(0);
+            }
+        } else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "dense") == 0) {
+                options.dump = DUMP_DENSE;
+            } else if (strcmp(argv[i], "sparse") == 0) {
+                options.dump = DUMP_SPARSE;
+            } else if (strcmp(argv[i], "diff") == 0) {
+                options.dump = DUMP_DIFF;
+            } else {
+                print_usage();
+                exit(0);
+            }
+        } else if (strcmp(argv[i], "--dump-raw") == 0 && i + 1 < argc) {
+            options.dump_raw = argv[++i];
+        } else if (strcmp(argv[i], "--exact") == 0) {
+            options.exact = true;
+        } else if (strcmp(argv[i], "--sample") == 0 && i + 1 < argc) {
+            // Halving the range keeps the sum of the warm-up and the measurement from overflowing.
+            long long numbers[3];
+            const int count = parse_numbers(argv[++i], 0, LLONG_MAX / 2, numbers, 3);
+            options.sample.period = numbers[0];
+            options.sample.warmup = count > 1 ? numbers[1] : DEFAULT_SAMPLE_WARMUP;
+            options.sample.measure = count > 2 ? numbers[2] : DEFAULT_SAMPLE_MEASURE;
+            if (count == 0 || options.sample.measure <= 0
+                    || options.sample.period < options.sample.warmup + options.sample.measure) {
+                print_usage();
+                exit(0);
+            }
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            if (!parse_number(argv[++i], 1, WORK_POOL_MAX_WORKERS, &number)) {
+                print_usage();
+                exit(0);
+            }
+            workers = (int) number;
+        } else if (argv[i][0] != '-' && program_name == NULL) {
+            program_name = argv[i];
+        } else {
+            print_usage();
             exit(0);
+        }
     }
 
-    cpu_state state = {};
+    // Sampling already runs functionally between samples, and its pipeline state is not exact.
+    // The functional execution between samples does not train a cache or predictor, so every
+    // window would start them cold.
+    if (options.sample.period > 0 && (options.functional || options.checkpoint != NULL || options.restore
+                                      || predictor || options.cache.words > 0)) {
+        print_usage();
+        exit(0);
+    }
 
-    /* assemble input program */
-    AssembleSimpleDLX(program_name, state.instruction_memory, &state.instructions_count);
+    // A trace follows the pipeline of a single program.
+    if (options.trace != NULL && (options.functional || options.sample.period > 0 || batch != NULL || datasets != NULL
+                                  || options.image != NULL)) {
+        print_usage();
+        exit(0);
+    }
 
-    /* set initial simulator values */
-    state.cycles_executed = 0;       /* simulator cycle count */
-    state.instructions_executed = 0; /* simulator instruction count */
-    state.register_file[R0] = 0;     /* register R0 is alway zero */
-
-    // Execute the simulator until it is halted
-    while (!state.halt) {
-        simulate_cycle(&state);  /* simulate one cycle */
-        state.cycles_executed++; /* update cycle count */
-
-        /* check if simulator is stuck in an infinite loop */
-        if (state.cycles_executed > MAX_CYCLES) {
-            printf("\n\n *** Runaway program? (Program halted.) ***\n\n");
-            break;
+    // The predictor, cache and functional units belong to the pipeline, and a checkpoint carries its own.
+    if ((predictor || options.cache.words > 0 || units) && (options.functional || datasets != NULL || options.restore || options.image != NULL)) {
+        print_usage();
+        exit(0);
+    }
+
+    // The counters are only kept by the pipeline, and only for the cycles simulated in detail.
+    if (options.stats != STATS_NONE && (options.functional || options.sample.period > 0 || datasets != NULL
+                                        || options.image != NULL)) {
+        print_usage();
+        exit(0);
+    }
+
+    // The wider core fetches past branches without a predictor, keeps no CPI stack, and has no
+    // trace or checkpoint format of its own.
+    if (options.width > 1 && (options.functional || predictor || options.stats != STATS_NONE || options.trace != NULL
+                              || options.checkpoint != NULL || options.restore || options.sample.period > 0
+                              || datasets != NULL || options.image != NULL)) {
+        print_usage();
+        exit(0);
+    }
+
+    // The out-of-order core has the same limits, and replaces the in-order pipelines.
+    if (options.ooo.width > 0 && (options.width > 1 || options.functional || options.stats != STATS_NONE
+                                  || options.trace != NULL || options.checkpoint != NULL || options.restore
+                                  || options.sample.period > 0 || datasets != NULL || options.image != NULL)) {
+        print_usage();
+        exit(0);
+    }
+
+    // So does a pipeline of configured depth, which does not predict branches either.
+    if (options.pipeline.fetch > 0 && (options.width > 1 || options.ooo.width > 0 || options.functional || predictor
+                                       || options.stats != STATS_NONE || options.trace != NULL
+                                       || options.checkpoint != NULL || options.restore || options.sample.period > 0
+                                       || datasets != NULL || options.image != NULL)) {
+        print_usage();
+        exit(0);
+    }
+
+    // A multicore machine is made of scalar pipelines, and reports on each core in full.
+    if (options.cores.cores > 0 && (options.width > 1 || options.ooo.width > 0 || options.pipeline.fetch > 0
+                                    || options.functional || options.stats != STATS_NONE || options.trace != NULL
+                                    || options.checkpoint != NULL || options.restore || options.sample.period > 0
+                                    || datasets != NULL || options.image != NULL)) {
+        print_usage();
+        exit(0);
+    }
+
+    // The memory dumps are of a single program's memory, and only lockstep lanes lack its initial data.
+    if ((options.dump != DUMP_DENSE && (!options.debug || datasets != NULL))
+            || (options.dump_raw != NULL && (batch != NULL || datasets != NULL || options.image != NULL))) {
+        print_usage();
+        exit(0);
+    }
+
+    // A checkpoint belongs to a single program run.
+    if ((options.checkpoint != NULL || options.restore)
+            && (batch != NULL || datasets != NULL || options.image != NULL || (options.restore && options.data != NULL))) {
+        print_usage();
+        exit(0);
+    }
+
+    // A server runs the scalar pipeline, or executes functionally, on the programs it is sent
+    // alone, and replies with the statistics itself.
+    if (socket_path != NULL && (program_name != NULL || batch != NULL || datasets != NULL || options.image != NULL
+                                || options.data != NULL || options.checkpoint != NULL || options.restore
+                                || options.trace != NULL || options.sample.period > 0 || options.width > 1
+                                || options.ooo.width > 0 || options.pipeline.fetch > 0 || options.cores.cores > 0
+                                || options.stats != STATS_NONE || options.debug || options.dump_raw != NULL)) {
+        print_usage();
+        exit(0);
+    }
+
+    if (socket_path != NULL)
+        return serve(socket_path, workers, &options);
+
+    if (options.image != NULL && program_name != NULL && batch == NULL && datasets == NULL) {
+        struct program program;
+
+        AssembleSimpleDLX(program_name, &program);
+        if (!image_write(options.image, &program)) {
+            printf("Unable to write image %s\n", options.image);
+            return 1;
         }
+        FreeProgram(&program);
+        return 0;
+    }
+
+    if (options.image != NULL) {
+        print_usage();
+        exit(0);
     }
 
-    if (debug) {
-        printf("Registers:\n");
-        print_registers(state.register_file);
-        printf("Memory:\n");
-        print_memory(state.data_memory);
-        printf("Instructions: %d\n", state.instructions_executed);
-        printf("Cycles: %d\n", state.cycles_executed);
-   } else {
-        printf("Final register file values:\n");
-        print_registers_original(state.register_file);
-        printf("\nCycles executed: %d\n", state.cycles_executed);
-        printf("IPC:  %6.3f\n", (float) state.instructions_executed / (float) state.cycles_executed);
-        printf("CPI:  %6.3f\n", (float) state.cycles_executed / (float) state.instructions_executed);
+    if (batch != NULL && program_name == NULL && datasets == NULL)
+        return simulate_batch(batch, workers, &options);
+
+    if (datasets != NULL && program_name != NULL && batch == NULL && !options.functional && options.data == NULL
+            && options.sample.period == 0)
+        return simulate_lockstep(program_name, datasets, &options);
+
+    if (program_name == NULL || batch != NULL || datasets != NULL) {
+        print_usage();
+        exit(0);
     }
+
+    // An exception ends sim with its error as the exit status, as fault_raise would.
+    cpu_state state;
+    const int status = simulate_program(stdout, program_name, &options, &state);
+    return status < 0 ? status : 0;
 }
@@ -0,0 +1,255 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stages.h"
+
+bool stages_parse(const char *spec, stage_options *options) {
+    *options = (stage_options) { 1, 1, 1 };
+
+    while (*spec != '\0' && strcmp(spec, "default") != 0) {
+        char key[16], value[16];
+        int length = 0;
+        if (sscanf(spec, "%15[^=]=%15[^,]%n", key, value, &length) != 2)
+            return false;
+        spec += length;
+        if (*spec == ',')
+            spec++;
+
+        char *end;
+        const long number = strtol(value, &end, 10);
+        if (*end != '\0' || number < 1 || number > STAGES_MAX_SPAN)
+            return false;
+
+        if (strcmp(key, "fetch") == 0)
+            options->fetch = (int) number;
+        else if (strcmp(key, "execute") == 0)
+            options->execute = (int) number;
+        else if (strcmp(key, "memory") == 0)
+            options->memory = (int) number;
+        else
+            return false;
+    }
+    return true;
+}
+
+const char *stages_name(const staged_pipeline *pipe, int i, char name[STAGES_NAME_SIZE]) {
+    static const char *names[] = { "IF", "ID", "EX", "MEM", "WB" };
+    const int first[] = { 0, pipe->decode, pipe->execute, pipe->memory, pipe->writeback };
+    const int span[] = { pipe->options.fetch, 1, pipe->options.execute, pipe->options.memory, 1 };
+    const stage_kind kind = pipe->kinds[i];
+
+    if (span[kind] == 1)
+        snprintf(name, STAGES_NAME_SIZE, "%s", names[kind]);
+    else
+        snprintf(name, STAGES_NAME_SIZE, "%s%d", names[kind], i - first[kind] + 1);
+    return name;
+}
+
+void stages_init(staged_pipeline *pipe, const stage_options *options) {
+    memset(pipe, 0, sizeof(*pipe));
+    pipe->options = *options;
+    pipe->decode = options->fetch;
+    pipe->execute = pipe->decode + 1;
+    pipe->memory = pipe->execute + options->execute;
+    pipe->writeback = pipe->memory + options->memory;
+    pipe->depth = pipe->writeback + 1;
+
+    for (int i = 0; i < pipe->depth; i++) {
+        pipe->kinds[i] = i < pipe->decode ? STAGE_FETCH : i == pipe->decode ? STAGE_DECODE
+                : i < pipe->memory ? STAGE_EXECUTE : i < pipe->writeback ? STAGE_MEMORY : STAGE_WRITEBACK;
+        pipe->latches[i] = (stage_latch) { .inst = nop, .ready = LLONG_MAX };
+    }
+}
+
+/**
+ * Reads a register for the instruction in decode, forwarded from the youngest instruction
+ * ahead of it that writes the register, or else from the register file.
+ * @param computed the last cycle a forwarded value may have been computed in
+ * @return false if the value is not ready in time
+ */
+static bool stages_operand(const cpu_state *state, const staged_pipeline *pipe, int reg, long long computed, int *value) {
+    *value = 0;
+    if (reg == NOT_USED)
+        return true;
+
+    for (int i = pipe->decode + 1; i < pipe->depth; i++) {
+        const stage_latch *latch = &pipe->latches[i];
+        if ((latch->inst.flags & INST_WRITES) && latch->inst.dest == reg) {
+            *value = latch->result;
+            return latch->ready <= computed;
+        }
+    }
+
+    *value = state->register_file[reg];
+    return true;
+}
+
+/**
+ * Resolves the instruction in decode and reads its operands.
+ * @return true if it holds decode, waiting for an operand
+ */
+static bool stages_decode(cpu_state *state, staged_pipeline *pipe, stage_latch *latch, long long now) {
+    const struct instruction *inst = &latch->inst;
+
+    // rs is read by everything but jumps, and rt by the register-register instructions and stores.
+    const int rs = (inst->flags & INST_JUMP) ? NOT_USED : inst->rs;
+    const int rt = !(inst->flags & (INST_IMMEDIATE | INST_BRANCH | INST_JUMP)) || (inst->flags & INST_STORE)
+            ? inst->rt : NOT_USED;
+
+    // A branch is resolved here, so its operand must have been computed in an earlier cycle;
+    // anything else takes its operands in the first execute stage next cycle.
+    const bool branch = (inst->flags & INST_BRANCH) != 0;
+    const long long computed = branch ? now - 1 : now;
+    if (!stages_operand(state, pipe, rs, computed, &latch->a) || !stages_operand(state, pipe, rt, computed, &latch->b)) {
+        pipe->operand_stalls += !branch;
+        pipe->branch_stalls += branch;
+        return true;
+    }
+
+    if (!latch->done && (inst->flags & (INST_BRANCH | INST_JUMP))) {
+        const bool taken = (inst->flags & INST_JUMP) || (latch->a == 0) == (inst->branch == BRANCH_EQZ);
+        const int target = latch->pc + 1 + inst->imm;
+
+        if (taken) {
+            if (target < 0 || target > state->instructions_count - 1) {
+                fault_raise(ERROR_ILLEGAL_JUMP, "out-of-bounds should_jump to %d\n", target);
+            }
+            for (int i = 0; i < pipe->decode; i++) {
+                pipe->flushed += pipe->latches[i].inst.op != NOP;
+                pipe->latches[i].inst = nop;
+            }
+            pipe->pc = target;
+            pipe->redirected = true;
+        }
+        state->stats.branches++;
+        state->stats.taken += taken;
+    }
+    latch->done = true;
+    return false;
+}
+
+/**
+ * Performs the work of stage i on the instruction it holds.
+ * @return true if the instruction holds the stage, and those behind it, for another cycle
+ */
+static bool stages_work(cpu_state *state, staged_pipeline *pipe, int i, long long now) {
+    stage_latch *latch = &pipe->latches[i];
+    const struct instruction *inst = &latch->inst;
+
+    switch (pipe->kinds[i]) {
+        case STAGE_FETCH:
+            if (i == 0 && inst->op == NOP && !pipe->redirected && pipe->pc < state->instructions_count)
+                *latch = (stage_latch) { .inst = state->instruction_memory[pipe->pc], .pc = pipe->pc++, .ready = LLONG_MAX };
+            return false;
+
+        case STAGE_DECODE:
+            return inst->op != NOP && stages_decode(state, pipe, latch, now);
+
+        case STAGE_EXECUTE:
+            if (i != pipe->memory - 1 || latch->done)
+                return false;
+
+            // A multiplication or division stays for the rest of the latency of its unit.
+            if (inst->flags & INST_UNIT) {
+                if (latch->wait == 0)
+                    latch->wait = state->scoreboard.options.latency[scoreboard_unit(inst)] - pipe->options.execute + 1;
+                if (--latch->wait > 0) {
+                    pipe->unit_waits++;
+                    return true;
+                }
+            }
+
+            latch->result = processor_alu(inst->alu, latch->a, (inst->flags & INST_IMMEDIATE) ? inst->imm : latch->b);
+            latch->ready = (inst->flags & (INST_LOAD | INST_ATOMIC)) ? LLONG_MAX : now;
+            latch->done = true;
+            return false;
+
+        case STAGE_MEMORY:
+            if (i == pipe->memory && !latch->done && (inst->flags & INST_MEMORY)) {
+                const int address = latch->result;
+                if (!memory_in_bounds(&state->data_memory, address)) {
+                    fault_raise(ERROR_ILLEGAL_MEM_ACCESS, "Exception: out-of-bounds data memory access at %d\n",
+                                address);
+                }
+
+                if (state->cache.lines != NULL && latch->wait == 0) {
+                    int latency;
+                    const cache_outcome outcome = cache_access(&state->cache, address, inst->flags & INST_STORE, &latency);
+                    state->stats.cache_hits += outcome == CACHE_HIT;
+                    state->stats.cache_misses += outcome != CACHE_HIT;
+                    state->stats.cache_writebacks += outcome == CACHE_MISS_WRITEBACK;
+                    latch->wait = latency;
+                }
+                if (latch->wait > 1) {
+                    latch->wait--;
+                    pipe->memory_waits++;
+                    state->stats.memory_stalls++;
+                    return true;
+                }
+
+                if (inst->flags & INST_LOAD) {
+                    latch->result = memory_load(&state->data_memory, address);
+                    if (inst->flags & INST_ATOMIC)
+                        processor_load_linked(state, address);
+                } else if (inst->flags & INST_ATOMIC) {
+                    latch->result = processor_store_conditional(state, address, latch->b);
+                } else {
+                    memory_store(&state->data_memory, address, latch->b);
+                }
+                latch->done = true;
+            }
+            if (i == pipe->writeback - 1 && (inst->flags & (INST_LOAD | INST_ATOMIC)))
+                latch->ready = now;
+            return false;
+
+        case STAGE_WRITEBACK:
+            if (inst->flags & INST_WRITES) {
+                if (inst->dest == R0) {
+                    fault_raise(ERROR_ILLEGAL_REG_WRITE, "Exception: Attempt to overwrite R0\n");
+                }
+                state->register_file[inst->dest] = latch->result;
+            }
+            state->instructions_executed += inst->op != NOP;
+            return false;
+    }
+    return false;
+}
+
+/**
+ * Simulates one cycle of the pipeline. The stages work from writeback back to fetch, and
+ * each passes its instruction on as soon as the stage after it is free, so a stage holding
+ * its instruction holds every stage behind it. The processor halts once the pipeline is
+ * empty past the end of the program.
+ */
+static void stages_cycle(cpu_state *state, staged_pipeline *pipe) {
+    const long long now = state->cycles_executed;
+    bool empty = true;
+
+    pipe->redirected = false;
+    for (int i = pipe->depth - 1; i >= 0; i--) {
+        stage_latch *latch = &pipe->latches[i];
+        if (stages_work(state, pipe, i, now))
+            continue;
+
+        if (i == pipe->writeback) {
+            latch->inst = nop;
+        } else if (pipe->latches[i + 1].inst.op == NOP) {
+            pipe->latches[i + 1] = *latch;
+            pipe->latches[i + 1].wait = 0;
+            pipe->latches[i + 1].done = false;
+            latch->inst = nop;
+        }
+    }
+
+    for (int i = 0; i < pipe->depth; i++)
+        empty &= pipe->latches[i].inst.op == NOP;
+    state->halt = empty && pipe->pc >= state->instructions_count;
+}
+
+void stages_run(cpu_state *state, staged_pipeline *pipe, long long cycles) {
+    while (!state->halt && state->cycles_executed < cycles) {
+        stages_cycle(state, pipe);
+        state->cycles_executed++;
+    }
+}
@@ -0,0 +1,362 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "superscalar.h"
+
+void superscalar_init(superscalar *core, int width) {
+    memset(core, 0, sizeof(*core));
+    core->width = width;
+    for (int i = 0; i < SUPERSCALAR_MAX_WIDTH; i++) {
+        core->execute.inst[i] = nop;
+        core->memory.inst[i] = nop;
+        core->writeback.inst[i] = nop;
+    }
+}
+
+/**
+ * @return true if any of count instructions reads the register writer writes to
+ */
+static bool superscalar_reads(const struct instruction *readers, int count, const struct instruction *writer) {
+    for (int i = 0; i < count; i++) {
+        if (instruction_get_reg_read_after_write(readers[i], *writer) != NOT_USED)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @return true if every lane of a stage holds a NOP
+ */
+static bool superscalar_empty(const struct instruction *lanes, int width) {
+    for (int i = 0; i < width; i++) {
+        if (lanes[i].op != NOP)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @param limit output; the rule that ended the group, if it is shorter than the instructions waiting
+ * @return the number of instructions at the front of decode that may issue together
+ */
+static int superscalar_group(const superscalar *core, pairing_limit *limit) {
+    const struct instruction *waiting = core->decode.inst;
+    bool memory = false, unit = false;
+
+    for (int group = 0; group < core->decode.count; group++) {
+        const struct instruction *inst = &waiting[group];
+
+        for (int i = 0; i < group; i++) {
+            if (instruction_get_reg_read_after_write(*inst, waiting[i]) != NOT_USED
+                    || (inst->dest_mask & waiting[i].dest_mask)) {
+                *limit = PAIR_DEPENDENCE;
+                return group;
+            }
+        }
+        if ((inst->flags & INST_MEMORY) && memory) {
+            *limit = PAIR_MEMORY;
+            return group;
+        }
+        if ((inst->flags & INST_UNIT) && unit) {
+            *limit = PAIR_UNIT;
+            return group;
+        }
+        if (inst->flags & (INST_BRANCH | INST_JUMP)) {
+            *limit = PAIR_BRANCH;
+            return group + 1;
+        }
+
+        memory |= (inst->flags & INST_MEMORY) != 0;
+        unit |= (inst->flags & INST_UNIT) != 0;
+    }
+    return core->decode.count;
+}
+
+/**
+ * Forwards the result of an instruction in the memory or writeback stage to the lanes of
+ * the execute stage and the branches in decode that read it.
+ */
+static void superscalar_forward(superscalar *core, const struct instruction *writer, int data) {
+    for (int i = 0; i < core->width; i++) {
+        const struct instruction *reader = &core->execute.inst[i];
+        if (reader->src_mask & writer->dest_mask) {
+            if (writer->dest == reader->rs)
+                core->execute.a[i] = data;
+            if (writer->dest == reader->rt)
+                core->execute.b[i] = data;
+        }
+    }
+
+    for (int i = 0; i < core->decode.count; i++) {
+        const struct instruction *branch = &core->decode.inst[i];
+        if ((branch->flags & INST_BRANCH) && (branch->src_mask & writer->dest_mask)) {
+            core->decode.forward[i] = true;
+            core->decode.data[i] = data;
+        }
+    }
+}
+
+static void superscalar_fetch(cpu_state *state, superscalar *core) {
+    if (core->memory.waiting)
+        return;
+
+    if (core->fetch.stall) {
+        core->fetch.stall = false;
+        return;
+    }
+
+    // Decode has already discarded what followed the branch or jump.
+    if (core->fetch.flush) {
+        core->fetch.flush = false;
+        core->fetch.pc = core->fetch.pc_branch;
+        return;
+    }
+
+    // Nothing is fetched past the end of the program, and the pipeline drains.
+    while (core->decode.count < core->width && core->fetch.pc < state->instructions_count) {
+        const int slot = core->decode.count++;
+        core->decode.inst[slot] = state->instruction_memory[core->fetch.pc];
+        core->decode.pc_next[slot] = ++core->fetch.pc;
+        core->decode.forward[slot] = false;
+    }
+}
+
+static void superscalar_decode(cpu_state *state, superscalar *core) {
+    const scoreboard *board = &state->scoreboard;
+
+    if (core->memory.waiting)
+        return;
+
+    pairing_limit limit;
+    const int group = superscalar_group(core, &limit);
+
+    // Of the group, issue the instructions the scoreboard clears. Every one but a NOP, or an
+    // instruction staying in its unit for longer than a cycle, needs a lane of the memory
+    // stage two cycles from now, which an instruction leaving a unit may have reserved.
+    int issued = 0;
+    int lanes = (board->reserved & 2) != 0;
+    for (; issued < group && !core->decode.stall; issued++) {
+        const struct instruction *inst = &core->decode.inst[issued];
+        const int unit = scoreboard_unit(inst);
+        if (scoreboard_waits(board, inst))
+            break;
+        if (unit >= 0 && (board->busy[unit] > 0 || (board->reserved >> board->options.latency[unit] & 1)))
+            break;
+
+        const bool lane = inst->op != NOP && (unit < 0 || board->options.latency[unit] == 1);
+        if (lane && lanes == core->width)
+            break;
+        lanes += lane;
+    }
+
+    // Inject NOPs into the execute stage when requested to stall, or when the scoreboard
+    // holds the first instruction, and instruct the fetch stage to stall.
+    if (core->decode.stall || (group > 0 && issued == 0)) {
+        core->decode.stall = false;
+        core->fetch.stall = true;
+        for (int i = 0; i < core->width; i++)
+            core->execute.inst[i] = nop;
+        core->issued[0]++;
+        return;
+    }
+    if (issued == group && group < core->decode.count)
+        core->limits[limit]++;
+
+    bool taken = false;
+    for (int i = 0; i < issued; i++) {
+        const struct instruction inst = core->decode.inst[i];
+        if (inst.flags & INST_UNIT)
+            scoreboard_issue(&state->scoreboard, &inst);
+
+        const int a = core->decode.forward[i] ? core->decode.data[i]
+                : inst.rs != NOT_USED ? state->register_file[inst.rs] : 0;
+        const int b = inst.rt != NOT_USED ? state->register_file[inst.rt] : 0;
+
+        // Only the last instruction of a group can be a branch or jump.
+        if (inst.flags & (INST_BRANCH | INST_JUMP)) {
+            const int target = inst.imm + core->decode.pc_next[i];
+            taken = (inst.flags & INST_JUMP) || (a == 0) == (inst.branch == BRANCH_EQZ);
+            if (taken && (target < 0 || target > state->instructions_count - 1)) {
+                fault_raise(ERROR_ILLEGAL_JUMP, "out-of-bounds should_jump to %d\n", target);
+            }
+            core->fetch.pc_branch = target;
+        }
+
+        core->execute.inst[i] = inst;
+        core->execute.a[i] = a;
+        core->execute.b[i] = b;
+    }
+    for (int i = issued; i < core->width; i++)
+        core->execute.inst[i] = nop;
+    core->issued[issued]++;
+
+    // The instructions left move to the front, unless a taken branch or jump discards them.
+    core->fetch.flush = taken;
+    core->decode.count = taken ? 0 : core->decode.count - issued;
+    memmove(core->decode.inst, &core->decode.inst[issued], core->decode.count * sizeof(struct instruction));
+    memmove(core->decode.pc_next, &core->decode.pc_next[issued], core->decode.count * sizeof(int));
+    memmove(core->decode.forward, &core->decode.forward[issued], core->decode.count * sizeof(bool));
+    memmove(core->decode.data, &core->decode.data[issued], core->decode.count * sizeof(int));
+}
+
+static void superscalar_execute(cpu_state *state, superscalar *core) {
+    struct instruction out[SUPERSCALAR_MAX_WIDTH];
+
+    if (core->memory.waiting)
+        return;
+
+    scoreboard_tick(&state->scoreboard);
+
+    for (int i = 0; i < core->width; i++) {
+        const struct instruction inst = core->execute.inst[i];
+        const int b = (inst.flags & INST_IMMEDIATE) ? inst.imm : core->execute.b[i];
+
+        out[i] = inst;
+        core->memory.alu_out[i] = processor_alu(inst.alu, core->execute.a[i], b);
+        core->memory.write_data[i] = core->execute.b[i];
+
+        if (inst.flags & INST_UNIT) {
+            scoreboard_start(&state->scoreboard, &inst, core->memory.alu_out[i]);
+            out[i] = nop;
+        }
+    }
+
+    // What leaves a unit takes a lane decode left free for it.
+    unit_operation done;
+    if (state->scoreboard.count > 0 && scoreboard_finish(&state->scoreboard, &done)) {
+        int lane = 0;
+        while (out[lane].op != NOP)
+            lane++;
+        out[lane] = done.inst;
+        core->memory.alu_out[lane] = done.result;
+    }
+
+    // A branch about to issue stalls while its operand is still being computed.
+    pairing_limit limit;
+    const int group = superscalar_group(core, &limit);
+    for (int i = 0; i < group; i++) {
+        if (!(core->decode.inst[i].flags & INST_BRANCH))
+            continue;
+        for (int j = 0; j < core->width; j++)
+            core->decode.stall |= superscalar_reads(&core->decode.inst[i], 1, &out[j]);
+    }
+
+    memcpy(core->memory.inst, out, sizeof(out));
+    core->memory.accessed = false;
+}
+
+static void superscalar_memory(cpu_state *state, superscalar *core) {
+    pairing_limit limit;
+    const int group = superscalar_group(core, &limit);
+
+    // At most one lane accesses memory. Until its access completes, every lane stays here.
+    core->memory.waiting = false;
+    for (int i = 0; i < core->width; i++) {
+        const struct instruction *inst = &core->memory.inst[i];
+        const int address = core->memory.alu_out[i];
+        if (!(inst->flags & INST_MEMORY))
+            continue;
+
+        if (!memory_in_bounds(&state->data_memory, address)) {
+            fault_raise(ERROR_ILLEGAL_MEM_ACCESS, "Exception: out-of-bounds data memory access at %d\n", address);
+        }
+        if (state->cache.lines == NULL)
+            break;
+
+        if (!core->memory.accessed) {
+            int latency;
+            const cache_outcome outcome = cache_access(&state->cache, address, inst->flags & INST_STORE, &latency);
+            state->stats.cache_hits += outcome == CACHE_HIT;
+            state->stats.cache_misses += outcome != CACHE_HIT;
+            state->stats.cache_writebacks += outcome == CACHE_MISS_WRITEBACK;
+            core->memory.accessed = true;
+            core->memory.wait = latency - 1;
+        }
+
+        if (core->memory.wait > 0) {
+            core->memory.wait--;
+            core->memory.waiting = true;
+            for (int j = 0; j < core->width; j++)
+                core->writeback.inst[j] = nop;
+            state->stats.memory_stalls++;
+            return;
+        }
+    }
+
+    for (int i = 0; i < core->width; i++) {
+        const struct instruction inst = core->memory.inst[i];
+        const int alu_out = core->memory.alu_out[i];
+        int data = alu_out;
+
+        switch (inst.flags & INST_MEMORY) {
+            case INST_LOAD:
+                data = memory_load(&state->data_memory, alu_out);
+                core->writeback.read_data[i] = data;
+                if (inst.flags & INST_ATOMIC)
+                    processor_load_linked(state, alu_out);
+
+                // Stall if the group about to issue, or an instruction executing, reads the value loaded.
+                core->decode.stall |= superscalar_reads(core->decode.inst, group, &inst)
+                        | superscalar_reads(core->execute.inst, core->width, &inst);
+                break;
+            case INST_STORE:
+                if (!(inst.flags & INST_ATOMIC)) {
+                    memory_store(&state->data_memory, alu_out, core->memory.write_data[i]);
+                    break;
+                }
+
+                // A store conditional writes whether it stored, and is waited for like a load.
+                data = processor_store_conditional(state, alu_out, core->memory.write_data[i]);
+                core->decode.stall |= superscalar_reads(core->decode.inst, group, &inst)
+                        | superscalar_reads(core->execute.inst, core->width, &inst);
+                break;
+        }
+
+        superscalar_forward(core, &inst, data);
+        core->writeback.inst[i] = inst;
+        core->writeback.alu_out[i] = (inst.flags & INST_ATOMIC) ? data : alu_out;
+    }
+}
+
+static void superscalar_writeback(cpu_state *state, superscalar *core) {
+    for (int i = 0; i < core->width; i++) {
+        const struct instruction inst = core->writeback.inst[i];
+        int data = 0;
+
+        if (inst.flags & INST_WRITES) {
+            if (inst.dest == R0) {
+                fault_raise(ERROR_ILLEGAL_REG_WRITE, "Exception: Attempt to overwrite R0\n");
+            }
+
+            data = (inst.flags & INST_LOAD) ? core->writeback.read_data[i] : core->writeback.alu_out[i];
+            state->register_file[inst.dest] = data;
+        }
+
+        superscalar_forward(core, &inst, data);
+        state->instructions_executed += inst.op != NOP;
+    }
+}
+
+/**
+ * Simulates one cycle of the core, its stages in reverse as in simulate_cycle. The
+ * processor halts once every instruction has left the pipeline and the functional units.
+ */
+static void superscalar_cycle(cpu_state *state, superscalar *core) {
+    superscalar_writeback(state, core);
+    superscalar_memory(state, core);
+    superscalar_execute(state, core);
+    superscalar_decode(state, core);
+    superscalar_fetch(state, core);
+
+    state->halt = core->fetch.pc >= state->instructions_count && !core->fetch.flush && core->decode.count == 0
+            && superscalar_empty(core->execute.inst, core->width)
+            && superscalar_empty(core->memory.inst, core->width)
+            && superscalar_empty(core->writeback.inst, core->width) && scoreboard_idle(&state->scoreboard);
+}
+
+void superscalar_run(cpu_state *state, superscalar *core, long long cycles) {
+    while (!state->halt && state->cycles_executed < cycles) {
+        superscalar_cycle(state, core);
+        state->cycles_executed++;
+    }
+}
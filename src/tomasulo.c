@@ -0,0 +1,438 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tomasulo.h"
+
+static void tomasulo_default(tomasulo_options *options) {
+    *options = (tomasulo_options) { DEFAULT_OOO_WIDTH, DEFAULT_OOO_ROB, DEFAULT_OOO_STATIONS, DEFAULT_OOO_QUEUE };
+}
+
+bool tomasulo_parse(const char *spec, tomasulo_options *options) {
+    tomasulo_default(options);
+
+    while (*spec != '\0' && strcmp(spec, "default") != 0) {
+        char key[16], value[16];
+        int length = 0;
+        if (sscanf(spec, "%15[^=]=%15[^,]%n", key, value, &length) != 2)
+            return false;
+        spec += length;
+        if (*spec == ',')
+            spec++;
+
+        char *end;
+        const long number = strtol(value, &end, 10);
+        if (*end != '\0' || number < 1 || number > OOO_MAX_ENTRIES)
+            return false;
+
+        if (strcmp(key, "width") == 0 && number <= OOO_MAX_WIDTH)
+            options->width = (int) number;
+        else if (strcmp(key, "rob") == 0)
+            options->rob = (int) number;
+        else if (strcmp(key, "rs") == 0)
+            options->stations = (int) number;
+        else if (strcmp(key, "lsq") == 0)
+            options->queue = (int) number;
+        else
+            return false;
+    }
+    return true;
+}
+
+void tomasulo_init(tomasulo_core *core, const tomasulo_options *options) {
+    memset(core, 0, sizeof(*core));
+    core->options = *options;
+    core->rob = calloc(options->rob, sizeof(rob_entry));
+    for (int i = 0; i < 16; i++)
+        core->alias[i] = -1;
+}
+
+void tomasulo_free(tomasulo_core *core) {
+    free(core->rob);
+    core->rob = NULL;
+}
+
+/**
+ * @return the i-th oldest entry of the reorder buffer
+ */
+static inline rob_entry *tomasulo_entry(const tomasulo_core *core, int i) {
+    return &core->rob[(core->head + i) % core->options.rob];
+}
+
+/**
+ * @return true if the instruction waits in a reservation station. Loads and stores wait in
+ * the load/store queue instead, and NOPs and jumps are done as they are dispatched.
+ */
+static bool tomasulo_station(const struct instruction *inst) {
+    return inst->op != NOP && !(inst->flags & (INST_MEMORY | INST_JUMP));
+}
+
+/**
+ * Reads a source register through the register alias table.
+ * @param tag output; the entry to wait for, or -1 if value holds the operand
+ */
+static void tomasulo_read(const cpu_state *state, const tomasulo_core *core, int reg, int *value, int *tag) {
+    *value = 0;
+    *tag = -1;
+    if (reg == NOT_USED || reg == R0)
+        return;
+
+    // A store conditional only has its result once it retires.
+    const int entry = core->alias[reg];
+    if (entry == -1)
+        *value = state->register_file[reg];
+    else if (core->rob[entry].state == ENTRY_DONE
+             && (core->rob[entry].inst.flags & (INST_ATOMIC | INST_STORE)) != (INST_ATOMIC | INST_STORE))
+        *value = core->rob[entry].value;
+    else
+        *tag = entry;
+}
+
+/**
+ * Squashes every entry of the reorder buffer after the first keep, and maps the registers
+ * back to the entries left.
+ */
+static void tomasulo_squash(tomasulo_core *core, int keep) {
+    for (int i = keep; i < core->count; i++) {
+        const rob_entry *entry = tomasulo_entry(core, i);
+        core->queue_used -= (entry->inst.flags & INST_MEMORY) != 0;
+        core->stations_used -= tomasulo_station(&entry->inst) && entry->state == ENTRY_WAITING;
+    }
+    core->squashed += core->count - keep;
+    core->count = keep;
+
+    for (int i = 0; i < 16; i++)
+        core->alias[i] = -1;
+    for (int i = 0; i < core->count; i++) {
+        const rob_entry *entry = tomasulo_entry(core, i);
+        if ((entry->inst.flags & INST_WRITES) && entry->inst.dest != R0)
+            core->alias[entry->inst.dest] = (core->head + i) % core->options.rob;
+    }
+}
+
+/**
+ * Retires the finished instructions at the head of the reorder buffer, in order, raising
+ * their exceptions.
+ */
+static void tomasulo_retire(cpu_state *state, tomasulo_core *core) {
+    for (int n = 0; n < core->options.width && core->count > 0; n++) {
+        rob_entry *entry = tomasulo_entry(core, 0);
+        const struct instruction *inst = &entry->inst;
+        if (entry->state != ENTRY_DONE)
+            break;
+
+        switch (entry->error) {
+            case ERROR_ILLEGAL_MEM_ACCESS:
+                fault_raise(ERROR_ILLEGAL_MEM_ACCESS, "Exception: out-of-bounds data memory access at %d\n",
+                            entry->address);
+            case ERROR_ILLEGAL_JUMP:
+                fault_raise(ERROR_ILLEGAL_JUMP, "out-of-bounds should_jump to %d\n", entry->target);
+            case ERROR_DIVIDE_BY_ZERO:
+                fault_raise(ERROR_DIVIDE_BY_ZERO, "Exception: division by zero\n");
+        }
+
+        // A load linked reserves its word, and a store conditional is only performed here,
+        // in order, its result reaching the instructions waiting for it as it retires.
+        if ((inst->flags & INST_ATOMIC) && (inst->flags & INST_LOAD))
+            processor_load_linked(state, entry->address);
+        if ((inst->flags & INST_ATOMIC) && (inst->flags & INST_STORE)) {
+            entry->value = processor_store_conditional(state, entry->address, entry->value);
+            for (int j = 1; j < core->count; j++) {
+                rob_entry *waiting = tomasulo_entry(core, j);
+                for (int k = 0; k < 2; k++) {
+                    if (waiting->tag[k] == core->head) {
+                        waiting->operand[k] = entry->value;
+                        waiting->tag[k] = -1;
+                    }
+                }
+            }
+        }
+
+        if (inst->flags & INST_WRITES) {
+            if (inst->dest == R0) {
+                fault_raise(ERROR_ILLEGAL_REG_WRITE, "Exception: Attempt to overwrite R0\n");
+            }
+            state->register_file[inst->dest] = entry->value;
+            if (core->alias[inst->dest] == core->head)
+                core->alias[inst->dest] = -1;
+        }
+
+        // The write buffer takes a store, so the cache adds nothing to its time.
+        if (inst->flags & INST_STORE) {
+            if (!(inst->flags & INST_ATOMIC))
+                memory_store(&state->data_memory, entry->address, entry->value);
+            if (state->cache.lines != NULL) {
+                int latency;
+                const cache_outcome outcome = cache_access(&state->cache, entry->address, true, &latency);
+                state->stats.cache_hits += outcome == CACHE_HIT;
+                state->stats.cache_misses += outcome != CACHE_HIT;
+                state->stats.cache_writebacks += outcome == CACHE_MISS_WRITEBACK;
+            }
+        }
+        core->queue_used -= (inst->flags & INST_MEMORY) != 0;
+
+        if (inst->flags & (INST_BRANCH | INST_JUMP)) {
+            predictor_update(&state->predictor, inst, entry->pc, entry->taken, entry->target);
+            state->stats.branches++;
+            state->stats.taken += entry->taken;
+            state->stats.flushes += entry->mispredicted;
+        }
+
+        state->instructions_executed += inst->op != NOP;
+        core->head = (core->head + 1) % core->options.rob;
+        core->count--;
+    }
+}
+
+/**
+ * Broadcasts the results of the instructions finishing this cycle to those waiting for
+ * them, and resolves branches, squashing what follows a mispredicted one.
+ */
+static void tomasulo_complete(cpu_state *state, tomasulo_core *core, long long now) {
+    for (int i = 0; i < core->count; i++) {
+        rob_entry *entry = tomasulo_entry(core, i);
+        const int slot = (core->head + i) % core->options.rob;
+        if (entry->state != ENTRY_EXECUTING || entry->ready > now)
+            continue;
+
+        // A store is done once its address is known and its data has arrived.
+        if ((entry->inst.flags & INST_STORE) && entry->tag[1] != -1 && entry->error == 0)
+            continue;
+        entry->state = ENTRY_DONE;
+        if (entry->inst.flags & INST_STORE) {
+            entry->value = entry->operand[1];
+            continue;
+        }
+
+        for (int j = i + 1; j < core->count; j++) {
+            rob_entry *waiting = tomasulo_entry(core, j);
+            for (int k = 0; k < 2; k++) {
+                if (waiting->tag[k] == slot) {
+                    waiting->operand[k] = entry->value;
+                    waiting->tag[k] = -1;
+                }
+            }
+        }
+
+        if (!(entry->inst.flags & INST_BRANCH))
+            continue;
+
+        int next = entry->taken ? entry->target : entry->pc + 1;
+        if (entry->taken && (entry->target < 0 || entry->target > state->instructions_count - 1)) {
+            entry->error = ERROR_ILLEGAL_JUMP;
+            next = state->instructions_count;
+        }
+        if (next != entry->next_pc) {
+            entry->mispredicted = true;
+            core->mispredictions++;
+            tomasulo_squash(core, i + 1);
+            core->fetched_count = 0;
+            core->pc = next;
+        }
+    }
+}
+
+/**
+ * Starts the oldest instructions whose operands are ready on the units free this cycle.
+ */
+static void tomasulo_issue(cpu_state *state, tomasulo_core *core, long long now) {
+    const unit_options *units = &state->scoreboard.options;
+    int alus = core->options.width;
+    bool port = true;
+    bool started[UNIT_KINDS] = { false };
+
+    for (int i = 0; i < core->count; i++) {
+        rob_entry *entry = tomasulo_entry(core, i);
+        const struct instruction *inst = &entry->inst;
+        if (entry->state != ENTRY_WAITING || entry->tag[0] != -1)
+            continue;
+
+        // A store computes its address on an ALU, and its data may follow later.
+        if (inst->flags & INST_STORE) {
+            if (alus == 0)
+                continue;
+            alus--;
+            entry->address = entry->operand[0] + inst->imm;
+            entry->error = memory_in_bounds(&state->data_memory, entry->address) ? 0 : ERROR_ILLEGAL_MEM_ACCESS;
+            entry->state = ENTRY_EXECUTING;
+            entry->ready = now + 1;
+            continue;
+        }
+
+        if (inst->flags & INST_LOAD) {
+            const int address = entry->operand[0] + inst->imm;
+            const rob_entry *store = NULL;
+            bool unknown = false;
+            for (int j = i - 1; j >= 0 && !unknown && store == NULL; j--) {
+                const rob_entry *older = tomasulo_entry(core, j);
+                if (!(older->inst.flags & INST_STORE))
+                    continue;
+                unknown = older->state == ENTRY_WAITING || older->ready > now || (older->inst.flags & INST_ATOMIC);
+                if (!unknown && older->address == address)
+                    store = older;
+            }
+            if (!port || unknown || (store != NULL && store->tag[1] != -1))
+                continue;
+            port = false;
+
+            int latency = 1;
+            entry->address = address;
+            if (store != NULL) {
+                entry->value = store->operand[1];
+                core->forwarded++;
+            } else if (!memory_in_bounds(&state->data_memory, address)) {
+                entry->error = ERROR_ILLEGAL_MEM_ACCESS;
+            } else {
+                entry->value = memory_load(&state->data_memory, address);
+                if (state->cache.lines != NULL) {
+                    const cache_outcome outcome = cache_access(&state->cache, address, false, &latency);
+                    state->stats.cache_hits += outcome == CACHE_HIT;
+                    state->stats.cache_misses += outcome != CACHE_HIT;
+                    state->stats.cache_writebacks += outcome == CACHE_MISS_WRITEBACK;
+                    state->stats.memory_stalls += latency - state->cache.options.hit_latency;
+                }
+            }
+            entry->state = ENTRY_EXECUTING;
+            entry->ready = now + 1 + latency;
+            continue;
+        }
+
+        if (entry->tag[1] != -1)
+            continue;
+
+        int latency = 1;
+        const int unit = scoreboard_unit(inst);
+        if (unit >= 0) {
+            if (started[unit] || core->unit_free[unit] > now)
+                continue;
+            started[unit] = true;
+            latency = units->latency[unit];
+            core->unit_free[unit] = units->pipelined[unit] ? now + 1 : now + latency;
+        } else {
+            if (alus == 0)
+                continue;
+            alus--;
+        }
+
+        const int b = (inst->flags & INST_IMMEDIATE) ? inst->imm : entry->operand[1];
+        if (inst->alu == DIVIDE && b == 0)
+            entry->error = ERROR_DIVIDE_BY_ZERO;
+        else
+            entry->value = processor_alu(inst->alu, entry->operand[0], b);
+
+        if (inst->flags & INST_BRANCH) {
+            entry->taken = (entry->operand[0] == 0) == (inst->branch == BRANCH_EQZ);
+            entry->target = entry->pc + 1 + inst->imm;
+        }
+
+        entry->state = ENTRY_EXECUTING;
+        entry->ready = now + latency;
+        core->stations_used--;
+    }
+}
+
+/**
+ * Renames the fetched instructions into the reorder buffer, in order, while it, the
+ * reservation stations and the load/store queue have room.
+ */
+static void tomasulo_dispatch(cpu_state *state, tomasulo_core *core) {
+    int dispatched = 0;
+    for (; dispatched < core->options.width && dispatched < core->fetched_count; dispatched++) {
+        const fetched_instruction *fetched = &core->fetched[dispatched];
+        const struct instruction *inst = &fetched->inst;
+
+        if (core->count == core->options.rob) {
+            core->rob_full++;
+            break;
+        }
+        if ((inst->flags & INST_MEMORY) && core->queue_used == core->options.queue) {
+            core->queue_full++;
+            break;
+        }
+        if (tomasulo_station(inst) && core->stations_used == core->options.stations) {
+            core->stations_full++;
+            break;
+        }
+
+        const int slot = (core->head + core->count) % core->options.rob;
+        rob_entry *entry = &core->rob[slot];
+        memset(entry, 0, sizeof(*entry));
+        entry->inst = *inst;
+        entry->pc = fetched->pc;
+        entry->next_pc = fetched->next_pc;
+
+        // rt is a source of the register-register instructions and of stores.
+        const bool reads_rt = !(inst->flags & (INST_IMMEDIATE | INST_BRANCH | INST_JUMP)) || (inst->flags & INST_STORE);
+        tomasulo_read(state, core, (inst->flags & INST_JUMP) ? NOT_USED : inst->rs, &entry->operand[0], &entry->tag[0]);
+        tomasulo_read(state, core, reads_rt ? inst->rt : NOT_USED, &entry->operand[1], &entry->tag[1]);
+
+        // Fetch has already followed a jump, or stopped at one leaving the program.
+        entry->state = inst->op == NOP || (inst->flags & INST_JUMP) ? ENTRY_DONE : ENTRY_WAITING;
+        if (inst->flags & INST_JUMP) {
+            entry->taken = true;
+            entry->target = entry->pc + 1 + inst->imm;
+            if (entry->target < 0 || entry->target > state->instructions_count - 1)
+                entry->error = ERROR_ILLEGAL_JUMP;
+        }
+
+        if ((inst->flags & INST_WRITES) && inst->dest != R0)
+            core->alias[inst->dest] = slot;
+        core->count++;
+        core->queue_used += (inst->flags & INST_MEMORY) != 0;
+        core->stations_used += tomasulo_station(inst);
+    }
+
+    core->fetched_count -= dispatched;
+    memmove(core->fetched, &core->fetched[dispatched], core->fetched_count * sizeof(fetched_instruction));
+}
+
+/**
+ * Fetches up to width instructions, ending at a branch predicted taken or a jump.
+ */
+static void tomasulo_fetch(cpu_state *state, tomasulo_core *core) {
+    const int capacity = 2 * core->options.width;
+
+    for (int n = 0; n < core->options.width && core->fetched_count < capacity; n++) {
+        const int pc = core->pc;
+        if (pc < 0 || pc >= state->instructions_count)
+            break;
+
+        const struct instruction *inst = &state->instruction_memory[pc];
+        int next = pc + 1, target;
+        if (inst->flags & INST_JUMP) {
+            target = pc + 1 + inst->imm;
+            next = target >= 0 && target < state->instructions_count ? target : state->instructions_count;
+        } else if (predictor_predict(&state->predictor, inst, pc, &target)
+                   && target >= 0 && target < state->instructions_count) {
+            next = target;
+        }
+
+        core->fetched[core->fetched_count++] = (fetched_instruction) { *inst, pc, next };
+        core->pc = next;
+        if (next != pc + 1)
+            break;
+    }
+}
+
+/**
+ * Simulates one cycle of the core, its stages in reverse so that each sees the state the
+ * cycle started with. The processor halts once every instruction has retired.
+ */
+static void tomasulo_cycle(cpu_state *state, tomasulo_core *core) {
+    const long long now = state->cycles_executed;
+
+    tomasulo_retire(state, core);
+    tomasulo_complete(state, core, now);
+    tomasulo_issue(state, core, now);
+    tomasulo_dispatch(state, core);
+    tomasulo_fetch(state, core);
+
+    state->halt = core->count == 0 && core->fetched_count == 0
+            && (core->pc < 0 || core->pc >= state->instructions_count);
+}
+
+void tomasulo_run(cpu_state *state, tomasulo_core *core, long long cycles) {
+    while (!state->halt && state->cycles_executed < cycles) {
+        tomasulo_cycle(state, core);
+        state->cycles_executed++;
+    }
+}
@@ -0,0 +1,276 @@
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "trace.h"
+#include "image.h"
+
+static void *trace_writer_thread(void *argument) {
+    trace_writer *trace = argument;
+    size_t tail = atomic_load_explicit(&trace->tail, memory_order_relaxed);
+
+    for (;;) {
+        // head is read after closing, so once closing is seen, head is final.
+        const bool closing = atomic_load_explicit(&trace->closing, memory_order_acquire);
+        const size_t head = atomic_load_explicit(&trace->head, memory_order_acquire);
+        if (head == tail) {
+            if (closing)
+                break;
+
+            const struct timespec pause = { 0, 100000 };
+            nanosleep(&pause, NULL);
+            continue;
+        }
+
+        const size_t offset = tail & (TRACE_RING_SIZE - 1);
+        size_t size = head - tail;
+        if (size > TRACE_RING_SIZE - offset)
+            size = TRACE_RING_SIZE - offset;
+
+        trace->ok &= fwrite(trace->ring + offset, 1, size, trace->file) == size;
+        tail += size;
+        atomic_store_explicit(&trace->tail, tail, memory_order_release);
+    }
+    return NULL;
+}
+
+trace_writer *trace_open(const char *path, cpu_state *state) {
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+        return NULL;
+
+    const int fetched = state->decode_buffer.inst.op == NOP ? -1 : state->decode_buffer.pc_next - 1;
+    trace_header header = { .version = TRACE_VERSION, .instructions = state->instructions_count,
+                            .first_cycle = state->cycles_executed, .fetched = fetched };
+    for (int i = 0; i < UNIT_KINDS; i++)
+        header.latency[i] = (uint16_t) state->scoreboard.options.latency[i];
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (int i = 0; i < state->instructions_count; i++) {
+        const struct instruction *inst = &state->instruction_memory[i];
+        const image_instruction packed = { inst->op, inst->rd, inst->rs, inst->rt, inst->imm };
+        written &= fwrite(&packed, sizeof(packed), 1, file) == 1;
+    }
+    if (!written) {
+        fclose(file);
+        return NULL;
+    }
+
+    trace_writer *trace = calloc(1, sizeof(*trace));
+    trace->file = file;
+    trace->ok = true;
+    trace->ring = malloc(TRACE_RING_SIZE);
+    trace->fetched = fetched;
+    state->events = 0;
+
+    pthread_create(&trace->thread, NULL, trace_writer_thread, trace);
+    return trace;
+}
+
+/**
+ * Copies the pending records into the ring, waiting for the writer thread only if the
+ * ring is full.
+ */
+static void trace_publish(trace_writer *trace) {
+    const size_t head = atomic_load_explicit(&trace->head, memory_order_relaxed);
+    while (head + trace->chunk_size - atomic_load_explicit(&trace->tail, memory_order_acquire) > TRACE_RING_SIZE)
+        sched_yield();
+
+    const size_t offset = head & (TRACE_RING_SIZE - 1);
+    const size_t first = trace->chunk_size < TRACE_RING_SIZE - offset ? trace->chunk_size : TRACE_RING_SIZE - offset;
+    memcpy(trace->ring + offset, trace->chunk, first);
+    memcpy(trace->ring, trace->chunk + first, trace->chunk_size - first);
+
+    atomic_store_explicit(&trace->head, head + trace->chunk_size, memory_order_release);
+    trace->chunk_size = 0;
+}
+
+void trace_cycle(trace_writer *trace, cpu_state *state) {
+    const int events = state->events;
+    state->events = 0;
+
+    // Room for a record with the longest varint
+    if (trace->chunk_size > TRACE_CHUNK - 6)
+        trace_publish(trace);
+
+    uint8_t *record = &trace->chunk[trace->chunk_size++];
+    *record = events & 0xFC;
+
+    if (events & EVENT_MEMORY_WAIT) {
+        *record = TRACE_MEMORY_WAIT;
+    } else if (events & EVENT_STALL) {
+        *record |= TRACE_STALLED;
+    } else if (state->decode_buffer.inst.op == NOP) {
+        *record |= TRACE_BUBBLE;
+    } else {
+        const int pc = state->decode_buffer.pc_next - 1;
+        if (pc == trace->fetched + 1) {
+            *record |= TRACE_NEXT;
+        } else {
+            *record |= TRACE_JUMPED;
+
+            const int32_t distance = pc - (trace->fetched + 1);
+            uint32_t zigzag = ((uint32_t) distance << 1) ^ (uint32_t) (distance >> 31);
+            while (zigzag >= 0x80) {
+                trace->chunk[trace->chunk_size++] = (uint8_t) (zigzag | 0x80);
+                zigzag >>= 7;
+            }
+            trace->chunk[trace->chunk_size++] = (uint8_t) zigzag;
+        }
+        trace->fetched = pc;
+    }
+}
+
+bool trace_close(trace_writer *trace) {
+    trace_publish(trace);
+    atomic_store_explicit(&trace->closing, true, memory_order_release);
+    pthread_join(trace->thread, NULL);
+
+    bool ok = trace->ok;
+    ok &= fclose(trace->file) == 0;
+    free(trace->ring);
+    free(trace);
+    return ok;
+}
+
+bool trace_read_open(trace_reader *reader, const char *path) {
+    memset(reader, 0, sizeof(*reader));
+    reader->file = fopen(path, "rb");
+    if (reader->file == NULL)
+        return false;
+
+    bool ok = fread(&reader->header, sizeof(reader->header), 1, reader->file) == 1
+            && memcmp(reader->header.magic, TRACE_MAGIC, sizeof(reader->header.magic)) == 0
+            && reader->header.version == TRACE_VERSION;
+
+    reader->program = calloc(ok ? reader->header.instructions + 1 : 1, sizeof(struct instruction));
+    for (uint32_t i = 0; ok && i < reader->header.instructions; i++) {
+        image_instruction packed;
+        ok = fread(&packed, sizeof(packed), 1, reader->file) == 1;
+        reader->program[i] = (struct instruction) { .op = packed.op, .rd = packed.rd, .rs = packed.rs,
+                                                    .rt = packed.rt, .imm = packed.imm };
+    }
+    for (int i = 0; ok && i < UNIT_KINDS; i++)
+        ok = reader->header.latency[i] >= 1 && reader->header.latency[i] <= UNIT_MAX_LATENCY;
+    if (ok)
+        instruction_predecode_program(reader->program, reader->header.instructions);
+
+    // Of the latches before the first record, only the decode latch is known; the others
+    // are shown as bubbles.
+    reader->fetched = reader->header.fetched;
+    reader->last.cycle = reader->header.first_cycle;
+    for (int i = 0; i < 4; i++)
+        reader->last.latches[i] = (trace_slot) { -1, -1 };
+    reader->last.decode = reader->last.execute = reader->last.memory = reader->last.writeback
+            = reader->last.fetch = (trace_slot) { -1, -1 };
+    if (reader->fetched != -1)
+        reader->last.latches[0] = (trace_slot) { reader->fetches++, reader->fetched };
+
+    if (!ok) {
+        fclose(reader->file);
+        free(reader->program);
+    }
+    return ok;
+}
+
+/**
+ * Advances the functional units by the cycle of record, whose execute stage is filled in,
+ * and fills in the memory latch the cycle leaves.
+ */
+static void trace_read_units(trace_reader *reader, trace_cycle_record *record) {
+    const trace_slot execute = record->execute;
+    const struct instruction *inst = (uint32_t) execute.pc < reader->header.instructions
+            ? &reader->program[execute.pc] : &nop;
+
+    record->unit_count = reader->unit_count;
+    memcpy(record->units, reader->units, reader->unit_count * sizeof(trace_slot));
+    record->latches[2] = execute;
+    if (reader->unit_count == 0 && !(inst->flags & INST_UNIT))
+        return;
+
+    for (int i = 0; i < reader->unit_count; i++)
+        reader->remaining[i]--;
+    if ((inst->flags & INST_UNIT) && reader->unit_count < SCOREBOARD_MAX_OPERATIONS) {
+        reader->units[reader->unit_count] = execute;
+        reader->remaining[reader->unit_count++] = reader->header.latency[scoreboard_unit(inst)] - 1;
+        record->latches[2] = (trace_slot) { -1, -1 };
+    }
+
+    for (int i = 0; i < reader->unit_count; i++) {
+        if (reader->remaining[i] > 0)
+            continue;
+
+        record->latches[2] = reader->units[i];
+        reader->unit_count--;
+        memmove(&reader->units[i], &reader->units[i + 1], (reader->unit_count - i) * sizeof(trace_slot));
+        memmove(&reader->remaining[i], &reader->remaining[i + 1], (reader->unit_count - i) * sizeof(int));
+        break;
+    }
+}
+
+bool trace_read_cycle(trace_reader *reader, trace_cycle_record *record) {
+    const int byte = fgetc(reader->file);
+    if (byte == EOF)
+        return false;
+
+    const trace_cycle_record *last = &reader->last;
+    const trace_slot bubble = { -1, -1 };
+    const int kind = byte & 3;
+
+    record->cycle = last->cycle + 1;
+    if (byte == TRACE_MEMORY_WAIT) {
+        // Only the memory and writeback stages worked; the other latches and the
+        // functional units hold.
+        record->events = EVENT_MEMORY_WAIT;
+        record->fetch = record->decode = record->execute = bubble;
+        record->unit_count = reader->unit_count;
+        memcpy(record->units, reader->units, reader->unit_count * sizeof(trace_slot));
+        record->memory = last->latches[2];
+        record->writeback = last->latches[3];
+        memcpy(record->latches, last->latches, sizeof(record->latches));
+        record->latches[3] = bubble;
+
+        reader->last = *record;
+        return true;
+    }
+
+    record->events = (byte & 0xFC) | (kind == TRACE_STALLED ? EVENT_STALL : 0);
+    record->fetch = bubble;
+
+    if (kind == TRACE_NEXT || kind == TRACE_JUMPED) {
+        int pc = reader->fetched + 1;
+        if (kind == TRACE_JUMPED) {
+            uint32_t zigzag = 0;
+            int shift = 0, next;
+            do {
+                next = fgetc(reader->file);
+                if (next == EOF)
+                    return false;
+                zigzag |= (uint32_t) (next & 0x7F) << shift;
+                shift += 7;
+            } while ((next & 0x80) && shift < 35);
+            pc += (int32_t) ((zigzag >> 1) ^ -(zigzag & 1));
+        }
+        record->fetch = (trace_slot) { reader->fetches++, pc };
+        reader->fetched = pc;
+    }
+
+    // Decode works on the instruction fetched before, unless it stalls.
+    record->decode = kind == TRACE_STALLED ? bubble : last->latches[0];
+    record->execute = last->latches[1];
+    record->memory = last->latches[2];
+    record->writeback = last->latches[3];
+
+    record->latches[0] = kind == TRACE_STALLED ? last->latches[0] : record->fetch;
+    record->latches[1] = record->decode;
+    record->latches[3] = record->memory;
+    trace_read_units(reader, record);
+
+    reader->last = *record;
+    return true;
+}
+
+void trace_read_close(trace_reader *reader) {
+    fclose(reader->file);
+    free(reader->program);
+}
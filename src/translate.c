@@ -0,0 +1,168 @@
+#include <stdlib.h>
+#include <string.h>
+#include "translate.h"
+
+/**
+ * Marks the instructions that start a basic block: the first, the targets of branches and
+ * jumps, and the instructions following them.
+ */
+static void translation_find_leaders(translation_cache *cache) {
+    if (cache->count > 0)
+        cache->leaders[0] = true;
+
+    for (int pc = 0; pc < cache->count; pc++) {
+        const struct instruction inst = cache->code[pc];
+        if (!(inst.flags & (INST_BRANCH | INST_JUMP)))
+            continue;
+
+        const int target = pc + 1 + inst.imm;
+        if (target >= 0 && target < cache->count)
+            cache->leaders[target] = true;
+        if (pc + 1 < cache->count)
+            cache->leaders[pc + 1] = true;
+    }
+}
+
+translation_cache *translation_cache_create(const struct instruction *code, int count) {
+    translation_cache *cache = malloc(sizeof(*cache));
+    cache->code = code;
+    cache->count = count;
+    cache->leaders = calloc(count + 1, sizeof(*cache->leaders));
+    cache->blocks = calloc(count + 1, sizeof(*cache->blocks));
+    translation_find_leaders(cache);
+    return cache;
+}
+
+void translation_cache_destroy(translation_cache *cache) {
+    for (int pc = 0; pc < cache->count; pc++)
+        free(cache->blocks[pc]);
+    free(cache->blocks);
+    free(cache->leaders);
+    free(cache);
+}
+
+/**
+ * Translates one instruction that does not end a block into op. If next is a branch
+ * or jump ending the block, it is fused into op when possible.
+ * @return the number of instructions consumed, 1 or 2
+ */
+static int translate_instruction(translated_op *op, struct instruction inst, const struct instruction *next) {
+    op->dest = inst.dest;
+    op->src1 = inst.rs;
+    op->src2 = inst.rt;
+    op->imm = inst.op == SUBI ? (int) (0u - (unsigned int) inst.imm) : inst.imm;
+    op->alu = inst.alu;
+
+    switch (inst.op) {
+        case ADDI:
+        case SUBI: op->kind = inst.rs == R0 ? T_LOADI : T_ADDI; break;
+        case ADD:  op->kind = T_ADD;  break;
+        case SUB:  op->kind = T_SUB;  break;
+        case MULT:
+        case DIV:
+        case AND:
+        case OR:
+        case XOR:
+        case SLL:
+        case SRL:
+        case SLT:  op->kind = T_ALU;  break;
+        case LW:   op->kind = T_LW;   break;
+        case SW:   op->kind = T_SW;   return 1;
+        case LL:   op->kind = T_LL;   break;
+        case SC:   op->kind = T_SC;   break;
+        default:   op->kind = T_NOP;  return 1;
+    }
+
+    // Writing R0 is only an error once the instruction executes. A load still
+    // performs (and bounds-checks) its access first, and a division checks its divisor.
+    const bool accesses = op->kind == T_LW || op->kind == T_ALU || op->kind == T_LL || op->kind == T_SC;
+    if (inst.dest == R0) {
+        if (!accesses)
+            op->kind = T_ILLEGAL_WRITE;
+        return 1;
+    }
+
+    if (next == NULL || accesses)
+        return 1;
+
+    if (next->flags & INST_BRANCH) {
+        op->test = next->rs;
+        op->if_zero = next->branch == BRANCH_EQZ;
+        switch (op->kind) {
+            case T_ADD: op->kind = T_ADD_BRANCH; break;
+            case T_SUB: op->kind = T_SUB_BRANCH; break;
+            default:    op->kind = T_ADDI_BRANCH; break;  // R0 reads as zero for T_LOADI
+        }
+        return 2;
+    }
+
+    if ((next->flags & INST_JUMP) && (op->kind == T_ADDI || op->kind == T_LOADI)) {
+        op->kind = T_ADDI_JUMP;
+        return 2;
+    }
+
+    return 1;
+}
+
+translated_block *translation_lookup(translation_cache *cache, int pc) {
+    translated_block *block = cache->blocks[pc];
+    if (block != NULL)
+        return block;
+
+    // Find the end of the block: just after a branch or jump, or just before the next leader.
+    int end = pc;
+    while (end < cache->count) {
+        const int flags = cache->code[end++].flags;
+        if ((flags & (INST_BRANCH | INST_JUMP)) || (end < cache->count && cache->leaders[end]))
+            break;
+    }
+
+    // Each op consumes at least one instruction, except that a load or ALU operation into
+    // R0 is followed by the exception, and a block without a branch needs one more op to fall through.
+    block = malloc(sizeof(*block) + (2 * (end - pc) + 1) * sizeof(translated_op));
+    block->start_pc = pc;
+    block->end_pc = end;
+    block->taken = block->fallthrough = NULL;
+    block->target = NOT_USED;
+
+    int ops = 0;
+    int i = pc;
+    while (i < end) {
+        const struct instruction inst = cache->code[i];
+        translated_op *op = &block->ops[ops++];
+        memset(op, 0, sizeof(*op));
+
+        if (inst.flags & (INST_BRANCH | INST_JUMP)) {
+            op->kind = (inst.flags & INST_JUMP) ? T_JUMP : T_BRANCH;
+            op->test = inst.rs;
+            op->if_zero = inst.branch == BRANCH_EQZ;
+            block->target = i + 1 + inst.imm;
+            i++;
+            continue;
+        }
+
+        const struct instruction *next = i + 1 < end ? &cache->code[i + 1] : NULL;
+        if (next != NULL && !(next->flags & (INST_BRANCH | INST_JUMP)))
+            next = NULL;
+
+        i += translate_instruction(op, inst, next);
+        if (next != NULL && i == end)
+            block->target = end + next->imm;
+
+        if ((op->kind == T_LW || op->kind == T_ALU || op->kind == T_LL || op->kind == T_SC) && op->dest == R0) {
+            op = &block->ops[ops++];
+            memset(op, 0, sizeof(*op));
+            op->kind = T_ILLEGAL_WRITE;
+        }
+    }
+
+    if (!(cache->code[end - 1].flags & (INST_BRANCH | INST_JUMP))) {
+        translated_op *op = &block->ops[ops++];
+        memset(op, 0, sizeof(*op));
+        op->kind = T_FALLTHROUGH;
+    }
+
+    block->ops_count = ops;
+    cache->blocks[pc] = block;
+    return block;
+}